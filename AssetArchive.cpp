@@ -0,0 +1,383 @@
+#include "AssetArchive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+static const uint32_t ArchiveMagic = 0x4B434150; // "PACK"
+static const size_t BlobAlignment = 64;
+
+struct ArchiveHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t EntryCount;
+	uint64_t EntriesOffset;
+	uint64_t PathsOffset;
+	uint64_t PathsSize;
+};
+
+AssetArchive::~AssetArchive()
+{
+	Close();
+}
+
+bool AssetArchive::Open(const std::filesystem::path& path)
+{
+	Close();
+	if (!file.Open(path) || file.GetSize() < sizeof(ArchiveHeader))
+	{
+		Close();
+		return false;
+	}
+	base = file.GetData();
+	size_t fileSize = file.GetSize();
+
+	// Everything the table of contents points at has to be in the file
+	ArchiveHeader header;
+	memcpy(&header, base, sizeof(header));
+	bool valid =
+		header.Magic == ArchiveMagic &&
+		header.Version == Version &&
+		header.EntriesOffset % alignof(ArchiveEntry) == 0 &&
+		header.EntriesOffset <= fileSize &&
+		header.EntryCount <= (fileSize - header.EntriesOffset) / sizeof(ArchiveEntry) &&
+		header.PathsOffset <= fileSize &&
+		header.PathsSize <= fileSize - header.PathsOffset;
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	entries = (const ArchiveEntry*)(base + header.EntriesOffset);
+	entryCount = (size_t)header.EntryCount;
+	paths = (const char*)(base + header.PathsOffset);
+	pathsSize = (size_t)header.PathsSize;
+
+	for (size_t i = 0; i < entryCount; i++)
+	{
+		const ArchiveEntry& entry = entries[i];
+		if (entry.Offset > fileSize || entry.StoredSize > fileSize - entry.Offset ||
+			(uint64_t)entry.PathOffset + entry.PathLength > pathsSize)
+		{
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void AssetArchive::Close()
+{
+	file.Close();
+	base = 0;
+	entries = 0;
+	entryCount = 0;
+	paths = 0;
+	pathsSize = 0;
+}
+
+std::string_view AssetArchive::GetPath(const ArchiveEntry& entry)
+{
+	return std::string_view(paths + entry.PathOffset, entry.PathLength);
+}
+
+const ArchiveEntry* AssetArchive::Find(std::string_view path)
+{
+	if (!base)
+		return 0;
+
+	std::string normalized = NormalizePath(path);
+	uint64_t hash = HashPath(normalized);
+
+	const ArchiveEntry* end = entries + entryCount;
+	const ArchiveEntry* entry = std::lower_bound(entries, end, hash,
+		[](const ArchiveEntry& e, uint64_t h) { return e.PathHash < h; });
+
+	// Anything sharing the hash has to be checked by name
+	for (; entry != end && entry->PathHash == hash; entry++)
+		if (NormalizePath(GetPath(*entry)) == normalized)
+			return entry;
+	return 0;
+}
+
+bool AssetArchive::Read(const ArchiveEntry& entry, AssetBytes& bytes)
+{
+	const uint8_t* stored = base + entry.Offset;
+	if (!(entry.Flags & CompressedFlag))
+	{
+		bytes.Storage.clear();
+		bytes.Data = stored;
+		bytes.Size = (size_t)entry.Size;
+		return true;
+	}
+
+	bytes.Storage.resize((size_t)entry.Size);
+	bytes.Data = bytes.Storage.data();
+	bytes.Size = bytes.Storage.size();
+	return DecompressLZ4(stored, (size_t)entry.StoredSize, bytes.Storage.data(), bytes.Storage.size());
+}
+
+std::string AssetArchive::NormalizePath(std::string_view path)
+{
+	std::string result(path);
+	for (char& c : result)
+	{
+		if (c == '\\')
+			c = '/';
+		else if (c >= 'A' && c <= 'Z')
+			c = c - 'A' + 'a';
+	}
+
+	size_t start = 0;
+	while (result.compare(start, 2, "./") == 0)
+		start += 2;
+	return result.substr(start);
+}
+
+uint64_t AssetArchive::HashPath(std::string_view path)
+{
+	// FNV-1a over the normalized path
+	std::string normalized = NormalizePath(path);
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : normalized)
+	{
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool AssetArchive::Build(const std::filesystem::path& root, const std::vector<std::string>& folders, const std::filesystem::path& output, bool compress)
+{
+	std::vector<std::string> files;
+	for (auto& folder : folders)
+	{
+		std::error_code error;
+		for (auto& p : std::filesystem::recursive_directory_iterator(root / folder, error))
+			if (p.is_regular_file())
+				files.push_back(p.path().lexically_relative(root).generic_string());
+	}
+	std::sort(files.begin(), files.end()); // Same archive every time
+
+	std::ofstream out(output, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	ArchiveHeader header = {};
+	out.write((const char*)&header, sizeof(header));
+	uint64_t offset = sizeof(header);
+
+	auto pad = [&](size_t alignment)
+	{
+		static const char zeros[BlobAlignment] = {};
+		size_t padding = (alignment - offset % alignment) % alignment;
+		out.write(zeros, padding);
+		offset += padding;
+	};
+
+	std::vector<ArchiveEntry> entries;
+	std::string paths;
+	for (auto& name : files)
+	{
+		std::ifstream in(root / name, std::ios::binary | std::ios::ate);
+		std::vector<uint8_t> data((size_t)in.tellg());
+		in.seekg(0);
+		if (!in.read((char*)data.data(), data.size()))
+			return false;
+
+		ArchiveEntry entry = {};
+		entry.PathHash = HashPath(name);
+		entry.Size = data.size();
+		entry.PathOffset = (uint32_t)paths.size();
+		entry.PathLength = (uint32_t)name.size();
+		paths += name;
+
+		// Only worth decompressing if it saved a good amount
+		std::vector<uint8_t> compressed;
+		if (compress)
+			compressed = CompressLZ4(data.data(), data.size());
+		const std::vector<uint8_t>& stored = compress && compressed.size() < data.size() * 9 / 10 ? compressed : data;
+		if (&stored == &compressed)
+			entry.Flags |= CompressedFlag;
+
+		pad(BlobAlignment);
+		entry.Offset = offset;
+		entry.StoredSize = stored.size();
+		out.write((const char*)stored.data(), stored.size());
+		offset += stored.size();
+
+		entries.push_back(entry);
+	}
+
+	std::sort(entries.begin(), entries.end(),
+		[](const ArchiveEntry& a, const ArchiveEntry& b) { return a.PathHash < b.PathHash; });
+
+	pad(alignof(ArchiveEntry));
+	header.EntriesOffset = offset;
+	header.EntryCount = entries.size();
+	out.write((const char*)entries.data(), entries.size() * sizeof(ArchiveEntry));
+	offset += entries.size() * sizeof(ArchiveEntry);
+
+	header.PathsOffset = offset;
+	header.PathsSize = paths.size();
+	out.write(paths.data(), paths.size());
+
+	header.Magic = ArchiveMagic;
+	header.Version = Version;
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+	return out.good();
+}
+
+// --------------------------------------------------------
+// LZ4 block format: a run of sequences, each a token (literal
+// length and match length, 4 bits each, with 15 meaning more
+// bytes follow), the literals, then a 2 byte offset back to
+// where the match is copied from.  The last sequence is only
+// literals, and ends at least 5 bytes after the last match.
+// --------------------------------------------------------
+static const size_t MinMatch = 4;
+static const size_t LastLiterals = 5;
+static const size_t MatchFindLimit = 12; // No match may start closer to the end than this
+static const int HashBits = 16;
+
+static uint32_t Read32(const uint8_t* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static void WriteLength(std::vector<uint8_t>& out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		out.push_back(255);
+	out.push_back((uint8_t)length);
+}
+
+std::vector<uint8_t> AssetArchive::CompressLZ4(const uint8_t* data, size_t size)
+{
+	std::vector<uint8_t> out;
+	out.reserve(size + size / 255 + 16);
+
+	// Last place each 4 byte sequence was seen (plus one, so 0 is empty)
+	std::vector<uint32_t> table((size_t)1 << HashBits, 0);
+	auto hash = [](uint32_t sequence) { return (sequence * 2654435761u) >> (32 - HashBits); };
+
+	size_t anchor = 0;
+	size_t position = 0;
+	while (size >= MatchFindLimit && position <= size - MatchFindLimit)
+	{
+		uint32_t sequence = Read32(data + position);
+		uint32_t& slot = table[hash(sequence)];
+		size_t candidate = slot;
+		slot = (uint32_t)position + 1;
+
+		if (candidate == 0 || position - (candidate - 1) > 65535 || Read32(data + candidate - 1) != sequence)
+		{
+			// Skip ahead faster the longer nothing has matched
+			position += 1 + ((position - anchor) >> 6);
+			continue;
+		}
+		candidate--;
+
+		// Grow the match backwards into the literals, then forwards
+		while (position > anchor && candidate > 0 && data[position - 1] == data[candidate - 1])
+		{
+			position--;
+			candidate--;
+		}
+
+		size_t matchLength = MinMatch;
+		while (position + matchLength < size - LastLiterals && data[candidate + matchLength] == data[position + matchLength])
+			matchLength++;
+
+		size_t literalLength = position - anchor;
+		size_t extraMatch = matchLength - MinMatch;
+		out.push_back((uint8_t)((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(extraMatch, 15)));
+		if (literalLength >= 15)
+			WriteLength(out, literalLength - 15);
+		out.insert(out.end(), data + anchor, data + position);
+
+		size_t offset = position - candidate;
+		out.push_back((uint8_t)offset);
+		out.push_back((uint8_t)(offset >> 8));
+		if (extraMatch >= 15)
+			WriteLength(out, extraMatch - 15);
+
+		position += matchLength;
+		anchor = position;
+	}
+
+	size_t literalLength = size - anchor;
+	out.push_back((uint8_t)(std::min<size_t>(literalLength, 15) << 4));
+	if (literalLength >= 15)
+		WriteLength(out, literalLength - 15);
+	out.insert(out.end(), data + anchor, data + size);
+	return out;
+}
+
+bool AssetArchive::DecompressLZ4(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize)
+{
+	const uint8_t* in = data;
+	const uint8_t* inEnd = data + size;
+	uint8_t* out = output;
+	uint8_t* outEnd = output + outputSize;
+
+	auto readLength = [&](size_t& length)
+	{
+		uint8_t more;
+		do
+		{
+			if (in == inEnd)
+				return false;
+			more = *in++;
+			length += more;
+		} while (more == 255);
+		return true;
+	};
+
+	while (in < inEnd)
+	{
+		uint8_t token = *in++;
+
+		size_t literalLength = token >> 4;
+		if (literalLength == 15 && !readLength(literalLength))
+			return false;
+		if (literalLength > (size_t)(inEnd - in) || literalLength > (size_t)(outEnd - out))
+			return false;
+		memcpy(out, in, literalLength);
+		in += literalLength;
+		out += literalLength;
+
+		if (in == inEnd)
+			break; // The last sequence has no match
+
+		if (inEnd - in < 2)
+			return false;
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		if (offset == 0 || offset > (size_t)(out - output))
+			return false;
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !readLength(matchLength))
+			return false;
+		matchLength += MinMatch;
+		if (matchLength > (size_t)(outEnd - out))
+			return false;
+
+		// Matches can overlap what they're writing, so go a byte at a time then
+		const uint8_t* match = out - offset;
+		if (offset >= matchLength)
+			memcpy(out, match, matchLength);
+		else
+			for (size_t i = 0; i < matchLength; i++)
+				out[i] = match[i];
+		out += matchLength;
+	}
+
+	return out == outEnd;
+}
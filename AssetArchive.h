@@ -0,0 +1,99 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One file in an archive.  Offsets are from the start of the
+// archive, and sizes are in bytes.
+struct ArchiveEntry
+{
+	uint64_t PathHash;
+	uint64_t Offset;
+	uint64_t StoredSize;	// In the archive (compressed or not)
+	uint64_t Size;			// Once decompressed
+	uint32_t PathOffset;	// Into the path strings
+	uint32_t PathLength;
+	uint32_t Flags;
+	uint32_t Padding;
+};
+
+// The bytes of a file, either pointing straight into a mapped
+// archive (and valid as long as it's open) or held in Storage
+struct AssetBytes
+{
+	const uint8_t* Data = 0;
+	size_t Size = 0;
+	std::vector<uint8_t> Storage;
+};
+
+// --------------------------------------------------------
+// A single file holding every asset and definition, so a
+// load opens one file instead of hundreds, and never walks
+// a directory.
+//
+// Layout:
+//  - a header
+//  - every file's bytes, each starting on a 64 byte boundary,
+//    and LZ4 compressed if that made it noticeably smaller
+//    (text compresses well, PNGs don't)
+//  - the table of contents, sorted by path hash
+//  - the paths themselves, for listing and hash collisions
+//
+// The archive is memory mapped, and files stored without
+// compression are read in place with no copies at all.
+//
+// Paths are relative to the folder the archive was built
+// from, and matching ignores case, which slashes are used
+// and a leading ".\", so ".\Assets\Textures\x.png" finds
+// "Assets/Textures/x.png".
+// --------------------------------------------------------
+class AssetArchive
+{
+public:
+	static const uint32_t Version = 1;
+	static const uint32_t CompressedFlag = 1;
+
+	AssetArchive() = default;
+	~AssetArchive();
+	AssetArchive(const AssetArchive&) = delete;
+	AssetArchive& operator=(const AssetArchive&) = delete;
+
+	// Maps the archive in.  False if it's missing or not an archive.
+	bool Open(const std::filesystem::path& file);
+	void Close();
+	bool IsOpen() { return base != 0; }
+
+	const ArchiveEntry* Find(std::string_view path);
+	bool Read(const ArchiveEntry& entry, AssetBytes& bytes);
+
+	size_t GetEntryCount() { return entryCount; }
+	const ArchiveEntry& GetEntry(size_t index) { return entries[index]; }
+	std::string_view GetPath(const ArchiveEntry& entry);
+
+	// Everything under folders (relative to root) into one archive.
+	// Returns false if the archive couldn't be written.
+	static bool Build(const std::filesystem::path& root, const std::vector<std::string>& folders, const std::filesystem::path& output, bool compress = true);
+
+	// Lower case, forward slashes and no leading "./"
+	static std::string NormalizePath(std::string_view path);
+	static uint64_t HashPath(std::string_view path);
+
+	// LZ4 block format (no frame), so the output can be checked
+	// against the reference implementation
+	static std::vector<uint8_t> CompressLZ4(const uint8_t* data, size_t size);
+	static bool DecompressLZ4(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize);
+
+private:
+	MappedFile file;
+	const uint8_t* base = 0;
+	const ArchiveEntry* entries = 0;
+	size_t entryCount = 0;
+	const char* paths = 0;
+	size_t pathsSize = 0;
+};
@@ -0,0 +1,203 @@
+#include "AssetBudget.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+static const char* CategoryNames[AssetCategoryCount] = { "Meshes", "Textures", "Bundles", "Materials" };
+
+AssetBudget::AssetBudget() : frame(0), evictions(0), loads(0)
+{
+	for (auto& budget : budgets)
+		budget = { Unlimited, Unlimited };
+}
+
+const char* AssetBudget::GetCategoryName(AssetCategory category)
+{
+	return CategoryNames[(int)category];
+}
+
+void AssetBudget::SetBudget(AssetCategory category, AssetMemory budget)
+{
+	budgets[(int)category] = budget;
+}
+
+size_t AssetBudget::GetResidentCount(AssetCategory category)
+{
+	size_t count = 0;
+	for (auto& [name, index] : indices[(int)category])
+		if (entries[index].Resident)
+			count++;
+	return count;
+}
+
+size_t AssetBudget::GetCount(AssetCategory category)
+{
+	return indices[(int)category].size();
+}
+
+void AssetBudget::Track(AssetCategory category, const std::string& name, std::unique_ptr<BudgetedAsset> asset)
+{
+	auto found = indices[(int)category].find(name);
+	if (found == indices[(int)category].end()) {
+		indices[(int)category][name] = entries.size();
+		entries.push_back({ category, name, nullptr, {}, false, false, false, frame });
+		found = indices[(int)category].find(name);
+	}
+
+	// Whatever was measured before may not be true of this one
+	Entry& entry = entries[found->second];
+	SetResident(entry, false);
+	entry.Asset = std::move(asset);
+	entry.Wanted = false;
+	entry.Failed = false;
+	entry.LastUsed = frame;
+	SetResident(entry, entry.Asset->IsResident());
+}
+
+bool AssetBudget::Contains(AssetCategory category, const std::string& name)
+{
+	return indices[(int)category].contains(name);
+}
+
+// Keeps use in step with what's resident
+void AssetBudget::SetResident(Entry& entry, bool resident)
+{
+	if (entry.Resident == resident)
+		return;
+
+	AssetMemory& total = use[(int)entry.Category];
+	if (resident) {
+		entry.Size = entry.Asset->Measure();
+		total.CpuBytes += entry.Size.CpuBytes;
+		total.GpuBytes += entry.Size.GpuBytes;
+	}
+	else {
+		total.CpuBytes -= entry.Size.CpuBytes;
+		total.GpuBytes -= entry.Size.GpuBytes;
+		entry.Size = {};
+	}
+	entry.Resident = resident;
+}
+
+bool AssetBudget::IsOver(int category)
+{
+	return use[category].CpuBytes > budgets[category].CpuBytes || use[category].GpuBytes > budgets[category].GpuBytes;
+}
+
+// Evicts the least recently used of what can go, until the
+// category fits (or there's nothing left that can go)
+int AssetBudget::Enforce(int category)
+{
+	if (!IsOver(category))
+		return 0;
+
+	std::vector<Entry*> candidates;
+	for (auto& [name, index] : indices[category]) {
+		Entry& entry = entries[index];
+		if (entry.Resident && entry.LastUsed != frame && !entry.Asset->IsReferenced())
+			candidates.push_back(&entry);
+	}
+
+	// Oldest first, and by name when that's a tie, so it's the
+	// same every run
+	std::sort(candidates.begin(), candidates.end(), [](Entry* a, Entry* b)
+		{
+			return a->LastUsed != b->LastUsed ? a->LastUsed < b->LastUsed : a->Name < b->Name;
+		});
+
+	int evicted = 0;
+	for (Entry* entry : candidates) {
+		if (!IsOver(category))
+			break;
+
+		entry->Asset->Evict();
+		SetResident(*entry, false);
+		evictions++;
+		evicted++;
+	}
+	return evicted;
+}
+
+int AssetBudget::Update(double budgetMilliseconds)
+{
+	auto start = std::chrono::steady_clock::now();
+	frame++;
+
+	// Anything rebuilt (or loaded) elsewhere since the last
+	// frame is picked up here too
+	for (auto& entry : entries) {
+		if (entry.Asset->TakeUsed()) {
+			entry.LastUsed = frame;
+			entry.Wanted = !entry.Resident && !entry.Failed;
+		}
+
+		bool resident = entry.Asset->IsResident();
+		if (resident != entry.Resident) {
+			SetResident(entry, resident);
+			entry.Wanted = entry.Wanted && !resident;
+		}
+	}
+
+	int changed = 0;
+	for (auto& entry : entries) {
+		if (!entry.Wanted)
+			continue;
+
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (milliseconds >= budgetMilliseconds)
+			break;
+
+		entry.Wanted = false;
+		if (!entry.Asset->Load()) {
+			printf("Couldn't load %s again after it was evicted\n", entry.Name.c_str());
+			entry.Failed = true;
+			continue;
+		}
+
+		SetResident(entry, true);
+		loads++;
+		changed++;
+	}
+
+	for (int category = AssetCategoryCount - 1; category >= 0; category--)
+		changed += Enforce(category);
+	return changed;
+}
+
+bool AssetBudget::Load(AssetCategory category, const std::string& name)
+{
+	auto found = indices[(int)category].find(name);
+	if (found == indices[(int)category].end())
+		return false;
+
+	Entry& entry = entries[found->second];
+	entry.LastUsed = frame;
+	if (entry.Resident)
+		return true;
+	if (entry.Failed || !entry.Asset->Load())
+		return false;
+
+	entry.Wanted = false;
+	SetResident(entry, true);
+	loads++;
+	return true;
+}
+
+void AssetBudget::PrintStats()
+{
+	auto megabytes = [](uint64_t bytes) { return bytes / (1024.0 * 1024.0); };
+	printf("Asset memory (resident of budget):\n");
+	for (int category = 0; category < AssetCategoryCount; category++) {
+		printf("  %-10s %5zu of %5zu assets, CPU %8.2f MB", CategoryNames[category],
+			GetResidentCount((AssetCategory)category), GetCount((AssetCategory)category), megabytes(use[category].CpuBytes));
+		if (budgets[category].CpuBytes != Unlimited)
+			printf(" of %.2f", megabytes(budgets[category].CpuBytes));
+		printf(", GPU %8.2f MB", megabytes(use[category].GpuBytes));
+		if (budgets[category].GpuBytes != Unlimited)
+			printf(" of %.2f", megabytes(budgets[category].GpuBytes));
+		printf("\n");
+	}
+	if (evictions || loads)
+		printf("  %llu evicted, %llu loaded again\n", (unsigned long long)evictions, (unsigned long long)loads);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What the memory budget is split up by
+enum class AssetCategory
+{
+	Mesh,
+	Texture,
+	Bundle,
+	Material,
+};
+constexpr int AssetCategoryCount = 4;
+
+// Bytes in system memory, and (an estimate of) bytes on the GPU
+struct AssetMemory
+{
+	uint64_t CpuBytes = 0;
+	uint64_t GpuBytes = 0;
+};
+
+// --------------------------------------------------------
+// Something the budget can unload, and load again once it's
+// used.  Assets aren't owned through this, just looked after.
+// --------------------------------------------------------
+class BudgetedAsset
+{
+public:
+	virtual ~BudgetedAsset() = default;
+
+	virtual bool IsResident() = 0;
+	virtual bool IsReferenced() = 0;	// Held by anything, so it has to stay
+	virtual bool TakeUsed() = 0;		// Whether it's been used since the last call
+	virtual AssetMemory Measure() = 0;	// Only while it's resident
+
+	virtual void Evict() = 0;
+	virtual bool Load() = 0;			// False if it couldn't be
+};
+
+// --------------------------------------------------------
+// Keeps each category of asset within a memory budget (CPU
+// and GPU bytes, each on its own).  Whenever a category is
+// over either one, the assets in it that nothing references
+// are evicted, least recently used first, until it fits.
+// Anything that's been evicted loads again the next time
+// it's used.
+//
+// Materials are gone through first, then bundles, textures
+// and meshes, as each one evicted can leave whatever it was
+// holding unreferenced (and so, free to go in the same call).
+//
+// Nothing here is thread safe: it's meant to be looked after
+// between frames, on the main thread.
+// --------------------------------------------------------
+class AssetBudget
+{
+public:
+	static constexpr uint64_t Unlimited = UINT64_MAX;
+
+	// Every category starts out unlimited
+	AssetBudget();
+
+	// "Meshes", "Textures" and so on
+	static const char* GetCategoryName(AssetCategory category);
+
+	void SetBudget(AssetCategory category, AssetMemory budget);
+	AssetMemory GetBudget(AssetCategory category) { return budgets[(int)category]; }
+
+	// What's resident right now, and how many assets that is
+	AssetMemory GetUse(AssetCategory category) { return use[(int)category]; }
+	size_t GetResidentCount(AssetCategory category);
+	size_t GetCount(AssetCategory category);
+
+	// Starts looking after an asset, or replaces what's looked after
+	// under that name (which is how to say it's been rebuilt)
+	void Track(AssetCategory category, const std::string& name, std::unique_ptr<BudgetedAsset> asset);
+	bool Contains(AssetCategory category, const std::string& name);
+
+	// --------------------------------------------------------
+	// Call once a frame.  Notes what's been used, loads what was
+	// evicted and is wanted again (for up to budgetMilliseconds),
+	// then evicts whatever's needed to fit.  Anything used in this
+	// frame stays, even if nothing references it.  Returns how many
+	// assets were loaded or evicted.
+	// --------------------------------------------------------
+	int Update(double budgetMilliseconds);
+
+	// Loads an evicted asset right away, for anything that can't wait
+	// for Update().  False if it couldn't be, or isn't looked after.
+	bool Load(AssetCategory category, const std::string& name);
+
+	uint64_t GetEvictionCount() { return evictions; }
+	uint64_t GetLoadCount() { return loads; }
+	void PrintStats();
+
+private:
+	struct Entry
+	{
+		AssetCategory Category;
+		std::string Name;
+		std::unique_ptr<BudgetedAsset> Asset;
+		AssetMemory Size;		// As of when it was last made resident
+		bool Resident;
+		bool Wanted;			// Used while it was evicted
+		bool Failed;			// Couldn't be loaded, so it isn't tried again
+		uint64_t LastUsed;		// Frame
+	};
+
+	std::vector<Entry> entries;
+	std::unordered_map<std::string, size_t> indices[AssetCategoryCount];
+
+	AssetMemory budgets[AssetCategoryCount];
+	AssetMemory use[AssetCategoryCount];
+	uint64_t frame;
+	uint64_t evictions;
+	uint64_t loads;
+
+	void SetResident(Entry& entry, bool resident);
+	bool IsOver(int category);
+	int Enforce(int category);
+};
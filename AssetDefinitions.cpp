@@ -0,0 +1,41 @@
+#include "AssetDefinitions.h"
+
+const std::vector<DefinitionField<NamedDefinition>> NamedDefinition::Fields = {
+	{ "name", &NamedDefinition::Name, false },
+};
+
+const std::vector<DefinitionField<BundleDefinition>> BundleDefinition::Fields = {
+	{ "name", &BundleDefinition::Name, true },
+	{ "location", &BundleDefinition::Location, false },
+	{ "packed", &BundleDefinition::Packed, false },
+	{ "albedo", &BundleDefinition::Albedo, false },
+	{ "normal", &BundleDefinition::Normal, false },
+	{ "roughness", &BundleDefinition::Roughness, false },
+	{ "metal", &BundleDefinition::Metal, false },
+	{ "ao", &BundleDefinition::AO, false },
+};
+
+const std::vector<DefinitionField<MaterialDefinition>> MaterialDefinition::Fields = {
+	{ "name", &MaterialDefinition::Name, false },
+	{ "shader.vertex", &MaterialDefinition::VertexShader, true },
+	{ "shader.pixel", &MaterialDefinition::PixelShader, true },
+	{ "color", &MaterialDefinition::Color, true },
+	{ "shininess", &MaterialDefinition::Shininess, true },
+	{ "uvScale", &MaterialDefinition::UVScale, true },
+	{ "textures", &MaterialDefinition::Textures, false },
+	{ "textures.albedo", &MaterialDefinition::InlineAlbedo, false },
+	{ "textures.normal", &MaterialDefinition::InlineNormal, false },
+	{ "textures.roughness", &MaterialDefinition::InlineRoughness, false },
+	{ "textures.metalness", &MaterialDefinition::InlineMetal, false },
+};
+
+const std::vector<DefinitionField<EntityDefinition>> EntityDefinition::Fields = {
+	{ "name", &EntityDefinition::Name, false },
+	{ "mesh", &EntityDefinition::Mesh, true },
+	{ "material", &EntityDefinition::Material, true },
+	{ "position", &EntityDefinition::Position, true },
+	{ "rotation", &EntityDefinition::Rotation, true },
+	{ "scale", &EntityDefinition::Scale, true },
+	{ "parent", &EntityDefinition::Parent, false },
+	{ "children", &EntityDefinition::Children, false },
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "DefinitionReader.h"
+
+#include <array>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// A definition file, read on whatever thread got to it first.
+// Skies are still read as JSON (nlohmann::json), everything
+// else into one of the structs below.
+template <typename T>
+struct AssetDefinition
+{
+	std::filesystem::path Path;
+	T Data;
+	bool Read = false;	// Whether Data was read (and fit T)
+};
+
+// Any definition's name (every kind keeps it in "name")
+struct NamedDefinition
+{
+	std::string Name;
+
+	static const std::vector<DefinitionField<NamedDefinition>> Fields;
+};
+
+// --------------------------------------------------------
+// A .bundle file.  Its textures are either found by name in
+// Location (like "Textures\bronze_albedo"), or each listed.
+// Texture paths are relative to the asset folder, without
+// their extension.
+// --------------------------------------------------------
+struct BundleDefinition
+{
+	std::string Name;
+	std::string Location;
+	bool Packed = false;
+	std::string Albedo;
+	std::string Normal;
+	std::string Roughness;
+	std::string Metal;
+	std::string AO;
+
+	static const std::vector<DefinitionField<BundleDefinition>> Fields;
+};
+
+// --------------------------------------------------------
+// A .material file.  Textures names a bundle, unless the
+// textures are listed inline (as "textures": { ... }).
+// --------------------------------------------------------
+struct MaterialDefinition
+{
+	std::string Name;
+	std::string VertexShader;
+	std::string PixelShader;
+	std::array<float, 4> Color = {};
+	float Shininess = 0;
+	std::array<float, 2> UVScale = {};
+
+	std::string Textures;
+	std::string InlineAlbedo;
+	std::string InlineNormal;
+	std::string InlineRoughness;
+	std::string InlineMetal;
+
+	static const std::vector<DefinitionField<MaterialDefinition>> Fields;
+};
+
+// A .ge file, or one entity in a .scene file's "entities"
+struct EntityDefinition
+{
+	std::string Name;
+	std::string Mesh;
+	std::string Material;
+	std::array<float, 3> Position = {};
+	std::array<float, 3> Rotation = {};
+	std::array<float, 3> Scale = {};
+	std::string Parent;
+	std::vector<std::string> Children;
+
+	static const std::vector<DefinitionField<EntityDefinition>> Fields;
+};
@@ -0,0 +1,259 @@
+#include "AssetDependencies.h"
+#include "AssetArchive.h"
+
+#include <algorithm>
+#include <functional>
+
+void AssetDependencies::AddFile(const AssetRef& asset, const std::filesystem::path& file)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	fileAssets[AssetArchive::NormalizePath(file.string())].insert(asset);
+	assetFiles[asset].insert(file);
+}
+
+void AssetDependencies::AddDependency(const AssetRef& dependent, const AssetRef& dependency, bool isOptional)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	dependencies[dependent].insert(dependency);
+	dependents[dependency].insert(dependent);
+	if (isOptional)
+		optional.insert({ dependent, dependency });
+}
+
+void AssetDependencies::Remove(const AssetRef& asset)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& file : assetFiles[asset])
+	{
+		auto assets = fileAssets.find(AssetArchive::NormalizePath(file.string()));
+		if (assets == fileAssets.end())
+			continue;
+
+		assets->second.erase(asset);
+		if (assets->second.empty())
+			fileAssets.erase(assets);
+	}
+	assetFiles.erase(asset);
+
+	for (auto& dependency : dependencies[asset])
+	{
+		dependents[dependency].erase(asset);
+		optional.erase({ asset, dependency });
+	}
+	dependencies.erase(asset);
+}
+
+void AssetDependencies::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	fileAssets.clear();
+	assetFiles.clear();
+	dependencies.clear();
+	dependents.clear();
+	optional.clear();
+}
+
+std::vector<AssetRef> AssetDependencies::GetAssetsBuiltFrom(const std::vector<std::filesystem::path>& files)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::set<AssetRef> assets;
+	for (auto& file : files)
+	{
+		auto found = fileAssets.find(AssetArchive::NormalizePath(file.string()));
+		if (found != fileAssets.end())
+			assets.insert(found->second.begin(), found->second.end());
+	}
+	return std::vector<AssetRef>(assets.begin(), assets.end());
+}
+
+std::vector<std::filesystem::path> AssetDependencies::GetFiles(const AssetRef& asset)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = assetFiles.find(asset);
+	if (found == assetFiles.end())
+		return {};
+	return std::vector<std::filesystem::path>(found->second.begin(), found->second.end());
+}
+
+std::vector<AssetRef> AssetDependencies::GetDependencies(const AssetRef& asset)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = dependencies.find(asset);
+	if (found == dependencies.end())
+		return {};
+	return std::vector<AssetRef>(found->second.begin(), found->second.end());
+}
+
+std::vector<AssetRef> AssetDependencies::GetDependents(const AssetRef& asset)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = dependents.find(asset);
+	if (found == dependents.end())
+		return {};
+	return std::vector<AssetRef>(found->second.begin(), found->second.end());
+}
+
+std::vector<AssetRef> AssetDependencies::GetAffected(const std::vector<AssetRef>& changed)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Everything reachable through dependents
+	std::set<AssetRef> affected;
+	std::vector<AssetRef> open(changed.begin(), changed.end());
+	while (!open.empty())
+	{
+		AssetRef asset = open.back();
+		open.pop_back();
+		if (!affected.insert(asset).second)
+			continue;
+
+		auto found = dependents.find(asset);
+		if (found != dependents.end())
+			open.insert(open.end(), found->second.begin(), found->second.end());
+	}
+
+	// Then each one after whatever it uses (that's also affected)
+	std::vector<AssetRef> ordered;
+	std::set<AssetRef> visited;
+	std::function<void(const AssetRef&)> visit = [&](const AssetRef& asset)
+		{
+			if (!visited.insert(asset).second)
+				return;
+
+			auto found = dependencies.find(asset);
+			if (found != dependencies.end())
+				for (auto& dependency : found->second)
+					if (affected.contains(dependency))
+						visit(dependency);
+			ordered.push_back(asset);
+		};
+	for (auto& asset : affected)
+		visit(asset);
+
+	return ordered;
+}
+
+// --------------------------------------------------------
+// Tarjan's strongly connected components: each component
+// is finished only once everything it uses is, so they come
+// out in dependency order, and any with more than one asset
+// (or one that uses itself) is a cycle.  Everything's visited
+// in the maps' order, so the result never depends on the
+// order things were added in.
+// --------------------------------------------------------
+AssetResolution AssetDependencies::Resolve(const std::set<AssetKind>& madeFirst)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	AssetResolution resolution;
+
+	// Anything that was built from something, or uses something, is
+	// there.  Anything else is missing, and isn't part of the order.
+	auto exists = [&](const AssetRef& asset) { return assetFiles.contains(asset) || dependencies.contains(asset); };
+
+	std::set<AssetRef> assets;
+	for (auto& [asset, files] : assetFiles)
+		assets.insert(asset);
+	for (auto& [asset, used] : dependencies)
+	{
+		assets.insert(asset);
+		for (auto& dependency : used)
+			if (!exists(dependency) && !optional.contains({ asset, dependency }))
+				resolution.Missing.push_back({ asset, dependency });
+	}
+
+	struct Visit
+	{
+		int Index;
+		int LowLink;
+		bool OnStack;
+	};
+	std::map<AssetRef, Visit> visits;
+	std::vector<AssetRef> stack;
+	std::function<void(const AssetRef&)> visit = [&](const AssetRef& asset)
+		{
+			int index = (int)visits.size();
+			visits[asset] = { index, index, true };
+			stack.push_back(asset);
+
+			bool usesItself = false;
+			auto found = dependencies.find(asset);
+			if (found != dependencies.end())
+			{
+				for (auto& dependency : found->second)
+				{
+					if (!exists(dependency))
+						continue;
+					usesItself = usesItself || dependency == asset;
+
+					auto visited = visits.find(dependency);
+					if (visited == visits.end())
+					{
+						visit(dependency);
+						visits[asset].LowLink = std::min(visits[asset].LowLink, visits[dependency].LowLink);
+					}
+					else if (visited->second.OnStack)
+						visits[asset].LowLink = std::min(visits[asset].LowLink, visited->second.Index);
+				}
+			}
+
+			if (visits[asset].LowLink != index)
+				return;
+
+			std::vector<AssetRef> component;
+			do
+			{
+				component.push_back(stack.back());
+				visits[stack.back()].OnStack = false;
+				stack.pop_back();
+			} while (component.back() != asset);
+
+			std::reverse(component.begin(), component.end());
+			if (component.size() > 1 || usesItself)
+				resolution.Cycles.push_back(component);
+			resolution.Order.insert(resolution.Order.end(), component.begin(), component.end());
+		};
+	for (auto& asset : assets)
+		if (!visits.contains(asset))
+			visit(asset);
+
+	// Groups are whatever's connected, either way, with union-find
+	std::map<AssetRef, AssetRef> roots;
+	std::function<AssetRef(const AssetRef&)> findRoot = [&](const AssetRef& asset)
+		{
+			AssetRef& root = roots[asset];
+			if (root == asset)
+				return asset;
+			root = findRoot(root);
+			return root;
+		};
+	for (auto& asset : resolution.Order)
+		roots[asset] = asset;
+	for (auto& [asset, used] : dependencies)
+	{
+		if (madeFirst.contains(asset.Kind))
+			continue;
+		for (auto& dependency : used)
+		{
+			if (!exists(dependency) || madeFirst.contains(dependency.Kind))
+				continue;
+			AssetRef a = findRoot(asset);
+			AssetRef b = findRoot(dependency);
+			if (!(a == b))
+				roots[std::max(a, b)] = std::min(a, b);
+		}
+	}
+
+	std::map<AssetRef, size_t> groups;
+	for (auto& asset : resolution.Order)
+	{
+		if (madeFirst.contains(asset.Kind))
+			continue;
+		auto group = groups.insert({ findRoot(asset), resolution.Groups.size() });
+		if (group.second)
+			resolution.Groups.emplace_back();
+		resolution.Groups[group.first->second].push_back(asset);
+	}
+	return resolution;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Listed so that an asset's kind comes after the kinds it can use
+enum class AssetKind : uint32_t
+{
+	Texture,
+	Mesh,
+	Bundle,
+	Material,
+	Entity,
+	Scene,
+	Sky
+};
+
+struct AssetRef
+{
+	AssetKind Kind;
+	std::string Name;
+
+	bool operator==(const AssetRef& other) const { return Kind == other.Kind && Name == other.Name; }
+	bool operator<(const AssetRef& other) const { return Kind != other.Kind ? Kind < other.Kind : Name < other.Name; }
+};
+
+// What AssetDependencies::Resolve() found
+struct AssetResolution
+{
+	// Every asset, each after everything it uses.  The same graph
+	// always gives the same order, whatever order it was filled in.
+	std::vector<AssetRef> Order;
+
+	// Assets used by another (dependent, then dependency) that
+	// weren't built from anything, so don't exist
+	std::vector<std::pair<AssetRef, AssetRef>> Missing;
+
+	// Assets that end up using themselves, each cycle in Order
+	std::vector<std::vector<AssetRef>> Cycles;
+
+	// Assets that don't share anything (directly or not) with any
+	// other group, so each group can be made on its own, in Order.
+	// Kinds that are made before anything else aren't in any group.
+	std::vector<std::vector<AssetRef>> Groups;
+};
+
+// --------------------------------------------------------
+// Which files each asset was built from, and which other
+// assets it uses, so a changed file can be traced to every
+// asset it affects, and assets can be made in an order that
+// doesn't depend on which file happened to be read first.
+// Needs nothing but the standard library, so it can be
+// driven (and checked) without a device.
+//
+// Files are matched the way the archive matches them (case,
+// slashes and a leading ".\" don't matter).  Safe to fill in
+// from any thread.
+// --------------------------------------------------------
+class AssetDependencies
+{
+public:
+	// asset was built from file (its definition, or source data)
+	void AddFile(const AssetRef& asset, const std::filesystem::path& file);
+
+	// dependent uses dependency, so changing one changes the other.
+	// An optional dependency (like a bundle's AO map) isn't missing
+	// if it doesn't exist, but is still followed if it's added later.
+	void AddDependency(const AssetRef& dependent, const AssetRef& dependency, bool optional = false);
+
+	// Forgets an asset's files and dependencies (but not what depends
+	// on it), before it's rebuilt and they're added again
+	void Remove(const AssetRef& asset);
+	void Clear();
+
+	std::vector<AssetRef> GetAssetsBuiltFrom(const std::vector<std::filesystem::path>& files);
+	std::vector<std::filesystem::path> GetFiles(const AssetRef& asset);
+	std::vector<AssetRef> GetDependencies(const AssetRef& asset);
+	std::vector<AssetRef> GetDependents(const AssetRef& asset);
+
+	// The changed assets and everything that uses them (directly or
+	// not), ordered so that each comes after everything it uses.
+	// Cycles are broken wherever they're first found.
+	std::vector<AssetRef> GetAffected(const std::vector<AssetRef>& changed);
+
+	// Orders every asset for making them all at once, and finds what's
+	// missing, what's in a cycle and which assets are independent.
+	// Assets of a kind in madeFirst (already made by the time anything
+	// uses them) don't tie together the assets that share them.
+	AssetResolution Resolve(const std::set<AssetKind>& madeFirst = {});
+
+private:
+	std::mutex mutex;
+	std::map<std::string, std::set<AssetRef>> fileAssets;	// By normalized path
+	std::map<AssetRef, std::set<std::filesystem::path>> assetFiles;
+	std::map<AssetRef, std::set<AssetRef>> dependencies;	// What each asset uses
+	std::map<AssetRef, std::set<AssetRef>> dependents;		// What uses each asset
+	std::set<std::pair<AssetRef, AssetRef>> optional;		// Dependencies that may not exist
+};
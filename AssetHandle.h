@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+
+// --------------------------------------------------------
+// Points at an asset that may still be loading.  It starts
+// out on a placeholder and is swapped over to the real asset
+// once that's ready, so anything holding the handle (rather
+// than the asset) picks up the swap without being told.
+//
+// Handles don't own either asset.  A handle with no
+// placeholder just points at nothing until it's resolved.
+//
+// Anything that keeps a handle should hold a reference to
+// it (AddReference() and RemoveReference()), as the memory
+// budget can evict whatever nothing references back to its
+// placeholder.  It's loaded again once the handle's used.
+// --------------------------------------------------------
+template <typename T>
+class AssetHandle
+{
+public:
+	AssetHandle(T* placeholder) : asset(placeholder), placeholder(placeholder), references(0), used(false) {}
+
+	AssetHandle(AssetHandle const&) = delete;
+	void operator=(AssetHandle const&) = delete;
+
+	// Whatever should be used right now, which counts as using it
+	T* Get() const
+	{
+		if (!used.load(std::memory_order_relaxed))
+			used.store(true, std::memory_order_relaxed);
+		return Peek();
+	}
+	T* operator->() const { return Get(); }
+
+	// The same, without counting as a use
+	T* Peek() const { return asset.load(std::memory_order_acquire); }
+
+	bool IsLoaded() const { return Peek() != placeholder; }
+
+	// Swaps in the real asset.  A failed load (null) leaves the
+	// placeholder where it is.
+	void Resolve(T* loaded)
+	{
+		if (loaded)
+			asset.store(loaded, std::memory_order_release);
+	}
+
+	// Swaps in a reloaded asset, returning the one it replaced for
+	// the caller to delete (null if that was the placeholder)
+	T* Replace(T* loaded)
+	{
+		T* previous = asset.exchange(loaded, std::memory_order_acq_rel);
+		return previous == placeholder ? 0 : previous;
+	}
+
+	// Puts the placeholder back, returning the asset for the
+	// caller to delete (null if it hadn't loaded)
+	T* Unload() { return Replace(placeholder); }
+
+	void AddReference() { references.fetch_add(1, std::memory_order_relaxed); }
+	void RemoveReference() { references.fetch_sub(1, std::memory_order_relaxed); }
+	int GetReferenceCount() const { return references.load(std::memory_order_relaxed); }
+
+	// Whether it's been used since the last call
+	bool TakeUsed() { return used.exchange(false, std::memory_order_relaxed); }
+
+private:
+	std::atomic<T*> asset;
+	T* placeholder;
+	std::atomic<int> references;
+	mutable std::atomic<bool> used;
+};
@@ -0,0 +1,46 @@
+#include "AssetId.h"
+
+#include <cstdio>
+
+#ifdef ASSET_ID_NAMES
+#include <mutex>
+#include <unordered_map>
+
+// Every name registered so far, by its hash
+static std::mutex namesMutex;
+static std::unordered_map<uint64_t, std::string>& GetNames()
+{
+	static std::unordered_map<uint64_t, std::string> names;
+	return names;
+}
+#endif
+
+AssetId AssetId::Register(std::string_view name)
+{
+	AssetId id(name);
+
+#ifdef ASSET_ID_NAMES
+	std::lock_guard<std::mutex> lock(namesMutex);
+	auto inserted = GetNames().insert({ id.Value, std::string(name) });
+	if (!inserted.second && inserted.first->second != name)
+		printf("Asset names \"%s\" and \"%.*s\" have the same id\n", inserted.first->second.c_str(), (int)name.size(), name.data());
+#endif
+
+	return id;
+}
+
+std::string AssetId::GetName(AssetId id)
+{
+#ifdef ASSET_ID_NAMES
+	{
+		std::lock_guard<std::mutex> lock(namesMutex);
+		auto found = GetNames().find(id.Value);
+		if (found != GetNames().end())
+			return found->second;
+	}
+#endif
+
+	char hex[20] = {};
+	snprintf(hex, sizeof(hex), "#%016llx", (unsigned long long)id.Value);
+	return hex;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#if defined(DEBUG) || defined(_DEBUG)
+#define ASSET_ID_NAMES
+#endif
+
+// --------------------------------------------------------
+// Names an asset with a 64 bit hash (FNV-1a) of its name,
+// so looking one up never touches a string.  The hash is
+// constexpr, and "name"_id is guaranteed to happen at
+// compile time, so ids for names in code cost nothing.
+//
+// Ids can't be turned back into names, except in debug
+// builds, where every name registered (as every asset's
+// is, when it's loaded) is remembered for GetName().
+// --------------------------------------------------------
+struct AssetId
+{
+	uint64_t Value = 0; // 0 is no asset
+
+	constexpr AssetId() = default;
+	constexpr explicit AssetId(uint64_t value) : Value(value) {}
+	constexpr AssetId(std::string_view name) : Value(Hash(name)) {}
+	constexpr AssetId(const char* name) : AssetId(std::string_view(name)) {}
+	AssetId(const std::string& name) : AssetId(std::string_view(name)) {}
+
+	constexpr bool IsValid() const { return Value != 0; }
+	constexpr bool operator==(const AssetId& other) const { return Value == other.Value; }
+	constexpr bool operator!=(const AssetId& other) const { return Value != other.Value; }
+
+	static constexpr uint64_t Hash(std::string_view name)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (char c : name)
+		{
+			hash ^= (uint8_t)c;
+			hash *= 1099511628211ull;
+		}
+		return hash ? hash : 1; // Never "no asset"
+	}
+
+	// Hashes a name, and in debug builds remembers it (reporting
+	// any other name that hashes the same).  Safe on any thread.
+	static AssetId Register(std::string_view name);
+
+	// The registered name in debug builds, otherwise the hash in hex
+	static std::string GetName(AssetId id);
+};
+
+consteval AssetId operator""_id(const char* name, size_t length)
+{
+	return AssetId(std::string_view(name, length));
+}
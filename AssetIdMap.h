@@ -0,0 +1,172 @@
+#pragma once
+
+#include "AssetId.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// --------------------------------------------------------
+// A flat map from AssetId to V.  Entries sit packed in one
+// array (so walking them is just walking that), and a table
+// of slots, open addressed with linear probing, finds them
+// by id.  Looking up hashes nothing and allocates nothing.
+//
+// Each entry keeps its name too, for anything that lists
+// assets (like the UI).  Adding or removing entries can
+// move the others, so don't hold on to what FindEntry() returns.
+// --------------------------------------------------------
+template <typename V>
+class AssetIdMap
+{
+public:
+	struct Entry
+	{
+		AssetId Id;
+		std::string Name;
+		V Value;
+	};
+
+	// The entry for id, or null if there isn't one
+	Entry* FindEntry(AssetId id) { return Find(id); }
+	const Entry* FindEntry(AssetId id) const { return Find(id); }
+
+	// The value for id, or V() if there isn't one
+	V Get(AssetId id) const
+	{
+		const Entry* entry = Find(id);
+		return entry ? entry->Value : V();
+	}
+
+	bool Contains(AssetId id) const { return Find(id) != 0; }
+
+	// Adds or replaces the value for a name
+	V& Insert(std::string_view name, V value)
+	{
+		AssetId id = AssetId::Register(name);
+		if (Entry* entry = Find(id))
+		{
+			entry->Value = std::move(value);
+			return entry->Value;
+		}
+
+		// Kept at most half full, so probes stay short
+		if ((entries.size() + 1) * 2 > slots.size())
+			Rehash(slots.empty() ? 16 : slots.size() * 2);
+
+		entries.push_back({ id, std::string(name), std::move(value) });
+		size_t slot = GetSlot(id);
+		while (slots[slot].Index)
+			slot = (slot + 1) & (slots.size() - 1);
+		slots[slot] = { id.Value, (uint32_t)entries.size() };
+		return entries.back().Value;
+	}
+
+	// Removes id (if it's there), moving the last entry into its place
+	bool Erase(AssetId id)
+	{
+		size_t slot = FindSlot(id);
+		if (slot == NotFound)
+			return false;
+
+		uint32_t index = slots[slot].Index - 1;
+		RemoveSlot(slot);
+		if (index != entries.size() - 1)
+		{
+			slots[FindSlot(entries.back().Id)].Index = index + 1;
+			entries[index] = std::move(entries.back());
+		}
+		entries.pop_back();
+		return true;
+	}
+
+	// Makes room for count entries, so adding that many never rehashes
+	void Reserve(size_t count)
+	{
+		entries.reserve(count);
+		size_t slotCount = slots.empty() ? 16 : slots.size();
+		while (count * 2 > slotCount)
+			slotCount *= 2;
+		if (slotCount != slots.size())
+			Rehash(slotCount);
+	}
+
+	void Clear()
+	{
+		entries.clear();
+		slots.clear();
+	}
+
+	size_t Size() const { return entries.size(); }
+
+	auto begin() { return entries.begin(); }
+	auto end() { return entries.end(); }
+	auto begin() const { return entries.begin(); }
+	auto end() const { return entries.end(); }
+
+private:
+	static constexpr size_t NotFound = ~(size_t)0;
+
+	struct Slot
+	{
+		uint64_t Id;
+		uint32_t Index; // Into entries, plus one (0 is empty)
+	};
+
+	std::vector<Entry> entries;
+	std::vector<Slot> slots; // Always a power of two long
+
+	// FNV's low bits aren't well mixed, so the high bits of a
+	// multiply by 2^64 / phi pick the slot instead
+	size_t GetSlot(AssetId id) const
+	{
+		return (size_t)((id.Value * 0x9E3779B97F4A7C15ull) >> 32) & (slots.size() - 1);
+	}
+
+	size_t FindSlot(AssetId id) const
+	{
+		if (slots.empty())
+			return NotFound;
+
+		for (size_t slot = GetSlot(id);; slot = (slot + 1) & (slots.size() - 1))
+		{
+			if (!slots[slot].Index)
+				return NotFound;
+			if (slots[slot].Id == id.Value)
+				return slot;
+		}
+	}
+
+	Entry* Find(AssetId id) { size_t slot = FindSlot(id); return slot == NotFound ? 0 : &entries[slots[slot].Index - 1]; }
+	const Entry* Find(AssetId id) const { size_t slot = FindSlot(id); return slot == NotFound ? 0 : &entries[slots[slot].Index - 1]; }
+
+	// Shifts later slots in the same run back over the gap, so
+	// no probe ever stops short of what it's looking for
+	void RemoveSlot(size_t slot)
+	{
+		size_t mask = slots.size() - 1;
+		for (size_t next = (slot + 1) & mask; slots[next].Index; next = (next + 1) & mask)
+		{
+			size_t home = GetSlot(AssetId(slots[next].Id));
+			if (((next - home) & mask) >= ((next - slot) & mask))
+			{
+				slots[slot] = slots[next];
+				slot = next;
+			}
+		}
+		slots[slot] = {};
+	}
+
+	void Rehash(size_t slotCount)
+	{
+		slots.assign(slotCount, {});
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			size_t slot = GetSlot(entries[i].Id);
+			while (slots[slot].Index)
+				slot = (slot + 1) & (slotCount - 1);
+			slots[slot] = { entries[i].Id.Value, (uint32_t)i + 1 };
+		}
+	}
+};
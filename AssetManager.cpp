@@ -1,313 +1,2159 @@
 #include "AssetManager.h"
 
-#include "WICTextureLoader.h"
 #include "DXCore.h"
+#include "ImageLoader.h"
+#include "JobGraph.h"
+#include "Profiler.h"
+#include "TextureCompressor.h"
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
-#include <nlohmann/json.hpp>
+#include <sstream>
 
 AssetManager* AssetManager::instance;
 
 constexpr auto ASSET_PATH = ".\\Assets";
 constexpr auto DEFINITIONS_PATH = ".\\Definitions";
 
-#define LoadTexture(srv) DirectX::CreateWICTextureFromFile(device.Get(), context.Get(), (wide_path + L"\\..\\..\\" + p.path().wstring()).c_str(), 0, srv.GetAddressOf())
-
 #define LoadShader(type, file) new type(device.Get(), context.Get(), (wide_path + L"\\" + file).c_str())
 
 #define RemoveExtension(s) s.erase(s.find_last_of("."), std::string::npos)
 
-AssetManager::~AssetManager()
+// Everything that's loaded after BeginLoad() returns.  The jobs
+// point into this, so it sticks around until they've all finished.
+struct AssetManager::StreamingLoad
+{
+	struct TextureLoad
+	{
+		std::string Key;
+		std::filesystem::path File;
+		ImageData Image;
+
+		// Set for bundle textures, which are block compressed
+		bool Compress;
+		BlockFormat Format;
+		MipContent Content;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Texture;
+
+		// Made from FirstMip on, and streamed from there if that isn't 0
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t MipCount;
+		uint32_t FirstMip;
+	};
+	struct MeshLoad
+	{
+		std::string Name;
+		std::filesystem::path File;
+		Mesh* Result;
+	};
+	struct SkyLoad
+	{
+		AssetDefinition<nlohmann::json> Definition;
+		Sky* Result;
+	};
+
+	JobGraph Graph;
+	std::chrono::steady_clock::time_point Start;
+	int DefinitionJobCount;		// Already run by BeginLoad()
+
+	std::vector<TextureLoad> Textures;
+	std::vector<MeshLoad> Meshes;
+	std::vector<PendingBundle> Bundles;
+	std::vector<SkyLoad> Skies;
+};
+
+// --------------------------------------------------------
+// Helpers for importing textures, which run on any thread
+// --------------------------------------------------------
+// PngDecoder on the bytes already read, or WIC for anything else
+static bool DecodeSource(const AssetBytes& bytes, ImageData& image)
 {
-	delete sky;
-	for (auto& p : textureBundles) delete p.second;
-	for (auto& p : materials) delete p.second;
-	for (auto& p : meshes) delete p.second;
-	for (auto& p : shaders) delete p.second;
-	for (auto& p : entities) delete p.second;
+	return PngDecoder::Decode(bytes.Data, bytes.Size, image) || ImageLoader::DecodeWithWIC(bytes.Data, bytes.Size, image);
 }
 
-void AssetManager::LoadTextureBundles(std::vector<std::filesystem::directory_entry> bundlePaths) {
-	for (auto& p : bundlePaths) {
-		std::ifstream i(p.path());
-		nlohmann::json d;
-		i >> d;
+// Compresses, reports how well that went and stores the result.
+// start is when importing began, so decoding counts as build time.
+static void CompressToCache(
+	const std::string& name,
+	const ImageData& image,
+	BlockFormat format,
+	MipContent content,
+	DerivedDataCache& cache,
+	uint64_t key,
+	std::chrono::steady_clock::time_point start,
+	CompressedTexture& texture)
+{
+	// Other textures are compressing on the other threads
+	texture = TextureCompressor::Compress(image, format, content, 1);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	size_t compressedBytes = 0;
+	for (auto& mip : texture.Mips)
+		compressedBytes += mip.size();
+	printf("Compressed %s to %s: %.1f dB PSNR, %.2f MB instead of %.2f MB\n",
+		name.c_str(),
+		TextureCompressor::GetFormatName(format),
+		TextureCompressor::PSNR(image, texture),
+		compressedBytes / (1024.0 * 1024.0),
+		image.Pixels.size() * 4 / 3 / (1024.0 * 1024.0)); // RGBA8 with mips
+
+	if (!cache.Store("tex", key, TextureCompressor::Serialize(texture), milliseconds))
+		printf("Couldn't write %s to the cache\n", name.c_str());
+}
+
+// Only what's already in the cache, for when there's no time to compress
+static bool LoadCachedTexture(
+	const AssetBytes& source,
+	BlockFormat format,
+	MipContent content,
+	DerivedDataCache& cache,
+	CompressedTexture& texture)
+{
+	uint64_t key = TextureCompressor::HashInputs(source.Data, source.Size, format, content);
+	std::vector<uint8_t> cached;
+	return cache.Load("tex", key, cached) && TextureCompressor::Deserialize(cached, texture);
+}
+
+// --------------------------------------------------------
+// Block compresses a texture, or loads it from the cache if
+// this file has been compressed to this format before.  If
+// it can't be compressed it's left decoded in image instead
+// (and false is returned).
+// --------------------------------------------------------
+static bool LoadCompressedTexture(
+	const std::string& name,
+	const AssetBytes& source,
+	BlockFormat format,
+	MipContent content,
+	DerivedDataCache& cache,
+	bool useCache,
+	CompressedTexture& texture,
+	ImageData& image)
+{
+	if (useCache && LoadCachedTexture(source, format, content, cache, texture))
+		return true;
+
+	uint64_t key = TextureCompressor::HashInputs(source.Data, source.Size, format, content);
+	auto start = std::chrono::steady_clock::now();
+	if (!DecodeSource(source, image) || !TextureCompressor::CanCompress(image))
+		return false;
+
+	CompressToCache(name, image, format, content, cache, key, start, texture);
+	image = {};
+	return true;
+}
+
+// --------------------------------------------------------
+// Packs roughness, metalness and (optionally) ambient
+// occlusion into one BC7 texture, or loads it from the
+// cache.  Sources with no data are filled in: no AO is white.
+// --------------------------------------------------------
+static bool LoadPackedTexture(
+	const std::string& name,
+	const AssetBytes sources[3],
+	DerivedDataCache& cache,
+	bool useCache,
+	CompressedTexture& texture)
+{
+	// The key covers every source, each prefixed by its size
+	std::vector<uint8_t> keyData;
+	for (int i = 0; i < 3; i++)
+	{
+		uint64_t size = sources[i].Size;
+		keyData.insert(keyData.end(), (uint8_t*)&size, (uint8_t*)&size + sizeof(size));
+		keyData.insert(keyData.end(), sources[i].Data, sources[i].Data + sources[i].Size);
+	}
+
+	uint64_t key = TextureCompressor::HashInputs(keyData.data(), keyData.size(), BlockFormat::BC7, MipContent::Data);
+	std::vector<uint8_t> cached;
+	if (useCache && cache.Load("tex", key, cached) && TextureCompressor::Deserialize(cached, texture))
+		return true;
+
+	auto start = std::chrono::steady_clock::now();
+	ImageData images[3] = {};
+	const ImageData* channels[4] = {};
+	for (int i = 0; i < 3; i++)
+	{
+		if (!sources[i].Data)
+			continue;
+		if (!DecodeSource(sources[i], images[i]))
+			return false;
+		channels[i] = &images[i];
+	}
+
+	const uint8_t fill[4] = { 255, 0, 255, 255 };
+	ImageData packed = TextureCompressor::PackChannels(channels, fill);
+	if (!TextureCompressor::CanCompress(packed))
+		return false;
+
+	CompressToCache(name, packed, BlockFormat::BC7, MipContent::Data, cache, key, start, texture);
+	return true;
+}
 
-		textureBundles[d["name"].get<std::string>()] = new TextureBundle();
-		std::string name = d["name"].get<std::string>();
-		textureBundles[name]->name = name;
-		if (d.contains("location")) {
-			std::string location = d["location"].get<std::string>();
-			std::string root = std::string(ASSET_PATH) + "\\" + location + "\\" + d["name"].get<std::string>().c_str();
-			textureBundles[d["name"].get<std::string>()]->albedo = textures[root + "_albedo"];
-			textureBundles[d["name"].get<std::string>()]->normal = textures[root + "_normals"];
-			textureBundles[d["name"].get<std::string>()]->roughness = textures[root + "_roughness"];
-			textureBundles[d["name"].get<std::string>()]->metalness = textures[root + "_metal"];
+// A definition's "name", or its file name without the extension
+template <typename T>
+static std::string GetDefinitionName(AssetDefinition<T>& definition)
+{
+	if constexpr (std::is_same_v<T, nlohmann::json>) {
+		if (definition.Data["name"].is_string())
+			return definition.Data["name"].get<std::string>();
+	}
+	else if (!definition.Data.Name.empty())
+		return definition.Data.Name;
+
+	std::string name = definition.Path.filename().string();
+	RemoveExtension(name);
+	return name;
+}
+
+// The kind of asset a definition file describes
+static bool GetDefinitionKind(const std::filesystem::path& file, AssetKind& kind)
+{
+	const std::pair<const char*, AssetKind> extensions[] = {
+		{ ".bundle", AssetKind::Bundle },
+		{ ".material", AssetKind::Material },
+		{ ".ge", AssetKind::Entity },
+		{ ".scene", AssetKind::Scene },
+		{ ".sky", AssetKind::Sky },
+	};
+	for (auto& extension : extensions) {
+		if (file.extension().compare(extension.first) == 0) {
+			kind = extension.second;
+			return true;
 		}
-		else {
-			textureBundles[d["name"].get<std::string>()]->albedo = textures[std::string(ASSET_PATH) + "\\" + d["albedo"].get<std::string>()];
-			textureBundles[d["name"].get<std::string>()]->normal = textures[std::string(ASSET_PATH) + "\\" + d["normal"].get<std::string>()];
-			textureBundles[d["name"].get<std::string>()]->roughness = textures[std::string(ASSET_PATH) + "\\" + d["roughness"].get<std::string>()];
-			textureBundles[d["name"].get<std::string>()]->metalness = textures[std::string(ASSET_PATH) + "\\" + d["metal"].get<std::string>()];
+	}
+	return false;
+}
+
+// Deletes a handle along with whatever it loaded (but not its placeholder)
+template <typename T>
+static void DeleteHandle(AssetHandle<T>* handle)
+{
+	if (!handle)
+		return;
+
+	if (handle->IsLoaded())
+		delete handle->Get();
+	delete handle;
+}
+
+// --------------------------------------------------------
+// A handle the memory budget looks after.  Evicting it puts
+// its placeholder back, and loading it again calls load (on
+// the main thread, between frames).
+// --------------------------------------------------------
+template <typename T>
+class BudgetedHandle : public BudgetedAsset
+{
+public:
+	BudgetedHandle(AssetHandle<T>* handle, std::function<AssetMemory(T*)> measure, std::function<T*()> load)
+		: handle(handle), measure(measure), load(load) {}
+
+	bool IsResident() override { return handle->IsLoaded() && handle->Peek(); }
+	bool IsReferenced() override { return handle->GetReferenceCount() > 0; }
+	bool TakeUsed() override { return handle->TakeUsed(); }
+	AssetMemory Measure() override { return measure(handle->Peek()); }
+
+	void Evict() override { delete handle->Unload(); }
+	bool Load() override
+	{
+		T* loaded = load();
+		if (!loaded)
+			return false;
+		delete handle->Replace(loaded);
+		return true;
+	}
+
+private:
+	AssetHandle<T>* handle;
+	std::function<AssetMemory(T*)> measure;
+	std::function<T*()> load;
+};
+
+// Bundles share their textures, so a texture is held for as
+// long as any bundle using it is resident (see BudgetedTexture)
+class BudgetedBundle : public BudgetedHandle<TextureBundle>
+{
+public:
+	BudgetedBundle(AssetHandle<TextureBundle>* handle, std::function<AssetMemory(TextureBundle*)> measure, std::function<TextureBundle*()> load,
+		std::vector<std::string> keys, std::unordered_map<std::string, int>& holders)
+		: BudgetedHandle(handle, measure, load), keys(keys), holders(holders), holding(false)
+	{
+		Hold(IsResident());
+	}
+	~BudgetedBundle() { Hold(false); }
+
+	void Evict() override
+	{
+		BudgetedHandle::Evict();
+		Hold(false);
+	}
+	bool Load() override
+	{
+		if (!BudgetedHandle::Load())
+			return false;
+		Hold(true);
+		return true;
+	}
+
+private:
+	std::vector<std::string> keys;
+	std::unordered_map<std::string, int>& holders;
+	bool holding;
+
+	void Hold(bool hold)
+	{
+		if (hold == holding)
+			return;
+		for (auto& key : keys)
+			holders[key] += hold ? 1 : -1;
+		holding = hold;
+	}
+};
+
+// A texture on its own, which counts as used (and referenced)
+// while a resident bundle holds it.  Evicting it just lets go
+// of it, and it's imported again by the next bundle wanting it.
+class BudgetedTexture : public BudgetedAsset
+{
+public:
+	BudgetedTexture(const std::string& key, std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>& textures,
+		std::unordered_map<std::string, int>& holders, std::function<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>()> load)
+		: key(key), textures(textures), holders(holders), load(load) {}
+
+	bool IsResident() override
+	{
+		auto found = textures.find(key);
+		return found != textures.end() && found->second;
+	}
+	bool IsReferenced() override { return holders[key] > 0; }
+	bool TakeUsed() override { return IsReferenced(); }
+	AssetMemory Measure() override { return { 0, ImageLoader::EstimateBytes(textures[key].Get()) }; }
+
+	void Evict() override { textures.erase(key); }
+	bool Load() override
+	{
+		textures[key] = load();
+		return IsResident();
+	}
+
+private:
+	std::string key;
+	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>& textures;
+	std::unordered_map<std::string, int>& holders;
+	std::function<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>()> load;
+};
+
+AssetManager::~AssetManager()
+{
+	watcher.Stop();
+
+	// Waits for them, as they write to the cache
+	textureEncodes.clear();
+
+	// Anything still loading needs somewhere to go
+	if (streaming) {
+		streaming->Graph.Finish();
+		EndLoad();
+	}
+
+	// Entities hold references to meshes and materials, and
+	// materials to bundles, so they go before what they hold
+	for (auto& p : entities) delete p.Value;
+	for (auto& p : materials) DeleteHandle(p.Value);
+	for (auto& p : skies) delete p.Value;
+	delete placeholderSky; // Skies hold a reference to their mesh
+	for (auto& p : textureBundles) DeleteHandle(p.Value);
+	for (auto& [name, b] : materialBundles) DeleteHandle(b);
+	for (auto& p : meshes) DeleteHandle(p.Value);
+	for (auto& p : shaders) delete p.Value;
+
+	delete placeholderBundleHandle;
+	delete placeholderBundle;
+	delete placeholderMeshHandle;
+	delete placeholderMesh;
+}
+
+// --------------------------------------------------------
+// Stand-ins for anything that's still loading: a unit cube
+// and flat grey textures
+// --------------------------------------------------------
+void AssetManager::CreatePlaceholders()
+{
+	using namespace DirectX;
+
+	if (IsHeadless())
+		return;
+
+	// Each face gets its own 4 vertices so the normals stay flat
+	const XMFLOAT3 normals[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const XMFLOAT3 tangents[6] = { { 0, 0, 1 }, { 0, 0, -1 }, { 1, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 }, { 1, 0, 0 } };
+	const float corners[4][2] = { { -1, -1 }, { -1, 1 }, { 1, 1 }, { 1, -1 } };
+	const unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+
+	Vertex verts[24] = {};
+	unsigned int indices[36] = {};
+	for (int f = 0; f < 6; f++) {
+		XMVECTOR n = XMLoadFloat3(&normals[f]);
+		XMVECTOR t = XMLoadFloat3(&tangents[f]);
+		XMVECTOR b = XMVector3Cross(t, n); // Keeps the winding clockwise from outside
+
+		for (int c = 0; c < 4; c++) {
+			Vertex& v = verts[f * 4 + c];
+			XMStoreFloat3(&v.Position, (n + t * corners[c][0] + b * corners[c][1]) * 0.5f);
+			v.UV = XMFLOAT2((corners[c][0] + 1) * 0.5f, (1 - corners[c][1]) * 0.5f);
+			v.Normal = normals[f];
+			v.Tangent = tangents[f];
 		}
+
+		for (int i = 0; i < 6; i++)
+			indices[f * 6 + i] = f * 4 + quad[i];
 	}
-	
+	placeholderMesh = new Mesh("placeholder", verts, 24, indices, 36, device);
+	placeholderMeshHandle = new AssetHandle<Mesh>(placeholderMesh);
+
+	auto solid = [&](uint8_t r, uint8_t g, uint8_t b)
+		{
+			ImageData image = { 1, 1, { r, g, b, 255 } };
+			return ImageLoader::CreateTexture(device, context, image);
+		};
+	placeholderBundle = new TextureBundle("placeholder");
+	placeholderBundle->albedo = solid(128, 128, 128);
+	placeholderBundle->normal = solid(128, 128, 255);
+	placeholderBundle->roughness = solid(128, 128, 128);
+	placeholderBundle->metalness = solid(0, 0, 0);
+	placeholderBundle->roughnessMetalAO = solid(128, 0, 255);
 }
 
-void AssetManager::LoadMaterials(std::vector<std::filesystem::directory_entry> materialPaths) {
-	for (auto& p : materialPaths) {
-		std::ifstream i(p.path());
-		nlohmann::json d;
+// Reads a definition straight into its struct (see DefinitionReader)
+template <typename T>
+bool AssetManager::ReadDefinition(AssetDefinition<T>& definition)
+{
+	AssetBytes bytes;
+	if (!ReadFile(definition.Path, bytes))
+		return false;
+
+	std::string error;
+	definition.Read = DefinitionReader<T>::Read(bytes.Data, bytes.Size, definition.Data, error);
+	if (!definition.Read)
+		printf("Couldn't read %s: %s\n", definition.Path.string().c_str(), error.c_str());
+	return definition.Read;
+}
+
+// Skies are still parsed whole (throwing if they aren't valid JSON)
+bool AssetManager::ReadDefinition(AssetDefinition<nlohmann::json>& definition)
+{
+	AssetBytes bytes;
+	if (!ReadFile(definition.Path, bytes))
+		return false;
+
+	definition.Data = nlohmann::json::parse(bytes.Data, bytes.Data + bytes.Size);
+	definition.Read = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// Hands each entity in a .scene file to onEntity as it's
+// read.  Loose files are streamed, and archived ones are
+// already mapped, so a scene is never in memory all at once
+// (only one entity, and the stream's buffer).
+// --------------------------------------------------------
+bool AssetManager::ReadScene(const std::filesystem::path& file, const std::function<void(EntityDefinition&)>& onEntity)
+{
+	std::string error;
+	bool read;
+	if (archive.IsOpen()) {
+		AssetBytes bytes;
+		if (!ReadFile(file, bytes))
+			return false;
+		read = DefinitionReader<EntityDefinition>::ReadEach(bytes.Data, bytes.Size, "entities", onEntity, error);
+	}
+	else {
+		std::ifstream stream(file, std::ios::binary);
+		if (!stream)
+			return false;
+		read = DefinitionReader<EntityDefinition>::ReadEach(stream, "entities", onEntity, error);
+	}
+
+	if (!read)
+		printf("Couldn't read all of %s: %s\n", file.string().c_str(), error.c_str());
+	return read;
+}
+
+// Parses a mesh (or takes its geometry from the cache) and builds
+// it, which only needs the device.  Headless, the geometry is still
+// parsed and cached, but no mesh is made.
+Mesh* AssetManager::ImportMesh(const std::string& name, const std::filesystem::path& file)
+{
+	AssetBytes bytes;
+	if (!ReadFile(file, bytes))
+		return 0;
+
+	// Parsing is most of the work, so that's what's cached
+	uint64_t key = Mesh::HashInputs(bytes.Data, bytes.Size);
+	std::vector<uint8_t> cached;
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	if (!derivedData.Load("mesh", key, cached) || !Mesh::DeserializeGeometry(cached, verts, indices)) {
+		auto start = std::chrono::steady_clock::now();
+		std::istringstream obj(std::string((const char*)bytes.Data, bytes.Size));
+		if (!Mesh::ParseOBJ(obj, verts, indices))
+			return 0;
+
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		derivedData.Store("mesh", key, Mesh::SerializeGeometry(verts, indices), milliseconds);
+	}
+
+	if (IsHeadless() || verts.empty() || indices.empty())
+		return 0;
+	return new Mesh(name, &verts[0], (int)verts.size(), &indices[0], (int)indices.size(), device);
+}
+
+// What each of a bundle's textures is used for, which decides how it's
+// compressed and how its mips are filtered.  Packed bundles read their
+// roughness, metal and AO files themselves, so those aren't listed.
+std::vector<std::pair<std::string, AssetManager::TextureImport>> AssetManager::GetTextureUses(const PendingBundle& bundle)
+{
+	std::vector<std::pair<std::string, TextureImport>> uses = {
+		{ bundle.Albedo, { BlockFormat::BC7, MipContent::Color } },
+		{ bundle.Normal, { BlockFormat::BC5, MipContent::Normal } },
+	};
+	if (!bundle.Packed) {
+		uses.push_back({ bundle.Roughness, { BlockFormat::BC4, MipContent::Data } });
+		uses.push_back({ bundle.Metal, { BlockFormat::BC4, MipContent::Data } });
+	}
+	return uses;
+}
+
+// Works out where a bundle's textures are (but doesn't give it a handle)
+PendingBundle AssetManager::ParseBundle(AssetDefinition<BundleDefinition>& p) {
+	BundleDefinition& d = p.Data;
+
+	PendingBundle bundle = {};
+	bundle.Name = d.Name;
+	bundle.Packed = d.Packed;
+	if (!d.Location.empty()) {
+		std::string root = std::string(ASSET_PATH) + "\\" + d.Location + "\\" + d.Name;
+		bundle.Albedo = root + "_albedo";
+		bundle.Normal = root + "_normals";
+		bundle.Roughness = root + "_roughness";
+		bundle.Metal = root + "_metal";
+		bundle.AO = root + "_ao"; // Only if there is one
+	}
+	else {
+		bundle.Albedo = std::string(ASSET_PATH) + "\\" + d.Albedo;
+		bundle.Normal = std::string(ASSET_PATH) + "\\" + d.Normal;
+		bundle.Roughness = std::string(ASSET_PATH) + "\\" + d.Roughness;
+		bundle.Metal = std::string(ASSET_PATH) + "\\" + d.Metal;
+		if (!d.AO.empty())
+			bundle.AO = std::string(ASSET_PATH) + "\\" + d.AO;
+	}
+
+	AssetRef asset = { AssetKind::Bundle, bundle.Name };
+	dependencies.AddFile(asset, p.Path);
+	for (const std::string* key : { &bundle.Albedo, &bundle.Normal, &bundle.Roughness, &bundle.Metal })
+		dependencies.AddDependency(asset, { AssetKind::Texture, *key });
+	if (!bundle.AO.empty())
+		dependencies.AddDependency(asset, { AssetKind::Texture, bundle.AO }, true);
+	return bundle;
+}
+
+// A material uses its bundle, or the textures it lists inline
+void AssetManager::TrackMaterial(AssetDefinition<MaterialDefinition>& p, const std::string& name) {
+	MaterialDefinition& d = p.Data;
+	AssetRef asset = { AssetKind::Material, name };
+	dependencies.AddFile(asset, p.Path);
+
+	if (!d.Textures.empty())
+		dependencies.AddDependency(asset, { AssetKind::Bundle, d.Textures });
+	else
+		for (const std::string* key : { &d.InlineAlbedo, &d.InlineNormal, &d.InlineRoughness, &d.InlineMetal })
+			dependencies.AddDependency(asset, { AssetKind::Texture, *key });
+}
 
-		i >> d;
+// Makes a material from its definition.  A bundle listed inline
+// gets a handle of its own, and is added to pending to load.
+Material* AssetManager::CreateMaterial(AssetDefinition<MaterialDefinition>& p, std::vector<PendingBundle>& pending) {
+	MaterialDefinition& d = p.Data;
 
-		std::string name;
-		if (d["name"].is_string()) {
-			name = d["name"].get<std::string>();
+	AssetHandle<TextureBundle>* bundle = 0;
+	if (!d.Textures.empty()) {
+		bundle = textureBundles.Get(d.Textures);
+	}
+	else {
+		// Reloads build into the handle the material had before
+		std::string name = GetDefinitionName(p);
+		AssetHandle<TextureBundle>*& handle = materialBundles[name];
+		if (!handle)
+			handle = new AssetHandle<TextureBundle>(placeholderBundle);
+
+		PendingBundle materialBundle = {};
+		materialBundle.Handle = handle;
+		materialBundle.Name = name + " (inline)"; // Only for the budget to go by
+		materialBundle.Albedo = d.InlineAlbedo;
+		materialBundle.Normal = d.InlineNormal;
+		materialBundle.Roughness = d.InlineRoughness;
+		materialBundle.Metal = d.InlineMetal;
+		pending.push_back(materialBundle);
+		bundle = materialBundle.Handle;
+	}
+
+	// A bundle that doesn't exist (which Resolve() reports) leaves
+	// the material with the placeholder textures
+	if (!bundle) {
+		if (!placeholderBundleHandle)
+			placeholderBundleHandle = new AssetHandle<TextureBundle>(placeholderBundle);
+		bundle = placeholderBundleHandle;
+	}
+
+	return new Material(
+		GetVertexShader(d.VertexShader),
+		GetPixelShader(d.PixelShader),
+		DirectX::XMFLOAT4(d.Color.data()),
+		d.Shininess,
+		DirectX::XMFLOAT2(d.UVScale.data()),
+		bundle,
+		samplerOptions,
+		clamplerOptions
+	);
+}
+
+// Entities in their own file are built from it, and use their
+// mesh, material and parent.  Scenes are tracked as a whole instead.
+void AssetManager::TrackEntity(AssetDefinition<EntityDefinition>& p, const std::string& name) {
+	AssetRef asset = { AssetKind::Entity, name };
+	dependencies.AddFile(asset, p.Path);
+	dependencies.AddDependency(asset, { AssetKind::Mesh, p.Data.Mesh });
+	dependencies.AddDependency(asset, { AssetKind::Material, p.Data.Material });
+	if (!p.Data.Parent.empty())
+		dependencies.AddDependency(asset, { AssetKind::Entity, p.Data.Parent });
+}
+
+// Whether ancestor is transform, or anywhere above it
+static bool IsAncestor(Transform* ancestor, Transform* transform)
+{
+	for (; transform; transform = transform->GetParent())
+		if (transform == ancestor)
+			return true;
+	return false;
+}
+
+// Makes an entity from its definition, or updates the one
+// that's already there (so anything holding it keeps working).
+// Links that would make the hierarchy loop are left out.
+void AssetManager::ApplyEntity(const EntityDefinition& d, const std::string& name) {
+	GameEntity* entity = entities.Get(name);
+	if (!entity) {
+		entity = entities.Insert(name, new GameEntity(name, meshes.Get(d.Mesh), materials.Get(d.Material)));
+	}
+	else {
+		entity->SetMesh(meshes.Get(d.Mesh));
+		entity->SetMaterial(materials.Get(d.Material));
+	}
+
+	entity->GetTransform()->SetPosition(d.Position[0], d.Position[1], d.Position[2]);
+	entity->GetTransform()->SetScale(d.Scale[0], d.Scale[1], d.Scale[2]);
+	entity->GetTransform()->SetRotation(d.Rotation[0], d.Rotation[1], d.Rotation[2]);
+
+	if (!d.Parent.empty()) {
+		GameEntity* parent = entities.Get(d.Parent);
+		if (parent && !IsAncestor(entity->GetTransform(), parent->GetTransform())) {
+			parent->GetTransform()->AddChild(entity->GetTransform());
 		}
-		else
+	}
+
+	for (auto& childName : d.Children) {
+		GameEntity* child = entities.Get(childName);
+		if (child && child->GetTransform()->GetParent() != entity->GetTransform() && !IsAncestor(child->GetTransform(), entity->GetTransform())) {
+			child->GetTransform()->SetParent(entity->GetTransform());
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Makes (or updates) every entity in a .scene file, one at
+// a time as they're read.  Scene entities need a name, and
+// ones whose mesh or material doesn't exist are skipped.
+// A parent or child that comes later in the file is linked
+// at the end (only the two names are kept until then), so
+// the order entities are listed in doesn't matter.
+// Returns how many were applied.
+// --------------------------------------------------------
+int AssetManager::ApplyScene(const std::filesystem::path& file) {
+	int applied = 0;
+	int skipped = 0;
+	std::vector<std::pair<std::string, std::string>> laterLinks; // Child, then parent
+	ReadScene(file, [&](EntityDefinition& entity)
 		{
-			name = p.path().filename().string();
-			RemoveExtension(name);
+			if (entity.Name.empty() || !meshes.Contains(entity.Mesh) || !materials.Contains(entity.Material)) {
+				skipped++;
+				return;
+			}
+
+			if (!entity.Parent.empty() && !entities.Contains(entity.Parent)) {
+				laterLinks.push_back({ entity.Name, entity.Parent });
+				entity.Parent.clear();
+			}
+			std::erase_if(entity.Children, [&](const std::string& child)
+				{
+					if (entities.Contains(child))
+						return false;
+					laterLinks.push_back({ child, entity.Name });
+					return true;
+				});
+
+			ApplyEntity(entity, entity.Name);
+			applied++;
+		});
+
+	int unlinked = 0;
+	for (auto& [childName, parentName] : laterLinks) {
+		GameEntity* child = entities.Get(childName);
+		GameEntity* parent = entities.Get(parentName);
+		if (!child || !parent || IsAncestor(child->GetTransform(), parent->GetTransform()))
+			unlinked++;
+		else if (child->GetTransform()->GetParent() != parent->GetTransform())
+			child->GetTransform()->SetParent(parent->GetTransform());
+	}
+
+	if (skipped)
+		printf("Skipped %d entities in %s (unnamed, or with no such mesh or material)\n", skipped, file.string().c_str());
+	if (unlinked)
+		printf("Left out %d parent links in %s (to entities that don't exist, or in a cycle)\n", unlinked, file.string().c_str());
+	return applied;
+}
+
+static const char* GetKindName(AssetKind kind)
+{
+	const char* names[] = { "texture", "mesh", "bundle", "material", "entity", "scene", "sky" };
+	return names[(int)kind];
+}
+
+// --------------------------------------------------------
+// Records what every bundle, material and entity uses (see
+// TrackEntity() and the like), then resolves them as one
+// graph before any is made, so they can be made in an order
+// that only depends on the graph (not on which file was read
+// first), each after whatever it uses.  Anything that's
+// missing or in a cycle is reported here, and each asset's
+// definition is kept by name for MakeAssets().
+//
+// Parents can be given from either end, so each entity's is
+// settled first: its own "parent", or else the first entity
+// (by file) listing it in "children".
+// --------------------------------------------------------
+AssetResolution AssetManager::ResolveDefinitions(
+	std::vector<AssetDefinition<BundleDefinition>>& bundleDefinitions,
+	std::vector<AssetDefinition<MaterialDefinition>>& materialDefinitions,
+	std::vector<AssetDefinition<EntityDefinition>>& entityDefinitions,
+	DefinitionsByName& byName)
+{
+	// Parents ------------------------------------------------
+	std::unordered_map<std::string, size_t> entityIndices;
+	for (size_t i = 0; i < entityDefinitions.size(); i++)
+		if (entityDefinitions[i].Read)
+			entityIndices[GetDefinitionName(entityDefinitions[i])] = i;
+
+	std::vector<std::string> parents(entityDefinitions.size());
+	for (size_t i = 0; i < entityDefinitions.size(); i++)
+		parents[i] = entityDefinitions[i].Data.Parent;
+	for (auto& p : entityDefinitions) {
+		if (!p.Read)
+			continue;
+
+		std::string name = GetDefinitionName(p);
+		for (auto& childName : p.Data.Children) {
+			// Children that don't exist are ignored, as they always were
+			auto child = entityIndices.find(childName);
+			if (child == entityIndices.end())
+				continue;
+			if (parents[child->second].empty())
+				parents[child->second] = name;
+			else if (parents[child->second] != name)
+				printf("Entity %s is a child of both %s and %s (keeping %s)\n", childName.c_str(), parents[child->second].c_str(), name.c_str(), parents[child->second].c_str());
+		}
+	}
+
+	// Tracking -----------------------------------------------
+	for (auto& p : bundleDefinitions) {
+		if (p.Read) {
+			PendingBundle bundle = ParseBundle(p);
+			byName.Bundles[bundle.Name] = bundle;
 		}
+	}
+	for (auto& p : materialDefinitions) {
+		if (p.Read) {
+			std::string name = GetDefinitionName(p);
+			TrackMaterial(p, name);
+			byName.Materials[name] = &p;
+		}
+	}
+	for (size_t i = 0; i < entityDefinitions.size(); i++) {
+		auto& p = entityDefinitions[i];
+		if (p.Read) {
+			std::string name = GetDefinitionName(p);
+			p.Data.Parent = parents[i];
+			p.Data.Children.clear(); // They're the children's parents now
+			TrackEntity(p, name);
+			byName.Entities[name] = &p;
+		}
+	}
+
+	// Resolving ----------------------------------------------
+	// Textures and meshes have their handles before anything's
+	// made, so sharing one doesn't tie two groups together
+	AssetResolution resolution;
+	{
+		ProfileScope profile("Resolve");
+		resolution = dependencies.Resolve({ AssetKind::Texture, AssetKind::Mesh });
+	}
+	for (auto& [dependent, dependency] : resolution.Missing)
+		printf("%s %s uses %s %s, which doesn't exist\n", GetKindName(dependent.Kind), dependent.Name.c_str(), GetKindName(dependency.Kind), dependency.Name.c_str());
 
-		TextureBundle* bundle;
-		if (d["textures"].is_string()) {
-			std::string textureName = d["textures"].get<std::string>();
-			bundle = textureBundles[textureName];
-		}
-		else {
-			bundle = new TextureBundle();
-			bundle->albedo = textures[d["textures"]["albedo"].get<std::string>()];
-			bundle->normal = textures[d["textures"]["normal"].get<std::string>()];
-			bundle->roughness = textures[d["textures"]["roughness"].get<std::string>()];
-			bundle->metalness = textures[d["textures"]["metalness"].get<std::string>()];
-		}
-
-		float color[4];
-		d["color"].get_to(color);
-		float uv[2];
-		d["uvScale"].get_to(uv);
-		SimpleVertexShader* vs = GetVertexShader(d["shader"]["vertex"].get<std::string>());
-		SimplePixelShader* ps = GetPixelShader(d["shader"]["pixel"].get<std::string>());
-		materials[name] = new Material(
-			vs,
-			ps,
-			DirectX::XMFLOAT4(color),
-			d["shininess"].get<float>(),
-			DirectX::XMFLOAT2(uv),
-			bundle,
+	// The only cycles there can be are in the hierarchy, and
+	// the entities in one are left without parents
+	for (auto& cycle : resolution.Cycles) {
+		printf("Entities");
+		for (auto& asset : cycle) {
+			printf(" %s", asset.Name.c_str());
+			byName.Unparented.insert(asset.Name);
+		}
+		printf(" are each other's parents, so they're left without any\n");
+	}
+
+	printf("Resolved %zu assets in %zu independent groups (%zu missing, %zu cycles)\n",
+		resolution.Order.size(), resolution.Groups.size(), resolution.Missing.size(), resolution.Cycles.size());
+	return resolution;
+}
+
+// --------------------------------------------------------
+// Makes the bundles, materials and entities in assets, in
+// the order given (anything else is skipped).  Groups from
+// Resolve() are made on separate jobs at once, and the maps
+// aren't thread safe, so they're only touched under
+// makeMutex.  Bundles that need loading go in pending.
+// --------------------------------------------------------
+void AssetManager::MakeAssets(const std::vector<AssetRef>& assets, DefinitionsByName& byName, std::vector<PendingBundle>& pending) {
+	for (auto& asset : assets) {
+		if (asset.Kind == AssetKind::Bundle && byName.Bundles.contains(asset.Name)) {
+			// Stays on the placeholder until its textures are in
+			ProfileScope profile("Bundle", asset.Name);
+			PendingBundle bundle = byName.Bundles[asset.Name];
+			bundle.Handle = new AssetHandle<TextureBundle>(placeholderBundle);
+			{
+				std::lock_guard<std::mutex> lock(makeMutex);
+				textureBundles.Insert(bundle.Name, bundle.Handle);
+			}
+			pending.push_back(bundle);
+		}
+		else if (asset.Kind == AssetKind::Material && byName.Materials.contains(asset.Name)) {
+			// Materials themselves are cheap, so they're made right
+			// away (it's their textures that might still be loading)
+			ProfileScope profile("Material", asset.Name);
+			std::lock_guard<std::mutex> lock(makeMutex);
+			materials.Insert(asset.Name, new AssetHandle<Material>(0))->Resolve(CreateMaterial(*byName.Materials[asset.Name], pending));
+		}
+		else if (asset.Kind == AssetKind::Entity && byName.Entities.contains(asset.Name)) {
+			ProfileScope profile("Entity", asset.Name);
+			EntityDefinition& entity = byName.Entities[asset.Name]->Data;
+			if (byName.Unparented.contains(asset.Name))
+				entity.Parent.clear();
+
+			// Without a mesh or material there's nothing to draw
+			std::lock_guard<std::mutex> lock(makeMutex);
+			if (meshes.Contains(entity.Mesh) && materials.Contains(entity.Material))
+				ApplyEntity(entity, asset.Name);
+		}
+	}
+}
+
+// Scenes go last, as they can use any entity
+void AssetManager::ApplyScenes(std::vector<std::filesystem::path>& scenes) {
+	for (auto& scene : scenes) {
+		std::string name = scene.filename().string();
+		RemoveExtension(name);
+		ProfileScope profile("Scene", name);
+		dependencies.AddFile({ AssetKind::Scene, name }, scene);
+		ApplyScene(scene);
+	}
+}
+
+// --------------------------------------------------------
+// Makes every bundle, material and entity in the compiled
+// scene.  Bundles and materials go through the same path as
+// their definitions (see MakeAssets()).  Entities point
+// at their mesh, material and parent by index, so each is
+// found once (not once per entity), and parents come first,
+// so the hierarchy is built as it goes.
+// --------------------------------------------------------
+void AssetManager::LoadCompiledScene(std::vector<PendingBundle>& pending) {
+	ProfileScope profile("Compiled scene");
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<AssetDefinition<BundleDefinition>> bundleDefinitions(compiledScene.GetBundleCount());
+	for (size_t i = 0; i < bundleDefinitions.size(); i++)
+		bundleDefinitions[i] = { CompiledScenePath, compiledScene.GetBundle(i), true };
+
+	std::vector<AssetDefinition<MaterialDefinition>> materialDefinitions(compiledScene.GetMaterialCount());
+	std::vector<AssetHandle<Material>*> materialHandles(materialDefinitions.size());
+	for (size_t i = 0; i < materialDefinitions.size(); i++)
+		materialDefinitions[i] = { CompiledScenePath, compiledScene.GetMaterial(i), true };
+
+	DefinitionsByName byName;
+	std::vector<AssetDefinition<EntityDefinition>> noEntities;
+	AssetResolution resolution = ResolveDefinitions(bundleDefinitions, materialDefinitions, noEntities, byName);
+	MakeAssets(resolution.Order, byName, pending);
+	for (size_t i = 0; i < materialDefinitions.size(); i++)
+		materialHandles[i] = materials.Get(materialDefinitions[i].Data.Name);
+
+	// A mesh that's gone since the scene was compiled stays a placeholder
+	std::vector<AssetHandle<Mesh>*> meshHandles(compiledScene.GetMeshCount());
+	for (size_t i = 0; i < meshHandles.size(); i++) {
+		std::string name(compiledScene.GetMeshName(i));
+		meshHandles[i] = meshes.Get(name);
+		if (!meshHandles[i]) {
+			printf("The compiled scene uses mesh %s, which doesn't exist\n", name.c_str());
+			meshHandles[i] = meshes.Insert(name, new AssetHandle<Mesh>(placeholderMesh));
+		}
+	}
+
+	size_t count = compiledScene.GetEntityCount();
+	const float* positions = compiledScene.GetPositions();
+	const float* rotations = compiledScene.GetRotations();
+	const float* scales = compiledScene.GetScales();
+	std::vector<GameEntity*> made(count);
+	entities.Reserve(entities.Size() + count);
+	for (size_t i = 0; i < count; i++) {
+		const SceneEntity& e = compiledScene.GetEntity(i);
+		std::string name(compiledScene.GetString(e.Name));
+		GameEntity* entity = new GameEntity(name, meshHandles[e.Mesh], materialHandles[e.Material]);
+		entities.Insert(name, entity);
+		made[i] = entity;
+
+		Transform* transform = entity->GetTransform();
+		transform->SetPosition(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+		transform->SetRotation(rotations[i * 3], rotations[i * 3 + 1], rotations[i * 3 + 2]);
+		transform->SetScale(scales[i * 3], scales[i * 3 + 1], scales[i * 3 + 2]);
+		if (e.Parent != -1)
+			made[e.Parent]->GetTransform()->AttachChild(transform);
+	}
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Made %zu entities from %s in %.1f ms\n", count, CompiledScenePath, milliseconds);
+}
+
+// Builds (but doesn't add) a sky.  Skies made from separate
+// faces only need the device; a DDS cube map is read back
+// through the context, so that has to be on the main thread.
+Sky* AssetManager::LoadSky(AssetDefinition<nlohmann::json>& skyDefinition, AssetHandle<Mesh>* cube) {
+	nlohmann::json& d = skyDefinition.Data;
+
+	std::filesystem::path root = ASSET_PATH;
+	if (d["cubemap"].is_string()) {
+		AssetBytes dds;
+		ReadFile(root / d["cubemap"].get<std::string>(), dds);
+		return new Sky(
+			dds.Data,
+			dds.Size,
+			cube,
+			GetVertexShader("SkyVS"_id),
+			GetPixelShader("SkyPS"_id),
 			samplerOptions,
-			clamplerOptions
-		);
+			device,
+			context);
+	}
 
-		bundle = nullptr;
+	// Faces that are left out are filled with a solid color
+	const char* faceNames[6] = { "right", "left", "up", "down", "front", "back" };
+	ImageData faces[6];
+	for (int f = 0; f < 6; f++) {
+		AssetBytes bytes;
+		if (d["faces"][faceNames[f]].is_string() && ReadFile(root / d["faces"][faceNames[f]].get<std::string>(), bytes))
+			if (!DecodeSource(bytes, faces[f]))
+				faces[f] = {};
 	}
+
+	float fill[3] = {};
+	if (d["fill"].is_array())
+		d["fill"].get_to(fill);
+
+	return new Sky(
+		Sky::MakeFaces(faces, DirectX::XMFLOAT3(fill)),
+		cube,
+		GetVertexShader("SkyVS"_id),
+		GetPixelShader("SkyPS"_id),
+		samplerOptions,
+		device,
+		context);
 }
 
+// Skies are built from their definition, the files it lists
+// and the cube mesh (which they keep a handle to)
+void AssetManager::TrackSky(AssetDefinition<nlohmann::json>& skyDefinition, const std::string& name) {
+	nlohmann::json& d = skyDefinition.Data;
+	AssetRef asset = { AssetKind::Sky, name };
+	std::filesystem::path root = ASSET_PATH;
 
-void AssetManager::LoadEntities(std::vector<std::filesystem::directory_entry> entityPaths) {
-	for (auto& p : entityPaths) {
-		std::ifstream i(p.path());
-		nlohmann::json d;
+	dependencies.AddFile(asset, skyDefinition.Path);
+	if (d["cubemap"].is_string())
+		dependencies.AddFile(asset, root / d["cubemap"].get<std::string>());
+	if (d["faces"].is_object())
+		for (auto& face : d["faces"])
+			if (face.is_string())
+				dependencies.AddFile(asset, root / face.get<std::string>());
+	dependencies.AddDependency(asset, { AssetKind::Mesh, "cube" });
+}
+
+AssetHandle<Mesh>* AssetManager::GetSkyMesh() {
+	AssetHandle<Mesh>* cube = meshes.Get("cube"_id);
+	return cube ? cube : placeholderMeshHandle;
+}
+
+void AssetManager::AddSky(AssetDefinition<nlohmann::json>& skyDefinition, Sky* loaded) {
+	nlohmann::json& d = skyDefinition.Data;
+	std::string name = GetDefinitionName(skyDefinition);
+
+	TrackSky(skyDefinition, name);
+	skies.Insert(name, loaded);
+	if (activeSky.empty() || (d["default"].is_boolean() && d["default"].get<bool>()))
+		SetActiveSky(name);
+}
+
+// --------------------------------------------------------
+// Gets everything to the point where the scene exists:
+// shaders, samplers and definitions are loaded (through a
+// job graph, so reading and parsing files goes wide) and
+// every mesh, bundle, material and entity has its handle.
+//
+// Every definition is parsed (and the shaders are loaded)
+// first, then they're all resolved as one graph (see
+// ResolveDefinitions()) before anything's made.  Each group
+// of assets that doesn't share anything with another is made
+// on its own job, in resolved order, then scenes are applied.
+//
+// The rest (the heavy part) is set up as a second graph in
+// streaming->Graph for Load() or LoadAsync() to run:
+//  - texture decodes, then creating each texture
+//  - each bundle after its own textures
+//  - meshes on their own
+//  - skies on their own, swapped in one at a time
+// Only work that needs the immediate context (texture mips,
+// DDS skies, swapping things in) is kept on the main thread.
+// Bundle textures are block compressed (or read from the
+// cache) and created off the main thread, as they come with
+// their mips.
+// --------------------------------------------------------
+void AssetManager::BeginLoad(unsigned int threadCount)
+{
+	const bool headless = IsHeadless();
+	streaming = new StreamingLoad();
+	streaming->Start = std::chrono::steady_clock::now();
+	derivedData.ResetStats();
+	JobGraph graph;
+
+	// Shaders ------------------------------------------------
+	struct ShaderLoad
+	{
+		const char* Name;
+		const wchar_t* File;
+		bool Vertex;
+		ISimpleShader* Result;
+	};
+	ShaderLoad shaderLoads[] = {
+		{ "VertexShader", L"VertexShader.cso", true },
+		{ "PixelShader", L"PixelShader.cso", false },
+		{ "PixelShaderPBR", L"PixelShaderPBR.cso", false },
+		{ "PixelShaderPBRPacked", L"PixelShaderPBRPacked.cso", false },
+		{ "SolidColorPS", L"SolidColorPS.cso", false },
+		{ "SkyPS", L"SkyPS.cso", false },
+		{ "SkyVS", L"SkyVS.cso", true },
+		{ "FullscreenVS", L"FullscreenVS.cso", true },
+		{ "RefractionPS", L"RefractionPS.cso", false },
+		{ "UpscalePS", L"UpscalePS.cso", false },
+		{ "LightGizmoVS", L"LightGizmoVS.cso", true },
+		{ "LightGizmoPS", L"LightGizmoPS.cso", false },
+		{ "IBLBrdfLookUpTablePS", L"IBLBrdfLookUpTablePS.cso", false },
+		{ "IBLSpecularConvolutionPS", L"IBLSpecularConvolutionPS.cso", false },
+	};
+
+	int shadersLoaded = graph.AddJob("Gather shaders", [&]()
+		{
+			for (auto& load : shaderLoads)
+				if (load.Result) shaders.Insert(load.Name, load.Result);
+		});
+
+	for (auto& load : shaderLoads) {
+		int job = graph.AddJob(load.Name, [&]()
+			{
+				if (headless)
+					return;
+
+				ProfileScope profile("Shader", load.Name);
+				if (load.Vertex)
+					load.Result = LoadShader(SimpleVertexShader, load.File);
+				else
+					load.Result = LoadShader(SimplePixelShader, load.File);
+			});
+		graph.AddDependency(shadersLoaded, job);
+	}
 
-		i >> d;
+	// Describe and create our sampler state
+	if (!headless) {
+		D3D11_SAMPLER_DESC sampDesc = {};
+		sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+		sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+		sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+		sampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+		sampDesc.MaxAnisotropy = 16;
+		sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+		device->CreateSamplerState(&sampDesc, samplerOptions.GetAddressOf());
+
+		D3D11_SAMPLER_DESC clampDesc = {};
+		clampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+		clampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+		clampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+		clampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+		clampDesc.MaxAnisotropy = 16;
+		clampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+		device->CreateSamplerState(&clampDesc, clamplerOptions.GetAddressOf());
+	}
+
+	CreatePlaceholders();
+
+	// Textures and meshes are only found here, and every mesh
+	// gets its (placeholder) handle before any entity wants it
+	for (auto& p : ListFiles(ASSET_PATH)) {
+		if (p.extension().compare(".png") == 0) {
+			std::string s = p.string();
+			RemoveExtension(s);
+			streaming->Textures.push_back({ s, p });
+			dependencies.AddFile({ AssetKind::Texture, s }, p);
+		}
+		else if (p.extension().compare(".obj") == 0) {
+			std::string s = p.filename().string();
+			RemoveExtension(s);
+			streaming->Meshes.push_back({ s, p, 0 });
+			meshes.Insert(s, new AssetHandle<Mesh>(placeholderMesh));
+			dependencies.AddFile({ AssetKind::Mesh, s }, p);
+		}
+	}
+
+	// Definitions --------------------------------------------
+	std::vector<AssetDefinition<BundleDefinition>> bundleDefinitions;
+	std::vector<AssetDefinition<MaterialDefinition>> materialDefinitions;
+	std::vector<AssetDefinition<EntityDefinition>> entityDefinitions;
+	std::vector<std::filesystem::path> scenes;
+	const bool compiled = compiledScene.IsOpen();
+	std::vector<std::filesystem::path> definitionFiles = ListFiles(DEFINITIONS_PATH);
+	std::sort(definitionFiles.begin(), definitionFiles.end()); // So conflicts settle the same way every run
+	for (auto& p : definitionFiles) {
+		if (compiled && p.extension().compare(".sky") != 0)
+			continue;
 
-		std::string name;
-		if (d["name"].is_string()) {
-			name = d["name"].get<std::string>();
+		if (p.extension().compare(".bundle") == 0) {
+			bundleDefinitions.push_back({ p });
+		}
+		else if (p.extension().compare(".material") == 0) {
+			materialDefinitions.push_back({ p });
+		}
+		else if (p.extension().compare(".ge") == 0) {
+			entityDefinitions.push_back({ p });
+		}
+		else if (p.extension().compare(".scene") == 0) {
+			scenes.push_back(p);
 		}
-		else
+		else if (p.extension().compare(".sky") == 0) {
+			streaming->Skies.push_back({ { p }, 0 });
+		}
+	}
+
+	// Every file is parsed on its own job, before whatever reads it.
+	// Scenes are read as they're applied, so they're never held whole.
+	auto addParseJob = [&](auto& definition, int before)
 		{
-			name = p.path().filename().string();
-			RemoveExtension(name);
+			int job = graph.AddJob("Parse " + definition.Path.filename().string(), [&]()
+				{
+					ProfileScope profile("Parse", definition.Path.filename().string());
+					ReadDefinition(definition);
+				});
+			if (before != -1)
+				graph.AddDependency(before, job);
+		};
+	auto addParseJobs = [&](auto& definitions, int before)
+		{
+			for (auto& definition : definitions)
+				addParseJob(definition, before);
+		};
+
+	if (compiled) {
+		// Nothing to parse, so it's one job
+		int sceneLoaded = graph.AddJob("Compiled scene", [&]() { LoadCompiledScene(streaming->Bundles); });
+		graph.AddDependency(sceneLoaded, shadersLoaded);
+	}
+	else {
+		addParseJobs(bundleDefinitions, -1);
+		addParseJobs(materialDefinitions, -1);
+		addParseJobs(entityDefinitions, -1);
+	}
+
+	for (auto& load : streaming->Skies)
+		addParseJob(load.Definition, -1);
+
+	graph.Run(threadCount);
+	streaming->DefinitionJobCount = graph.GetJobCount();
+
+	// Making -------------------------------------------------
+	// Nothing's made until everything's resolved, and a graph's
+	// jobs are fixed once it runs, so making is a graph of its own
+	if (!compiled) {
+		DefinitionsByName byName;
+		AssetResolution resolution = ResolveDefinitions(bundleDefinitions, materialDefinitions, entityDefinitions, byName);
+
+		JobGraph making;
+		std::vector<std::vector<PendingBundle>> groupBundles(resolution.Groups.size());
+		int scenesApplied = making.AddJob("Scenes", [&]() { ApplyScenes(scenes); });
+		for (size_t i = 0; i < resolution.Groups.size(); i++) {
+			int group = making.AddJob("Make " + resolution.Groups[i].front().Name, [&, i]()
+				{
+					MakeAssets(resolution.Groups[i], byName, groupBundles[i]);
+				});
+			making.AddDependency(scenesApplied, group);
 		}
+		making.Run(threadCount);
+		streaming->DefinitionJobCount += making.GetJobCount();
+
+		// In group order, so bundles queue the same way every run
+		for (auto& bundles : groupBundles)
+			streaming->Bundles.insert(streaming->Bundles.end(), bundles.begin(), bundles.end());
+	}
+
+	// Something to draw and light with until a real sky is in.  A
+	// single texel is cheap enough to precompute IBL for right here.
+	if (!headless) {
+		IBLCubeImage grey = {};
+		grey.Size = 1;
+		for (auto& face : grey.Faces)
+			face.assign(1, 0xFF808080);
 
-		float position[3];
-		d["position"].get_to(position);
-		float scale[3];
-		d["scale"].get_to(scale);
-		float rotation[3];
-		d["rotation"].get_to(rotation);
-
-		entities[name] = new GameEntity(
-			name,
-			meshes[d["mesh"].get<std::string>()],
-			materials[d["material"].get<std::string>()]
-		);
-
-		entities[name]->GetTransform()->SetPosition(position[0], position[1], position[2]);
-		entities[name]->GetTransform()->SetScale(scale[0], scale[1], scale[2]);
-		entities[name]->GetTransform()->SetRotation(rotation[0], rotation[1], rotation[2]);
-
-		if (!d["parent"].is_null()) {
-			std::string parent_str = d["parent"].get<std::string>();
-			if (entities.contains(parent_str)) {
-				if (entities[parent_str]->GetTransform()->IndexOfChild(entities[name]->GetTransform()) == -1) {
-					entities[parent_str]->GetTransform()->AddChild(entities[name]->GetTransform());
+		placeholderSky = new Sky(grey, GetSkyMesh(), GetVertexShader("SkyVS"_id), GetPixelShader("SkyPS"_id), samplerOptions, device, context);
+		sky = placeholderSky;
+	}
+
+	// Everything else ----------------------------------------
+	JobGraph& stream = streaming->Graph;
+
+	// Only textures a bundle uses are loaded (see GetTextureUses()),
+	// and they're remembered in case they're reloaded
+	std::unordered_map<std::string, std::filesystem::path> textureFiles;
+	for (auto& load : streaming->Textures)
+		textureFiles[load.Key] = load.File;
+
+	for (auto& bundle : streaming->Bundles) {
+		for (auto& [key, use] : GetTextureUses(bundle)) {
+			for (auto& load : streaming->Textures) {
+				if (load.Key == key) {
+					load.Compress = true;
+					load.Format = use.Format;
+					load.Content = use.Content;
 				}
 			}
 		}
+	}
+	std::erase_if(streaming->Textures, [](const StreamingLoad::TextureLoad& load) { return !load.Compress; });
+	for (auto& load : streaming->Textures)
+		textureImports[load.Key] = { load.Format, load.Content };
 
-		if (!d["children"].is_null()) {
-			for (int i = 0; i < d["children"].size(); i++) {
-				std::string child_str = d["children"][i].get<std::string>();
-				if (entities.contains(child_str) && entities[child_str]->GetTransform()->GetParent() != entities[name]->GetTransform()) {
-					entities[child_str]->GetTransform()->SetParent(entities[name]->GetTransform());
+	// Decoding goes wide, then the texture (and its mips) is made on the main thread
+	bool useCache = textureCacheEnabled;
+	std::unordered_map<std::string, int> textureJobs;
+	for (auto& load : streaming->Textures) {
+		int decode = stream.AddJob("Decode " + load.Key, [&, useCache, headless]()
+			{
+				ProfileScope profile("Texture decode", load.Key);
+				AssetBytes source;
+				CompressedTexture compressed = {};
+				if (!ReadFile(load.File, source))
+					printf("Couldn't read %s\n", load.Key.c_str());
+				else if (LoadCompressedTexture(load.Key, source, load.Format, load.Content, derivedData, useCache, compressed, load.Image)) {
+					if (!headless) {
+						load.Width = compressed.Width;
+						load.Height = compressed.Height;
+						load.MipCount = (uint32_t)compressed.Mips.size();
+						load.FirstMip = TextureStreamer::GetStartMip(load.Width, load.Height, load.MipCount);
+						load.Texture = ImageLoader::CreateTexture(device, compressed, load.FirstMip);
+					}
 				}
-			}
+				else if (load.Image.Pixels.empty())
+					printf("Couldn't decode %s\n", load.Key.c_str());
+
+				if (headless)
+					load.Image = {};
+			});
+
+		if (headless)
+			continue;
+
+		int create = stream.AddJob("Create " + load.Key, [&]()
+			{
+				ProfileScope profile("Texture create", load.Key);
+				if (load.Texture) {
+					textures[load.Key] = load.Texture;
+					if (load.FirstMip > 0)
+						textureStreamer.Add(load.Key, load.Width, load.Height, load.MipCount, TextureCompressor::GetBlockBytes(load.Format), load.FirstMip);
+				}
+				else
+					textures[load.Key] = ImageLoader::CreateTexture(device, context, load.Image);
+				load.Image = {}; // Done with the pixels
+			}, true);
+		stream.AddDependency(create, decode);
+		textureJobs[load.Key] = create;
+	}
+
+	// Each bundle is swapped in as soon as its own textures are,
+	// with packed textures built (and created) off the main thread
+	auto fileFor = [&](const std::string& key) { return textureFiles.contains(key) ? textureFiles[key] : std::filesystem::path(); };
+	for (auto& bundle : streaming->Bundles) {
+		int pack = -1;
+		if (bundle.Packed) {
+			std::filesystem::path files[3] = { fileFor(bundle.Roughness), fileFor(bundle.Metal), fileFor(bundle.AO) };
+			pack = stream.AddJob("Pack " + bundle.Name, [&, files, useCache, headless]()
+				{
+					// Maps the bundle doesn't have are left without data
+					ProfileScope profile("Texture pack", bundle.Name);
+					AssetBytes sources[3];
+					bool read = true;
+					for (int i = 0; i < 3; i++)
+						if (!files[i].empty())
+							read = ReadFile(files[i], sources[i]) && read;
+
+					CompressedTexture packed = {};
+					if (!read || !LoadPackedTexture(bundle.Name, sources, derivedData, useCache, packed))
+						printf("Couldn't pack roughness, metal and AO for %s\n", bundle.Name.c_str());
+					else if (!headless)
+						bundle.RoughnessMetalAO = ImageLoader::CreateTexture(device, packed);
+				});
 		}
+
+		int job = stream.AddJob("Bundle " + bundle.Name, [&]()
+			{
+				ProfileScope profile("Bundle create", bundle.Name);
+				TextureBundle* loaded = new TextureBundle(bundle.Name);
+				loaded->albedo = textures[bundle.Albedo];
+				loaded->normal = textures[bundle.Normal];
+				if (bundle.Packed) {
+					loaded->roughnessMetalAO = bundle.RoughnessMetalAO;
+				}
+				else {
+					loaded->roughness = textures[bundle.Roughness];
+					loaded->metalness = textures[bundle.Metal];
+				}
+				bundle.Handle->Resolve(loaded);
+			}, true);
+
+		if (pack != -1)
+			stream.AddDependency(job, pack);
+		for (const std::string* key : { &bundle.Albedo, &bundle.Normal, &bundle.Roughness, &bundle.Metal })
+			if (textureJobs.contains(*key))
+				stream.AddDependency(job, textureJobs[*key]);
+	}
+
+	// Buffers only need the device, so meshes are made right
+	// away and just swapped in on the main thread
+	for (auto& load : streaming->Meshes) {
+		int job = stream.AddJob("Mesh " + load.Name, [&]()
+			{
+				ProfileScope profile("Mesh", load.Name);
+				load.Result = ImportMesh(load.Name, load.File);
+			});
+		int swap = stream.AddJob("Swap mesh " + load.Name, [&]() { meshes.Get(load.Name)->Resolve(load.Result); }, true);
+		stream.AddDependency(swap, job);
+	}
+
+	// Skies are built off the main thread (unless they need the
+	// context) and their IBL precompute is threaded on its own.
+	// They draw through the cube's handle, so they don't wait for
+	// it.  They're swapped in one at a time, in order, so the
+	// default sky is picked the same way every time.
+	AssetHandle<Mesh>* cube = GetSkyMesh();
+	int previousSky = -1;
+	for (auto& load : streaming->Skies) {
+		if (headless)
+			break;
+
+		std::string fileName = load.Definition.Path.filename().string();
+		int build = stream.AddJob("Sky " + fileName, [&, cube]()
+			{
+				ProfileScope profile("Sky", load.Definition.Path.filename().string());
+				load.Result = LoadSky(load.Definition, cube);
+			}, load.Definition.Data["cubemap"].is_string());
+
+		int swap = stream.AddJob("Swap sky " + fileName, [&]() { AddSky(load.Definition, load.Result); }, true);
+		stream.AddDependency(swap, build);
+		if (previousSky != -1)
+			stream.AddDependency(swap, previousSky);
+		previousSky = swap;
 	}
 }
 
-void AssetManager::Load()
+void AssetManager::EndLoad()
 {
-	shaders["VertexShader"] = LoadShader(SimpleVertexShader, L"VertexShader.cso");
-	shaders["PixelShader"] = LoadShader(SimplePixelShader, L"PixelShader.cso");
-	shaders["PixelShaderPBR"] = LoadShader(SimplePixelShader, L"PixelShaderPBR.cso");
-	shaders["SolidColorPS"] = LoadShader(SimplePixelShader, L"SolidColorPS.cso");
-	shaders["SkyPS"] = LoadShader(SimplePixelShader, L"SkyPS.cso");
-	shaders["SkyVS"] = LoadShader(SimpleVertexShader, L"SkyVS.cso");
-	shaders["FullscreenVS"] = LoadShader(SimpleVertexShader, L"FullscreenVS.cso");
-	shaders["RefractionPS"] = LoadShader(SimplePixelShader, L"RefractionPS.cso");
-	shaders["IBLBrdfLookUpTablePS"] = LoadShader(SimplePixelShader, L"IBLBrdfLookUpTablePS.cso");
-	shaders["IBLIrradianceMapPS"] = LoadShader(SimplePixelShader, L"IBLIrradianceMapPS.cso");
-	shaders["IBLSpecularConvolutionPS"] = LoadShader(SimplePixelShader, L"IBLSpecularConvolutionPS.cso");
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - streaming->Start).count();
+	printf("Loaded assets in %.1f ms (%d jobs on %u threads%s)\n",
+		milliseconds,
+		streaming->DefinitionJobCount + streaming->Graph.GetJobCount(),
+		streaming->Graph.GetThreadCount(),
+		IsHeadless() ? ", headless" : "");
+	derivedData.PrintStats();
+	derivedData.Trim();
 
-	for (auto& p : std::filesystem::recursive_directory_iterator(ASSET_PATH)) {
-		if (p.path().extension().compare(".png") == 0) {
-			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
-			LoadTexture(srv);
+	// Everything that's loaded is looked after by the budget from here on
+	for (auto& bundle : streaming->Bundles) BudgetBundle(bundle);
+	for (auto& p : meshes) BudgetMesh(p.Name);
+	for (auto& p : materials) BudgetMaterial(p.Name);
+	for (auto& p : textures) BudgetTexture(p.first);
+	memoryBudget.PrintStats();
 
-			std::string s = p.path().string();
-			RemoveExtension(s);
-			textures[s] = srv.Get();
+	delete streaming;
+	streaming = 0;
+}
+
+void AssetManager::Load(unsigned int threadCount)
+{
+	ProfileScope profile("Asset load");
+	BeginLoad(threadCount);
+	streaming->Graph.Run(threadCount);
+	EndLoad();
+}
+
+void AssetManager::LoadAsync(unsigned int threadCount)
+{
+	ProfileScope profile("Asset load (until ready)");
+	BeginLoad(threadCount);
+	streaming->Graph.Start(threadCount);
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - streaming->Start).count();
+	printf("Scene ready in %.1f ms, streaming in the rest (%d jobs)\n", milliseconds, streaming->Graph.GetJobCount());
+}
+
+bool AssetManager::Update(double budgetMilliseconds)
+{
+	// Reloads and evictions wait until streaming's done, so they
+	// never race a load for the same handle
+	if (!streaming) {
+		bool reloaded = watcher.IsRunning() && ReloadChangedFiles();
+		return memoryBudget.Update(budgetMilliseconds) > 0 || reloaded;
+	}
+
+	// This is the only place loads are swapped in, so nothing
+	// changes under a frame that's halfway through drawing
+	bool ran = streaming->Graph.RunMainThreadJobs(budgetMilliseconds) > 0;
+	if (streaming->Graph.IsFinished()) {
+		streaming->Graph.Finish();
+		EndLoad();
+	}
+	return ran;
+}
+
+int AssetManager::GetPendingLoadCount()
+{
+	return streaming ? streaming->Graph.GetRemainingJobCount() : 0;
+}
+
+
+// --------------------------------------------------------
+// Works out how densely each entity in view sees its bundle's
+// textures: the UV space one pixel covers, at the closest point
+// of its bounding sphere.  That's the mip each texture asks
+// the streamer for, and whatever it hands back is uploaded (or
+// dropped) right away.
+// --------------------------------------------------------
+bool AssetManager::StreamTextures(Camera* camera, unsigned int screenHeight)
+{
+	if (streaming || IsHeadless() || textureStreamer.GetCount() == 0)
+		return false;
+
+	// Back in the cache, so they can be asked for again (or couldn't
+	// be compressed, so they've got all they'll ever have)
+	for (auto encode = textureEncodes.begin(); encode != textureEncodes.end();) {
+		if (encode->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			encode++;
+			continue;
 		}
-		else if (p.path().extension().compare(".obj") == 0) {
-			std::string s = p.path().filename().string();
-			RemoveExtension(s);
-			meshes[s] = new Mesh(s, (path + "\\..\\..\\" + p.path().string()).c_str(), device);
+		if (!encode->second.get()) {
+			printf("Couldn't stream in %s\n", encode->first.c_str());
+			textureStreamer.Remove(encode->first);
 		}
+		encode = textureEncodes.erase(encode);
 	}
 
-	// Describe and create our sampler state
-	D3D11_SAMPLER_DESC sampDesc = {};
-	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-	sampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	sampDesc.MaxAnisotropy = 16;
-	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	device->CreateSamplerState(&sampDesc, samplerOptions.GetAddressOf());
-
-	D3D11_SAMPLER_DESC clampDesc = {};
-	clampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-	clampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-	clampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-	clampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	clampDesc.MaxAnisotropy = 16;
-	clampDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	device->CreateSamplerState(&clampDesc, clamplerOptions.GetAddressOf());
-
-	std::vector<std::filesystem::directory_entry> bundlePaths;
-	std::vector<std::filesystem::directory_entry> materialPaths;
-	std::vector<std::filesystem::directory_entry> entityPaths;
-	for (auto& p : std::filesystem::recursive_directory_iterator(DEFINITIONS_PATH)) {
-		if (p.path().extension().compare(".bundle") == 0) {
-			bundlePaths.push_back(p);
-		}
-		else if (p.path().extension().compare(".material") == 0) {
-			materialPaths.push_back(p);
-		}
-		else if (p.path().extension().compare(".ge") == 0) {
-			entityPaths.push_back(p);
-		}
-	}
-
-	LoadTextureBundles(bundlePaths);
-	LoadMaterials(materialPaths);
-	LoadEntities(entityPaths);
-
-	sky = new Sky(
-		(wide_path + L"\\..\\..\\Assets\\Skies\\Night\\right.png").c_str(),
-		(wide_path + L"\\..\\..\\Assets\\Skies\\Night\\left.png").c_str(),
-		(wide_path + L"\\..\\..\\Assets\\Skies\\Night\\up.png").c_str(),
-		(wide_path + L"\\..\\..\\Assets\\Skies\\Night\\down.png").c_str(),
-		(wide_path + L"\\..\\..\\Assets\\Skies\\Night\\front.png").c_str(),
-		(wide_path + L"\\..\\..\\Assets\\Skies\\Night\\back.png").c_str(),
-		GetMesh("cube"),
-		GetVertexShader("SkyVS"),
-		GetPixelShader("SkyPS"),
-		samplerOptions,
-		device,
-		context);
+	// Evicted by the budget, so nothing to stream until it's back
+	for (auto& [key, use] : textureImports)
+		if (textureStreamer.Contains(key) && !(textures.contains(key) && textures[key]))
+			textureStreamer.Remove(key);
+
+	DirectX::XMFLOAT4X4 view = camera->GetView();
+	DirectX::XMFLOAT4X4 proj = camera->GetProjection();
+	DirectX::XMMATRIX viewMatrix = DirectX::XMLoadFloat4x4(&view);
+
+	// Pixels a unit covers, one unit away, and the near clip plane
+	float pixelsAtOne = screenHeight * 0.5f * proj._22;
+	float nearClip = -proj._43 / proj._33;
+
+	// The frustum's side planes, as how far out (in x and y) they
+	// are for each unit forward
+	float lengthX = sqrtf(proj._11 * proj._11 + 1.0f);
+	float lengthY = sqrtf(proj._22 * proj._22 + 1.0f);
+
+	for (auto& p : entities) {
+		GameEntity* entity = p.Value;
+		Mesh* mesh = entity->GetMesh();
+		Material* material = entity->GetMaterial();
+		if (!mesh || !material)
+			continue;
+
+		auto keys = bundleTextures.find(material->GetTextures());
+		if (keys == bundleTextures.end())
+			continue;
+
+		// Its biggest scale on any axis (the rows of the world matrix)
+		DirectX::XMFLOAT4X4 world = entity->GetTransform()->GetWorldMatrix();
+		float scale = fmaxf(fmaxf(
+			sqrtf(world._11 * world._11 + world._12 * world._12 + world._13 * world._13),
+			sqrtf(world._21 * world._21 + world._22 * world._22 + world._23 * world._23)),
+			sqrtf(world._31 * world._31 + world._32 * world._32 + world._33 * world._33));
+		if (scale <= 0)
+			continue;
+
+		DirectX::XMFLOAT3 center;
+		DirectX::XMStoreFloat3(&center, DirectX::XMVector3Transform(DirectX::XMVectorSet(world._41, world._42, world._43, 1), viewMatrix));
+		float radius = mesh->GetBoundingRadius() * scale;
+		if (center.z < -radius ||
+			(proj._11 * fabsf(center.x) - center.z) / lengthX > radius ||
+			(proj._22 * fabsf(center.y) - center.z) / lengthY > radius)
+			continue;
+
+		DirectX::XMFLOAT2 uvScale = material->GetUVScale();
+		float uvPerUnit = mesh->GetUVDensity() * fmaxf(fabsf(uvScale.x), fabsf(uvScale.y)) / scale;
+		float pixelsPerUnit = pixelsAtOne / fmaxf(center.z - radius, nearClip);
+		for (auto& key : keys->second)
+			if (!textureEncodes.contains(key))
+				textureStreamer.Request(key, uvPerUnit / pixelsPerUnit);
+	}
+
+	bool changed = false;
+	for (auto& change : textureStreamer.Update())
+		changed = ChangeTextureMip(change) || changed;
+	return changed;
 }
 
-void AssetManager::Initialize(std::string path, std::wstring wide_path, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+// Makes a streamed texture start at another mip, and puts it
+// everywhere the old one was.  Uploads read the texture from
+// the cache again, as only its smaller mips were kept.  If
+// it's not there (the cache was trimmed, say), compressing it
+// takes far longer than a frame, so that's done on another
+// thread and the texture stays where it is.  It isn't asked
+// for again until it's back in the cache (see StreamTextures()).
+bool AssetManager::ChangeTextureMip(const TextureMipChange& change)
 {
-	this->path = path;
-	this->wide_path = wide_path;
-	this->device = device;
-	this->context = context;
+	auto found = textures.find(change.Name);
+	if (found == textures.end() || !found->second || !textureImports.contains(change.Name)) {
+		textureStreamer.Remove(change.Name);
+		return false;
+	}
+
+	CompressedTexture source = {};
+	if (change.ToMip < change.FromMip) {
+		const TextureImport& use = textureImports[change.Name];
+		AssetBytes bytes;
+		if (!ReadFile(change.Name + ".png", bytes)) {
+			printf("Couldn't stream in %s\n", change.Name.c_str());
+			textureStreamer.SetResidentMip(change.Name, change.FromMip);
+			return false;
+		}
+		if (!LoadCachedTexture(bytes, use.Format, use.Content, derivedData, source)) {
+			textureEncodes[change.Name] = std::async(std::launch::async, [this, name = change.Name, use]()
+				{
+					AssetBytes bytes;
+					CompressedTexture compressed = {};
+					ImageData image;
+					return ReadFile(name + ".png", bytes) &&
+						LoadCompressedTexture(name, bytes, use.Format, use.Content, derivedData, false, compressed, image);
+				});
+			textureStreamer.SetResidentMip(change.Name, change.FromMip);
+			return false;
+		}
+	}
+
+	auto texture = ImageLoader::ChangeFirstMip(device, context, found->second.Get(), change.FromMip, change.ToMip,
+		change.ToMip < change.FromMip ? &source : 0);
+	if (!texture) {
+		textureStreamer.SetResidentMip(change.Name, change.FromMip);
+		return false;
+	}
+
+	ReplaceTexture(found->second.Get(), texture);
+	found->second = texture;
+	textureStreamer.SetResidentMip(change.Name, change.ToMip);
+	BudgetTexture(change.Name);
+	return true;
 }
 
-int AssetManager::GetBundleCount()
+// Swaps a texture in every bundle that has it
+void AssetManager::ReplaceTexture(ID3D11ShaderResourceView* old, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> replacement)
 {
-	return textureBundles.size();
+	auto replace = [&](AssetHandle<TextureBundle>* handle)
+		{
+			TextureBundle* bundle = handle->Peek();
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* views[] = { &bundle->albedo, &bundle->normal, &bundle->roughness, &bundle->metalness };
+			for (auto view : views)
+				if (view->Get() == old)
+					*view = replacement;
+		};
+
+	for (auto& p : textureBundles)
+		replace(p.Value);
+	for (auto& [name, handle] : materialBundles)
+		replace(handle);
 }
 
-Material* AssetManager::GetMaterial(std::string tag)
+bool AssetManager::CompileScene()
 {
-	if (materials.contains(tag)) {
-		return materials[tag];
+	// It's about to be written over
+	compiledScene.Close();
+
+	// Sorted, so the same definitions always compile the same way
+	std::vector<std::filesystem::path> files = ListFiles(DEFINITIONS_PATH);
+	std::sort(files.begin(), files.end());
+
+	SceneSource source;
+	bool read = true;
+	for (auto& p : files) {
+		if (p.extension().compare(".bundle") == 0) {
+			AssetDefinition<BundleDefinition> definition = { p };
+			read = ReadDefinition(definition) && read;
+			source.Bundles.push_back(definition.Data);
+		}
+		else if (p.extension().compare(".material") == 0) {
+			AssetDefinition<MaterialDefinition> definition = { p };
+			read = ReadDefinition(definition) && read;
+			definition.Data.Name = GetDefinitionName(definition);
+			source.Materials.push_back(definition.Data);
+		}
+		else if (p.extension().compare(".ge") == 0) {
+			AssetDefinition<EntityDefinition> definition = { p };
+			read = ReadDefinition(definition) && read;
+			definition.Data.Name = GetDefinitionName(definition);
+			source.Entities.push_back(definition.Data);
+		}
+		else if (p.extension().compare(".scene") == 0) {
+			read = ReadScene(p, [&](EntityDefinition& entity) { source.Entities.push_back(entity); }) && read;
+		}
+	}
+
+	for (auto& p : ListFiles(ASSET_PATH)) {
+		if (p.extension().compare(".obj") == 0) {
+			std::string name = p.filename().string();
+			RemoveExtension(name);
+			source.Meshes.push_back(name);
+		}
 	}
-	return nullptr;
+
+	// Anything that couldn't be read has already said why
+	return read && CompiledScene::Compile(source, CompiledScenePath);
 }
 
-Mesh* AssetManager::GetMesh(std::string tag)
+bool AssetManager::EnableHotReload()
 {
-	if (meshes.contains(tag)) {
-		return meshes[tag];
+	// An archive can't change under us, a compiled scene doesn't follow
+	// its definitions, and headless there's nothing to swap
+	if (archive.IsOpen() || compiledScene.IsOpen() || IsHeadless())
+		return false;
+
+	if (!watcher.Start({ ASSET_PATH, DEFINITIONS_PATH })) {
+		printf("Couldn't watch %s or %s for changes\n", ASSET_PATH, DEFINITIONS_PATH);
+		return false;
 	}
-	return nullptr;
+
+	printf("Watching %s and %s for changes\n", ASSET_PATH, DEFINITIONS_PATH);
+	return true;
 }
 
-TextureBundle* AssetManager::GetBundle(std::string tag)
+// --------------------------------------------------------
+// Imports a texture right away, on the main thread.  Any file
+// that's changed misses the cache, as the key is its bytes.
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> AssetManager::ImportTexture(const std::string& key, const TextureImport& use)
 {
-	if (textureBundles.contains(tag)) {
-		return textureBundles[tag];
+	AssetBytes source;
+	CompressedTexture compressed = {};
+	ImageData image;
+	if (!ReadFile(key + ".png", source)) {
+		printf("Couldn't read %s\n", key.c_str());
+		return nullptr;
 	}
 
-	return nullptr;
+	// Anything that was streaming starts over from its smallest mips
+	textureStreamer.Remove(key);
+	if (LoadCompressedTexture(key, source, use.Format, use.Content, derivedData, textureCacheEnabled, compressed, image)) {
+		uint32_t mipCount = (uint32_t)compressed.Mips.size();
+		uint32_t firstMip = TextureStreamer::GetStartMip(compressed.Width, compressed.Height, mipCount);
+		auto texture = ImageLoader::CreateTexture(device, compressed, firstMip);
+		if (texture && firstMip > 0)
+			textureStreamer.Add(key, compressed.Width, compressed.Height, mipCount, TextureCompressor::GetBlockBytes(use.Format), firstMip);
+		return texture;
+	}
+	if (image.Pixels.empty()) {
+		printf("Couldn't decode %s\n", key.c_str());
+		return nullptr;
+	}
+	return ImageLoader::CreateTexture(device, context, image);
 }
 
-ISimpleShader* AssetManager::GetShader(std::string tag) {
-	if (shaders.contains(tag)) {
-		return shaders[tag];
+// --------------------------------------------------------
+// Builds a bundle right away, importing any of its textures
+// that weren't already (which a new or edited bundle can
+// want).  Packed textures are always rebuilt, since nothing
+// else keeps them.
+// --------------------------------------------------------
+TextureBundle* AssetManager::BuildBundle(PendingBundle& bundle)
+{
+	for (auto& [key, use] : GetTextureUses(bundle)) {
+		if (textures.contains(key) && textures[key])
+			continue;
+
+		if (!FileExists(key + ".png"))
+			continue;
+
+		textureImports[key] = use;
+		textures[key] = ImportTexture(key, use);
+	}
+
+	TextureBundle* loaded = new TextureBundle(bundle.Name);
+	loaded->albedo = textures[bundle.Albedo];
+	loaded->normal = textures[bundle.Normal];
+	if (!bundle.Packed) {
+		loaded->roughness = textures[bundle.Roughness];
+		loaded->metalness = textures[bundle.Metal];
+		return loaded;
 	}
-	return nullptr;
+
+	// Maps the bundle doesn't have are left without data
+	AssetBytes sources[3];
+	const std::string* keys[3] = { &bundle.Roughness, &bundle.Metal, &bundle.AO };
+	for (int i = 0; i < 3; i++)
+		if (!keys[i]->empty() && !ReadFile(*keys[i] + ".png", sources[i]))
+			sources[i] = {};
+
+	CompressedTexture packed = {};
+	if (LoadPackedTexture(bundle.Name, sources, derivedData, textureCacheEnabled, packed))
+		loaded->roughnessMetalAO = ImageLoader::CreateTexture(device, packed);
+	else
+		printf("Couldn't pack roughness, metal and AO for %s\n", bundle.Name.c_str());
+	return loaded;
 }
 
-SimpleVertexShader* AssetManager::GetVertexShader(std::string tag)
+// An asset's definition, or the one file it was imported from
+std::filesystem::path AssetManager::GetSourceFile(const AssetRef& asset)
 {
-	if (shaders.contains(tag)) {
-		return dynamic_cast<SimpleVertexShader*>(shaders[tag]);
+	std::vector<std::filesystem::path> files = dependencies.GetFiles(asset);
+	for (auto& file : files) {
+		AssetKind kind;
+		if (GetDefinitionKind(file, kind))
+			return file;
 	}
-	return nullptr;
+	return files.empty() ? std::filesystem::path() : files.front();
 }
 
-SimplePixelShader* AssetManager::GetPixelShader(std::string tag)
+// --------------------------------------------------------
+// Rebuilds one asset and swaps it in.  changed is whether
+// its own files changed, rather than something it uses.
+// Returns false if there was nothing to do (or it failed,
+// which leaves the old asset where it was).
+//
+// Most assets only point at what they use through handles,
+// so they're left alone unless their own files changed:
+// entities follow their mesh and material, and materials
+// follow their bundle, as skies do the cube mesh.  Bundles
+// copy their textures, so those are always rebuilt.
+// --------------------------------------------------------
+bool AssetManager::Reload(const AssetRef& asset, bool changed)
 {
-	if (shaders.contains(tag)) {
-		return dynamic_cast<SimplePixelShader*>(shaders[tag]);
+	std::filesystem::path file = GetSourceFile(asset);
+	if (file.empty())
+		return false;
+
+	// Loading assumes every name it's given exists, which an edit can break
+	auto missing = [&](const std::string& name, const char* kind, auto& assets)
+		{
+			if (name.empty() || assets.Contains(name))
+				return false;
+
+			printf("Couldn't reload %s: no %s named %s\n", asset.Name.c_str(), kind, name.c_str());
+			return true;
+		};
+
+	switch (asset.Kind) {
+	case AssetKind::Texture: {
+		// Only textures loaded on their own (packed ones are read by their bundle)
+		if (!textureImports.contains(asset.Name))
+			return false;
+
+		auto texture = ImportTexture(asset.Name, textureImports[asset.Name]);
+		if (!texture)
+			return false;
+		textures[asset.Name] = texture;
+		BudgetTexture(asset.Name);
+		return true;
+	}
+
+	case AssetKind::Mesh: {
+		Mesh* loaded = ImportMesh(asset.Name, file);
+		if (!loaded)
+			return false;
+
+		AssetHandle<Mesh>* handle = meshes.Get(asset.Name);
+		if (!handle)
+			handle = meshes.Insert(asset.Name, new AssetHandle<Mesh>(placeholderMesh));
+		delete handle->Replace(loaded);
+		BudgetMesh(asset.Name);
+		return true;
+	}
+
+	case AssetKind::Bundle: {
+		AssetDefinition<BundleDefinition> definition = { file };
+		if (!ReadDefinition(definition))
+			return false;
+
+		dependencies.Remove(asset);
+		PendingBundle bundle = ParseBundle(definition);
+		TextureBundle* loaded = BuildBundle(bundle);
+		AssetHandle<TextureBundle>* handle = textureBundles.Get(bundle.Name);
+		if (!handle)
+			handle = textureBundles.Insert(bundle.Name, new AssetHandle<TextureBundle>(placeholderBundle));
+		delete handle->Replace(loaded);
+		bundle.Handle = handle;
+		BudgetBundle(bundle);
+		return true;
+	}
+
+	case AssetKind::Material: {
+		// Inline bundles are the material's own, so they're rebuilt with it
+		bool inlineTextures = false;
+		for (auto& dependency : dependencies.GetDependencies(asset))
+			inlineTextures = inlineTextures || dependency.Kind == AssetKind::Texture;
+		AssetDefinition<MaterialDefinition> definition = { file };
+		if ((!changed && !inlineTextures) || !ReadDefinition(definition) || missing(definition.Data.Textures, "bundle", textureBundles))
+			return false;
+
+		dependencies.Remove(asset);
+		std::string name = GetDefinitionName(definition);
+		TrackMaterial(definition, name);
+		std::vector<PendingBundle> pending;
+		Material* loaded = CreateMaterial(definition, pending);
+		for (auto& bundle : pending) {
+			delete bundle.Handle->Replace(BuildBundle(bundle));
+			BudgetBundle(bundle);
+		}
+
+		AssetHandle<Material>* handle = materials.Get(name);
+		if (!handle)
+			handle = materials.Insert(name, new AssetHandle<Material>(0));
+		delete handle->Replace(loaded);
+		BudgetMaterial(name);
+		return true;
 	}
-	return nullptr;
+
+	case AssetKind::Entity: {
+		AssetDefinition<EntityDefinition> definition = { file };
+		if (!changed || !ReadDefinition(definition) || missing(definition.Data.Mesh, "mesh", meshes) || missing(definition.Data.Material, "material", materials))
+			return false;
+
+		dependencies.Remove(asset);
+		std::string name = GetDefinitionName(definition);
+		TrackEntity(definition, name);
+		ApplyEntity(definition.Data, name);
+		return true;
+	}
+
+	case AssetKind::Scene: {
+		// Scene entities follow their mesh and material like any
+		// other, so only an edit to the scene itself reapplies it
+		return changed && ApplyScene(file) > 0;
+	}
+
+	case AssetKind::Sky: {
+		AssetDefinition<nlohmann::json> definition = { file };
+		if (!changed || !ReadDefinition(definition))
+			return false;
+
+		dependencies.Remove(asset);
+		std::string name = GetDefinitionName(definition);
+		TrackSky(definition, name);
+
+		Sky* previous = skies.Get(name);
+		skies.Insert(name, LoadSky(definition, GetSkyMesh()));
+		if (activeSky.empty() || activeSky == name)
+			SetActiveSky(name);
+		delete previous;
+		return true;
+	}
+	}
+	return false;
 }
 
-GameEntity* AssetManager::GetEntity(std::string tag)
+// --------------------------------------------------------
+// Takes the files that have changed (and settled) since the
+// last call, works out every asset built from them, directly
+// or not, and reloads those in order, so each one is rebuilt
+// after whatever it uses.  Runs between frames.
+// --------------------------------------------------------
+bool AssetManager::ReloadChangedFiles()
 {
-	if (entities.contains(tag)) {
-		return entities[tag];
+	std::vector<std::filesystem::path> files = watcher.TakeChanges();
+	if (files.empty())
+		return false;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// Files nothing was built from yet (new ones) are recorded
+	// first, so they're found like any other
+	for (auto& file : files) {
+		if (!dependencies.GetAssetsBuiltFrom({ file }).empty())
+			continue;
+
+		AssetKind kind;
+		std::string name = file.string();
+		if (file.extension().compare(".png") == 0) {
+			RemoveExtension(name);
+			dependencies.AddFile({ AssetKind::Texture, name }, file);
+		}
+		else if (file.extension().compare(".obj") == 0) {
+			name = file.filename().string();
+			RemoveExtension(name);
+			dependencies.AddFile({ AssetKind::Mesh, name }, file);
+		}
+		else if (GetDefinitionKind(file, kind)) {
+			// Only the name's needed to find it, which any kind keeps in
+			// "name" (but scenes go by their file name, as they can be huge)
+			AssetDefinition<NamedDefinition> definition = { file };
+			if (kind == AssetKind::Scene || ReadDefinition(definition))
+				dependencies.AddFile({ kind, GetDefinitionName(definition) }, file);
+		}
+	}
+
+	std::vector<AssetRef> changed = dependencies.GetAssetsBuiltFrom(files);
+	std::vector<AssetRef> affected = dependencies.GetAffected(changed);
+	int reloaded = 0;
+	for (auto& asset : affected) {
+		bool direct = std::find(changed.begin(), changed.end(), asset) != changed.end();
+		try {
+			if (Reload(asset, direct))
+				reloaded++;
+		}
+		catch (const std::exception& e) {
+			// Most likely a definition that's only half written
+			printf("Couldn't reload %s: %s\n", asset.Name.c_str(), e.what());
+		}
 	}
-	return nullptr;
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Reloaded %d of %zu affected assets from %zu changed files in %.1f ms\n", reloaded, affected.size(), files.size(), milliseconds);
+	return reloaded > 0;
+}
+
+// --------------------------------------------------------
+// Each of these starts the memory budget looking after an
+// asset, or tells it the asset's been rebuilt.  How each is
+// made again after it's evicted is worked out here, so it
+// doesn't need its definition.
+// --------------------------------------------------------
+void AssetManager::BudgetMesh(const std::string& name)
+{
+	AssetHandle<Mesh>* handle = meshes.Get(name);
+	if (!handle)
+		return;
+
+	memoryBudget.Track(AssetCategory::Mesh, name, std::make_unique<BudgetedHandle<Mesh>>(handle,
+		[](Mesh* mesh) { return AssetMemory{ sizeof(Mesh) + mesh->name.capacity(), mesh->GetBufferBytes() }; },
+		[this, name]() { return ImportMesh(name, GetSourceFile({ AssetKind::Mesh, name })); }));
+}
+
+// Its own textures are budgeted on their own, so only a packed
+// texture (which nothing else shares) counts towards a bundle
+void AssetManager::BudgetBundle(const PendingBundle& bundle)
+{
+	std::vector<std::string> keys;
+	for (auto& [key, use] : GetTextureUses(bundle))
+		keys.push_back(key);
+	bundleTextures[bundle.Handle] = keys;
+
+	memoryBudget.Track(AssetCategory::Bundle, bundle.Name, std::make_unique<BudgetedBundle>(bundle.Handle,
+		[](TextureBundle* loaded) { return AssetMemory{ sizeof(TextureBundle) + loaded->name.capacity(), ImageLoader::EstimateBytes(loaded->roughnessMetalAO.Get()) }; },
+		[this, bundle]() mutable { return BuildBundle(bundle); },
+		keys,
+		textureHolders));
+}
+
+// Made again from what the one that's loaded was made with,
+// which only keeps its textures' handle (not a reference)
+void AssetManager::BudgetMaterial(const std::string& name)
+{
+	AssetHandle<Material>* handle = materials.Get(name);
+	if (!handle || !handle->IsLoaded())
+		return;
+
+	Material* material = handle->Peek();
+	SimpleVertexShader* vs = material->GetVS();
+	SimplePixelShader* ps = material->GetPS();
+	DirectX::XMFLOAT4 color = material->GetColor();
+	float shininess = material->GetShininess();
+	DirectX::XMFLOAT2 uvScale = material->GetUVScale();
+	AssetHandle<TextureBundle>* bundle = material->GetTextures();
+
+	memoryBudget.Track(AssetCategory::Material, name, std::make_unique<BudgetedHandle<Material>>(handle,
+		[](Material*) { return AssetMemory{ sizeof(Material), 0 }; },
+		[=, this]() { return new Material(vs, ps, color, shininess, uvScale, bundle, samplerOptions, clamplerOptions); }));
+}
+
+void AssetManager::BudgetTexture(const std::string& key)
+{
+	if (!textureImports.contains(key))
+		return;
+
+	memoryBudget.Track(AssetCategory::Texture, key, std::make_unique<BudgetedTexture>(key, textures, textureHolders,
+		[this, key]() { return ImportTexture(key, textureImports[key]); }));
+}
+
+// Whether an asset or definition is there to be read
+bool AssetManager::FileExists(const std::filesystem::path& file)
+{
+	if (archive.IsOpen())
+		return archive.Find(file.string()) != 0;
+
+	std::error_code error;
+	return std::filesystem::exists(file, error);
+}
+
+void AssetManager::Initialize(std::string path, std::wstring wide_path, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->path = path;
+	this->wide_path = wide_path;
+	this->device = device;
+	this->context = context;
+	derivedData.SetDirectory(GetCacheDirectory());
+
+	if (archive.Open(ArchivePath))
+		printf("Reading assets from %s (%zu files)\n", ArchivePath, archive.GetEntryCount());
+	if (compiledScene.Open(CompiledScenePath))
+		printf("Reading the scene from %s (%zu entities)\n", CompiledScenePath, compiledScene.GetEntityCount());
+}
+
+bool AssetManager::ReadFile(const std::filesystem::path& file, AssetBytes& bytes)
+{
+	if (archive.IsOpen()) {
+		const ArchiveEntry* entry = archive.Find(file.string());
+		return entry && archive.Read(*entry, bytes);
+	}
+
+	std::ifstream stream(file, std::ios::binary | std::ios::ate);
+	if (!stream)
+		return false;
+
+	bytes.Storage.resize((size_t)stream.tellg());
+	bytes.Data = bytes.Storage.data();
+	bytes.Size = bytes.Storage.size();
+	stream.seekg(0);
+	return (bool)stream.read((char*)bytes.Storage.data(), bytes.Storage.size());
+}
+
+std::vector<std::filesystem::path> AssetManager::ListFiles(const char* folder)
+{
+	std::vector<std::filesystem::path> files;
+	if (!archive.IsOpen()) {
+		for (auto& p : std::filesystem::recursive_directory_iterator(folder))
+			if (p.is_regular_file())
+				files.push_back(p.path());
+		return files;
+	}
+
+	// Archive paths are relative with forward slashes, so they're
+	// put back in the same form (and order) the directory walk gives
+	std::string prefix = AssetArchive::NormalizePath(folder) + "/";
+	for (size_t i = 0; i < archive.GetEntryCount(); i++) {
+		std::string file(archive.GetPath(archive.GetEntry(i)));
+		if (AssetArchive::NormalizePath(file).compare(0, prefix.size(), prefix) != 0)
+			continue;
+
+		std::replace(file.begin(), file.end(), '/', '\\');
+		files.push_back(".\\" + file);
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+int AssetManager::GetBundleCount()
+{
+	return (int)textureBundles.Size();
+}
+
+AssetHandle<Material>* AssetManager::GetMaterial(AssetId tag)
+{
+	// Materials have no placeholder, so one that was evicted
+	// is made again before it's handed out
+	auto* entry = materials.FindEntry(tag);
+	if (!entry)
+		return 0;
+	if (!entry->Value->IsLoaded())
+		memoryBudget.Load(AssetCategory::Material, entry->Name);
+	return entry->Value;
+}
+
+AssetHandle<Mesh>* AssetManager::GetMesh(AssetId tag)
+{
+	return meshes.Get(tag);
+}
+
+AssetHandle<TextureBundle>* AssetManager::GetBundle(AssetId tag)
+{
+	return textureBundles.Get(tag);
+}
+
+ISimpleShader* AssetManager::GetShader(AssetId tag) {
+	return shaders.Get(tag);
+}
+
+SimpleVertexShader* AssetManager::GetVertexShader(AssetId tag)
+{
+	return dynamic_cast<SimpleVertexShader*>(shaders.Get(tag));
+}
+
+SimplePixelShader* AssetManager::GetPixelShader(AssetId tag)
+{
+	return dynamic_cast<SimplePixelShader*>(shaders.Get(tag));
+}
+
+Sky* AssetManager::GetSky(AssetId tag)
+{
+	return skies.Get(tag);
+}
+
+// Just swaps which (already built) sky is used, so it's
+// safe to call at any point between frames
+bool AssetManager::SetActiveSky(AssetId tag)
+{
+	auto* entry = skies.FindEntry(tag);
+	if (!entry) {
+		return false;
+	}
+
+	sky = entry->Value;
+	activeSky = entry->Name;
+	return true;
+}
+
+GameEntity* AssetManager::GetEntity(AssetId tag)
+{
+	return entities.Get(tag);
 }
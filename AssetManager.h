@@ -5,12 +5,44 @@
 #include "SimpleShader.h"
 #include "GameEntity.h"
 #include "Sky.h"
+#include "AssetHandle.h"
+#include "AssetIdMap.h"
+#include "AssetArchive.h"
+#include "AssetBudget.h"
+#include "CompiledScene.h"
+#include "DerivedDataCache.h"
+#include "AssetDependencies.h"
+#include "AssetDefinitions.h"
+#include "FileWatcher.h"
+#include "TextureCompressor.h"
+#include "TextureStreamer.h"
 
 #include <filesystem>
 #include <unordered_map>
 #include <string>
 #include <concepts>
+#include <functional>
+#include <future>
 #include <boost/any.hpp>
+#include <nlohmann/json.hpp>
+
+// A texture bundle whose handle is made up front, and
+// resolved once its textures have loaded
+struct PendingBundle
+{
+	AssetHandle<TextureBundle>* Handle;
+	std::string Name;
+	std::string Albedo;
+	std::string Normal;
+	std::string Roughness;
+	std::string Metal;
+
+	// Packed bundles combine roughness, metal and an optional
+	// ambient occlusion map (AO) into RoughnessMetalAO
+	bool Packed;
+	std::string AO;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> RoughnessMetalAO;
+};
 
 class AssetManager
 {
@@ -33,39 +65,137 @@ public:
 
 private:
 	static AssetManager* instance;
-	AssetManager() {};
+	AssetManager() : sky(0), textureCacheEnabled(true), placeholderMesh(0), placeholderMeshHandle(0), placeholderBundle(0), placeholderBundleHandle(0), placeholderSky(0), streaming(0) {};
 #pragma endregion
 
 public:
 	~AssetManager();
 
+	// Passing no device makes the manager headless: files are still
+	// read, decoded and parsed, but no GPU resources are created.
+	// If there's an archive (ArchivePath) every asset and definition
+	// is read from it, and the folders aren't looked at.
 	void Initialize(std::string path, std::wstring wide_path, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
-	void Load();
+	bool IsHeadless() { return !device; }
+	bool IsUsingArchive() { return archive.IsOpen(); }
+
+	// Where the archive is looked for, and what goes in it
+	static constexpr const char* ArchivePath = ".\\Assets.pack";
+	static std::vector<std::string> GetArchiveFolders() { return { "Assets", "Definitions" }; }
+
+	// If there's a compiled scene (CompiledScenePath), every bundle,
+	// material and entity comes from it instead of their definitions
+	// (skies still have theirs).  It isn't checked against them, so
+	// compile it again after editing any, or delete it.
+	static constexpr const char* CompiledScenePath = ".\\Scene.bin";
+	bool IsUsingCompiledScene() { return compiledScene.IsOpen(); }
+
+	// Compiles every bundle, material and entity definition (.ge and
+	// .scene) into CompiledScenePath.  Call after Initialize() (it can
+	// be headless).  Prints what's wrong and returns false if anything
+	// refers to something that doesn't exist.
+	bool CompileScene();
+
+	// Reads an asset or definition (a path like ".\Assets\x.png") from
+	// the archive, or from disk without one.  Safe on any thread.
+	bool ReadFile(const std::filesystem::path& file, AssetBytes& bytes);
+
+	// Bundle textures are block compressed the first time they're seen
+	// and kept in the cache.  Turning the cache off compresses them all
+	// again, which reports the quality of each one.
+	void SetTextureCacheEnabled(bool enabled) { textureCacheEnabled = enabled; }
+
+	// Loads everything across threadCount threads (0 means one per core)
+	void Load(unsigned int threadCount = 0);
+
+	// Only waits for shaders and definitions, so every entity, material
+	// and handle exists when this returns.  Meshes, texture bundles and
+	// skies start out as placeholders (a cube, flat grey textures and a
+	// grey sky) and are swapped for the real ones by Update().
+	void LoadAsync(unsigned int threadCount = 0);
+
+	// Call once a frame.  Finishes loads that are waiting on the main
+	// thread, for up to budgetMilliseconds, and swaps them in.  Once
+	// everything's loaded, this is also where hot reloads happen, and
+	// where the memory budget evicts (and loads again) what it has to.
+	// Returns true if anything ran (as it may have changed state on
+	// the context).
+	bool Update(double budgetMilliseconds = 4.0);
+	bool IsLoading() { return streaming != 0; }
+	int GetPendingLoadCount();
+
+	// Watches the asset and definition folders, and from then on
+	// Update() reimports any file that changes, along with whatever
+	// was built from it.  Not possible headless, from an archive or
+	// with a compiled scene.
+	bool EnableHotReload();
+	bool IsHotReloading() { return watcher.IsRunning(); }
+
+	// Which files and assets each asset was built from, filled in as
+	// they load
+	AssetDependencies& GetDependencies() { return dependencies; }
+
+	// Meshes, textures, bundles and materials are looked after by the
+	// budget once they've loaded, and each category can be given a
+	// limit (nothing is by default).  Update() evicts whatever nothing
+	// references to fit, and loads it again once it's used.
+	AssetBudget& GetMemoryBudget() { return memoryBudget; }
+
+	// Bundle textures start out with only their smaller mips, and
+	// StreamTextures() uploads (and drops) the rest as the entities
+	// using them are seen closer up (or further away).  Call it once
+	// a frame, with the camera and the height of the screen (in
+	// pixels) the scene's drawn at.  Returns true if any texture
+	// changed (so anything holding their views needs to let go).
+	bool StreamTextures(Camera* camera, unsigned int screenHeight);
+	TextureStreamer& GetTextureStreamer() { return textureStreamer; }
 
 	// Texture related resources
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> clamplerOptions;
 
+	// The sky currently being drawn and lit with.  Every sky is
+	// fully built (IBL included) at load, so switching is free.
+	// While loading asynchronously this is a placeholder until the
+	// default sky is ready.
 	Sky* sky;
 
-	TextureBundle* GetBundle(std::string tag);
-	std::unordered_map<std::string, TextureBundle*> GetBundles() { return textureBundles; }
+	// Everything is looked up by AssetId, so per frame lookups should
+	// use "name"_id (hashed at compile time).  Names that are only
+	// known at runtime, like a std::string, are hashed on the way in.
+	// Each returns null if there's nothing by that name.  Hold a
+	// reference to any handle that's kept (see AssetHandle).
+	Sky* GetSky(AssetId tag);
+	const AssetIdMap<Sky*>& GetSkies() { return skies; }
+	bool SetActiveSky(AssetId tag);
+	std::string GetActiveSkyName() { return activeSky; }
+
+	AssetHandle<TextureBundle>* GetBundle(AssetId tag);
+	const AssetIdMap<AssetHandle<TextureBundle>*>& GetBundles() { return textureBundles; }
 	int GetBundleCount();
 
-	Material* GetMaterial(std::string tag);
-	std::unordered_map<std::string, Material*> GetMaterials() { return materials; }
-	int GetMaterialCount() { return materials.size(); }
+	AssetHandle<Material>* GetMaterial(AssetId tag);
+	const AssetIdMap<AssetHandle<Material>*>& GetMaterials() { return materials; }
+	int GetMaterialCount() { return (int)materials.Size(); }
+
+	AssetHandle<Mesh>* GetMesh(AssetId tag);
+	const AssetIdMap<AssetHandle<Mesh>*>& GetMeshes() { return meshes; }
+	int GetMeshCount() { return (int)meshes.Size(); }
+
+	ISimpleShader* GetShader(AssetId tag);
+	const AssetIdMap<ISimpleShader*>& GetShaders() { return shaders; }
+	SimpleVertexShader* GetVertexShader(AssetId tag);
+	SimplePixelShader* GetPixelShader(AssetId tag);
 
-	Mesh* GetMesh(std::string tag);
-	std::unordered_map<std::string, Mesh*> GetMeshes() { return meshes; }
-	int GetMeshCount() { return meshes.size(); }
+	GameEntity* GetEntity(AssetId tag);
+	const AssetIdMap<GameEntity*>& GetEntities() { return entities; }
 
-	ISimpleShader* GetShader(std::string tag);
-	SimpleVertexShader* GetVertexShader(std::string tag);
-	SimplePixelShader* GetPixelShader(std::string tag);
+	// Where precomputed data (like IBL maps) is kept between runs
+	std::wstring GetCacheDirectory() { return wide_path + L"\\..\\..\\Cache\\"; }
 
-	GameEntity* GetEntity(std::string tag);
-	std::unordered_map<std::string, GameEntity*> GetEntities() { return entities; }
+	// Shared by everything that imports an asset.  Stats are printed
+	// (and the cache trimmed) at the end of every load.
+	DerivedDataCache& GetDerivedDataCache() { return derivedData; }
 private:
 	std::wstring wide_path;
 	std::string path;
@@ -73,15 +203,122 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11Device>		device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext>	context;
 
+	AssetArchive archive;
+	CompiledScene compiledScene;
+	DerivedDataCache derivedData;
+	AssetDependencies dependencies;
+	FileWatcher watcher;
+
+	// How many resident bundles hold each texture.  The budget's
+	// assets count on this, so it has to outlive the budget.
+	std::unordered_map<std::string, int> textureHolders;
+	AssetBudget memoryBudget;
+
+	// How a texture is imported, which depends on what a bundle uses it for
+	struct TextureImport
+	{
+		BlockFormat Format;
+		MipContent Content;
+	};
+	std::unordered_map<std::string, TextureImport> textureImports;
+	static std::vector<std::pair<std::string, TextureImport>> GetTextureUses(const PendingBundle& bundle);
+
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textures;
-	std::unordered_map<std::string, TextureBundle*> textureBundles;
+	bool textureCacheEnabled;
+	AssetIdMap<AssetHandle<TextureBundle>*> textureBundles;
+	// Listed inline in a material, so unnamed.  Kept by material
+	// name, so a reload reuses the handle (which the budget holds).
+	std::unordered_map<std::string, AssetHandle<TextureBundle>*> materialBundles;
+
+	// The textures each bundle's made from, by key in textures
+	std::unordered_map<AssetHandle<TextureBundle>*, std::vector<std::string>> bundleTextures;
+	TextureStreamer textureStreamer;
+
+	// Streamed textures that weren't in the cache, being compressed
+	// back into it on other threads (true once they are)
+	std::unordered_map<std::string, std::future<bool>> textureEncodes;
+
+	AssetIdMap<AssetHandle<Material>*> materials;
+	AssetIdMap<AssetHandle<Mesh>*> meshes;
+	AssetIdMap<ISimpleShader*> shaders;
+	AssetIdMap<GameEntity*> entities;
+	AssetIdMap<Sky*> skies;
+	std::string activeSky;
+
+	// Stand-ins for anything that hasn't loaded yet
+	Mesh* placeholderMesh;
+	AssetHandle<Mesh>* placeholderMeshHandle;	// For skies, when there's no cube
+	TextureBundle* placeholderBundle;
+	AssetHandle<TextureBundle>* placeholderBundleHandle;	// For materials whose bundle doesn't exist
+	Sky* placeholderSky;
+
+	// Everything still loading in the background (see AssetManager.cpp)
+	struct StreamingLoad;
+	StreamingLoad* streaming;
+
+	// Every file under folder (".\Assets" or ".\Definitions"), from
+	// the archive if there is one
+	std::vector<std::filesystem::path> ListFiles(const char* folder);
+	bool FileExists(const std::filesystem::path& file);
+
+	void BeginLoad(unsigned int threadCount);
+	void EndLoad();
+	void CreatePlaceholders();
+
+	template <typename T>
+	bool ReadDefinition(AssetDefinition<T>& definition);
+	bool ReadDefinition(AssetDefinition<nlohmann::json>& definition);
+	bool ReadScene(const std::filesystem::path& file, const std::function<void(EntityDefinition&)>& onEntity);
+	Mesh* ImportMesh(const std::string& name, const std::filesystem::path& file);
+
+	// Each of these records what the asset was built from
+	PendingBundle ParseBundle(AssetDefinition<BundleDefinition>& bundleDefinition);
+	void TrackMaterial(AssetDefinition<MaterialDefinition>& materialDefinition, const std::string& name);
+	void TrackEntity(AssetDefinition<EntityDefinition>& entityDefinition, const std::string& name);
+	void TrackSky(AssetDefinition<nlohmann::json>& skyDefinition, const std::string& name);
+
+	Material* CreateMaterial(AssetDefinition<MaterialDefinition>& materialDefinition, std::vector<PendingBundle>& pending);
+
+	void ApplyEntity(const EntityDefinition& entity, const std::string& name);
+	int ApplyScene(const std::filesystem::path& file);
+
+	// Definitions by name, to be made in resolved order
+	struct DefinitionsByName
+	{
+		std::unordered_map<std::string, PendingBundle> Bundles;
+		std::unordered_map<std::string, AssetDefinition<MaterialDefinition>*> Materials;
+		std::unordered_map<std::string, AssetDefinition<EntityDefinition>*> Entities;
+		std::set<std::string> Unparented;	// Entities in a parent cycle
+	};
+	AssetResolution ResolveDefinitions(
+		std::vector<AssetDefinition<BundleDefinition>>& bundleDefinitions,
+		std::vector<AssetDefinition<MaterialDefinition>>& materialDefinitions,
+		std::vector<AssetDefinition<EntityDefinition>>& entityDefinitions,
+		DefinitionsByName& byName);
+	void MakeAssets(const std::vector<AssetRef>& assets, DefinitionsByName& byName, std::vector<PendingBundle>& pending);
+	void ApplyScenes(std::vector<std::filesystem::path>& scenes);
+	std::mutex makeMutex;	// Held around the maps while groups are made
+	void LoadCompiledScene(std::vector<PendingBundle>& pending);
+	Sky* LoadSky(AssetDefinition<nlohmann::json>& skyDefinition, AssetHandle<Mesh>* cube);
+
+	// The cube mesh, or the placeholder's handle if there isn't one
+	AssetHandle<Mesh>* GetSkyMesh();
+	void AddSky(AssetDefinition<nlohmann::json>& skyDefinition, Sky* loaded);
+
+	// Hot reloading (main thread only, between frames)
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ImportTexture(const std::string& key, const TextureImport& use);
+	TextureBundle* BuildBundle(PendingBundle& bundle);
+	std::filesystem::path GetSourceFile(const AssetRef& asset);
+	bool Reload(const AssetRef& asset, bool changed);
+	bool ReloadChangedFiles();
 
-	std::unordered_map<std::string, Material*> materials;
-	std::unordered_map<std::string, Mesh*> meshes;
-	std::unordered_map<std::string, ISimpleShader*> shaders;
-	std::unordered_map<std::string, GameEntity*> entities;
+	// Memory budget (main thread only)
+	void BudgetMesh(const std::string& name);
+	void BudgetBundle(const PendingBundle& bundle);
+	void BudgetMaterial(const std::string& name);
+	void BudgetTexture(const std::string& key);
 
-	void LoadTextureBundles(std::vector<std::filesystem::directory_entry> bundlePaths);
-	void LoadMaterials(std::vector<std::filesystem::directory_entry> materialPaths);
-	void LoadEntities(std::vector<std::filesystem::directory_entry> entityPaths);
+	// Texture streaming (main thread only)
+	bool ChangeTextureMip(const TextureMipChange& change);
+	void ReplaceTexture(ID3D11ShaderResourceView* old, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> replacement);
 };
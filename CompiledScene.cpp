@@ -0,0 +1,406 @@
+#include "CompiledScene.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+static const uint32_t SceneMagic = 0x454E4353; // "SCNE"
+
+struct SceneHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t StringsOffset;
+	uint64_t StringsSize;
+	uint64_t BundleCount;
+	uint64_t BundlesOffset;
+	uint64_t MaterialCount;
+	uint64_t MaterialsOffset;
+	uint64_t MeshCount;
+	uint64_t MeshesOffset;
+	uint64_t EntityCount;
+	uint64_t EntitiesOffset;
+	uint64_t TransformsOffset;	// Positions, then rotations, then scales
+};
+
+// Strings are offsets into the strings, like SceneEntity::Name
+struct CompiledScene::Bundle
+{
+	uint32_t Name;
+	uint32_t Location;
+	uint32_t Albedo;
+	uint32_t Normal;
+	uint32_t Roughness;
+	uint32_t Metal;
+	uint32_t AO;
+	uint32_t Packed;
+};
+
+struct CompiledScene::Material
+{
+	uint32_t Name;
+	uint32_t VertexShader;
+	uint32_t PixelShader;
+	int32_t Bundle;		// Or -1, if its textures are listed inline
+	uint32_t Albedo;
+	uint32_t Normal;
+	uint32_t Roughness;
+	uint32_t Metal;
+	float Color[4];
+	float Shininess;
+	float UVScale[2];
+	uint32_t Padding;
+};
+
+bool CompiledScene::Open(const std::filesystem::path& path)
+{
+	Close();
+	if (!file.Open(path) || file.GetSize() < sizeof(SceneHeader))
+	{
+		Close();
+		return false;
+	}
+	const uint8_t* data = file.GetData();
+	size_t size = file.GetSize();
+
+	SceneHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	// Each section has to fit in the file, and line up for what's in it
+	auto fits = [&](uint64_t offset, uint64_t count, size_t stride)
+		{
+			return offset % 4 == 0 && offset <= size && count <= (size - offset) / stride;
+		};
+	bool valid =
+		header.Magic == SceneMagic &&
+		header.Version == Version &&
+		header.StringsSize > 0 &&
+		fits(header.StringsOffset, header.StringsSize, 1) &&
+		data[header.StringsOffset + header.StringsSize - 1] == 0 &&
+		fits(header.BundlesOffset, header.BundleCount, sizeof(Bundle)) &&
+		fits(header.MaterialsOffset, header.MaterialCount, sizeof(Material)) &&
+		fits(header.MeshesOffset, header.MeshCount, sizeof(uint32_t)) &&
+		fits(header.EntitiesOffset, header.EntityCount, sizeof(SceneEntity)) &&
+		header.EntityCount <= UINT32_MAX &&
+		fits(header.TransformsOffset, header.EntityCount * 3, sizeof(float) * 3);
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	base = data;
+	strings = (const char*)(data + header.StringsOffset);
+	bundles = (const Bundle*)(data + header.BundlesOffset);
+	bundleCount = (size_t)header.BundleCount;
+	materials = (const Material*)(data + header.MaterialsOffset);
+	materialCount = (size_t)header.MaterialCount;
+	meshes = (const uint32_t*)(data + header.MeshesOffset);
+	meshCount = (size_t)header.MeshCount;
+	entities = (const SceneEntity*)(data + header.EntitiesOffset);
+	entityCount = (size_t)header.EntityCount;
+	positions = (const float*)(data + header.TransformsOffset);
+	rotations = positions + entityCount * 3;
+	scales = rotations + entityCount * 3;
+
+	// Every index has to point at something that's there
+	uint64_t stringsSize = header.StringsSize;
+	auto isString = [&](uint32_t offset) { return offset < stringsSize; };
+	for (size_t i = 0; i < bundleCount && valid; i++)
+	{
+		const Bundle& b = bundles[i];
+		for (uint32_t s : { b.Name, b.Location, b.Albedo, b.Normal, b.Roughness, b.Metal, b.AO })
+			valid = valid && isString(s);
+	}
+	for (size_t i = 0; i < materialCount && valid; i++)
+	{
+		const Material& m = materials[i];
+		for (uint32_t s : { m.Name, m.VertexShader, m.PixelShader, m.Albedo, m.Normal, m.Roughness, m.Metal })
+			valid = valid && isString(s);
+		valid = valid && m.Bundle >= -1 && m.Bundle < (int64_t)bundleCount;
+	}
+	for (size_t i = 0; i < meshCount && valid; i++)
+		valid = isString(meshes[i]);
+	for (size_t i = 0; i < entityCount && valid; i++)
+	{
+		const SceneEntity& e = entities[i];
+		valid = isString(e.Name) && e.Mesh < meshCount && e.Material < materialCount &&
+			e.Parent >= -1 && e.Parent < (int64_t)i;
+	}
+
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void CompiledScene::Close()
+{
+	file.Close();
+	base = 0;
+	strings = 0;
+	bundles = 0;
+	bundleCount = 0;
+	materials = 0;
+	materialCount = 0;
+	meshes = 0;
+	meshCount = 0;
+	entities = 0;
+	entityCount = 0;
+	positions = 0;
+	rotations = 0;
+	scales = 0;
+}
+
+BundleDefinition CompiledScene::GetBundle(size_t index)
+{
+	const Bundle& b = bundles[index];
+	BundleDefinition bundle;
+	bundle.Name = GetString(b.Name);
+	bundle.Location = GetString(b.Location);
+	bundle.Packed = b.Packed != 0;
+	bundle.Albedo = GetString(b.Albedo);
+	bundle.Normal = GetString(b.Normal);
+	bundle.Roughness = GetString(b.Roughness);
+	bundle.Metal = GetString(b.Metal);
+	bundle.AO = GetString(b.AO);
+	return bundle;
+}
+
+MaterialDefinition CompiledScene::GetMaterial(size_t index)
+{
+	const Material& m = materials[index];
+	MaterialDefinition material;
+	material.Name = GetString(m.Name);
+	material.VertexShader = GetString(m.VertexShader);
+	material.PixelShader = GetString(m.PixelShader);
+	std::copy(std::begin(m.Color), std::end(m.Color), material.Color.begin());
+	material.Shininess = m.Shininess;
+	std::copy(std::begin(m.UVScale), std::end(m.UVScale), material.UVScale.begin());
+	if (m.Bundle >= 0)
+		material.Textures = GetString(bundles[m.Bundle].Name);
+	material.InlineAlbedo = GetString(m.Albedo);
+	material.InlineNormal = GetString(m.Normal);
+	material.InlineRoughness = GetString(m.Roughness);
+	material.InlineMetal = GetString(m.Metal);
+	return material;
+}
+
+bool CompiledScene::Compile(const SceneSource& source, const std::filesystem::path& output)
+{
+	int problems = 0;
+
+	// Names to indices, for everything that can be referred to
+	auto index = [&](const char* kind, const auto& definitions)
+		{
+			std::unordered_map<std::string, uint32_t> indices;
+			for (size_t i = 0; i < definitions.size(); i++)
+			{
+				const std::string& name = definitions[i].Name;
+				if (name.empty())
+				{
+					printf("Found a %s with no name\n", kind);
+					problems++;
+				}
+				else if (!indices.insert({ name, (uint32_t)i }).second)
+				{
+					printf("More than one %s is named %s\n", kind, name.c_str());
+					problems++;
+				}
+			}
+			return indices;
+		};
+	std::unordered_map<std::string, uint32_t> bundleIndices = index("bundle", source.Bundles);
+	std::unordered_map<std::string, uint32_t> materialIndices = index("material", source.Materials);
+	std::unordered_map<std::string, uint32_t> entityIndices = index("entity", source.Entities);
+	std::unordered_set<std::string> meshNames(source.Meshes.begin(), source.Meshes.end());
+
+	for (auto& material : source.Materials)
+	{
+		if (!material.Textures.empty() && !bundleIndices.contains(material.Textures))
+		{
+			printf("Material %s uses bundle %s, which doesn't exist\n", material.Name.c_str(), material.Textures.c_str());
+			problems++;
+		}
+	}
+
+	// Parents --------------------------------------------------
+	size_t count = source.Entities.size();
+	std::vector<int32_t> parents(count, -1);
+	for (size_t i = 0; i < count; i++)
+	{
+		const EntityDefinition& entity = source.Entities[i];
+		if (!meshNames.contains(entity.Mesh))
+		{
+			printf("Entity %s uses mesh %s, which doesn't exist\n", entity.Name.c_str(), entity.Mesh.c_str());
+			problems++;
+		}
+		if (!materialIndices.contains(entity.Material))
+		{
+			printf("Entity %s uses material %s, which doesn't exist\n", entity.Name.c_str(), entity.Material.c_str());
+			problems++;
+		}
+
+		if (entity.Parent.empty())
+			continue;
+		auto parent = entityIndices.find(entity.Parent);
+		if (parent == entityIndices.end())
+			printf("Entity %s has parent %s, which doesn't exist (ignored)\n", entity.Name.c_str(), entity.Parent.c_str());
+		else
+			parents[i] = (int32_t)parent->second;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const EntityDefinition& entity = source.Entities[i];
+		for (auto& childName : entity.Children)
+		{
+			auto child = entityIndices.find(childName);
+			if (child == entityIndices.end())
+				printf("Entity %s has child %s, which doesn't exist (ignored)\n", entity.Name.c_str(), childName.c_str());
+			else if (parents[child->second] == -1)
+				parents[child->second] = (int32_t)i;
+			else if (parents[child->second] != (int32_t)i)
+			{
+				const std::string& kept = source.Entities[parents[child->second]].Name;
+				printf("Entity %s is a child of both %s and %s (keeping %s)\n", childName.c_str(), kept.c_str(), entity.Name.c_str(), kept.c_str());
+			}
+		}
+	}
+
+	// Parents first, each followed by its descendants, and
+	// otherwise in the order they were given
+	std::vector<std::vector<uint32_t>> children(count);
+	for (size_t i = 0; i < count; i++)
+		if (parents[i] != -1)
+			children[parents[i]].push_back((uint32_t)i);
+
+	std::vector<uint32_t> order;
+	std::vector<int32_t> newIndices(count, -1);
+	std::vector<uint32_t> stack;
+	order.reserve(count);
+	for (size_t root = 0; root < count; root++)
+	{
+		if (parents[root] != -1)
+			continue;
+
+		stack.push_back((uint32_t)root);
+		while (!stack.empty())
+		{
+			uint32_t entity = stack.back();
+			stack.pop_back();
+			newIndices[entity] = (int32_t)order.size();
+			order.push_back(entity);
+			stack.insert(stack.end(), children[entity].rbegin(), children[entity].rend());
+		}
+	}
+
+	// Whatever wasn't reached hangs off a cycle
+	for (size_t i = 0; i < count; i++)
+	{
+		if (newIndices[i] == -1)
+		{
+			printf("Entity %s is its own ancestor\n", source.Entities[i].Name.c_str());
+			problems++;
+		}
+	}
+
+	if (problems > 0)
+	{
+		printf("Couldn't compile the scene (%d problems)\n", problems);
+		return false;
+	}
+
+	// Writing ------------------------------------------------
+	std::vector<char> strings(1, 0);	// "" is always at 0
+	std::unordered_map<std::string, uint32_t> stringOffsets = { { "", 0 } };
+	auto addString = [&](const std::string& s)
+		{
+			auto found = stringOffsets.find(s);
+			if (found != stringOffsets.end())
+				return found->second;
+
+			uint32_t offset = (uint32_t)strings.size();
+			strings.insert(strings.end(), s.begin(), s.end());
+			strings.push_back(0);
+			stringOffsets[s] = offset;
+			return offset;
+		};
+
+	std::vector<Bundle> bundles;
+	for (auto& b : source.Bundles)
+		bundles.push_back({ addString(b.Name), addString(b.Location), addString(b.Albedo), addString(b.Normal),
+			addString(b.Roughness), addString(b.Metal), addString(b.AO), b.Packed ? 1u : 0u });
+
+	std::vector<Material> materials;
+	for (auto& m : source.Materials)
+	{
+		Material material = {};
+		material.Name = addString(m.Name);
+		material.VertexShader = addString(m.VertexShader);
+		material.PixelShader = addString(m.PixelShader);
+		material.Bundle = m.Textures.empty() ? -1 : (int32_t)bundleIndices[m.Textures];
+		material.Albedo = addString(m.InlineAlbedo);
+		material.Normal = addString(m.InlineNormal);
+		material.Roughness = addString(m.InlineRoughness);
+		material.Metal = addString(m.InlineMetal);
+		std::copy(m.Color.begin(), m.Color.end(), material.Color);
+		material.Shininess = m.Shininess;
+		std::copy(m.UVScale.begin(), m.UVScale.end(), material.UVScale);
+		materials.push_back(material);
+	}
+
+	// Only the meshes that are used
+	std::vector<uint32_t> meshes;
+	std::unordered_map<std::string, uint32_t> meshIndices;
+	std::vector<SceneEntity> entities;
+	std::vector<float> transforms(count * 9);
+	entities.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const EntityDefinition& e = source.Entities[order[i]];
+		auto mesh = meshIndices.insert({ e.Mesh, (uint32_t)meshes.size() });
+		if (mesh.second)
+			meshes.push_back(addString(e.Mesh));
+
+		int32_t parent = parents[order[i]];
+		entities.push_back({ addString(e.Name), mesh.first->second, materialIndices[e.Material], parent == -1 ? -1 : newIndices[parent] });
+		std::copy(e.Position.begin(), e.Position.end(), &transforms[i * 3]);
+		std::copy(e.Rotation.begin(), e.Rotation.end(), &transforms[(count + i) * 3]);
+		std::copy(e.Scale.begin(), e.Scale.end(), &transforms[(count * 2 + i) * 3]);
+	}
+
+	// Sections go one after another, each on an 8 byte boundary
+	std::vector<uint8_t> blob(sizeof(SceneHeader));
+	auto append = [&](const void* data, size_t size)
+		{
+			blob.resize((blob.size() + 7) & ~(size_t)7);
+			uint64_t offset = blob.size();
+			blob.insert(blob.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+			return offset;
+		};
+
+	SceneHeader header = {};
+	header.Magic = SceneMagic;
+	header.Version = Version;
+	header.StringsSize = strings.size();
+	header.StringsOffset = append(strings.data(), strings.size());
+	header.BundleCount = bundles.size();
+	header.BundlesOffset = append(bundles.data(), bundles.size() * sizeof(Bundle));
+	header.MaterialCount = materials.size();
+	header.MaterialsOffset = append(materials.data(), materials.size() * sizeof(Material));
+	header.MeshCount = meshes.size();
+	header.MeshesOffset = append(meshes.data(), meshes.size() * sizeof(uint32_t));
+	header.EntityCount = entities.size();
+	header.EntitiesOffset = append(entities.data(), entities.size() * sizeof(SceneEntity));
+	header.TransformsOffset = append(transforms.data(), transforms.size() * sizeof(float));
+	memcpy(blob.data(), &header, sizeof(header));
+
+	std::ofstream stream(output, std::ios::binary | std::ios::trunc);
+	return stream && stream.write((const char*)blob.data(), blob.size());
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "AssetDefinitions.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Everything a scene is compiled from.  Every definition needs
+// its name filled in (from its file name, if it had no "name").
+struct SceneSource
+{
+	std::vector<BundleDefinition> Bundles;
+	std::vector<MaterialDefinition> Materials;
+	std::vector<EntityDefinition> Entities;
+	std::vector<std::string> Meshes;	// Every mesh there is, by name
+};
+
+// One entity, with everything it refers to as an index
+struct SceneEntity
+{
+	uint32_t Name;		// Into the strings (see GetString())
+	uint32_t Mesh;		// Into the mesh names
+	uint32_t Material;	// Into the materials
+	int32_t Parent;		// An earlier entity, or -1
+};
+
+// --------------------------------------------------------
+// Every bundle, material and entity definition compiled into
+// one file, which loads with a single map and no parsing.
+//
+// Layout:
+//  - a header
+//  - every string, each ending in a zero
+//  - the bundles and materials (a handful, kept close to
+//    their definitions), with materials pointing at their
+//    bundle by index
+//  - the names of the meshes entities use
+//  - the entities, each pointing at its mesh, material and
+//    parent by index, sorted so parents come before their
+//    children (and each one's descendants follow it)
+//  - positions, rotations and scales, as three packed arrays
+//    of (x, y, z), one per entity in the same order
+//
+// Every reference is checked when it's compiled, and every
+// index again when it's opened, so a loader can use them as
+// they are.
+// --------------------------------------------------------
+class CompiledScene
+{
+public:
+	static const uint32_t Version = 1;
+
+	CompiledScene() = default;
+	CompiledScene(const CompiledScene&) = delete;
+	CompiledScene& operator=(const CompiledScene&) = delete;
+
+	// Maps the scene in.  False if it's missing, not a compiled
+	// scene, or refers to anything it doesn't have.
+	bool Open(const std::filesystem::path& path);
+	void Close();
+	bool IsOpen() { return base != 0; }
+
+	size_t GetBundleCount() { return bundleCount; }
+	size_t GetMaterialCount() { return materialCount; }
+	size_t GetMeshCount() { return meshCount; }
+	size_t GetEntityCount() { return entityCount; }
+
+	// Bundles and materials are read back into their definitions.
+	// A material's Textures names its bundle, if it has one.
+	BundleDefinition GetBundle(size_t index);
+	MaterialDefinition GetMaterial(size_t index);
+	std::string_view GetMeshName(size_t index) { return GetString(meshes[index]); }
+
+	const SceneEntity& GetEntity(size_t index) { return entities[index]; }
+	const float* GetPositions() { return positions; }	// (x, y, z) per entity
+	const float* GetRotations() { return rotations; }	// Pitch, yaw and roll
+	const float* GetScales() { return scales; }
+
+	std::string_view GetString(uint32_t offset) { return std::string_view(strings + offset); }
+
+	// --------------------------------------------------------
+	// Resolves every reference in source and writes the scene
+	// to output.  Parents come from an entity's "parent" or
+	// another's "children", whichever order the definitions
+	// are in.  If an entity is given more than one, its own
+	// "parent" wins, then the first entity listing it.
+	//
+	// Prints every problem (a missing mesh, material or bundle,
+	// a name used twice, or a cycle) and returns false if there
+	// were any, or if the file couldn't be written.  Parents and
+	// children that don't exist are ignored, as they are when
+	// the definitions are loaded, but listed too.
+	// --------------------------------------------------------
+	static bool Compile(const SceneSource& source, const std::filesystem::path& output);
+
+private:
+	struct Bundle;
+	struct Material;
+
+	MappedFile file;
+	const uint8_t* base = 0;
+	const char* strings = 0;
+	const Bundle* bundles = 0;
+	size_t bundleCount = 0;
+	const Material* materials = 0;
+	size_t materialCount = 0;
+	const uint32_t* meshes = 0;
+	size_t meshCount = 0;
+	const SceneEntity* entities = 0;
+	size_t entityCount = 0;
+	const float* positions = 0;
+	const float* rotations = 0;
+	const float* scales = 0;
+};
@@ -1,5 +1,6 @@
 #include "DXCore.h"
 #include "Input.h"
+#include "Profiler.h"
 
 #include "imgui/imgui.h"
 
@@ -162,6 +163,8 @@ HRESULT DXCore::InitWindow()
 // --------------------------------------------------------
 HRESULT DXCore::InitDirectX()
 {
+	ProfileScope profile("DirectX init");
+
 	// This will hold options for DirectX initialization
 	unsigned int deviceFlags = 0;
 
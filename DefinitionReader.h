@@ -0,0 +1,342 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Where a field's value goes in a definition
+template <typename T>
+using DefinitionMember = std::variant<
+	std::string T::*,
+	float T::*,
+	bool T::*,
+	std::array<float, 2> T::*,
+	std::array<float, 3> T::*,
+	std::array<float, 4> T::*,
+	std::vector<std::string> T::*>;
+
+// One row of a definition's schema: the JSON field, and the member it's read into
+template <typename T>
+struct DefinitionField
+{
+	const char* Path; // Nested keys joined with '.', like "shader.pixel"
+	DefinitionMember<T> Member;
+	bool Required;
+};
+
+// --------------------------------------------------------
+// Reads definition files straight into typed structs, in
+// one pass over the JSON with no tree built along the way.
+// T lists what to read in its Fields table:
+//
+//   const std::vector<DefinitionField<Foo>> Foo::Fields = {
+//       { "name", &Foo::Name, true },
+//       { "shader.pixel", &Foo::PixelShader, true },
+//   };
+//
+// Fields that aren't in the table are skipped, fields that
+// are missing keep T's defaults, and null counts as missing.
+// Numbers are read as floats.
+// --------------------------------------------------------
+template <typename T>
+class DefinitionReader
+{
+public:
+	// A file holding one definition (its root object).  False (with
+	// the reason in error) if it isn't valid JSON or doesn't fit T.
+	static bool Read(const uint8_t* data, size_t size, T& definition, std::string& error)
+	{
+		Handler handler(0, 0);
+		bool parsed = nlohmann::json::sax_parse(data, data + size, &handler);
+		error = handler.FirstError;
+		if (!parsed || handler.Read != 1)
+		{
+			if (error.empty())
+				error = "no definition";
+			return false;
+		}
+
+		definition = std::move(handler.Definition);
+		return true;
+	}
+
+	// --------------------------------------------------------
+	// A file holding a list of definitions, in an array under
+	// listKey in its root object, like {"entities": [...]}.
+	// Each is handed to onDefinition as soon as it's read, and
+	// its struct is then reused, so however long the list is,
+	// only one definition is held at a time.  Reading from a
+	// stream keeps the file itself out of memory too.
+	//
+	// Definitions that don't fit T are skipped.  Returns false
+	// if any were, or if the JSON is broken (after handing out
+	// whatever came before), with the first problem in error.
+	// --------------------------------------------------------
+	static bool ReadEach(const uint8_t* data, size_t size, const char* listKey, const std::function<void(T&)>& onDefinition, std::string& error)
+	{
+		Handler handler(listKey, &onDefinition);
+		bool parsed = nlohmann::json::sax_parse(data, data + size, &handler);
+		error = handler.FirstError;
+		return parsed && error.empty();
+	}
+
+	static bool ReadEach(std::istream& stream, const char* listKey, const std::function<void(T&)>& onDefinition, std::string& error)
+	{
+		Handler handler(listKey, &onDefinition);
+		bool parsed = nlohmann::json::sax_parse(stream, &handler);
+		error = handler.FirstError;
+		return parsed && error.empty();
+	}
+
+private:
+	using json = nlohmann::json;
+
+	// Follows the nesting as events come in, and writes each
+	// value into whichever field its path matches
+	struct Handler
+	{
+		const char* ListKey;	// Null for a single definition
+		const std::function<void(T&)>* OnDefinition;
+
+		T Definition;
+		size_t Read = 0;
+		bool Invalid = false;
+		std::string FirstError;
+
+		int Depth = 0;				// Of every object and array
+		int DefinitionDepth;		// Where definition objects start
+		bool InList = false;		// Under ListKey, at the root
+		bool InDefinition = false;
+
+		// Within a definition, the path to the current key, and
+		// how long it was when each object it's in was entered
+		std::string Path;
+		std::vector<size_t> PathLengths;
+		std::vector<bool> InArray;	// For each object and array
+
+		// The array field being filled in (if it's in the schema)
+		const DefinitionField<T>* ArrayField = 0;
+		size_t ArrayLevel = 0;
+		size_t ArrayCount = 0;
+
+		uint64_t Found = 0;	// A bit per field in T::Fields (so 64 at most)
+
+		Handler(const char* listKey, const std::function<void(T&)>* onDefinition)
+			: ListKey(listKey), OnDefinition(onDefinition), DefinitionDepth(listKey ? 3 : 1)
+		{
+		}
+
+		void Fail(const std::string& message)
+		{
+			if (Invalid)
+				return;
+			Invalid = true;
+			if (FirstError.empty())
+				FirstError = ListKey ? "definition " + std::to_string(Read) + ": " + message : message;
+		}
+
+		const DefinitionField<T>* FindField()
+		{
+			for (auto& field : T::Fields)
+				if (Path == field.Path)
+					return &field;
+			return 0;
+		}
+
+		// Values directly in an object go to the field for their path,
+		// and values in an array to the array field being filled in
+		template <typename Value>
+		bool Set(const Value& value)
+		{
+			if (!InDefinition)
+				return true;
+
+			if (InArray.back())
+			{
+				if (ArrayField && InArray.size() == ArrayLevel)
+					std::visit([&](auto member) { SetElement(member, value); }, ArrayField->Member);
+				return true;
+			}
+
+			const DefinitionField<T>* field = FindField();
+			if (!field)
+				return true;
+
+			std::visit([&](auto member) { SetValue(member, value); }, field->Member);
+			Found |= 1ull << (field - T::Fields.data());
+			return true;
+		}
+
+		template <typename Member, typename Value>
+		void SetValue(Member member, const Value& value)
+		{
+			using Field = std::remove_reference_t<decltype(Definition.*member)>;
+			if constexpr (std::is_same_v<Field, std::string> && std::is_same_v<Value, std::string>)
+				Definition.*member = value;
+			else if constexpr (std::is_same_v<Field, float> && std::is_same_v<Value, float>)
+				Definition.*member = value;
+			else if constexpr (std::is_same_v<Field, bool> && std::is_same_v<Value, bool>)
+				Definition.*member = value;
+			else
+				Fail("\"" + Path + "\" is the wrong type");
+		}
+
+		template <typename Member, typename Value>
+		void SetElement(Member member, const Value& value)
+		{
+			using Field = std::remove_reference_t<decltype(Definition.*member)>;
+			if constexpr (std::is_same_v<Field, std::vector<std::string>> && std::is_same_v<Value, std::string>)
+				(Definition.*member).push_back(value);
+			else if constexpr (std::is_same_v<Field, std::array<float, 2>> || std::is_same_v<Field, std::array<float, 3>> || std::is_same_v<Field, std::array<float, 4>>)
+			{
+				if constexpr (std::is_same_v<Value, float>)
+				{
+					if (ArrayCount < (Definition.*member).size())
+						(Definition.*member)[ArrayCount] = value;
+				}
+				else
+					Fail("\"" + Path + "\" should only hold numbers");
+			}
+			else
+				Fail("\"" + Path + "\" is the wrong type");
+			ArrayCount++;
+		}
+
+		bool null() { return true; }
+		bool boolean(bool value) { return Set(value); }
+		bool number_integer(json::number_integer_t value) { return Set((float)value); }
+		bool number_unsigned(json::number_unsigned_t value) { return Set((float)value); }
+		bool number_float(json::number_float_t value, const json::string_t&) { return Set((float)value); }
+		bool string(json::string_t& value) { return Set(value); }
+		bool binary(json::binary_t&) { return true; }
+
+		bool key(json::string_t& key)
+		{
+			if (Depth == 1)
+				InList = ListKey && key == ListKey;
+			if (!InDefinition)
+				return true;
+
+			Path.resize(PathLengths.back());
+			if (!Path.empty())
+				Path += '.';
+			Path += key;
+			return true;
+		}
+
+		bool start_object(std::size_t)
+		{
+			Depth++;
+			if (!InDefinition && Depth == DefinitionDepth && (!ListKey || InList))
+			{
+				Definition = T();
+				InDefinition = true;
+				Invalid = false;
+				Found = 0;
+				Path.clear();
+				PathLengths.assign(1, 0);
+				InArray.assign(1, false);
+				return true;
+			}
+
+			if (InDefinition)
+			{
+				PathLengths.push_back(Path.size());
+				InArray.push_back(false);
+			}
+			return true;
+		}
+
+		bool end_object()
+		{
+			if (InDefinition && Depth == DefinitionDepth)
+				EndDefinition();
+			else if (InDefinition)
+			{
+				Path.resize(PathLengths.back());
+				PathLengths.pop_back();
+				InArray.pop_back();
+			}
+			Depth--;
+			return true;
+		}
+
+		bool start_array(std::size_t)
+		{
+			Depth++;
+			if (!InDefinition)
+				return true;
+
+			// Only an array straight under a key can be a field
+			const DefinitionField<T>* field = InArray.back() ? 0 : FindField();
+			InArray.push_back(true);
+			if (!field)
+				return true;
+
+			std::visit([&](auto member)
+				{
+					using Field = std::remove_reference_t<decltype(Definition.*member)>;
+					if constexpr (std::is_same_v<Field, std::vector<std::string>>)
+						(Definition.*member).clear();
+					else if constexpr (!std::is_same_v<Field, std::array<float, 2>> && !std::is_same_v<Field, std::array<float, 3>> && !std::is_same_v<Field, std::array<float, 4>>)
+						Fail("\"" + Path + "\" shouldn't be a list");
+				}, field->Member);
+			ArrayField = field;
+			ArrayLevel = InArray.size();
+			ArrayCount = 0;
+			Found |= 1ull << (field - T::Fields.data());
+			return true;
+		}
+
+		bool end_array()
+		{
+			if (InDefinition)
+			{
+				if (ArrayField && InArray.size() == ArrayLevel)
+				{
+					std::visit([&](auto member)
+						{
+							using Field = std::remove_reference_t<decltype(Definition.*member)>;
+							if constexpr (!std::is_same_v<Field, std::vector<std::string>> && !std::is_same_v<Field, std::string> && !std::is_same_v<Field, float> && !std::is_same_v<Field, bool>)
+								if (ArrayCount != std::tuple_size_v<Field>)
+									Fail("\"" + Path + "\" needs " + std::to_string(std::tuple_size_v<Field>) + " numbers");
+						}, ArrayField->Member);
+					ArrayField = 0;
+				}
+				InArray.pop_back();
+			}
+			Depth--;
+			return true;
+		}
+
+		bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& exception)
+		{
+			if (FirstError.empty())
+				FirstError = exception.what();
+			return false;
+		}
+
+		void EndDefinition()
+		{
+			for (size_t i = 0; i < T::Fields.size(); i++)
+				if (T::Fields[i].Required && !(Found & (1ull << i)))
+					Fail(std::string("missing \"") + T::Fields[i].Path + "\"");
+
+			InDefinition = false;
+			if (!Invalid)
+			{
+				Read++;
+				if (OnDefinition)
+					(*OnDefinition)(Definition);
+			}
+			else if (ListKey)
+				Read++; // Counted, so errors say which one it was
+		}
+	};
+};
@@ -0,0 +1,176 @@
+#include "DerivedDataCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+static const uint32_t EntryMagic = 0x31434444; // "DDC1"
+
+// At the start of every entry
+struct EntryHeader
+{
+	uint32_t Magic;
+	uint32_t Padding;
+	uint64_t Key;
+	uint64_t Size;
+	double BuildMilliseconds;
+};
+
+DerivedDataCache::DerivedDataCache()
+	: sizeLimit(DefaultSizeLimit), hits(0), misses(0), stores(0), microsecondsSaved(0), temporaryCount(0)
+{
+}
+
+void DerivedDataCache::HashBytes(uint64_t& hash, const void* data, size_t size)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+std::filesystem::path DerivedDataCache::GetFile(const char* type, uint64_t key)
+{
+	char fileName[64] = {};
+	snprintf(fileName, sizeof(fileName), "%016llx.%s", (unsigned long long)key, type);
+	return directory / fileName;
+}
+
+bool DerivedDataCache::Load(const char* type, uint64_t key, std::vector<uint8_t>& data)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::filesystem::path file = GetFile(type, key);
+
+	// Anything that doesn't match exactly (like a file from
+	// before this format, or a cut off write) is a miss
+	EntryHeader header = {};
+	std::ifstream in(file, std::ios::binary | std::ios::ate);
+	uint64_t fileSize = in ? (uint64_t)in.tellg() : 0;
+	in.seekg(0);
+	bool valid =
+		fileSize >= sizeof(header) &&
+		in.read((char*)&header, sizeof(header)) &&
+		header.Magic == EntryMagic &&
+		header.Key == key &&
+		header.Size == fileSize - sizeof(header);
+	if (valid)
+	{
+		data.resize((size_t)header.Size);
+		valid = (bool)in.read((char*)data.data(), data.size());
+	}
+	in.close();
+
+	if (!valid)
+	{
+		misses++;
+		return false;
+	}
+
+	// Used just now, so it's the last thing Trim() deletes
+	std::error_code error;
+	std::filesystem::last_write_time(file, std::filesystem::file_time_type::clock::now(), error);
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	microsecondsSaved += (int64_t)((header.BuildMilliseconds - milliseconds) * 1000.0);
+	hits++;
+	return true;
+}
+
+bool DerivedDataCache::Store(const char* type, uint64_t key, const std::vector<uint8_t>& data, double buildMilliseconds)
+{
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	std::filesystem::path file = GetFile(type, key);
+	std::filesystem::path temporary = file;
+	temporary += "." + std::to_string(temporaryCount++) + ".tmp";
+
+	EntryHeader header = {};
+	header.Magic = EntryMagic;
+	header.Key = key;
+	header.Size = data.size();
+	header.BuildMilliseconds = buildMilliseconds;
+
+	std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)data.data(), data.size());
+	out.close();
+
+	if (!out.good())
+	{
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+
+	// Replaces any older copy in one step
+	std::filesystem::rename(temporary, file, error);
+	if (error)
+	{
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+
+	stores++;
+	return true;
+}
+
+void DerivedDataCache::Trim()
+{
+	struct CachedFile
+	{
+		std::filesystem::path Path;
+		uint64_t Size;
+		std::filesystem::file_time_type LastUsed;
+	};
+
+	std::vector<CachedFile> files;
+	uint64_t total = 0;
+	std::error_code error;
+	for (auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (!entry.is_regular_file())
+			continue;
+
+		files.push_back({ entry.path(), entry.file_size(), entry.last_write_time() });
+		total += files.back().Size;
+	}
+	if (total <= sizeLimit)
+		return;
+
+	std::sort(files.begin(), files.end(), [](const CachedFile& a, const CachedFile& b) { return a.LastUsed < b.LastUsed; });
+
+	int removed = 0;
+	uint64_t removedBytes = 0;
+	for (size_t i = 0; i < files.size() && total > sizeLimit; i++)
+	{
+		if (!std::filesystem::remove(files[i].Path, error))
+			continue;
+
+		total -= files[i].Size;
+		removed++;
+		removedBytes += files[i].Size;
+	}
+
+	printf("Trimmed %d entries (%.1f MB) from the derived data cache\n", removed, removedBytes / (1024.0 * 1024.0));
+}
+
+void DerivedDataCache::PrintStats()
+{
+	printf("Derived data cache: %d hits, %d misses, %d stored, hits saved %.1f ms\n",
+		hits.load(),
+		misses.load(),
+		stores.load(),
+		microsecondsSaved.load() / 1000.0);
+}
+
+void DerivedDataCache::ResetStats()
+{
+	hits = 0;
+	misses = 0;
+	stores = 0;
+	microsecondsSaved = 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+// Builds up an entry's bytes out of plain values and arrays
+struct DerivedDataWriter
+{
+	std::vector<uint8_t> Data;
+
+	void Write(const void* data, size_t size)
+	{
+		Data.insert(Data.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+	}
+
+	template <typename T>
+	void Write(const T& value) { Write(&value, sizeof(T)); }
+};
+
+// Reads them back.  Every read fails (rather than running off
+// the end) once the data runs out, so a bad entry is a miss.
+struct DerivedDataReader
+{
+	const uint8_t* Data;
+	size_t Size;
+	size_t Offset = 0;
+
+	bool Read(void* data, size_t size)
+	{
+		if (size > Size - Offset)
+			return false;
+		memcpy(data, Data + Offset, size);
+		Offset += size;
+		return true;
+	}
+
+	template <typename T>
+	bool Read(T& value) { return Read(&value, sizeof(T)); }
+
+	bool IsFinished() { return Offset == Size; }
+};
+
+// --------------------------------------------------------
+// Everything built from a source asset (compressed textures,
+// parsed meshes, IBL maps) is kept here between runs, keyed
+// by a hash of the source bytes, the importer's version and
+// its settings.  Changing any of them changes the key, so
+// entries are never invalidated, just left to age out.
+//
+// Each entry is one file, <key>.<type>, where type names the
+// importer.  Files are written to a temporary name and then
+// renamed, so other threads (or a crash) never see half of
+// one.  Reading an entry touches it, and Trim() deletes the
+// least recently used entries once the cache is over its size
+// limit.
+//
+// Hits, misses and how much time the hits saved (how long the
+// entry took to build, less how long it took to load) are
+// counted across threads for PrintStats().
+// --------------------------------------------------------
+class DerivedDataCache
+{
+public:
+	static const uint64_t DefaultSizeLimit = 1024ull * 1024 * 1024;
+
+	DerivedDataCache();
+
+	void SetDirectory(const std::filesystem::path& directory) { this->directory = directory; }
+	std::filesystem::path GetDirectory() { return directory; }
+	void SetSizeLimit(uint64_t bytes) { sizeLimit = bytes; }
+
+	// FNV-1a, to build keys from (start hash at FNVOffset)
+	static const uint64_t FNVOffset = 14695981039346656037ull;
+	static void HashBytes(uint64_t& hash, const void* data, size_t size);
+
+	// Both are safe on any thread.  Load fails if there's no entry for
+	// the key (or it's damaged), and counts as a miss.  Store is given
+	// how long the data took to build, which a later hit has saved.
+	bool Load(const char* type, uint64_t key, std::vector<uint8_t>& data);
+	bool Store(const char* type, uint64_t key, const std::vector<uint8_t>& data, double buildMilliseconds);
+
+	// Deletes the least recently used entries until the cache fits.
+	// Not while anything else is using the cache.
+	void Trim();
+
+	void PrintStats();
+	void ResetStats();
+
+private:
+	std::filesystem::path directory;
+	uint64_t sizeLimit;
+
+	std::atomic<int> hits;
+	std::atomic<int> misses;
+	std::atomic<int> stores;
+	std::atomic<int64_t> microsecondsSaved;
+	std::atomic<unsigned int> temporaryCount;
+
+	std::filesystem::path GetFile(const char* type, uint64_t key);
+};
@@ -0,0 +1,182 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+DynamicResolution::DynamicResolution() : DynamicResolution(GetDefaultSettings())
+{
+}
+
+DynamicResolution::DynamicResolution(const DynamicResolutionSettings& settings) :
+	enabled(true),
+	desiredScale(0),
+	scale(0),
+	recording(false)
+{
+	SetSettings(settings);
+	Reset();
+}
+
+DynamicResolutionSettings DynamicResolution::GetDefaultSettings()
+{
+	DynamicResolutionSettings s = {};
+	s.TargetFrameTime = 1.0f / 60.0f;
+	s.MinScale = 0.5f;
+	s.MaxScale = 1.0f;
+	s.ScaleStep = 0.05f;
+	s.Smoothing = 0.1f;
+	s.ProportionalGain = 0.1f;
+	s.IntegralGain = 0.02f;
+	s.DerivativeGain = 0.05f;
+	return s;
+}
+
+void DynamicResolution::Reset()
+{
+	desiredScale = settings.MaxScale;
+	scale = settings.MaxScale;
+	smoothedFrameTime = settings.TargetFrameTime;
+	previousError = 0.0f;
+	previousPreviousError = 0.0f;
+	framesSeen = 0;
+}
+
+void DynamicResolution::SetEnabled(bool enabled)
+{
+	// Start over so old history doesn't leak into the new run
+	if (enabled && !this->enabled)
+		Reset();
+
+	this->enabled = enabled;
+}
+
+void DynamicResolution::SetSettings(const DynamicResolutionSettings& settings)
+{
+	// Past 1, the scene targets would outgrow the depth buffer
+	this->settings = settings;
+	this->settings.MaxScale = std::min(settings.MaxScale, 1.0f);
+	this->settings.MinScale = std::min(settings.MinScale, this->settings.MaxScale);
+	desiredScale = std::clamp(desiredScale, this->settings.MinScale, this->settings.MaxScale);
+	scale = std::clamp(scale, this->settings.MinScale, this->settings.MaxScale);
+}
+
+void DynamicResolution::SetRecording(bool recording)
+{
+	// Each recording is a trace of its own
+	if (recording && !this->recording)
+		recordedFrameTimes.clear();
+
+	this->recording = recording;
+}
+
+float DynamicResolution::Update(float frameTime)
+{
+	if (recording)
+		recordedFrameTimes.push_back(frameTime);
+
+	if (!enabled)
+		return GetScale();
+
+	// Ignore garbage (first frame, debugger breaks, etc.)
+	if (!(frameTime > 0.0f) || frameTime > 1.0f)
+		return scale;
+
+	// Exponential moving average, seeded with the first real frame
+	if (framesSeen == 0)
+		smoothedFrameTime = frameTime;
+	else
+		smoothedFrameTime += (frameTime - smoothedFrameTime) * settings.Smoothing;
+	framesSeen++;
+
+	// Positive error means we have time to spare
+	float error = (settings.TargetFrameTime - smoothedFrameTime) / settings.TargetFrameTime;
+
+	// Velocity form PID
+	float change =
+		settings.ProportionalGain * (error - previousError) +
+		settings.IntegralGain * error +
+		settings.DerivativeGain * (error - 2.0f * previousError + previousPreviousError);
+
+	previousPreviousError = previousError;
+	previousError = error;
+
+	desiredScale = std::clamp(desiredScale + change, settings.MinScale, settings.MaxScale);
+
+	// Only move the real scale in whole steps, and only once the
+	// controller is most of a step away, so it doesn't flicker
+	// between two neighboring scales
+	if (settings.ScaleStep > 0.0f)
+	{
+		if (std::fabs(desiredScale - scale) > settings.ScaleStep * 0.75f)
+		{
+			float steps = std::round((desiredScale - settings.MinScale) / settings.ScaleStep);
+			scale = std::clamp(settings.MinScale + steps * settings.ScaleStep, settings.MinScale, settings.MaxScale);
+
+			// The range might not be a whole number of steps
+			if (settings.MaxScale - desiredScale < settings.ScaleStep * 0.5f)
+				scale = settings.MaxScale;
+		}
+	}
+	else
+	{
+		scale = desiredScale;
+	}
+
+	return scale;
+}
+
+std::vector<float> DynamicResolution::Replay(const std::vector<float>& frameTimes)
+{
+	Reset();
+
+	std::vector<float> scales;
+	scales.reserve(frameTimes.size());
+	for (float t : frameTimes)
+		scales.push_back(Update(t));
+
+	return scales;
+}
+
+bool DynamicResolution::LoadTrace(const char* path, std::vector<float>& frameTimes)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	frameTimes.clear();
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+			continue;
+
+		char* end = 0;
+		float milliseconds = strtof(line.c_str() + start, &end);
+		if (end == line.c_str() + start)
+			return false;
+		frameTimes.push_back(milliseconds / 1000.0f);
+	}
+	return true;
+}
+
+bool DynamicResolution::SaveTrace(const char* path, const std::vector<float>& frameTimes)
+{
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	file << "# Frame times in milliseconds, one frame a line\n";
+	file << std::fixed;
+	file.precision(3);
+	for (float t : frameTimes)
+		file << t * 1000.0f << '\n';
+	return file.good();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+// Tuning for the dynamic resolution controller
+struct DynamicResolutionSettings
+{
+	float TargetFrameTime;	// Seconds per frame we're aiming for
+	float MinScale;			// Smallest fraction of the window we'll render at
+	float MaxScale;			// Largest, at most 1 (render targets are allocated at this size)
+	float ScaleStep;		// Scale only changes in increments of this much
+
+	float Smoothing;		// How much of each new frame time goes into the average (0 - 1]
+
+	// PID gains, applied to the frame time error as a
+	// fraction of the target (so they don't depend on it)
+	float ProportionalGain;
+	float IntegralGain;
+	float DerivativeGain;
+};
+
+// --------------------------------------------------------
+// Picks a render scale from measured frame times, using a
+// PID controller in velocity form (each update nudges the
+// scale rather than setting it outright, which keeps the
+// integral term from winding up at the scale limits).
+//
+// There is no clock in here: the output depends only on the
+// frame times fed to Update(), so a recorded trace always
+// produces the same scales.  Traces are text files with one
+// frame time (in milliseconds) a line, and # comments.
+// --------------------------------------------------------
+class DynamicResolution
+{
+public:
+	DynamicResolution();
+	DynamicResolution(const DynamicResolutionSettings& settings);
+
+	static constexpr const char* TracePath = ".\\Traces\\FrameTimes.txt";
+
+	static DynamicResolutionSettings GetDefaultSettings();
+
+	// Frame times are in seconds, as Update() takes them
+	static bool LoadTrace(const char* path, std::vector<float>& frameTimes);
+	static bool SaveTrace(const char* path, const std::vector<float>& frameTimes);
+
+	// Feeds in the last frame's time (in seconds) and returns the scale to use
+	float Update(float frameTime);
+
+	// Runs a whole trace from a fresh start, returning the scale after each frame
+	std::vector<float> Replay(const std::vector<float>& frameTimes);
+
+	// Goes back to full scale and forgets all history
+	void Reset();
+
+	float GetScale() { return enabled ? scale : settings.MaxScale; }
+	float GetSmoothedFrameTime() { return smoothedFrameTime; }
+
+	bool GetEnabled() { return enabled; }
+	void SetEnabled(bool enabled);
+
+	const DynamicResolutionSettings& GetSettings() { return settings; }
+
+	// Scales past 1 are clamped, since every scene pass shares
+	// the window sized depth buffer
+	void SetSettings(const DynamicResolutionSettings& settings);
+
+	// While recording, every frame time given to Update() is kept
+	// (whether or not it's enabled), to be saved as a trace
+	bool GetRecording() { return recording; }
+	void SetRecording(bool recording);
+	const std::vector<float>& GetRecordedFrameTimes() { return recordedFrameTimes; }
+
+private:
+	DynamicResolutionSettings settings;
+	bool enabled;
+
+	// Unquantized output of the controller, and the scale actually used
+	float desiredScale;
+	float scale;
+
+	float smoothedFrameTime;
+	float previousError;
+	float previousPreviousError;
+	int framesSeen;
+
+	bool recording;
+	std::vector<float> recordedFrameTimes;
+};
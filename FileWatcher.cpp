@@ -0,0 +1,256 @@
+#include "FileWatcher.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <memory>
+#else
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::~FileWatcher()
+{
+	Stop();
+}
+
+bool FileWatcher::Start(const std::vector<std::filesystem::path>& folders)
+{
+	Stop();
+
+	this->folders.clear();
+	std::error_code error;
+	for (auto& folder : folders)
+		if (std::filesystem::is_directory(folder, error))
+			this->folders.push_back(folder);
+	if (this->folders.empty())
+		return false;
+
+#ifdef _WIN32
+	stopEvent = CreateEventW(0, TRUE, FALSE, 0);
+	if (!stopEvent)
+		return false;
+#else
+	// Watches are added up front, so nothing written after
+	// this returns is missed
+	inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify < 0 || pipe(stopPipe) != 0)
+	{
+		Stop();
+		return false;
+	}
+	for (auto& folder : this->folders)
+		AddWatches(folder, false);
+#endif
+
+	running = true;
+	thread = std::thread(&FileWatcher::Run, this);
+	return true;
+}
+
+void FileWatcher::Stop()
+{
+	if (thread.joinable())
+	{
+#ifdef _WIN32
+		SetEvent(stopEvent);
+#else
+		char stop = 1;
+		(void)!write(stopPipe[1], &stop, 1);
+#endif
+		thread.join();
+	}
+	running = false;
+
+#ifdef _WIN32
+	if (stopEvent)
+		CloseHandle(stopEvent);
+	stopEvent = 0;
+#else
+	for (int fd : { stopPipe[0], stopPipe[1], inotify })
+		if (fd >= 0)
+			close(fd);
+	stopPipe[0] = stopPipe[1] = inotify = -1;
+	watches.clear();
+#endif
+}
+
+void FileWatcher::AddChange(const std::filesystem::path& file)
+{
+	std::lock_guard<std::mutex> lock(changesMutex);
+	changes[file] = std::chrono::steady_clock::now();
+}
+
+std::vector<std::filesystem::path> FileWatcher::TakeChanges(double quietMilliseconds)
+{
+	std::vector<std::filesystem::path> settled;
+	auto now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(changesMutex);
+	for (auto i = changes.begin(); i != changes.end();)
+	{
+		if (std::chrono::duration<double, std::milli>(now - i->second).count() < quietMilliseconds)
+		{
+			i++;
+			continue;
+		}
+
+		settled.push_back(i->first);
+		i = changes.erase(i);
+	}
+	return settled;
+}
+
+#ifdef _WIN32
+void FileWatcher::Run()
+{
+	struct Watch
+	{
+		std::filesystem::path Folder;
+		HANDLE Directory;
+		OVERLAPPED Overlapped;
+		alignas(DWORD) uint8_t Buffer[64 * 1024];
+	};
+
+	auto listen = [](Watch& watch)
+		{
+			ResetEvent(watch.Overlapped.hEvent);
+			return ReadDirectoryChangesW(
+				watch.Directory,
+				watch.Buffer,
+				sizeof(watch.Buffer),
+				TRUE, // Everything below too
+				FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+				0,
+				&watch.Overlapped,
+				0);
+		};
+
+	std::vector<std::unique_ptr<Watch>> watches;
+	std::vector<HANDLE> events = { stopEvent };
+	for (auto& folder : folders)
+	{
+		HANDLE directory = CreateFileW(
+			folder.c_str(),
+			FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			0,
+			OPEN_EXISTING,
+			FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+			0);
+		if (directory == INVALID_HANDLE_VALUE)
+			continue;
+
+		auto watch = std::make_unique<Watch>();
+		watch->Folder = folder;
+		watch->Directory = directory;
+		watch->Overlapped = {};
+		watch->Overlapped.hEvent = CreateEventW(0, TRUE, FALSE, 0);
+		if (!watch->Overlapped.hEvent || !listen(*watch))
+		{
+			if (watch->Overlapped.hEvent)
+				CloseHandle(watch->Overlapped.hEvent);
+			CloseHandle(directory);
+			continue;
+		}
+
+		events.push_back(watch->Overlapped.hEvent);
+		watches.push_back(std::move(watch));
+	}
+
+	while (true)
+	{
+		DWORD signaled = WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, INFINITE);
+		if (signaled <= WAIT_OBJECT_0 || signaled >= WAIT_OBJECT_0 + events.size())
+			break; // Stopped (or the wait failed)
+
+		// No bytes means the buffer overflowed, and those changes are lost
+		Watch& watch = *watches[signaled - WAIT_OBJECT_0 - 1];
+		DWORD bytes = 0;
+		if (GetOverlappedResult(watch.Directory, &watch.Overlapped, &bytes, FALSE) && bytes > 0)
+		{
+			for (DWORD offset = 0;;)
+			{
+				FILE_NOTIFY_INFORMATION* info = (FILE_NOTIFY_INFORMATION*)(watch.Buffer + offset);
+				if (info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+					AddChange(watch.Folder / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+
+				if (info->NextEntryOffset == 0)
+					break;
+				offset += info->NextEntryOffset;
+			}
+		}
+
+		if (!listen(watch))
+			break;
+	}
+
+	// The reads have to be finished before their buffers go away
+	for (auto& watch : watches)
+	{
+		DWORD bytes = 0;
+		CancelIoEx(watch->Directory, &watch->Overlapped);
+		GetOverlappedResult(watch->Directory, &watch->Overlapped, &bytes, TRUE);
+		CloseHandle(watch->Overlapped.hEvent);
+		CloseHandle(watch->Directory);
+	}
+}
+#else
+void FileWatcher::AddWatches(const std::filesystem::path& folder, bool isNew)
+{
+	int watch = inotify_add_watch(inotify, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (watch < 0)
+		return;
+	watches[watch] = folder;
+
+	std::error_code error;
+	for (auto& entry : std::filesystem::directory_iterator(folder, error))
+	{
+		if (entry.is_directory())
+			AddWatches(entry.path(), isNew);
+		else if (isNew)
+			AddChange(entry.path());
+	}
+}
+
+void FileWatcher::Run()
+{
+	alignas(inotify_event) char buffer[64 * 1024];
+	pollfd waits[2] = { { inotify, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+
+	while (true)
+	{
+		if (poll(waits, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (waits[1].revents)
+			break; // Stopped
+
+		ssize_t bytes;
+		while ((bytes = read(inotify, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* p = buffer; p < buffer + bytes; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+			{
+				inotify_event* event = (inotify_event*)p;
+				if (event->len == 0 || !watches.contains(event->wd))
+					continue;
+
+				// New folders need watching themselves
+				std::filesystem::path file = watches[event->wd] / event->name;
+				if (event->mask & IN_ISDIR)
+				{
+					if (event->mask & (IN_CREATE | IN_MOVED_TO))
+						AddWatches(file, true);
+					continue;
+				}
+				AddChange(file);
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Watches folders (and everything under them) for files
+// being written, created or renamed, on a thread of its own.
+// ReadDirectoryChangesW on Windows, inotify elsewhere.
+//
+// Editors tend to save a file in several writes, so changes
+// are only handed out once the file has been left alone for
+// a little while, and each file is handed out once however
+// many times it changed.
+//
+// Paths come back as the watched folder joined with the path
+// below it, so watching ".\Assets" gives ".\Assets\x\y.png".
+// --------------------------------------------------------
+class FileWatcher
+{
+public:
+	FileWatcher() = default;
+	~FileWatcher();
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// False if none of the folders could be watched
+	bool Start(const std::vector<std::filesystem::path>& folders);
+	void Stop();
+	bool IsRunning() { return running; }
+
+	// Files that changed, then stayed unchanged for quietMilliseconds
+	std::vector<std::filesystem::path> TakeChanges(double quietMilliseconds = 200.0);
+
+	// For changes noticed some other way (and for testing)
+	void AddChange(const std::filesystem::path& file);
+
+private:
+	std::vector<std::filesystem::path> folders;
+	std::thread thread;
+	std::atomic<bool> running = false;
+
+	std::mutex changesMutex;
+	std::map<std::filesystem::path, std::chrono::steady_clock::time_point> changes;
+
+	void Run();
+
+#ifdef _WIN32
+	void* stopEvent = 0;
+#else
+	int stopPipe[2] = { -1, -1 };
+	int inotify = -1;
+	std::map<int, std::filesystem::path> watches; // By watch descriptor
+
+	// inotify only watches one folder, so every folder below gets one
+	// too.  Files already in a new folder may have been written before
+	// it was watched, so those are reported as changes.
+	void AddWatches(const std::filesystem::path& folder, bool isNew);
+#endif
+};
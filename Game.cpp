@@ -6,6 +6,8 @@
 #include "Vertex.h"
 #include "Input.h"
 #include "AssetManager.h"
+#include "PipelineStateCache.h"
+#include "Profiler.h"
 
 #include "WICTextureLoader.h"
 
@@ -48,6 +50,8 @@ Game::Game(HINSTANCE hInstance)
 		true)			   // Show extra stats (fps) in title bar?
 {
 	camera = 0;
+	renderer = 0;
+	lightMesh = 0;
 
 	// Seed random
 	srand((unsigned int)time(0));
@@ -77,10 +81,13 @@ Game::~Game()
 	delete arial;
 	delete spriteBatch;
 	delete renderer;
+	if (lightMesh) lightMesh->RemoveReference();
 
 	// Delete singletons
 	delete& Input::GetInstance();
 	delete& AssetManager::GetInstance();
+	delete& PipelineStateCache::GetInstance();
+	delete& Profiler::GetInstance();
 
 	ImGui_ImplDX11_Shutdown();
 	ImGui_ImplWin32_Shutdown();
@@ -93,18 +100,28 @@ Game::~Game()
 // --------------------------------------------------------
 void Game::Init()
 {
+	ProfileScope profile("Game init");
+
 	// Initialize the input manager with the window's handle
 	Input::GetInstance().Initialize(this->hWnd);
+	PipelineStateCache::GetInstance().Initialize(context);
 	AssetManager::GetInstance().Initialize(GetExePath(), GetExePath_Wide(), device, context);
 
-	// Asset loading and entity creation
-	AssetManager::GetInstance().Load();
+	// Asset loading and entity creation.  Only definitions are waited
+	// on, everything else streams in behind placeholders (see Update).
+	AssetManager::GetInstance().LoadAsync();
 	LoadAssetsAndCreateEntities();
+
+	// Edits to assets and definitions show up without a restart
+	AssetManager::GetInstance().EnableHotReload();
+
+	// Loading binds state directly on the context (sky IBL setup)
+	PipelineStateCache::GetInstance().Invalidate();
 	
 	// Tell the input assembler stage of the pipeline what kind of
 	// geometric primitives (points, lines or triangles) we want to draw.  
 	// Essentially: "What kind of shape should the GPU draw with our data?"
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	PipelineStateCache::GetInstance().SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Set up lights initially
 	lightCount = 64;
@@ -154,16 +171,17 @@ void Game::LoadAssetsAndCreateEntities()
 
 	AssetManager& assets = AssetManager::GetInstance();
 
-	// Create the sky using 6 images
+	// Skies are built from Definitions\skies by the asset manager
 
 
 	// Save assets needed for drawing point lights
 	// (Since these are just copies of the pointers,
 	//  we won't need to directly delete them as 
 	//  the original pointers will be cleaned up)
-	lightMesh = assets.GetMesh("sphere");
-	lightVS = assets.GetVertexShader("VertexShader");
-	lightPS = assets.GetPixelShader("SolidColorPS");
+	lightMesh = assets.GetMesh("sphere"_id);
+	if (lightMesh) lightMesh->AddReference(); // So the budget keeps it
+	lightVS = assets.GetVertexShader("VertexShader"_id);
+	lightPS = assets.GetPixelShader("SolidColorPS"_id);
 }
 
 
@@ -214,6 +232,9 @@ void Game::GenerateLights()
 		lights.push_back(point);
 	}
 
+	// Every light may have changed
+	if (renderer)
+		renderer->MarkAllLightsDirty();
 }
 
 
@@ -309,21 +330,32 @@ void DisplayTransformData(Transform* t) {
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	// Swap in whatever finished loading since last frame
+	AssetManager& assets = AssetManager::GetInstance();
+	if (assets.Update())
+		PipelineStateCache::GetInstance().Invalidate();
+
+	// Startup's over once everything's streamed in
+	if (Profiler::IsRecording() && !assets.IsLoading())
+		Profiler::GetInstance().Finish();
+
 	// Update the camera
 	camera->Update(deltaTime);
 
 	float wave = sinf(totalTime);
 
-	AssetManager& assets = AssetManager::GetInstance();
-	auto entities = AssetManager::GetInstance().GetEntities();
-	
-	entities["cobSpherePBR"]->GetTransform()->Rotate(0, 0.01f, 0);
-	entities["floorSpherePBR"]->GetTransform()->Rotate(0.01f, 0, 0);
-	entities["floorSpherePBR"]->GetTransform()->SetScale(1 + wave / 2, 1 + wave / 2, 1 + wave / 2);
-	entities["paintSpherePBR"]->GetTransform()->Rotate(0, 0, 0.01f);
-	entities["bronzeSpherePBR"]->GetTransform()->Rotate(0, -0.01f, 0);
+	assets.GetEntity("cobSpherePBR"_id)->GetTransform()->Rotate(0, 0.01f, 0);
+	assets.GetEntity("floorSpherePBR"_id)->GetTransform()->Rotate(0.01f, 0, 0);
+	assets.GetEntity("floorSpherePBR"_id)->GetTransform()->SetScale(1 + wave / 2, 1 + wave / 2, 1 + wave / 2);
+	assets.GetEntity("paintSpherePBR"_id)->GetTransform()->Rotate(0, 0, 0.01f);
+	assets.GetEntity("bronzeSpherePBR"_id)->GetTransform()->Rotate(0, -0.01f, 0);
 
-	entities["cobSphere"]->GetTransform()->SetPosition(2 + wave * 2, 2 + wave * 2, 2 + wave * 2);
+	assets.GetEntity("cobSphere"_id)->GetTransform()->SetPosition(2 + wave * 2, 2 + wave * 2, 2 + wave * 2);
+
+	// Once everything's where it'll be drawn from, at the height
+	// the scene's rendered at (dynamic resolution can shrink it)
+	if (assets.StreamTextures(camera, renderer->GetRenderHeight()))
+		PipelineStateCache::GetInstance().Invalidate();
 
 	// Check individual input
 	Input& input = Input::GetInstance();
@@ -364,6 +396,8 @@ void Game::Update(float deltaTime, float totalTime)
 	ImGui::Begin("Config");
 	if (ImGui::CollapsingHeader("Info", ImGuiTreeNodeFlags_DefaultOpen)) {
 		ImGui::Text("FPS: %i", (int)io.Framerate);
+		if (assets.IsLoading())
+			ImGui::Text("Streaming assets: %d jobs left", assets.GetPendingLoadCount());
 		if (ImGui::TreeNode("Window Size")) {
 			ImGui::BulletText("Width: %d", this->width);
 			ImGui::BulletText("Height: %d", this->height);
@@ -371,19 +405,117 @@ void Game::Update(float deltaTime, float totalTime)
 			ImGui::BulletText("Aspect Ratio: %d:%d (%f)", this->width / gcd, this->height / gcd, this->width / (float)this->height);
 			ImGui::TreePop();
 		}
+		if (ImGui::TreeNode("Dynamic Resolution")) {
+			DynamicResolution& dynamicResolution = renderer->GetDynamicResolution();
+			bool enabled = dynamicResolution.GetEnabled();
+			if (ImGui::Checkbox("Enabled##DynamicResolution", &enabled))
+				dynamicResolution.SetEnabled(enabled);
+
+			DynamicResolutionSettings settings = dynamicResolution.GetSettings();
+			float targetFPS = 1.0f / settings.TargetFrameTime;
+			bool changed = ImGui::SliderFloat("Target FPS", &targetFPS, 30.0f, 240.0f, "%.0f");
+			changed = ImGui::SliderFloat("Min Scale", &settings.MinScale, 0.25f, settings.MaxScale) || changed;
+			if (changed) {
+				settings.TargetFrameTime = 1.0f / targetFPS;
+				dynamicResolution.SetSettings(settings);
+			}
+
+			ImGui::BulletText("Scale: %.2f", dynamicResolution.GetScale());
+			ImGui::BulletText("Render Size: %u x %u", renderer->GetRenderWidth(), renderer->GetRenderHeight());
+			ImGui::BulletText("Smoothed Frame Time: %.2f ms", dynamicResolution.GetSmoothedFrameTime() * 1000.0f);
+
+			// Saved when recording stops, for -test-dynamic-resolution
+			bool recording = dynamicResolution.GetRecording();
+			if (ImGui::Checkbox("Record Frame Times", &recording)) {
+				dynamicResolution.SetRecording(recording);
+				if (!recording) {
+					const std::vector<float>& frameTimes = dynamicResolution.GetRecordedFrameTimes();
+					if (DynamicResolution::SaveTrace(DynamicResolution::TracePath, frameTimes))
+						printf("Saved %zu frame times to %s\n", frameTimes.size(), DynamicResolution::TracePath);
+					else
+						printf("Couldn't save frame times to %s\n", DynamicResolution::TracePath);
+				}
+			}
+			if (recording)
+				ImGui::BulletText("Recorded: %zu frames", dynamicResolution.GetRecordedFrameTimes().size());
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Render Graph")) {
+			RenderGraph& graph = renderer->GetRenderGraph();
+			for (int i = 0; i < graph.GetPassCount(); i++)
+				ImGui::BulletText("%s%s", graph.GetPassName(i).c_str(), graph.IsPassCulled(i) ? " (culled)" : "");
+			ImGui::Text("Render targets: %d", graph.GetPhysicalCount());
+			ImGui::Text("Requested: %.1f MB", graph.GetRequestedBytes() / (1024.0f * 1024.0f));
+			ImGui::Text("Allocated: %.1f MB", graph.GetAllocatedBytes() / (1024.0f * 1024.0f));
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Texture Streaming")) {
+			TextureStreamer& streamer = assets.GetTextureStreamer();
+			ImGui::Text("Textures: %zu", streamer.GetCount());
+			ImGui::Text("Resident: %.1f of %.1f MB", streamer.GetResidentBytes() / (1024.0f * 1024.0f), streamer.GetFullBytes() / (1024.0f * 1024.0f));
+			ImGui::Text("Uploaded: %.1f MB", streamer.GetUploadedBytes() / (1024.0f * 1024.0f));
+
+			// In MB, where 0 is unlimited
+			uint64_t memory = streamer.GetMemoryBudget();
+			int megabytes = memory == TextureStreamer::Unlimited ? 0 : (int)(memory / (1024 * 1024));
+			if (ImGui::InputInt("Memory budget, MB (0 is unlimited)", &megabytes))
+				streamer.SetMemoryBudget(megabytes <= 0 ? TextureStreamer::Unlimited : (uint64_t)megabytes * 1024 * 1024);
+			int kilobytes = (int)(streamer.GetBandwidthBudget() / 1024);
+			if (ImGui::InputInt("Uploads per frame, KB", &kilobytes))
+				streamer.SetBandwidthBudget((uint64_t)max(kilobytes, 1) * 1024);
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Memory Budget")) {
+			AssetBudget& budget = assets.GetMemoryBudget();
+			ImGui::Text("Evicted: %llu, loaded again: %llu", (unsigned long long)budget.GetEvictionCount(), (unsigned long long)budget.GetLoadCount());
+			for (int i = 0; i < AssetCategoryCount; i++) {
+				AssetCategory category = (AssetCategory)i;
+				AssetMemory use = budget.GetUse(category);
+				ImGui::Text("%s: %zu of %zu resident, CPU %.1f MB, GPU %.1f MB",
+					AssetBudget::GetCategoryName(category),
+					budget.GetResidentCount(category),
+					budget.GetCount(category),
+					use.CpuBytes / (1024.0f * 1024.0f),
+					use.GpuBytes / (1024.0f * 1024.0f));
+
+				// In MB, where 0 is unlimited
+				AssetMemory limit = budget.GetBudget(category);
+				auto toMegabytes = [](uint64_t bytes) { return bytes == AssetBudget::Unlimited ? 0 : (int)(bytes / (1024 * 1024)); };
+				auto toBytes = [](int megabytes) { return megabytes <= 0 ? AssetBudget::Unlimited : (uint64_t)megabytes * 1024 * 1024; };
+				int megabytes[2] = { toMegabytes(limit.CpuBytes), toMegabytes(limit.GpuBytes) };
+				ImGui::PushID(i);
+				if (ImGui::InputInt2("CPU, GPU MB (0 is unlimited)", megabytes))
+					budget.SetBudget(category, { toBytes(megabytes[0]), toBytes(megabytes[1]) });
+				ImGui::PopID();
+			}
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Pipeline State Cache")) {
+			PipelineStateCache& cache = PipelineStateCache::GetInstance();
+			unsigned int totalIssued = 0;
+			unsigned int totalFiltered = 0;
+			for (int i = 0; i < PIPELINE_CALL_COUNT; i++) {
+				const PipelineStateCounter& counter = cache.GetFrameCounter((PipelineStateCall)i);
+				ImGui::BulletText("%s: %u issued, %u filtered", PipelineCallToString(i), counter.Issued, counter.Filtered);
+				totalIssued += counter.Issued;
+				totalFiltered += counter.Filtered;
+			}
+			ImGui::Text("Total: %u issued, %u filtered", totalIssued, totalFiltered);
+			ImGui::TreePop();
+		}
 	}
 
 	if (ImGui::CollapsingHeader("Scene Info", ImGuiTreeNodeFlags_DefaultOpen)) {
 		if (ImGui::CollapsingHeader("Entities")) {
-			ImGui::Text("Amount: %d", assets.GetEntities().size());
+			ImGui::Text("Amount: %d", (int)assets.GetEntities().Size());
 			static std::string current_index = "";
 			GameEntity* current_entity = assets.GetEntity(current_index);
 			if (ImGui::BeginCombo("EntitySelect", current_index.c_str())) {
 				for (auto& p : assets.GetEntities()) {
-					const bool isSelected = (current_index == p.first);
-					if (ImGui::Selectable(p.first.c_str(), isSelected)) {
-						current_index = p.first;
-						current_entity = p.second;
+					const bool isSelected = (current_index == p.Name);
+					if (ImGui::Selectable(p.Name.c_str(), isSelected)) {
+						current_index = p.Name;
+						current_entity = p.Value;
 					}
 
 					if (isSelected) {
@@ -405,16 +537,16 @@ void Game::Update(float deltaTime, float totalTime)
 				TextureBundle* textures = m->GetSRVs();
 
 				static std::string current_index_tex = textures->name;
-				TextureBundle* current_texture = assets.GetBundle(textures->name);
-				std::string preview = current_texture == nullptr ? "Custom" : current_texture->name;
+				AssetHandle<TextureBundle>* current_texture = assets.GetBundle(textures->name);
+				std::string preview = current_texture == nullptr ? "Custom" : textures->name;
 				if (ImGui::BeginCombo("Texture Group", preview.c_str())) {
 					bool inList = false;
 					for (auto& p : AssetManager::GetInstance().GetBundles()) {
-						const bool isSelected = (current_index_tex == p.first);
+						const bool isSelected = (current_index_tex == p.Name);
 						inList = inList || isSelected;
-						if (ImGui::Selectable(p.first.c_str(), isSelected)) {
-							current_index_tex = p.first;
-							m->SetSRVs(p.second);
+						if (ImGui::Selectable(p.Name.c_str(), isSelected)) {
+							current_index_tex = p.Name;
+							m->SetSRVs(p.Value);
 						}
 
 						if (isSelected) {
@@ -442,7 +574,14 @@ void Game::Update(float deltaTime, float totalTime)
 					ImGui::TreePop();
 				}
 
-				if (ImGui::TreeNode("Roughness##Entity")) {
+				if (textures->roughnessMetalAO && ImGui::TreeNode("Roughness/Metal/AO##Entity")) {
+					ImGui::Image(textures->roughnessMetalAO.Get(), ImVec2(200, 200));
+
+					ImGui::Separator();
+					ImGui::TreePop();
+				}
+
+				if (textures->roughness && ImGui::TreeNode("Roughness##Entity")) {
 					//ImGui::Button("Change##RoughnessTexture");
 					ImGui::Image(textures->roughness.Get(), ImVec2(200, 200));
 
@@ -450,7 +589,7 @@ void Game::Update(float deltaTime, float totalTime)
 					ImGui::TreePop();
 				}
 
-				if (ImGui::TreeNode("Metalness##Entity")) {
+				if (textures->metalness && ImGui::TreeNode("Metalness##Entity")) {
 					//ImGui::Button("Change##MetalnessTexture");
 					ImGui::Image(textures->metalness.Get(), ImVec2(200, 200));
 
@@ -467,10 +606,10 @@ void Game::Update(float deltaTime, float totalTime)
 				static std::string current_mesh = assets.GetMesh(m->name) != nullptr ? m->name : std::string();
 				if (ImGui::BeginCombo("Mesh##EntityLabel", current_mesh.c_str())) {
 					for (const auto& p : assets.GetMeshes()) {
-						const bool isSelected = (current_mesh == p.first);
-						if (ImGui::Selectable(p.first.c_str(), isSelected)) {
-							current_mesh = p.first;
-							current_entity->SetMesh(p.second);
+						const bool isSelected = (current_mesh == p.Name);
+						if (ImGui::Selectable(p.Name.c_str(), isSelected)) {
+							current_mesh = p.Name;
+							current_entity->SetMesh(p.Value);
 						}
 
 						if (isSelected) {
@@ -487,10 +626,15 @@ void Game::Update(float deltaTime, float totalTime)
 		}
 
 		if (ImGui::CollapsingHeader("Lights")) {
-			ImGui::Text("Amount: %d", this->lightCount);
-			for (int i = 0; i < this->lightCount; i++) {
+			// No fixed limit, the light buffer grows to fit
+			if (ImGui::DragInt("Amount", &this->lightCount, 1.0f, 3, 4096))
+				GenerateLights();
+			ImGui::Text("Uploaded: %u bytes in %u calls", renderer->GetLightBuffer().GetUploadedBytes(), renderer->GetLightBuffer().GetUploadCalls());
+
+			for (int i = 0; i < (int)this->lights.size(); i++) {
 				Light l = this->lights[i];
 				int lightType = this->lights[i].Type;
+				bool changed = false;
 				const std::string str_label = "Light " + std::to_string(i);
 				if (ImGui::TreeNode(str_label.c_str())) {
 					const std::string str_barLabel = "LightInfo##" + str_label;
@@ -506,6 +650,7 @@ void Game::Update(float deltaTime, float totalTime)
 									if (ImGui::Selectable(TypeToString(types[n]), isSelected)) {
 										cur_type_idx = n;
 										this->lights[i].Type = types[n];
+										changed = true;
 									}
 
 									if (isSelected) {
@@ -516,16 +661,16 @@ void Game::Update(float deltaTime, float totalTime)
 							}
 
 							const std::string str_intensityLabel = "Intensity##" + str_label;
-							ImGui::SliderFloat(str_intensityLabel.c_str(), &this->lights[i].Intensity, 0.0f, 1.0f, "%.3f", ImGuiSliderFlags_AlwaysClamp);
+							changed |= ImGui::SliderFloat(str_intensityLabel.c_str(), &this->lights[i].Intensity, 0.0f, 1.0f, "%.3f", ImGuiSliderFlags_AlwaysClamp);
 
 							if (this->lights[i].Type != LIGHT_TYPE_DIRECTIONAL) {
 								const std::string str_rangeLabel = "Range##" + str_label;
-								ImGui::SliderFloat(str_rangeLabel.c_str(), &this->lights[i].Range, 0.0f, 100.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+								changed |= ImGui::SliderFloat(str_rangeLabel.c_str(), &this->lights[i].Range, 0.0f, 100.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
 							}
 
 							if (lightType == LIGHT_TYPE_SPOT) {
 								const std::string str_falloffLabel = "Spot Falloff##" + str_label;
-								ImGui::SliderFloat(str_falloffLabel.c_str(), &this->lights[i].SpotFalloff, 0.0f, 100.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+								changed |= ImGui::SliderFloat(str_falloffLabel.c_str(), &this->lights[i].SpotFalloff, 0.0f, 100.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
 							}
 
 							ImGui::EndTabItem();
@@ -534,12 +679,12 @@ void Game::Update(float deltaTime, float totalTime)
 						if (ImGui::BeginTabItem(str_orientationLabel.c_str())) {
 							if (lightType != LIGHT_TYPE_POINT) {
 								const std::string str_directionLabel = "Direction##" + str_label;
-								ImGui::DragFloat3(str_directionLabel.c_str(), &this->lights[i].Direction.x);
+								changed |= ImGui::DragFloat3(str_directionLabel.c_str(), &this->lights[i].Direction.x);
 							}
 
 							if (lightType != LIGHT_TYPE_DIRECTIONAL) {
 								const std::string str_positionLabel = "Position##" + str_label;
-								ImGui::DragFloat3(str_positionLabel.c_str(), &this->lights[i].Position.x);
+								changed |= ImGui::DragFloat3(str_positionLabel.c_str(), &this->lights[i].Position.x);
 							}
 
 							ImGui::EndTabItem();
@@ -547,7 +692,7 @@ void Game::Update(float deltaTime, float totalTime)
 
 						const std::string str_colorLabel = "Color##" + str_label;
 						if (ImGui::BeginTabItem(str_colorLabel.c_str())) {
-							ImGui::ColorPicker3(str_colorLabel.c_str(), &this->lights[i].Color.x);
+							changed |= ImGui::ColorPicker3(str_colorLabel.c_str(), &this->lights[i].Color.x);
 
 							ImGui::EndTabItem();
 						}
@@ -557,7 +702,27 @@ void Game::Update(float deltaTime, float totalTime)
 					ImGui::Separator();
 					ImGui::TreePop();
 				}
+
+				if (changed)
+					renderer->MarkLightDirty(i);
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Sky")) {
+			// Every sky is already built, so this just changes which one is bound
+			std::string current_sky = assets.GetActiveSkyName();
+			if (ImGui::BeginCombo("SkySelect", current_sky.empty() ? "Loading..." : current_sky.c_str())) {
+				for (auto& p : assets.GetSkies()) {
+					const bool isSelected = (current_sky == p.Name);
+					if (ImGui::Selectable(p.Name.c_str(), isSelected))
+						assets.SetActiveSky(p.Id);
+
+					if (isSelected)
+						ImGui::SetItemDefaultFocus();
+				}
+				ImGui::EndCombo();
 			}
+			ImGui::Text("Specular IBL mips: %d", assets.sky->GetTotalSpecIBLMipLevels());
 		}
 	}
 
@@ -591,14 +756,23 @@ void Game::Update(float deltaTime, float totalTime)
 	}
 
 
-	if (ImGui::CollapsingHeader("All Render Targets"))
+	// While open, the renderer keeps every target around for us
+	bool showAllRenderTargets = ImGui::CollapsingHeader("All Render Targets");
+	renderer->SetShowAllRenderTargets(showAllRenderTargets);
+	if (showAllRenderTargets)
 	{
 		ImVec2 size = ImGui::GetItemRectSize();
 		float rtHeight = size.x * ((float)height / width);
 
 		for (int i = 0; i < RenderTargetType::RENDER_TARGET_TYPE_COUNT; i++)
 		{
-			ImGui::Image(renderer->GetRenderTargetSRV((RenderTargetType)i).Get(), ImVec2(size.x, rtHeight));
+			ImGui::Text("%s", RenderTargetTypeToString(i));
+
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv = renderer->GetRenderTargetSRV((RenderTargetType)i);
+			if (srv)
+				ImGui::Image(srv.Get(), ImVec2(size.x, rtHeight));
+			else
+				ImGui::BulletText("Not used by any pass");
 		}
 	}
 
@@ -610,5 +784,6 @@ void Game::Update(float deltaTime, float totalTime)
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
+	renderer->UpdateDynamicResolution(deltaTime);
 	renderer->Render(camera);
 }
@@ -46,7 +46,7 @@ private:
 
 	// These will be loaded along with other assets and
 	// saved to these variables for ease of access
-	Mesh* lightMesh;
+	AssetHandle<Mesh>* lightMesh;
 	SimpleVertexShader* lightVS;
 	SimplePixelShader* lightPS;
 
@@ -2,25 +2,47 @@
 
 using namespace DirectX;
 
-GameEntity::GameEntity(std::string name, Mesh* mesh, Material* material)
+GameEntity::GameEntity(std::string name, AssetHandle<Mesh>* mesh, AssetHandle<Material>* material)
 {
 	// Save the data
 	this->name = name;
 	this->mesh = mesh;
 	this->material = material;
+	if (mesh) mesh->AddReference();
+	if (material) material->AddReference();
 }
 
-Mesh* GameEntity::GetMesh() { return mesh; }
-Material* GameEntity::GetMaterial() { return material; }
+GameEntity::~GameEntity()
+{
+	if (mesh) mesh->RemoveReference();
+	if (material) material->RemoveReference();
+}
+
+Mesh* GameEntity::GetMesh() { return mesh->Get(); }
+Material* GameEntity::GetMaterial() { return material->Get(); }
 Transform* GameEntity::GetTransform() { return &transform; }
 std::string GameEntity::GetName() { return name; }
 
+void GameEntity::SetMesh(AssetHandle<Mesh>* m)
+{
+	if (m) m->AddReference();
+	if (mesh) mesh->RemoveReference();
+	mesh = m;
+}
+
+void GameEntity::SetMaterial(AssetHandle<Material>* m)
+{
+	if (m) m->AddReference();
+	if (material) material->RemoveReference();
+	material = m;
+}
+
 
 void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera)
 {
 	// Tell the material to prepare for a draw
-	material->PrepareMaterial(&transform, camera);
+	GetMaterial()->PrepareMaterial(&transform, camera);
 
 	// Draw the mesh
-	mesh->SetBuffersAndDraw(context);
+	GetMesh()->SetBuffersAndDraw(context);
 }
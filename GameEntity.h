@@ -7,11 +7,14 @@
 #include "Transform.h"
 #include "Camera.h"
 #include "SimpleShader.h"
+#include "AssetHandle.h"
 
 class GameEntity
 {
 public:
-	GameEntity(std::string name, Mesh* mesh, Material* material);
+	// Entities hold a reference to their mesh's and material's handles
+	GameEntity(std::string name, AssetHandle<Mesh>* mesh, AssetHandle<Material>* material);
+	~GameEntity();
 
 	Mesh* GetMesh();
 	Material* GetMaterial();
@@ -19,14 +22,15 @@ public:
 	std::string GetName();
 
 	void SetName(std::string n) { this->name = n; }
-	void SetMesh(Mesh* m) { this->mesh = m; }
+	void SetMesh(AssetHandle<Mesh>* m);
+	void SetMaterial(AssetHandle<Material>* m);
 
 	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera);
 
 private:
 	std::string name;
-	Mesh* mesh;
-	Material* material;
+	AssetHandle<Mesh>* mesh;			// Either may still be a placeholder
+	AssetHandle<Material>* material;
 	Transform transform = Transform(this);
 };
 
@@ -0,0 +1,913 @@
+#include "IBLPrecompute.h"
+#include "DerivedDataCache.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include <emmintrin.h> // SSE2
+
+static const float PI = 3.14159265359f;
+
+// --------------------------------------------------------
+// Runs job(i) for every i in [0, count) across threads
+// --------------------------------------------------------
+template<typename Job>
+static void ParallelFor(unsigned int count, unsigned int threadCount, Job job)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	threadCount = std::min(threadCount, count);
+
+	std::atomic<unsigned int> next = 0;
+	auto worker = [&]()
+	{
+		for (unsigned int i = next++; i < count; i = next++)
+			job(i);
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < threadCount; t++)
+		threads.emplace_back(worker);
+
+	worker(); // This thread helps too
+	for (auto& t : threads)
+		t.join();
+}
+
+// Same as radicalInverse_VdC() / Hammersley2d() in Lighting.hlsli
+static float RadicalInverse(uint32_t bits)
+{
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return (float)(bits * 2.3283064365386963e-10);
+}
+
+// Same basis as ImportanceSampleGGX() in Lighting.hlsli
+static void TangentFrame(const float n[3], float tx[3], float ty[3])
+{
+	float up[3] = { 0, 0, 1 };
+	if (std::fabs(n[2]) >= 0.999f)
+	{
+		up[0] = 1;
+		up[2] = 0;
+	}
+
+	tx[0] = up[1] * n[2] - up[2] * n[1];
+	tx[1] = up[2] * n[0] - up[0] * n[2];
+	tx[2] = up[0] * n[1] - up[1] * n[0];
+	float length = std::sqrt(tx[0] * tx[0] + tx[1] * tx[1] + tx[2] * tx[2]);
+	tx[0] /= length;
+	tx[1] /= length;
+	tx[2] /= length;
+
+	ty[0] = n[1] * tx[2] - n[2] * tx[1];
+	ty[1] = n[2] * tx[0] - n[0] * tx[2];
+	ty[2] = n[0] * tx[1] - n[1] * tx[0];
+}
+
+// 8-bit (gamma 2.2) to linear
+static const float* GetDecodeTable()
+{
+	static const std::array<float, 256> table = []()
+		{
+			std::array<float, 256> t = {};
+			for (int i = 0; i < 256; i++)
+				t[i] = std::pow(i / 255.0f, 2.2f);
+			return t;
+		}();
+	return table.data();
+}
+
+// Picks the smallest mip that still has at least the output's resolution
+static const IBLFloatCube& PickSourceMip(const std::vector<IBLFloatCube>& mips, unsigned int size)
+{
+	size_t level = 0;
+	while (level + 1 < mips.size() && mips[level + 1].Size >= size)
+		level++;
+	return mips[level];
+}
+
+IBLSettings IBLPrecompute::GetDefaultSettings()
+{
+	IBLSettings s = {};
+	s.SHProjectionSize = 64;
+	s.SpecularSize = 256;
+	s.SpecularMipLevels = 6;
+	s.SpecularSamples = 256;
+	s.EnvironmentSamples = 256;
+	s.ImportanceTableSize = 64;
+	s.BrdfLookUpSize = 256;
+	s.BrdfLookUpSamples = 1024;
+	return s;
+}
+
+IBLResults IBLPrecompute::Compute(const IBLCubeImage& environment, const IBLSettings& settings, unsigned int threadCount)
+{
+	IBLResults results = {};
+
+	std::vector<IBLFloatCube> mips;
+	{
+		ProfileScope profile("IBL mip chain");
+		mips = BuildMipChain(
+			environment,
+			std::max({ settings.SpecularSize, settings.SHProjectionSize, settings.ImportanceTableSize }),
+			threadCount);
+	}
+
+	{
+		ProfileScope profile("IBL irradiance");
+		results.IrradianceSH = ProjectSH9(PickSourceMip(mips, settings.SHProjectionSize));
+	}
+
+	// Where the light in the environment actually comes from
+	IBLEnvironmentCDF cdf = BuildEnvironmentCDF(PickSourceMip(mips, settings.ImportanceTableSize));
+
+	// Roughness goes from 0 at the top mip to 1 at the last one
+	results.SpecularSize = settings.SpecularSize;
+	for (unsigned int mip = 0; mip < settings.SpecularMipLevels; mip++)
+	{
+		ProfileScope profile("IBL specular", "Mip " + std::to_string(mip));
+		unsigned int size = std::max(settings.SpecularSize >> mip, 1u);
+		float roughness = settings.SpecularMipLevels > 1 ? mip / (float)(settings.SpecularMipLevels - 1) : 0.0f;
+		results.Specular.push_back(EncodeCube(Specular(mips, &cdf, size, roughness, settings.SpecularSamples, settings.EnvironmentSamples, threadCount)));
+	}
+
+	ProfileScope profile("IBL BRDF");
+	results.BrdfLookUpSize = settings.BrdfLookUpSize;
+	std::vector<float> brdf = BrdfLookUp(settings.BrdfLookUpSize, settings.BrdfLookUpSamples, threadCount);
+	results.BrdfLookUp.resize(brdf.size() / 2);
+	for (size_t i = 0; i < results.BrdfLookUp.size(); i++)
+	{
+		uint32_t scale = (uint32_t)std::lround(std::clamp(brdf[i * 2 + 0], 0.0f, 1.0f) * 65535.0f);
+		uint32_t bias = (uint32_t)std::lround(std::clamp(brdf[i * 2 + 1], 0.0f, 1.0f) * 65535.0f);
+		results.BrdfLookUp[i] = scale | (bias << 16);
+	}
+
+	return results;
+}
+
+// --------------------------------------------------------
+// Decodes the environment to linear floats while shrinking
+// it to topSize (the faces are usually much larger than
+// anything we output), then box filters the rest of the mips
+// --------------------------------------------------------
+std::vector<IBLFloatCube> IBLPrecompute::BuildMipChain(const IBLCubeImage& environment, unsigned int topSize, unsigned int threadCount)
+{
+	const float* decode = GetDecodeTable();
+	const unsigned int sourceSize = environment.Size;
+	const unsigned int size = std::max(std::min(sourceSize, topSize), 1u);
+
+	std::vector<IBLFloatCube> mips(1);
+	mips[0].Size = size;
+	for (auto& f : mips[0].Faces)
+		f.resize(size * size * 4);
+
+	ParallelFor(6 * size, threadCount, [&](unsigned int job)
+		{
+			unsigned int face = job / size;
+			unsigned int y = job % size;
+			const uint32_t* src = environment.Faces[face].data();
+			float* dst = &mips[0].Faces[face][y * size * 4];
+
+			unsigned int y0 = y * sourceSize / size;
+			unsigned int y1 = std::max((y + 1) * sourceSize / size, y0 + 1);
+			for (unsigned int x = 0; x < size; x++)
+			{
+				unsigned int x0 = x * sourceSize / size;
+				unsigned int x1 = std::max((x + 1) * sourceSize / size, x0 + 1);
+
+				float sum[3] = {};
+				for (unsigned int sy = y0; sy < y1; sy++)
+				{
+					for (unsigned int sx = x0; sx < x1; sx++)
+					{
+						uint32_t c = src[sy * sourceSize + sx];
+						sum[0] += decode[c & 0xFF];
+						sum[1] += decode[(c >> 8) & 0xFF];
+						sum[2] += decode[(c >> 16) & 0xFF];
+					}
+				}
+
+				float scale = 1.0f / ((y1 - y0) * (x1 - x0));
+				dst[x * 4 + 0] = sum[0] * scale;
+				dst[x * 4 + 1] = sum[1] * scale;
+				dst[x * 4 + 2] = sum[2] * scale;
+				dst[x * 4 + 3] = 1.0f;
+			}
+		});
+
+	// Remaining mips are small enough to not bother with threads
+	while (mips.back().Size > 1)
+	{
+		const IBLFloatCube& prev = mips.back();
+		IBLFloatCube next = {};
+		next.Size = prev.Size / 2;
+
+		for (int face = 0; face < 6; face++)
+		{
+			next.Faces[face].resize(next.Size * next.Size * 4);
+			for (unsigned int y = 0; y < next.Size; y++)
+			{
+				for (unsigned int x = 0; x < next.Size; x++)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (unsigned int i = 0; i < 4; i++)
+					{
+						unsigned int sx = std::min(x * 2 + (i & 1), prev.Size - 1);
+						unsigned int sy = std::min(y * 2 + (i >> 1), prev.Size - 1);
+						sum = _mm_add_ps(sum, _mm_loadu_ps(&prev.Faces[face][(sy * prev.Size + sx) * 4]));
+					}
+					_mm_storeu_ps(&next.Faces[face][(y * next.Size + x) * 4], _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+				}
+			}
+		}
+
+		mips.push_back(next);
+	}
+
+	return mips;
+}
+
+// --------------------------------------------------------
+// Cube map direction helpers.  These use the same face
+// orientation as the IBL*PS shaders.
+// --------------------------------------------------------
+void IBLPrecompute::FaceUVToDirection(int face, float u, float v, float dir[3])
+{
+	float ox = u * 2 - 1;
+	float oy = v * 2 - 1;
+
+	switch (face)
+	{
+	default:
+	case 0: dir[0] = +1; dir[1] = -oy; dir[2] = -ox; break;
+	case 1: dir[0] = -1; dir[1] = -oy; dir[2] = +ox; break;
+	case 2: dir[0] = +ox; dir[1] = +1; dir[2] = +oy; break;
+	case 3: dir[0] = +ox; dir[1] = -1; dir[2] = -oy; break;
+	case 4: dir[0] = +ox; dir[1] = -oy; dir[2] = +1; break;
+	case 5: dir[0] = -ox; dir[1] = -oy; dir[2] = -1; break;
+	}
+
+	float length = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+	dir[0] /= length;
+	dir[1] /= length;
+	dir[2] /= length;
+}
+
+void IBLPrecompute::DirectionToFaceUV(const float dir[3], int& face, float& u, float& v)
+{
+	float ax = std::fabs(dir[0]);
+	float ay = std::fabs(dir[1]);
+	float az = std::fabs(dir[2]);
+
+	float sc, tc, ma;
+	if (ax >= ay && ax >= az)
+	{
+		face = dir[0] > 0 ? 0 : 1;
+		sc = dir[0] > 0 ? -dir[2] : dir[2];
+		tc = -dir[1];
+		ma = ax;
+	}
+	else if (ay >= az)
+	{
+		face = dir[1] > 0 ? 2 : 3;
+		sc = dir[0];
+		tc = dir[1] > 0 ? dir[2] : -dir[2];
+		ma = ay;
+	}
+	else
+	{
+		face = dir[2] > 0 ? 4 : 5;
+		sc = dir[2] > 0 ? dir[0] : -dir[0];
+		tc = -dir[1];
+		ma = az;
+	}
+
+	u = (sc / ma + 1) * 0.5f;
+	v = (tc / ma + 1) * 0.5f;
+}
+
+// Bilinear filtered lookup (edges are clamped per face)
+static __m128 SampleCubeSSE(const IBLFloatCube& cube, const float dir[3])
+{
+	int face;
+	float u, v;
+	IBLPrecompute::DirectionToFaceUV(dir, face, u, v);
+
+	const int size = (int)cube.Size;
+	float x = std::clamp(u * size - 0.5f, 0.0f, (float)(size - 1));
+	float y = std::clamp(v * size - 0.5f, 0.0f, (float)(size - 1));
+	int x0 = (int)x;
+	int y0 = (int)y;
+	int x1 = std::min(x0 + 1, size - 1);
+	int y1 = std::min(y0 + 1, size - 1);
+	__m128 fx = _mm_set1_ps(x - x0);
+	__m128 fy = _mm_set1_ps(y - y0);
+
+	const float* texels = cube.Faces[face].data();
+	__m128 c00 = _mm_loadu_ps(&texels[(y0 * size + x0) * 4]);
+	__m128 c10 = _mm_loadu_ps(&texels[(y0 * size + x1) * 4]);
+	__m128 c01 = _mm_loadu_ps(&texels[(y1 * size + x0) * 4]);
+	__m128 c11 = _mm_loadu_ps(&texels[(y1 * size + x1) * 4]);
+
+	__m128 top = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), fx));
+	__m128 bottom = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), fx));
+	return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+}
+
+void IBLPrecompute::SampleCube(const IBLFloatCube& cube, const float dir[3], float rgb[3])
+{
+	alignas(16) float c[4];
+	_mm_store_ps(c, SampleCubeSSE(cube, dir));
+	rgb[0] = c[0];
+	rgb[1] = c[1];
+	rgb[2] = c[2];
+}
+
+std::vector<uint32_t> IBLPrecompute::EncodeCube(const IBLFloatCube& cube)
+{
+	const size_t texelsPerFace = (size_t)cube.Size * cube.Size;
+	std::vector<uint32_t> encoded(texelsPerFace * 6);
+
+	for (int face = 0; face < 6; face++)
+	{
+		for (size_t i = 0; i < texelsPerFace; i++)
+		{
+			uint32_t c = 0xFF000000; // Alpha is always 1
+			for (int channel = 0; channel < 3; channel++)
+			{
+				float linear = std::max(cube.Faces[face][i * 4 + channel], 0.0f);
+				float gamma = std::min(std::pow(linear, 1.0f / 2.2f), 1.0f);
+				c |= (uint32_t)std::lround(gamma * 255.0f) << (channel * 8);
+			}
+			encoded[face * texelsPerFace + i] = c;
+		}
+	}
+
+	return encoded;
+}
+
+// Trilinear lookup across the mip chain
+static __m128 SampleCubeLevelSSE(const std::vector<IBLFloatCube>& mips, const float dir[3], float level)
+{
+	level = std::clamp(level, 0.0f, (float)(mips.size() - 1));
+	unsigned int top = (unsigned int)level;
+	float blend = level - top;
+
+	__m128 c = SampleCubeSSE(mips[top], dir);
+	if (blend > 0)
+	{
+		__m128 next = SampleCubeSSE(mips[top + 1], dir);
+		c = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(next, c), _mm_set1_ps(blend)));
+	}
+	return c;
+}
+
+// --------------------------------------------------------
+// Environment importance sampling.  A cube face texel at
+// (s, t) in [-1, 1] covers a solid angle proportional to
+// 1 / (1 + s^2 + t^2)^1.5, so that's folded into the table
+// to make it proportional to luminance per steradian.
+// --------------------------------------------------------
+static float AreaPerSolidAngle(float u, float v)
+{
+	float s = u * 2 - 1;
+	float t = v * 2 - 1;
+	float d = 1 + s * s + t * t;
+	return d * std::sqrt(d);
+}
+
+// Turns running sums into a CDF that ends at exactly 1.
+// An all zero function becomes uniform instead.
+static void NormalizeCDF(float* cdf, unsigned int count, double sum)
+{
+	for (unsigned int i = 1; i < count; i++)
+		cdf[i] = sum > 0 ? (float)(cdf[i] / sum) : i / (float)count;
+	cdf[0] = 0;
+	cdf[count] = 1;
+}
+
+// Picks the cell of a piecewise constant function that u
+// falls in, and how far through that cell it is
+static unsigned int SampleCDF(const float* cdf, unsigned int count, float u, float& offset)
+{
+	// Last entry that's <= u
+	unsigned int i = (unsigned int)(std::upper_bound(cdf, cdf + count + 1, u) - cdf);
+	i = std::clamp(i, 1u, count) - 1;
+
+	float width = cdf[i + 1] - cdf[i];
+	offset = width > 0 ? std::clamp((u - cdf[i]) / width, 0.0f, 0.99999994f) : 0.5f;
+	return i;
+}
+
+IBLEnvironmentCDF IBLPrecompute::BuildEnvironmentCDF(const IBLFloatCube& cube)
+{
+	const unsigned int size = cube.Size;
+	const unsigned int rows = size * 6;
+
+	IBLEnvironmentCDF cdf = {};
+	cdf.Size = size;
+	cdf.Function.resize(size * rows);
+	cdf.Conditional.resize((size + 1) * rows);
+	cdf.RowIntegrals.resize(rows);
+	cdf.Marginal.resize(rows + 1);
+
+	// Sums are kept in doubles so the results don't depend on
+	// the table size in surprising ways
+	for (unsigned int row = 0; row < rows; row++)
+	{
+		unsigned int face = row / size;
+		unsigned int y = row % size;
+		float* function = &cdf.Function[row * size];
+		float* conditional = &cdf.Conditional[row * (size + 1)];
+
+		double sum = 0;
+		for (unsigned int x = 0; x < size; x++)
+		{
+			const float* c = &cube.Faces[face][(y * size + x) * 4];
+			float luminance = std::max(0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2], 0.0f);
+			function[x] = luminance / AreaPerSolidAngle((x + 0.5f) / size, (y + 0.5f) / size);
+
+			sum += function[x];
+			conditional[x + 1] = (float)sum;
+		}
+
+		NormalizeCDF(conditional, size, sum);
+		cdf.RowIntegrals[row] = (float)(sum / size);
+	}
+
+	double sum = 0;
+	for (unsigned int row = 0; row < rows; row++)
+	{
+		sum += cdf.RowIntegrals[row];
+		cdf.Marginal[row + 1] = (float)sum;
+	}
+
+	NormalizeCDF(cdf.Marginal.data(), rows, sum);
+	cdf.Integral = (float)(sum / rows);
+	return cdf;
+}
+
+// --------------------------------------------------------
+// The table covers [0, 1)^2 with each face taking 1/6 of
+// it vertically, so its density is converted to one over
+// a face's UVs (x6) and then to solid angle (4 du dv per
+// AreaPerSolidAngle steradians on the [-1, 1] face).
+// --------------------------------------------------------
+float IBLPrecompute::SampleEnvironment(const IBLEnvironmentCDF& cdf, float u1, float u2, float dir[3])
+{
+	const unsigned int size = cdf.Size;
+
+	float dx, dy;
+	unsigned int row = SampleCDF(cdf.Marginal.data(), size * 6, u2, dy);
+	unsigned int x = SampleCDF(&cdf.Conditional[row * (size + 1)], size, u1, dx);
+
+	float u = (x + dx) / size;
+	float v = (row % size + dy) / size;
+	FaceUVToDirection(row / size, u, v, dir);
+
+	if (cdf.Integral <= 0)
+		return 0;
+	return cdf.Function[row * size + x] / cdf.Integral * AreaPerSolidAngle(u, v) / 24.0f;
+}
+
+float IBLPrecompute::EnvironmentPdf(const IBLEnvironmentCDF& cdf, const float dir[3])
+{
+	if (cdf.Integral <= 0)
+		return 0;
+
+	int face;
+	float u, v;
+	DirectionToFaceUV(dir, face, u, v);
+
+	const unsigned int size = cdf.Size;
+	unsigned int x = std::min((unsigned int)std::max(u * size, 0.0f), size - 1);
+	unsigned int y = std::min((unsigned int)std::max(v * size, 0.0f), size - 1);
+	return cdf.Function[(face * size + y) * size + x] / cdf.Integral * AreaPerSolidAngle(u, v) / 24.0f;
+}
+
+// --------------------------------------------------------
+// Spherical harmonics.  Diffuse irradiance is so smooth that
+// 9 coefficients hold nearly all of it, so there's no need to
+// convolve a whole cube map.
+// --------------------------------------------------------
+static void SHBasis(const float d[3], float basis[9])
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * d[1];
+	basis[2] = 0.488603f * d[2];
+	basis[3] = 0.488603f * d[0];
+	basis[4] = 1.092548f * d[0] * d[1];
+	basis[5] = 1.092548f * d[1] * d[2];
+	basis[6] = 0.315392f * (3 * d[2] * d[2] - 1);
+	basis[7] = 1.092548f * d[0] * d[2];
+	basis[8] = 0.546274f * (d[0] * d[0] - d[1] * d[1]);
+}
+
+// Convolving with a clamped cosine scales each band by PI, 2PI/3
+// and PI/4.  These are those, divided by PI to match what the
+// irradiance shader used to store.
+static const float SHCosineLobe[9] = { 1.0f, 2.0f / 3, 2.0f / 3, 2.0f / 3, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+IBLSH9 IBLPrecompute::ProjectSH9(const IBLFloatCube& cube)
+{
+	double sum[9][3] = {};
+	double totalWeight = 0;
+
+	const unsigned int size = cube.Size;
+	for (int face = 0; face < 6; face++)
+	{
+		for (unsigned int y = 0; y < size; y++)
+		{
+			for (unsigned int x = 0; x < size; x++)
+			{
+				// Solid angle of this texel (approximately)
+				float u = (x + 0.5f) / size * 2 - 1;
+				float v = (y + 0.5f) / size * 2 - 1;
+				float r2 = 1 + u * u + v * v;
+				float weight = 1.0f / (r2 * std::sqrt(r2));
+
+				float d[3], basis[9];
+				FaceUVToDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, d);
+				SHBasis(d, basis);
+
+				const float* c = &cube.Faces[face][(y * size + x) * 4];
+				for (int i = 0; i < 9; i++)
+				{
+					sum[i][0] += c[0] * basis[i] * weight;
+					sum[i][1] += c[1] * basis[i] * weight;
+					sum[i][2] += c[2] * basis[i] * weight;
+				}
+				totalWeight += weight;
+			}
+		}
+	}
+
+	// Scale so the solid angles add up to exactly 4PI
+	IBLSH9 sh = {};
+	double scale = totalWeight > 0 ? 4 * PI / totalWeight : 0;
+	for (int i = 0; i < 9; i++)
+	{
+		for (int channel = 0; channel < 3; channel++)
+			sh.Coefficients[i][channel] = (float)(sum[i][channel] * scale);
+	}
+
+	return sh;
+}
+
+void IBLPrecompute::EvaluateIrradianceSH(const IBLSH9& sh, const float normal[3], float rgb[3])
+{
+	float basis[9];
+	SHBasis(normal, basis);
+
+	rgb[0] = rgb[1] = rgb[2] = 0;
+	for (int i = 0; i < 9; i++)
+	{
+		for (int channel = 0; channel < 3; channel++)
+			rgb[channel] += sh.Coefficients[i][channel] * SHCosineLobe[i] * basis[i];
+	}
+}
+
+// --------------------------------------------------------
+// Folds the basis constants and cosine lobe into the
+// coefficients, so the shader needs just a few dot products
+// --------------------------------------------------------
+void IBLPrecompute::PackIrradianceSH(const IBLSH9& sh, float packed[7][4])
+{
+	float c[9][3];
+	for (int i = 0; i < 9; i++)
+	{
+		for (int channel = 0; channel < 3; channel++)
+			c[i][channel] = sh.Coefficients[i][channel] * SHCosineLobe[i];
+	}
+
+	for (int channel = 0; channel < 3; channel++)
+	{
+		// Dotted with (x, y, z, 1)
+		packed[channel][0] = 0.488603f * c[3][channel];
+		packed[channel][1] = 0.488603f * c[1][channel];
+		packed[channel][2] = 0.488603f * c[2][channel];
+		packed[channel][3] = 0.282095f * c[0][channel] - 0.315392f * c[6][channel];
+
+		// Dotted with (xy, yz, zz, zx)
+		packed[3 + channel][0] = 1.092548f * c[4][channel];
+		packed[3 + channel][1] = 1.092548f * c[5][channel];
+		packed[3 + channel][2] = 3 * 0.315392f * c[6][channel];
+		packed[3 + channel][3] = 1.092548f * c[7][channel];
+
+		// Times x^2 - y^2
+		packed[6][channel] = 0.546274f * c[8][channel];
+	}
+	packed[6][3] = 0;
+}
+
+// --------------------------------------------------------
+// Prefilters for one roughness.  The lobe samples are the
+// same as ConvolveTextureCube() in the specular convolution
+// shader, and with N == V they only depend on the roughness,
+// so they're computed once.  Environment samples are in
+// world space and shared by every texel too.
+//
+// Each sample is weighted by the lobe (D / 4 * NdotL) over
+// the combined pdf of both strategies (balance heuristic),
+// and the result is normalized by the sum of the weights,
+// just like the NdotL weighting in the shader.  Samples
+// read from the mip whose texels match the solid angle the
+// sample stands for (+1 level, as in Colbert & Krivanek).
+// --------------------------------------------------------
+IBLFloatCube IBLPrecompute::Specular(const std::vector<IBLFloatCube>& mips, const IBLEnvironmentCDF* cdf, unsigned int size, float roughness, unsigned int lobeSamples, unsigned int environmentSamples, unsigned int threadCount)
+{
+	IBLFloatCube result = {};
+	result.Size = size;
+	for (auto& f : result.Faces)
+		f.resize(size * size * 4);
+
+	// Nothing sharper than the output itself is worth reading
+	unsigned int minLevel = 0;
+	while (minLevel + 1 < mips.size() && mips[minLevel + 1].Size >= size)
+		minLevel++;
+
+	// Every sample is the same perfect reflection
+	if (roughness <= 0.0f)
+	{
+		ParallelFor(6 * size, threadCount, [&](unsigned int job)
+			{
+				unsigned int face = job / size;
+				unsigned int y = job % size;
+				for (unsigned int x = 0; x < size; x++)
+				{
+					float n[3];
+					FaceUVToDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, n);
+					_mm_storeu_ps(&result.Faces[face][(y * size + x) * 4], SampleCubeSSE(mips[minLevel], n));
+				}
+			});
+		return result;
+	}
+
+	if (!cdf || cdf->Integral <= 0)
+		environmentSamples = 0;
+
+	// Environment samples already find the bright spots, so lobe
+	// samples mustn't also smear them in from blurrier mips than
+	// the table resolves
+	unsigned int maxLevel = (unsigned int)mips.size() - 1;
+	if (environmentSamples > 0)
+	{
+		maxLevel = minLevel;
+		while (maxLevel + 1 < mips.size() && mips[maxLevel].Size > cdf->Size)
+			maxLevel++;
+	}
+
+	const float a = roughness * roughness;
+	const float a2 = a * a;
+	const float lobeCount = (float)lobeSamples;
+	const float environmentCount = (float)environmentSamples;
+	const float texelSolidAngle = 4 * PI / (6.0f * mips[0].Size * mips[0].Size);
+
+	// Tangent space (N == Z) reflections of N around GGX half vectors
+	std::vector<float> lobe;
+	for (unsigned int i = 0; i < lobeSamples; i++)
+	{
+		float phi = 2 * PI * (i / (float)lobeSamples);
+		float y = RadicalInverse(i);
+		float cosTheta = std::sqrt((1 - y) / (1 + (a2 - 1) * y));
+		float sinTheta = std::sqrt(std::max(1 - cosTheta * cosTheta, 0.0f));
+
+		float h[3] = { sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta };
+		float l[3] = { 2 * h[2] * h[0], 2 * h[2] * h[1], 2 * h[2] * h[2] - 1 };
+		if (l[2] > 0)
+			lobe.insert(lobe.end(), { l[0], l[1], l[2] });
+	}
+
+	// World space directions and their pdfs
+	std::vector<float> environment;
+	for (unsigned int i = 0; i < environmentSamples; i++)
+	{
+		float l[3];
+		float pdf = SampleEnvironment(*cdf, i / environmentCount, RadicalInverse(i), l);
+		if (pdf > 0)
+			environment.insert(environment.end(), { l[0], l[1], l[2], pdf });
+	}
+
+	// Lobe over the combined pdf, plus the mip level to read
+	auto weigh = [&](float nDotL, float environmentPdf, float& level)
+		{
+			// With N == V, N dot H only depends on N dot L
+			float nDotH2 = (1 + nDotL) * 0.5f;
+			float d = nDotH2 * (a2 - 1) + 1;
+			float lobePdf = a2 / (PI * d * d) * 0.25f;
+
+			float combinedPdf = lobeCount * lobePdf + environmentCount * environmentPdf;
+			level = std::clamp(0.5f * std::log2(1.0f / (combinedPdf * texelSolidAngle)) + 1.0f, (float)minLevel, (float)maxLevel);
+			return lobePdf * nDotL / combinedPdf;
+		};
+
+	ParallelFor(6 * size, threadCount, [&](unsigned int job)
+		{
+			unsigned int face = job / size;
+			unsigned int y = job % size;
+
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float n[3], tx[3], ty[3];
+				FaceUVToDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, n);
+				TangentFrame(n, tx, ty);
+
+				__m128 total = _mm_setzero_ps();
+				float totalWeight = 0;
+				float level;
+
+				for (size_t i = 0; i < lobe.size(); i += 3)
+				{
+					float dir[3];
+					for (int axis = 0; axis < 3; axis++)
+						dir[axis] = tx[axis] * lobe[i] + ty[axis] * lobe[i + 1] + n[axis] * lobe[i + 2];
+
+					float pdf = environmentSamples > 0 ? EnvironmentPdf(*cdf, dir) : 0.0f;
+					float weight = weigh(lobe[i + 2], pdf, level);
+					total = _mm_add_ps(total, _mm_mul_ps(SampleCubeLevelSSE(mips, dir, level), _mm_set1_ps(weight)));
+					totalWeight += weight;
+				}
+
+				for (size_t i = 0; i < environment.size(); i += 4)
+				{
+					const float* dir = &environment[i];
+					float nDotL = n[0] * dir[0] + n[1] * dir[1] + n[2] * dir[2];
+					if (nDotL <= 0)
+						continue;
+
+					float weight = weigh(nDotL, environment[i + 3], level);
+					total = _mm_add_ps(total, _mm_mul_ps(SampleCubeLevelSSE(mips, dir, level), _mm_set1_ps(weight)));
+					totalWeight += weight;
+				}
+
+				__m128 normalize = _mm_set1_ps(totalWeight > 0 ? 1.0f / totalWeight : 0.0f);
+				_mm_storeu_ps(&result.Faces[face][(y * size + x) * 4], _mm_mul_ps(total, normalize));
+			}
+		});
+
+	return result;
+}
+
+// --------------------------------------------------------
+// Same as IntegrateBRDF() in the look up table shader, four
+// samples at a time
+// --------------------------------------------------------
+std::vector<float> IBLPrecompute::BrdfLookUp(unsigned int size, unsigned int samples, unsigned int threadCount)
+{
+	// Roughness doesn't change phi or the radical inverse.  Only sin(phi)
+	// is needed since V has no y component.
+	unsigned int padded = (samples + 3) & ~3u;
+	std::vector<float> sinPhi(padded, 0.0f), xiY(padded, 0.0f), valid(padded, 0.0f);
+	for (unsigned int i = 0; i < samples; i++)
+	{
+		float phi = 2 * PI * (i / (float)samples);
+		sinPhi[i] = std::sin(phi);
+		xiY[i] = RadicalInverse(i);
+		valid[i] = 1.0f;
+	}
+
+	std::vector<float> result(size * size * 2);
+	ParallelFor(size, threadCount, [&](unsigned int y)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+
+			float nDotV = (y + 0.5f) / size;
+			__m128 nv = _mm_set1_ps(nDotV);
+			__m128 vx = _mm_set1_ps(std::sqrt(1 - nDotV * nDotV));
+			__m128 vz = nv;
+
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float roughness = (x + 0.5f) / size;
+				float a = roughness * roughness;
+				__m128 a2Minus1 = _mm_set1_ps(a * a - 1);
+				__m128 k = _mm_set1_ps(a / 2);
+				__m128 oneMinusK = _mm_sub_ps(one, k);
+
+				// G1 for the view direction is the same for every sample
+				__m128 g1v = _mm_div_ps(nv, _mm_add_ps(_mm_mul_ps(nv, oneMinusK), k));
+
+				__m128 sumA = zero;
+				__m128 sumB = zero;
+				for (unsigned int i = 0; i < padded; i += 4)
+				{
+					__m128 xy = _mm_loadu_ps(&xiY[i]);
+					__m128 cosTheta = _mm_sqrt_ps(_mm_div_ps(_mm_sub_ps(one, xy), _mm_add_ps(one, _mm_mul_ps(a2Minus1, xy))));
+					__m128 sinTheta = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(cosTheta, cosTheta)), zero));
+
+					// ImportanceSampleGGX's basis for N = (0,0,1) maps
+					// tangent space (x, y, z) to world space (y, -x, z)
+					__m128 hx = _mm_mul_ps(sinTheta, _mm_loadu_ps(&sinPhi[i]));
+					__m128 hz = cosTheta;
+
+					__m128 vDotH = _mm_add_ps(_mm_mul_ps(vx, hx), _mm_mul_ps(vz, hz));
+					__m128 nDotL = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(vDotH, vDotH), hz), vz);
+					__m128 nDotH = _mm_max_ps(hz, zero);
+					vDotH = _mm_min_ps(_mm_max_ps(vDotH, zero), one);
+
+					__m128 mask = _mm_and_ps(_mm_cmpgt_ps(nDotL, zero), _mm_cmpgt_ps(_mm_loadu_ps(&valid[i]), zero));
+
+					__m128 g1l = _mm_div_ps(nDotL, _mm_add_ps(_mm_mul_ps(nDotL, oneMinusK), k));
+					__m128 gVis = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(g1v, g1l), vDotH), _mm_mul_ps(nDotH, nv));
+
+					__m128 f = _mm_sub_ps(one, vDotH);
+					__m128 f2 = _mm_mul_ps(f, f);
+					__m128 fc = _mm_mul_ps(_mm_mul_ps(f2, f2), f);
+
+					sumA = _mm_add_ps(sumA, _mm_and_ps(mask, _mm_mul_ps(_mm_sub_ps(one, fc), gVis)));
+					sumB = _mm_add_ps(sumB, _mm_and_ps(mask, _mm_mul_ps(fc, gVis)));
+				}
+
+				alignas(16) float a4[4], b4[4];
+				_mm_store_ps(a4, sumA);
+				_mm_store_ps(b4, sumB);
+				result[(y * size + x) * 2 + 0] = (a4[0] + a4[1] + a4[2] + a4[3]) / samples;
+				result[(y * size + x) * 2 + 1] = (b4[0] + b4[1] + b4[2] + b4[3]) / samples;
+			}
+		});
+
+	return result;
+}
+
+// --------------------------------------------------------
+// FNV-1a over everything that affects the results
+// --------------------------------------------------------
+uint64_t IBLPrecompute::HashInputs(const IBLCubeImage& environment, const IBLSettings& settings)
+{
+	uint64_t hash = DerivedDataCache::FNVOffset;
+
+	uint32_t header[] = {
+		CacheVersion,
+		environment.Size,
+		settings.SHProjectionSize,
+		settings.SpecularSize,
+		settings.SpecularMipLevels,
+		settings.SpecularSamples,
+		settings.EnvironmentSamples,
+		settings.ImportanceTableSize,
+		settings.BrdfLookUpSize,
+		settings.BrdfLookUpSamples
+	};
+	DerivedDataCache::HashBytes(hash, header, sizeof(header));
+
+	for (auto& f : environment.Faces)
+		DerivedDataCache::HashBytes(hash, f.data(), f.size() * sizeof(uint32_t));
+
+	return hash;
+}
+
+std::vector<uint8_t> IBLPrecompute::Serialize(const IBLResults& results)
+{
+	DerivedDataWriter out;
+	out.Write((uint32_t)results.SpecularSize);
+	out.Write((uint32_t)results.Specular.size());
+	out.Write((uint32_t)results.BrdfLookUpSize);
+
+	out.Write(results.IrradianceSH);
+	for (auto& mip : results.Specular)
+		out.Write(mip.data(), mip.size() * sizeof(uint32_t));
+	out.Write(results.BrdfLookUp.data(), results.BrdfLookUp.size() * sizeof(uint32_t));
+
+	return out.Data;
+}
+
+bool IBLPrecompute::Deserialize(const std::vector<uint8_t>& data, IBLResults& results)
+{
+	DerivedDataReader in = { data.data(), data.size() };
+
+	uint32_t sizes[3] = {};
+	if (!in.Read(sizes) || sizes[0] > 16384 || sizes[1] > 32 || sizes[2] > 16384)
+		return false;
+
+	IBLResults loaded = {};
+	loaded.SpecularSize = sizes[0];
+	loaded.BrdfLookUpSize = sizes[2];
+
+	if (!in.Read(loaded.IrradianceSH))
+		return false;
+
+	for (uint32_t mip = 0; mip < sizes[1]; mip++)
+	{
+		size_t size = std::max(loaded.SpecularSize >> mip, 1u);
+		std::vector<uint32_t> texels(size * size * 6);
+		if (!in.Read(texels.data(), texels.size() * sizeof(uint32_t)))
+			return false;
+		loaded.Specular.push_back(std::move(texels));
+	}
+
+	loaded.BrdfLookUp.resize((size_t)loaded.BrdfLookUpSize * loaded.BrdfLookUpSize);
+	if (!in.Read(loaded.BrdfLookUp.data(), loaded.BrdfLookUp.size() * sizeof(uint32_t)) || !in.IsFinished())
+		return false;
+
+	results = std::move(loaded);
+	return true;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// CPU versions of the image based lighting pre-passes that
+// Sky used to run on the GPU at every launch:
+//  - Irradiance (indirect diffuse), as 9 spherical harmonics
+//  - GGX prefiltered environment, one mip per roughness
+//  - Split-sum environment BRDF look up table
+//
+// The specular and BRDF results match what the IBL*PS shaders
+// write (including the gamma 2.2 encoding), so the shaders
+// that read them don't change.  Nothing in here touches the
+// GPU; work is split across threads and the inner loops use
+// SSE.
+//
+// Cube faces are always in D3D order: +X, -X, +Y, -Y, +Z, -Z
+// --------------------------------------------------------
+
+// 8-bit RGBA cube map, R in the low byte of each texel
+struct IBLCubeImage
+{
+	unsigned int Size;
+	std::vector<uint32_t> Faces[6];
+};
+
+// Linear floating point cube map, 4 floats (RGBA) per texel
+struct IBLFloatCube
+{
+	unsigned int Size;
+	std::vector<float> Faces[6];
+};
+
+// Piecewise constant distribution over the texels of a cube map, in
+// proportion to luminance times solid angle.  It's a 2D table with the
+// faces stacked vertically (row y of face f is row f * Size + y), sampled
+// with a marginal CDF over rows and a conditional CDF within each row.
+struct IBLEnvironmentCDF
+{
+	unsigned int Size;
+	std::vector<float> Function;		// Size x (6 * Size)
+	std::vector<float> Conditional;		// Size + 1 entries per row
+	std::vector<float> RowIntegrals;	// 6 * Size
+	std::vector<float> Marginal;		// 6 * Size + 1
+	float Integral;						// Zero for a black environment
+};
+
+// Order 3 (9 coefficient) spherical harmonics of linear RGB.
+// Coefficients are in the usual order: (0,0), (1,-1), (1,0),
+// (1,1), (2,-2), (2,-1), (2,0), (2,1), (2,2)
+struct IBLSH9
+{
+	float Coefficients[9][3];
+};
+
+struct IBLSettings
+{
+	unsigned int SHProjectionSize;		// Mip of the environment projected onto the SH
+
+	unsigned int SpecularSize;			// Size of the top mip
+	unsigned int SpecularMipLevels;		// Roughness goes from 0 to 1 across these
+	unsigned int SpecularSamples;		// Drawn from the GGX lobe
+	unsigned int EnvironmentSamples;	// Drawn from the environment's CDF
+	unsigned int ImportanceTableSize;	// Mip the environment CDF is built from
+
+	unsigned int BrdfLookUpSize;
+	unsigned int BrdfLookUpSamples;
+};
+
+struct IBLResults
+{
+	IBLSH9 IrradianceSH;							// Radiance, see PackIrradianceSH()
+
+	unsigned int SpecularSize;
+	std::vector<std::vector<uint32_t>> Specular;	// One entry per mip, 6 faces each, RGBA8
+
+	unsigned int BrdfLookUpSize;
+	std::vector<uint32_t> BrdfLookUp;				// R16G16 UNORM: scale (low), bias (high)
+};
+
+class IBLPrecompute
+{
+public:
+	// Bump this whenever the output of any step changes
+	static const uint32_t CacheVersion = 3;
+
+	static IBLSettings GetDefaultSettings();
+
+	// Runs every step.  threadCount 0 means one per core.
+	static IBLResults Compute(const IBLCubeImage& environment, const IBLSettings& settings, unsigned int threadCount = 0);
+
+	// The individual steps -------------------------------
+
+	// Linear (de-gammaed) copy of the environment, box filtered down to
+	// at most topSize, followed by every smaller mip down to 1x1
+	static std::vector<IBLFloatCube> BuildMipChain(const IBLCubeImage& environment, unsigned int topSize, unsigned int threadCount = 0);
+
+	// Projects the radiance of a cube map onto the SH basis
+	static IBLSH9 ProjectSH9(const IBLFloatCube& cube);
+
+	// Cosine weighted average of the incoming light (irradiance / PI)
+	// for a normal, from projected radiance
+	static void EvaluateIrradianceSH(const IBLSH9& sh, const float normal[3], float rgb[3]);
+
+	// Irradiance / PI in the 7 float4s IndirectDiffuseSH() in Lighting.hlsli
+	// expects: red, green and blue linear+constant terms, then red,
+	// green and blue quadratic terms, then the x^2 - y^2 term for rgb
+	static void PackIrradianceSH(const IBLSH9& sh, float packed[7][4]);
+
+	// GGX prefiltered environment, assuming N == V == R.  Lobe samples
+	// and environment samples (if there's a CDF) are combined with the
+	// balance heuristic, and each sample reads from a mip that matches
+	// its footprint (filtered importance sampling).
+	static IBLFloatCube Specular(const std::vector<IBLFloatCube>& mips, const IBLEnvironmentCDF* cdf, unsigned int size, float roughness, unsigned int lobeSamples, unsigned int environmentSamples, unsigned int threadCount = 0);
+
+	// Importance sampling tables for the environment
+	static IBLEnvironmentCDF BuildEnvironmentCDF(const IBLFloatCube& cube);
+
+	// Maps a point in [0, 1)^2 to a direction, returning its solid angle pdf
+	static float SampleEnvironment(const IBLEnvironmentCDF& cdf, float u1, float u2, float dir[3]);
+	static float EnvironmentPdf(const IBLEnvironmentCDF& cdf, const float dir[3]);
+
+	// Scale and bias to F0, 2 floats per texel.  X is roughness, Y is N dot V.
+	static std::vector<float> BrdfLookUp(unsigned int size, unsigned int samples, unsigned int threadCount = 0);
+
+	// Helpers --------------------------------------------
+	static void FaceUVToDirection(int face, float u, float v, float dir[3]);
+	static void DirectionToFaceUV(const float dir[3], int& face, float& u, float& v);
+	static void SampleCube(const IBLFloatCube& cube, const float dir[3], float rgb[3]);
+	static std::vector<uint32_t> EncodeCube(const IBLFloatCube& cube);
+
+	// Derived data cache ---------------------------------
+
+	// Key for the cache, from the face images and settings
+	static uint64_t HashInputs(const IBLCubeImage& environment, const IBLSettings& settings);
+
+	static std::vector<uint8_t> Serialize(const IBLResults& results);
+
+	// Fails if the data is cut off or isn't a set of IBL maps
+	static bool Deserialize(const std::vector<uint8_t>& data, IBLResults& results);
+};
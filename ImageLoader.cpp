@@ -0,0 +1,248 @@
+#include "ImageLoader.h"
+
+#include <wincodec.h>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+bool ImageLoader::Decode(const std::wstring& file, ImageData& image)
+{
+	if (PngDecoder::DecodeFile(file, image))
+		return true;
+	return DecodeWithWIC(file, image);
+}
+
+// Runs createDecoder (which gets the factory and makes a decoder
+// for the source) and converts the first frame to RGBA8
+template <typename CreateDecoder>
+static bool DecodeWithWICDecoder(CreateDecoder createDecoder, ImageData& image)
+{
+	// WIC needs COM on whichever thread this runs on.  If the thread
+	// already picked a different model that's fine, COM is still up.
+	HRESULT comResult = CoInitializeEx(0, COINIT_MULTITHREADED);
+	bool uninitialize = SUCCEEDED(comResult);
+
+	bool decoded = false;
+	{
+		Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+		Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
+		Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
+		Microsoft::WRL::ComPtr<IWICFormatConverter> converter;
+
+		UINT width = 0;
+		UINT height = 0;
+		if (SUCCEEDED(CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()))) &&
+			SUCCEEDED(createDecoder(factory.Get(), decoder.GetAddressOf())) &&
+			SUCCEEDED(decoder->GetFrame(0, frame.GetAddressOf())) &&
+			SUCCEEDED(frame->GetSize(&width, &height)) &&
+			SUCCEEDED(factory->CreateFormatConverter(converter.GetAddressOf())) &&
+			SUCCEEDED(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0, WICBitmapPaletteTypeCustom)))
+		{
+			image.Width = width;
+			image.Height = height;
+			image.Pixels.resize((size_t)width * height * 4);
+			decoded = SUCCEEDED(converter->CopyPixels(0, width * 4, (UINT)image.Pixels.size(), image.Pixels.data()));
+		}
+	}
+
+	if (uninitialize)
+		CoUninitialize();
+	return decoded;
+}
+
+bool ImageLoader::DecodeWithWIC(const std::wstring& file, ImageData& image)
+{
+	return DecodeWithWICDecoder([&](IWICImagingFactory* factory, IWICBitmapDecoder** decoder)
+		{
+			return factory->CreateDecoderFromFilename(file.c_str(), 0, GENERIC_READ, WICDecodeMetadataCacheOnDemand, decoder);
+		}, image);
+}
+
+bool ImageLoader::DecodeWithWIC(const uint8_t* data, size_t size, ImageData& image)
+{
+	// The decoder keeps its own reference to the stream.  The bytes
+	// aren't copied, so they have to outlive the call, which they do.
+	return DecodeWithWICDecoder([&](IWICImagingFactory* factory, IWICBitmapDecoder** decoder)
+		{
+			Microsoft::WRL::ComPtr<IWICStream> stream;
+			HRESULT result = factory->CreateStream(stream.GetAddressOf());
+			if (SUCCEEDED(result))
+				result = stream->InitializeFromMemory((BYTE*)data, (DWORD)size);
+			if (SUCCEEDED(result))
+				result = factory->CreateDecoderFromStream(stream.Get(), 0, WICDecodeMetadataCacheOnDemand, decoder);
+			return result;
+		}, image);
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ImageLoader::CreateTexture(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	const ImageData& image)
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (image.Pixels.empty())
+		return srv;
+
+	// Mips are generated on the GPU, which needs a render target
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = image.Width;
+	desc.Height = image.Height;
+	desc.MipLevels = 0; // Full chain
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	if (FAILED(device->CreateTexture2D(&desc, 0, texture.GetAddressOf())))
+		return srv;
+
+	device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf());
+	context->UpdateSubresource(texture.Get(), 0, 0, image.Pixels.data(), image.Width * 4, 0);
+	context->GenerateMips(srv.Get());
+	return srv;
+}
+
+// The DXGI format for a block format
+static DXGI_FORMAT GetFormat(BlockFormat blockFormat)
+{
+	switch (blockFormat)
+	{
+	case BlockFormat::BC1: return DXGI_FORMAT_BC1_UNORM;
+	case BlockFormat::BC4: return DXGI_FORMAT_BC4_UNORM;
+	case BlockFormat::BC5: return DXGI_FORMAT_BC5_UNORM;
+	case BlockFormat::BC7: return DXGI_FORMAT_BC7_UNORM;
+	}
+	return DXGI_FORMAT_UNKNOWN;
+}
+
+// Bytes from one row of blocks to the next, in a mip
+static UINT GetRowPitch(const CompressedTexture& texture, unsigned int mip)
+{
+	unsigned int width = max(texture.Width >> mip, 1u);
+	return ((width + 3) / 4) * TextureCompressor::GetBlockBytes(texture.Format);
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ImageLoader::CreateTexture(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	const CompressedTexture& texture,
+	unsigned int firstMip)
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (firstMip >= texture.Mips.size())
+		return srv;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = max(texture.Width >> firstMip, 1u);
+	desc.Height = max(texture.Height >> firstMip, 1u);
+	desc.MipLevels = (UINT)(texture.Mips.size() - firstMip);
+	desc.ArraySize = 1;
+	desc.Format = GetFormat(texture.Format);
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	// One row of blocks per pitch
+	std::vector<D3D11_SUBRESOURCE_DATA> data(desc.MipLevels);
+	for (UINT i = 0; i < desc.MipLevels; i++)
+	{
+		data[i].pSysMem = texture.Mips[firstMip + i].data();
+		data[i].SysMemPitch = GetRowPitch(texture, firstMip + i);
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> created;
+	if (FAILED(device->CreateTexture2D(&desc, data.data(), created.GetAddressOf())))
+		return srv;
+
+	device->CreateShaderResourceView(created.Get(), 0, srv.GetAddressOf());
+	return srv;
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ImageLoader::ChangeFirstMip(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	ID3D11ShaderResourceView* current,
+	unsigned int currentFirstMip,
+	unsigned int firstMip,
+	const CompressedTexture* source)
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	current->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&texture)))
+		return srv;
+
+	D3D11_TEXTURE2D_DESC currentDesc = {};
+	texture->GetDesc(&currentDesc);
+	unsigned int mipCount = currentFirstMip + currentDesc.MipLevels;
+	if (firstMip >= mipCount || (firstMip < currentFirstMip && (!source || source->Mips.size() != mipCount)))
+		return srv;
+
+	// Copied into, so it can't be immutable
+	D3D11_TEXTURE2D_DESC desc = currentDesc;
+	desc.Width = source ? max(source->Width >> firstMip, 1u) : max(currentDesc.Width >> (firstMip - currentFirstMip), 1u);
+	desc.Height = source ? max(source->Height >> firstMip, 1u) : max(currentDesc.Height >> (firstMip - currentFirstMip), 1u);
+	desc.MipLevels = mipCount - firstMip;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.CPUAccessFlags = 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> created;
+	if (FAILED(device->CreateTexture2D(&desc, 0, created.GetAddressOf())))
+		return srv;
+
+	for (unsigned int mip = firstMip; mip < mipCount; mip++)
+	{
+		UINT destination = mip - firstMip;
+		if (mip >= currentFirstMip)
+			context->CopySubresourceRegion(created.Get(), destination, 0, 0, 0, texture.Get(), mip - currentFirstMip, 0);
+		else
+			context->UpdateSubresource(created.Get(), destination, 0, source->Mips[mip].data(), GetRowPitch(*source, mip), 0);
+	}
+
+	device->CreateShaderResourceView(created.Get(), 0, srv.GetAddressOf());
+	return srv;
+}
+
+uint64_t ImageLoader::EstimateBytes(ID3D11ShaderResourceView* srv)
+{
+	if (!srv)
+		return 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	srv->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&texture)))
+		return 0;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->GetDesc(&desc);
+
+	// Block compressed formats are in 4x4 blocks, and everything
+	// else made here is 4 bytes a texel
+	unsigned int blockBytes = 0;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC4_UNORM:
+		blockBytes = 8;
+		break;
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+		blockBytes = 16;
+		break;
+	}
+
+	uint64_t bytes = 0;
+	for (UINT mip = 0; mip < desc.MipLevels; mip++)
+	{
+		uint64_t width = max(desc.Width >> mip, 1u);
+		uint64_t height = max(desc.Height >> mip, 1u);
+		if (blockBytes)
+			bytes += ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+		else
+			bytes += width * height * 4;
+	}
+	return bytes * desc.ArraySize;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <string>
+
+#include "TextureCompressor.h"
+
+// --------------------------------------------------------
+// Splits texture loading into a part that's safe on any
+// thread (reading and decoding the file) and a part that
+// needs the immediate context (creating the texture and
+// generating its mips).
+// --------------------------------------------------------
+class ImageLoader
+{
+public:
+	// Any thread.  Returns false if the file can't be read or decoded.
+	// PNGs go through PngDecoder, anything it can't handle through WIC.
+	static bool Decode(const std::wstring& file, ImageData& image);
+
+	// Any thread.  WIC only, for formats PngDecoder doesn't cover.
+	static bool DecodeWithWIC(const std::wstring& file, ImageData& image);
+	static bool DecodeWithWIC(const uint8_t* data, size_t size, ImageData& image);
+
+	// Main thread only.  Matches what CreateWICTextureFromFile() makes
+	// when given a context: R8G8B8A8_UNORM with a full mip chain.
+	static Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateTexture(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		const ImageData& image);
+
+	// Any thread (only needs the device).  Immutable, with the mips
+	// that came with it from firstMip on (smaller ones only, for a
+	// texture that's streamed).  Null if D3D doesn't take the blocks.
+	static Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateTexture(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		const CompressedTexture& texture,
+		unsigned int firstMip = 0);
+
+	// --------------------------------------------------------
+	// Main thread only.  A copy of a block compressed texture that
+	// starts at a different mip (firstMip, where currentFirstMip is
+	// the one it starts at now, both counting from the full size).
+	// Mips they both have are copied on the GPU, and more detailed
+	// ones come from source, which has to have every mip.  Null if
+	// it couldn't be made.
+	// --------------------------------------------------------
+	static Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ChangeFirstMip(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		ID3D11ShaderResourceView* current,
+		unsigned int currentFirstMip,
+		unsigned int firstMip,
+		const CompressedTexture* source);
+
+	// Any thread.  Roughly how much GPU memory a texture takes, from
+	// its size, format and mips (the driver may pad it out further).
+	static uint64_t EstimateBytes(ID3D11ShaderResourceView* srv);
+};
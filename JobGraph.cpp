@@ -0,0 +1,192 @@
+#include "JobGraph.h"
+
+#include <algorithm>
+#include <chrono>
+
+JobGraph::~JobGraph()
+{
+	// Workers can't outlive the jobs they're running
+	if (!workers.empty())
+		Finish();
+}
+
+int JobGraph::AddJob(std::string name, std::function<void()> work, bool mainThread)
+{
+	Job job = {};
+	job.Name = name;
+	job.Work = work;
+	job.MainThread = mainThread;
+	jobs.push_back(job);
+	return (int)jobs.size() - 1;
+}
+
+void JobGraph::AddDependency(int job, int dependsOn)
+{
+	jobs[dependsOn].Dependents.push_back(job);
+	jobs[job].DependencyCount++;
+}
+
+// Kahn's algorithm: if we can't retire every job, some are in a loop
+bool JobGraph::HasCycle()
+{
+	std::vector<int> remaining(jobs.size());
+	std::vector<int> ready;
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		remaining[i] = jobs[i].DependencyCount;
+		if (remaining[i] == 0)
+			ready.push_back((int)i);
+	}
+
+	size_t retired = 0;
+	while (!ready.empty())
+	{
+		int job = ready.back();
+		ready.pop_back();
+		retired++;
+
+		for (int d : jobs[job].Dependents)
+		{
+			if (--remaining[d] == 0)
+				ready.push_back(d);
+		}
+	}
+
+	return retired != jobs.size();
+}
+
+bool JobGraph::Run(unsigned int threadCount)
+{
+	if (HasCycle())
+		return false;
+
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	Launch(threadCount - 1);
+	Finish();
+	return true;
+}
+
+bool JobGraph::Start(unsigned int threadCount)
+{
+	if (HasCycle())
+		return false;
+
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	Launch(std::max(threadCount - 1, 1u));
+	return true;
+}
+
+void JobGraph::Launch(unsigned int workerCount)
+{
+	lastThreadCount = workerCount + 1;
+
+	ready.clear();
+	readyMain.clear();
+	remaining.resize(jobs.size());
+	finished = 0;
+
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		remaining[i] = jobs[i].DependencyCount;
+		if (remaining[i] == 0)
+			(jobs[i].MainThread ? readyMain : ready).push_back((int)i);
+	}
+
+	for (unsigned int t = 0; t < workerCount; t++)
+		workers.emplace_back(&JobGraph::WorkerLoop, this);
+}
+
+// Runs a job (without holding the lock), then releases
+// anything that was only waiting on it
+void JobGraph::Execute(std::unique_lock<std::mutex>& lock, int job)
+{
+	lock.unlock();
+
+	auto start = std::chrono::steady_clock::now();
+	jobs[job].Work();
+	jobs[job].Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	lock.lock();
+	for (int d : jobs[job].Dependents)
+	{
+		if (--remaining[d] == 0)
+			(jobs[d].MainThread ? readyMain : ready).push_back(d);
+	}
+	finished++;
+	wake.notify_all();
+}
+
+void JobGraph::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wake.wait(lock, [&]() { return !ready.empty() || finished == jobs.size(); });
+		if (ready.empty())
+			return;
+
+		int job = ready.front();
+		ready.pop_front();
+		Execute(lock, job);
+	}
+}
+
+int JobGraph::RunMainThreadJobs(double budgetMilliseconds)
+{
+	auto start = std::chrono::steady_clock::now();
+	int ran = 0;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!readyMain.empty())
+	{
+		int job = readyMain.front();
+		readyMain.pop_front();
+		Execute(lock, job);
+		ran++;
+
+		if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > budgetMilliseconds)
+			break;
+	}
+	return ran;
+}
+
+void JobGraph::Finish()
+{
+	// This thread owns the main thread jobs, and picks up
+	// regular ones whenever none of its own are ready
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (finished < jobs.size())
+		{
+			wake.wait(lock, [&]() { return !readyMain.empty() || !ready.empty() || finished == jobs.size(); });
+
+			std::deque<int>& queue = readyMain.empty() ? ready : readyMain;
+			if (queue.empty())
+				break;
+
+			int job = queue.front();
+			queue.pop_front();
+			Execute(lock, job);
+		}
+	}
+
+	for (auto& t : workers)
+		t.join();
+	workers.clear();
+}
+
+bool JobGraph::IsFinished()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return finished == jobs.size();
+}
+
+int JobGraph::GetRemainingJobCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)(jobs.size() - finished);
+}
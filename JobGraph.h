@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// A set of jobs with dependencies between them, run across
+// worker threads.  A job starts as soon as everything it
+// depends on has finished.
+//
+// Jobs marked as main thread jobs only ever run on the
+// thread that called Run(), which is where anything that
+// touches the immediate context has to go.  That thread
+// also helps out with regular jobs while it waits.
+//
+// Start() runs the same graph without blocking, for loading
+// in the background: workers get going on regular jobs, and
+// main thread jobs wait until RunMainThreadJobs() is called
+// (once a frame, say).
+// --------------------------------------------------------
+class JobGraph
+{
+public:
+	~JobGraph();
+
+	int AddJob(std::string name, std::function<void()> work, bool mainThread = false);
+
+	// job won't start until dependsOn has finished
+	void AddDependency(int job, int dependsOn);
+
+	// Runs every job and returns once they're all done.  threadCount
+	// includes the calling thread, and 0 means one per core.  Returns
+	// false (running nothing) if the dependencies have a cycle.
+	bool Run(unsigned int threadCount = 0);
+
+	// Starts running the graph and returns right away.  threadCount
+	// means the same as for Run(), but at least one worker is always
+	// started since this thread is off doing other things.
+	bool Start(unsigned int threadCount = 0);
+
+	// Runs whichever main thread jobs are ready, stopping early once
+	// budgetMilliseconds have gone by.  Returns how many ran.
+	int RunMainThreadJobs(double budgetMilliseconds);
+
+	// Blocks until everything started by Start() is done
+	void Finish();
+
+	bool IsFinished();
+	int GetRemainingJobCount();
+
+	int GetJobCount() { return (int)jobs.size(); }
+
+	// Stats from the last Run()
+	unsigned int GetThreadCount() { return lastThreadCount; }
+	double GetJobMilliseconds(int job) { return jobs[job].Milliseconds; }
+	const std::string& GetJobName(int job) { return jobs[job].Name; }
+
+private:
+	struct Job
+	{
+		std::string Name;
+		std::function<void()> Work;
+		bool MainThread;
+		std::vector<int> Dependents;
+		int DependencyCount;
+		double Milliseconds;
+	};
+
+	std::vector<Job> jobs;
+	unsigned int lastThreadCount = 0;
+
+	// Run state, guarded by mutex
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<int> ready;
+	std::deque<int> readyMain;
+	std::vector<int> remaining;
+	size_t finished = 0;
+	std::vector<std::thread> workers;
+
+	bool HasCycle();
+	void Launch(unsigned int workerCount);
+	void Execute(std::unique_lock<std::mutex>& lock, int job);
+	void WorkerLoop();
+};
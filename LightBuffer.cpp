@@ -0,0 +1,189 @@
+#include "LightBuffer.h"
+
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+// Clean lights between two dirty runs that are shorter than
+// this get uploaded anyway, to save on UpdateSubresource calls
+static const unsigned int MaxMergeGap = 4;
+
+LightBuffer::LightBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context) :
+	device(device),
+	context(context),
+	capacity(0),
+	uploadedCount(0),
+	allDirty(true),
+	uploadedBytes(0),
+	uploadCalls(0)
+{
+}
+
+// --------------------------------------------------------
+// Helpers for packing
+// --------------------------------------------------------
+static unsigned int PackSnorm16(float value)
+{
+	float clamped = std::clamp(value, -1.0f, 1.0f);
+	return (unsigned int)(int)std::round(clamped * 32767.0f) & 0xFFFF;
+}
+
+static unsigned int PackUnorm8(float value)
+{
+	return (unsigned int)std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+}
+
+// Octahedral encoding of a direction (doesn't need to be normalized)
+static unsigned int PackDirection(XMFLOAT3 dir)
+{
+	float length = std::fabs(dir.x) + std::fabs(dir.y) + std::fabs(dir.z);
+	if (length == 0.0f)
+		return 0; // Decodes to +Z
+
+	float x = dir.x / length;
+	float y = dir.y / length;
+
+	// Fold the lower hemisphere over the upper one
+	if (dir.z < 0.0f)
+	{
+		float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	return PackSnorm16(x) | (PackSnorm16(y) << 16);
+}
+
+PackedLight LightBuffer::Pack(const Light& light)
+{
+	PackedLight p = {};
+	p.Position = light.Position;
+	p.Direction = PackDirection(light.Direction);
+
+	p.ColorType =
+		PackUnorm8(light.Color.x) |
+		(PackUnorm8(light.Color.y) << 8) |
+		(PackUnorm8(light.Color.z) << 16) |
+		((unsigned int)light.Type << 24);
+
+	p.RangeIntensity =
+		PackedVector::XMConvertFloatToHalf(light.Range) |
+		(PackedVector::XMConvertFloatToHalf(light.Intensity) << 16);
+
+	p.SpotFalloff = PackedVector::XMConvertFloatToHalf(light.SpotFalloff);
+	return p;
+}
+
+void LightBuffer::MarkDirty(unsigned int index)
+{
+	if (index >= dirty.size())
+		dirty.resize(index + 1, false);
+
+	dirty[index] = true;
+}
+
+void LightBuffer::MarkAllDirty()
+{
+	allDirty = true;
+}
+
+// --------------------------------------------------------
+// Uploads dirty lights, merging nearby ones into a single
+// UpdateSubresource() call.  Grows the buffer if needed.
+// --------------------------------------------------------
+void LightBuffer::Update(const std::vector<Light>& lights)
+{
+	unsigned int count = (unsigned int)lights.size();
+	uploadedBytes = 0;
+	uploadCalls = 0;
+
+	if (count > capacity)
+		Resize(count);
+
+	// Anything past what we've uploaded before is new
+	if (allDirty)
+	{
+		dirty.assign(count, true);
+	}
+	else
+	{
+		dirty.resize(count, false);
+		for (unsigned int i = uploadedCount; i < count; i++)
+			dirty[i] = true;
+	}
+
+	unsigned int i = 0;
+	while (i < count)
+	{
+		if (!dirty[i])
+		{
+			i++;
+			continue;
+		}
+
+		// Extend the run over dirty lights and small clean gaps
+		unsigned int first = i;
+		unsigned int last = i;
+		for (i = i + 1; i < count && i - last <= MaxMergeGap; i++)
+		{
+			if (dirty[i])
+				last = i;
+		}
+
+		Upload(lights, first, last - first + 1);
+		i = last + 1;
+	}
+
+	dirty.assign(count, false);
+	allDirty = false;
+	uploadedCount = count;
+}
+
+void LightBuffer::Resize(unsigned int lightCount)
+{
+	// Grow geometrically so adding lights one at a time is cheap
+	capacity = max(lightCount, capacity * 2);
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = sizeof(PackedLight) * capacity;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(PackedLight);
+
+	buffer.Reset();
+	srv.Reset();
+	device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = capacity;
+	device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv.GetAddressOf());
+
+	// The new buffer starts out empty
+	allDirty = true;
+}
+
+void LightBuffer::Upload(const std::vector<Light>& lights, unsigned int first, unsigned int count)
+{
+	staging.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		staging[i] = Pack(lights[first + i]);
+
+	D3D11_BOX box = {};
+	box.left = first * sizeof(PackedLight);
+	box.right = (first + count) * sizeof(PackedLight);
+	box.top = 0;
+	box.bottom = 1;
+	box.front = 0;
+	box.back = 1;
+	context->UpdateSubresource(buffer.Get(), 0, &box, &staging[0], 0, 0);
+
+	uploadedBytes += count * sizeof(PackedLight);
+	uploadCalls++;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+
+#include "Lights.h"
+
+// --------------------------------------------------------
+// GPU copy of a light, as stored in the lights structured
+// buffer.  Must match PackedLight in Lighting.hlsli.
+// --------------------------------------------------------
+struct PackedLight
+{
+	DirectX::XMFLOAT3	Position;
+	unsigned int		Direction;		// Octahedral encoding, 2x snorm16
+	unsigned int		ColorType;		// RGB as unorm8, type in the top byte
+	unsigned int		RangeIntensity;	// Range (low) and intensity (high) as halfs
+	unsigned int		SpotFalloff;	// Half, top 16 bits unused
+	unsigned int		Padding;		// 32 bytes
+};
+static_assert(sizeof(PackedLight) == 32, "PackedLight must be 32 bytes");
+
+// --------------------------------------------------------
+// Holds the scene's lights in a structured buffer that grows
+// to fit however many there are.  Only lights marked dirty
+// (plus any new ones) are uploaded by Update().
+// --------------------------------------------------------
+class LightBuffer
+{
+public:
+	LightBuffer(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context
+	);
+
+	static PackedLight Pack(const Light& light);
+
+	// Change set: call these whenever lights are edited
+	void MarkDirty(unsigned int index);
+	void MarkAllDirty();
+
+	// Uploads whatever changed since the last update
+	void Update(const std::vector<Light>& lights);
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV() { return srv; }
+	unsigned int GetCapacity() { return capacity; }
+
+	// Stats for the most recent Update()
+	unsigned int GetUploadedBytes() { return uploadedBytes; }
+	unsigned int GetUploadCalls() { return uploadCalls; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	unsigned int capacity;
+
+	// Lights uploaded so far, and which of them have changed since
+	unsigned int uploadedCount;
+	std::vector<bool> dirty;
+	bool allDirty;
+
+	std::vector<PackedLight> staging;
+	unsigned int uploadedBytes;
+	unsigned int uploadCalls;
+
+	void Resize(unsigned int lightCount);
+	void Upload(const std::vector<Light>& lights, unsigned int first, unsigned int count);
+};
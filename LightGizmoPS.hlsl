@@ -0,0 +1,10 @@
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float4 color			: COLOR;
+};
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	return float4(input.color.rgb, 1);
+}
@@ -0,0 +1,36 @@
+// Data that changes at most once per frame
+cbuffer perFrame : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+// Per-vertex data from the sphere mesh, plus per-instance
+// data (one instance per point light) from the second slot
+struct VertexShaderInput
+{
+	float3 position			: POSITION;
+	float4 positionScale	: POSITIONSCALE_PER_INSTANCE; // xyz = world position, w = uniform scale
+	float4 color			: COLOR_PER_INSTANCE;
+};
+
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float4 color			: COLOR;
+};
+
+// --------------------------------------------------------
+// Places one light's gizmo - there's no rotation, so
+// the world transform is just a scale and a translation
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input)
+{
+	VertexToPixel output;
+
+	float3 worldPos = input.position * input.positionScale.w + input.positionScale.xyz;
+	output.screenPosition = mul(projection, mul(view, float4(worldPos, 1.0f)));
+	output.color = input.color;
+
+	return output;
+}
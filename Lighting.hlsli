@@ -25,12 +25,26 @@ struct Light
 	float3	Padding;	// 64 bytes
 };
 
+// Lights as they're stored in the lights structured buffer
+// Must match PackedLight in LightBuffer.h
+struct PackedLight
+{
+	float3	Position;
+	uint	Direction;		// Octahedral encoding, 2x snorm16
+	uint	ColorType;		// RGB as unorm8, type in the top byte
+	uint	RangeIntensity;	// Range (low) and intensity (high) as halfs
+	uint	SpotFalloff;	// Half, top 16 bits unused
+	uint	Padding;		// 32 bytes
+};
+
 // === UTILITY FUNCTIONS ============================================
 
-// Basic sample and unpack
+// Basic sample and unpack.  Only X and Y are read (BC5 normal
+// maps don't store Z), and Z is rebuilt from them.
 float3 SampleAndUnpackNormalMap(Texture2D map, SamplerState samp, float2 uv)
 {
-	return map.Sample(samp, uv).rgb * 2.0f - 1.0f;
+	float2 xy = map.Sample(samp, uv).rg * 2.0f - 1.0f;
+	return float3(xy, sqrt(saturate(1.0f - dot(xy, xy))));
 }
 
 // Handle converting tangent-space normal map to world space normal
@@ -65,6 +79,40 @@ float Attenuate(Light light, float3 worldPos)
 
 
 
+// Unpacks a direction stored with octahedral encoding
+float3 UnpackDirection(uint packed)
+{
+	// Sign extend each 16 bit half
+	float2 e = float2((int)(packed << 16) >> 16, (int)packed >> 16);
+	e = max(e / 32767.0f, -1.0f);
+
+	// Unfold the lower hemisphere
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+// Expands a light from the structured buffer
+Light UnpackLight(PackedLight packed)
+{
+	Light light;
+	light.Type = packed.ColorType >> 24;
+	light.Direction = UnpackDirection(packed.Direction);
+	light.Range = f16tof32(packed.RangeIntensity);
+	light.Position = packed.Position;
+	light.Intensity = f16tof32(packed.RangeIntensity >> 16);
+	light.Color = float3(
+		packed.ColorType & 0xFF,
+		(packed.ColorType >> 8) & 0xFF,
+		(packed.ColorType >> 16) & 0xFF) / 255.0f;
+	light.SpotFalloff = f16tof32(packed.SpotFalloff);
+	light.Padding = float3(0, 0, 0);
+	return light;
+}
+
+
+
 // === BASIC LIGHTING ===============================================
 
 // Lambert diffuse BRDF
@@ -311,20 +359,31 @@ float3 SpotLightPBR(Light light, float3 normal, float3 worldPos, float3 camPos,
 
 // Indirect diffuse irradiance for the scene
 // 
-// Uses an irradiance map for indirect diffuse lighting
+// Evaluates irradiance stored as 9 spherical harmonics per channel,
+// pre-packed on the CPU (see IBLPrecompute::PackIrradianceSH())
 //
-// irrMap			- The irradiance cube map
-// samp				- Sampler to use
-// direction		- Direction for sampling cube map
+// sh				- Red, green and blue linear terms, then red, green
+//					  and blue quadratic terms, then the x^2 - y^2 term
+// normal			- Surface normal (must be normalized)
 //
-float3 IndirectDiffuse(TextureCube irrMap, SamplerState samp, float3 direction)
+float3 IndirectDiffuseSH(float4 sh[7], float3 normal)
 {
-	// Sample in the specified direction - the irradiance map
-	// is a pre-computed cube map which represents light
-	// coming into this pixel from a particular hemisphere
-	float3 diff = irrMap.SampleLevel(samp, direction, 0).rgb;
-	return pow(abs(diff), 2.2);
-
+	// Constant and linear terms
+	float4 n = float4(normal, 1);
+	float3 result;
+	result.r = dot(sh[0], n);
+	result.g = dot(sh[1], n);
+	result.b = dot(sh[2], n);
+
+	// Quadratic terms
+	float4 quad = normal.xyzz * normal.yzzx;
+	result.r += dot(sh[3], quad);
+	result.g += dot(sh[4], quad);
+	result.b += dot(sh[5], quad);
+	result += sh[6].rgb * (normal.x * normal.x - normal.y * normal.y);
+
+	// Already linear, unlike the old irradiance map
+	return max(result, 0);
 }
 
 
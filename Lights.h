@@ -2,10 +2,6 @@
 
 #include <DirectXMath.h>
 
-// This define should match your
-// MAX_LIGHTS definition in your shader(s)
-#define MAX_LIGHTS 128
-
 // Light types
 // Must match definitions in shader
 #define LIGHT_TYPE_DIRECTIONAL	0
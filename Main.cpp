@@ -3,7 +3,465 @@
 #define SIMPLE_SHADER_REPORT_WARNINGS
 
 #include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
 #include "Game.h"
+#include "AssetManager.h"
+#include "DynamicResolution.h"
+#include "ImageLoader.h"
+#include "JobGraph.h"
+#include "Profiler.h"
+#include "SelfTest.h"
+
+// --------------------------------------------------------
+// Helpers for the command line modes below
+// --------------------------------------------------------
+static void OpenConsole()
+{
+	// Print to the console we were started from, or a new one
+	if (!AttachConsole(ATTACH_PARENT_PROCESS))
+		AllocConsole();
+	FILE* stream;
+	freopen_s(&stream, "CONOUT$", "w", stdout);
+}
+
+static unsigned int GetThreadCountArgument(const char* commandLine)
+{
+	unsigned int threadCount = 0; // One per core
+	const char* threads = strstr(commandLine, "-threads ");
+	if (threads)
+		threadCount = (unsigned int)atoi(threads + strlen("-threads "));
+	return threadCount;
+}
+
+// -budget-textures 256 (and -budget-meshes, -budget-bundles and
+// -budget-materials) limits that category of asset to 256 MB,
+// of both CPU and GPU memory.  -budget-streaming 256 limits the
+// mips texture streaming keeps resident to 256 MB.
+static void ApplyBudgetArguments(const char* commandLine)
+{
+	const char* streaming = strstr(commandLine, "-budget-streaming ");
+	if (streaming)
+	{
+		uint64_t megabytes = strtoull(streaming + strlen("-budget-streaming "), 0, 10);
+		AssetManager::GetInstance().GetTextureStreamer().SetMemoryBudget(megabytes * 1024 * 1024);
+	}
+
+	AssetBudget& budget = AssetManager::GetInstance().GetMemoryBudget();
+	for (int category = 0; category < AssetCategoryCount; category++)
+	{
+		std::string option = std::string("-budget-") + AssetBudget::GetCategoryName((AssetCategory)category) + " ";
+		std::transform(option.begin(), option.end(), option.begin(), [](char c) { return (char)tolower(c); });
+		const char* megabytes = strstr(commandLine, option.c_str());
+		if (!megabytes)
+			continue;
+
+		uint64_t bytes = strtoull(megabytes + option.size(), 0, 10) * 1024 * 1024;
+		budget.SetBudget((AssetCategory)category, { bytes, bytes });
+	}
+}
+
+static void GetExeFolder(char exePath[1024], wchar_t wideExePath[1024])
+{
+	// Same folder DXCore::GetExePath() finds
+	GetModuleFileName(0, exePath, 1024);
+	char* lastSlash = strrchr(exePath, '\\');
+	if (lastSlash)
+		*lastSlash = 0;
+
+	mbstowcs_s(0, wideExePath, 1024, exePath, 1024);
+}
+
+// --------------------------------------------------------
+// Loads every asset without a window or any GPU resources
+// and reports how long it took, to measure load times on
+// their own.  Command line: -headless-load [-threads N]
+// Add -recompress to skip the texture cache, which reports
+// the PSNR of every compressed texture.  With -profile-startup
+// the load is traced (see Profiler) too.
+// --------------------------------------------------------
+static int RunHeadlessLoad(const char* commandLine)
+{
+	OpenConsole();
+	unsigned int threadCount = GetThreadCountArgument(commandLine);
+
+	char exePath[1024] = {};
+	wchar_t wideExePath[1024] = {};
+	GetExeFolder(exePath, wideExePath);
+
+	AssetManager& assets = AssetManager::GetInstance();
+	assets.Initialize(exePath, wideExePath, 0, 0);
+	if (strstr(commandLine, "-recompress"))
+		assets.SetTextureCacheEnabled(false);
+	assets.Load(threadCount);
+	if (Profiler::IsRecording())
+		Profiler::GetInstance().Finish();
+	delete& assets;
+	delete& Profiler::GetInstance();
+	return 0;
+}
+
+// --------------------------------------------------------
+// Loads everything on a device (with no window), then budgets
+// each category down to nothing so whatever isn't referenced
+// is evicted, and draws a frame with what's left: every entity
+// and every sky.  Anything drawing with an asset it doesn't
+// hold a reference to would be drawing with freed memory here.
+// Then everything's used again, so it all has to load back in.
+// Returns non-zero if nothing was evicted, or anything that was
+// didn't come back.  Command line: -budget-test [-threads N]
+// --------------------------------------------------------
+static int RunBudgetTest(const char* commandLine)
+{
+	OpenConsole();
+	unsigned int threadCount = GetThreadCountArgument(commandLine);
+
+	char exePath[1024] = {};
+	wchar_t wideExePath[1024] = {};
+	GetExeFolder(exePath, wideExePath);
+
+	// Meshes and textures are only resident with a device, and WARP
+	// is enough for a frame nothing looks at
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	HRESULT hr = D3D11CreateDevice(0, D3D_DRIVER_TYPE_HARDWARE, 0, 0, 0, 0, D3D11_SDK_VERSION, device.GetAddressOf(), 0, context.GetAddressOf());
+	if (FAILED(hr))
+		hr = D3D11CreateDevice(0, D3D_DRIVER_TYPE_WARP, 0, 0, 0, 0, D3D11_SDK_VERSION, device.GetAddressOf(), 0, context.GetAddressOf());
+	if (FAILED(hr))
+	{
+		printf("Couldn't create a device\n");
+		return 1;
+	}
+
+	AssetManager& assets = AssetManager::GetInstance();
+	assets.Initialize(exePath, wideExePath, device, context);
+	assets.Load(threadCount);
+	AssetBudget& budget = assets.GetMemoryBudget();
+	budget.PrintStats();
+
+	Camera camera(0, 0, -10, 5.0f, 0.002f, 16.0f / 9.0f);
+	auto drawFrame = [&]()
+		{
+			for (auto& entity : assets.GetEntities())
+				entity.Value->Draw(context, &camera);
+			for (auto& sky : assets.GetSkies())
+				sky.Value->Draw(&camera);
+			context->Flush();
+		};
+	auto setBudgets = [&](uint64_t bytes)
+		{
+			for (int category = 0; category < AssetCategoryCount; category++)
+				budget.SetBudget((AssetCategory)category, { bytes, bytes });
+		};
+	auto updateUntilSettled = [&]()
+		{
+			// Each pass can free up (or want) what the last one didn't
+			for (int i = 0; i < 16 && assets.Update(1000.0); i++)
+				drawFrame();
+		};
+
+	setBudgets(0);
+	updateUntilSettled();
+	drawFrame();
+	printf("With nothing budgeted:\n");
+	budget.PrintStats();
+	uint64_t evictions = budget.GetEvictionCount();
+
+	// Everything counts as wanted once it's used, referenced or not
+	for (auto& mesh : assets.GetMeshes())
+		mesh.Value->Get();
+	for (auto& bundle : assets.GetBundles())
+		bundle.Value->Get();
+	for (auto& material : assets.GetMaterials())
+		material.Value->Get();
+	setBudgets(AssetBudget::Unlimited);
+	updateUntilSettled();
+	drawFrame();
+	printf("Once everything's used again:\n");
+	budget.PrintStats();
+
+	bool passed = true;
+	if (evictions == 0)
+	{
+		printf("FAILED: nothing was evicted, so nothing was tested\n");
+		passed = false;
+	}
+	for (int category = 0; category < AssetCategoryCount; category++)
+	{
+		size_t resident = budget.GetResidentCount((AssetCategory)category);
+		size_t count = budget.GetCount((AssetCategory)category);
+		if (resident != count)
+		{
+			printf("FAILED: %zu of %zu %s didn't load again\n", count - resident, count, AssetBudget::GetCategoryName((AssetCategory)category));
+			passed = false;
+		}
+	}
+	if (passed)
+		printf("Passed: %llu evicted, %llu loaded again\n", (unsigned long long)evictions, (unsigned long long)budget.GetLoadCount());
+
+	delete& assets;
+	return passed ? 0 : 1;
+}
+
+// --------------------------------------------------------
+// Checks the CPU image based lighting against environments
+// with known answers (see SelfTest::IBL() and
+// SelfTest::SphericalHarmonics()).  Returns non-zero if any
+// check fails.  Command line: -test-ibl [-threads N]
+// --------------------------------------------------------
+static int RunIBLTest(const char* commandLine)
+{
+	OpenConsole();
+	bool passed = SelfTest::IBL(GetThreadCountArgument(commandLine));
+	passed &= SelfTest::SphericalHarmonics();
+	printf(passed ? "Every check passed\n" : "Some checks FAILED\n");
+	return passed ? 0 : 1;
+}
+
+// --------------------------------------------------------
+// Checks which mips texture streaming picks and plans for
+// (see SelfTest::TextureStreaming()).  Returns non-zero if
+// any check fails.  Command line: -test-streaming
+// --------------------------------------------------------
+static int RunStreamingTest()
+{
+	OpenConsole();
+	bool passed = SelfTest::TextureStreaming();
+	printf(passed ? "Every check passed\n" : "Some checks FAILED\n");
+	return passed ? 0 : 1;
+}
+
+// --------------------------------------------------------
+// Traces and resolves a small asset dependency graph (see
+// SelfTest::Dependencies()).  Returns non-zero if any check
+// fails.  Command line: -test-dependencies
+// --------------------------------------------------------
+static int RunDependenciesTest()
+{
+	OpenConsole();
+	bool passed = SelfTest::Dependencies();
+	printf(passed ? "Every check passed\n" : "Some checks FAILED\n");
+	return passed ? 0 : 1;
+}
+
+// --------------------------------------------------------
+// Compiles small render graphs without a device (see
+// SelfTest::RenderGraph()).  Returns non-zero if any check
+// fails.  Command line: -test-render-graph
+// --------------------------------------------------------
+static int RunRenderGraphTest()
+{
+	OpenConsole();
+	bool passed = SelfTest::RenderGraph();
+	printf(passed ? "Every check passed\n" : "Some checks FAILED\n");
+	return passed ? 0 : 1;
+}
+
+// --------------------------------------------------------
+// Checks the dynamic resolution controller's response to a
+// synthetic step input, and replays a recorded frame time
+// trace if there's one (see SelfTest::DynamicScaling()).
+// Returns non-zero if any check fails.  Command line:
+// -test-dynamic-resolution [-trace path], where a recording
+// (from the Dynamic Resolution part of the UI) is saved to
+// DynamicResolution::TracePath.
+// --------------------------------------------------------
+static int RunDynamicResolutionTest(const char* commandLine)
+{
+	OpenConsole();
+	char tracePath[1024] = {};
+	const char* trace = strstr(commandLine, "-trace ");
+	if (trace && sscanf_s(trace + strlen("-trace "), "%1023s", tracePath, (unsigned)sizeof(tracePath)) != 1)
+		tracePath[0] = 0;
+
+	bool passed = SelfTest::DynamicScaling(tracePath[0] ? tracePath : 0);
+	printf(passed ? "Every check passed\n" : "Some checks FAILED\n");
+	return passed ? 0 : 1;
+}
+
+// --------------------------------------------------------
+// Times decoding every PNG under Assets/, with the files
+// already in memory so only the decoders are measured:
+// PngDecoder on one thread, PngDecoder with one job per file
+// across all threads, and WIC on one thread for comparison.
+// Command line: -decode-benchmark [-threads N]
+// --------------------------------------------------------
+static int RunDecodeBenchmark(const char* commandLine)
+{
+	OpenConsole();
+	unsigned int threadCount = GetThreadCountArgument(commandLine);
+
+	char exePath[1024] = {};
+	wchar_t wideExePath[1024] = {};
+	GetExeFolder(exePath, wideExePath);
+
+	struct EncodedFile
+	{
+		std::filesystem::path Path;
+		std::vector<uint8_t> Data;
+	};
+	std::vector<EncodedFile> files;
+	size_t bytesIn = 0;
+	for (auto& entry : std::filesystem::recursive_directory_iterator(std::filesystem::path(wideExePath) / L"Assets"))
+	{
+		if (!entry.is_regular_file() || entry.path().extension() != L".png")
+			continue;
+
+		std::ifstream stream(entry.path(), std::ios::binary | std::ios::ate);
+		EncodedFile file;
+		file.Path = entry.path();
+		file.Data.resize((size_t)stream.tellg());
+		stream.seekg(0);
+		stream.read((char*)file.Data.data(), file.Data.size());
+		bytesIn += file.Data.size();
+		files.push_back(std::move(file));
+	}
+
+	std::vector<ImageData> images(files.size());
+	auto report = [&](const char* name, std::chrono::steady_clock::time_point start)
+	{
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		size_t bytesOut = 0;
+		int failed = 0;
+		for (ImageData& image : images)
+		{
+			bytesOut += image.Pixels.size();
+			if (image.Pixels.empty())
+				failed++;
+			image = ImageData();
+		}
+
+		printf("%-28s %8.1f ms  %7.1f MB/s in  %7.1f MB/s out",
+			name, milliseconds,
+			bytesIn / (milliseconds * 1000.0),
+			bytesOut / (milliseconds * 1000.0));
+		if (failed > 0)
+			printf("  (%d failed)", failed);
+		printf("\n");
+	};
+
+	printf("Decoding %zu PNGs, %.1f MB\n", files.size(), bytesIn / (1024.0 * 1024.0));
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < files.size(); i++)
+		PngDecoder::Decode(files[i].Data.data(), files[i].Data.size(), images[i]);
+	report("PngDecoder, 1 thread", start);
+
+	JobGraph graph;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		graph.AddJob(files[i].Path.filename().string(), [&, i]()
+			{
+				PngDecoder::Decode(files[i].Data.data(), files[i].Data.size(), images[i]);
+			});
+	}
+	start = std::chrono::steady_clock::now();
+	graph.Run(threadCount);
+	char name[64];
+	sprintf_s(name, "PngDecoder, %u threads", graph.GetThreadCount());
+	report(name, start);
+
+	// WIC reads from disk, but the files were just read so
+	// they're coming out of the file cache
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < files.size(); i++)
+		ImageLoader::DecodeWithWIC(files[i].Path.wstring(), images[i]);
+	report("WIC, 1 thread", start);
+	return 0;
+}
+
+// --------------------------------------------------------
+// Packs Assets/ and Definitions/ into the archive the asset
+// manager reads from whenever it exists (delete it to go back
+// to the loose files).  Command line: -build-archive
+// Add -no-compression to store every file as is.
+// --------------------------------------------------------
+static int RunBuildArchive(const char* commandLine)
+{
+	OpenConsole();
+	bool compress = !strstr(commandLine, "-no-compression");
+
+	auto start = std::chrono::steady_clock::now();
+	if (!AssetArchive::Build(".", AssetManager::GetArchiveFolders(), AssetManager::ArchivePath, compress))
+	{
+		printf("Couldn't build %s\n", AssetManager::ArchivePath);
+		return 1;
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	AssetArchive archive;
+	if (!archive.Open(AssetManager::ArchivePath))
+	{
+		printf("Built %s but couldn't open it\n", AssetManager::ArchivePath);
+		return 1;
+	}
+
+	uint64_t size = 0;
+	uint64_t storedSize = 0;
+	size_t compressed = 0;
+	for (size_t i = 0; i < archive.GetEntryCount(); i++)
+	{
+		const ArchiveEntry& entry = archive.GetEntry(i);
+		size += entry.Size;
+		storedSize += entry.StoredSize;
+		if (entry.Flags & AssetArchive::CompressedFlag)
+			compressed++;
+	}
+	printf("Built %s in %.1f ms: %zu files (%zu compressed), %.2f MB stored as %.2f MB\n",
+		AssetManager::ArchivePath,
+		milliseconds,
+		archive.GetEntryCount(),
+		compressed,
+		size / (1024.0 * 1024.0),
+		storedSize / (1024.0 * 1024.0));
+	return 0;
+}
+
+// --------------------------------------------------------
+// Compiles every bundle, material and entity definition into
+// the scene file the asset manager loads instead of them
+// whenever it exists (delete it to go back to the
+// definitions).  Command line: -compile-scene
+// --------------------------------------------------------
+static int RunCompileScene()
+{
+	OpenConsole();
+
+	char exePath[1024] = {};
+	wchar_t wideExePath[1024] = {};
+	GetExeFolder(exePath, wideExePath);
+
+	AssetManager& assets = AssetManager::GetInstance();
+	assets.Initialize(exePath, wideExePath, 0, 0);
+
+	auto start = std::chrono::steady_clock::now();
+	bool compiled = assets.CompileScene();
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	delete& assets;
+	if (!compiled)
+	{
+		printf("Couldn't compile %s\n", AssetManager::CompiledScenePath);
+		return 1;
+	}
+
+	CompiledScene scene;
+	if (!scene.Open(AssetManager::CompiledScenePath))
+	{
+		printf("Compiled %s but couldn't open it\n", AssetManager::CompiledScenePath);
+		return 1;
+	}
+	printf("Compiled %s in %.1f ms: %zu bundles, %zu materials, %zu entities (%.2f MB)\n",
+		AssetManager::CompiledScenePath,
+		milliseconds,
+		scene.GetBundleCount(),
+		scene.GetMaterialCount(),
+		scene.GetEntityCount(),
+		std::filesystem::file_size(AssetManager::CompiledScenePath) / (1024.0 * 1024.0));
+	return 0;
+}
 
 // --------------------------------------------------------
 // Entry point for a graphical (non-console) Windows application
@@ -21,6 +479,35 @@ int WINAPI WinMain(
 	_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+	// Traces everything up to the end of loading, then writes it to
+	// Profiler::TracePath and prints a summary.  Command line:
+	// -profile-startup (with a window or -headless-load)
+	if (strstr(lpCmdLine, "-profile-startup"))
+		Profiler::GetInstance().Start();
+
+	ApplyBudgetArguments(lpCmdLine);
+
+	if (strstr(lpCmdLine, "-headless-load"))
+		return RunHeadlessLoad(lpCmdLine);
+	if (strstr(lpCmdLine, "-budget-test"))
+		return RunBudgetTest(lpCmdLine);
+	if (strstr(lpCmdLine, "-test-ibl"))
+		return RunIBLTest(lpCmdLine);
+	if (strstr(lpCmdLine, "-test-streaming"))
+		return RunStreamingTest();
+	if (strstr(lpCmdLine, "-test-dependencies"))
+		return RunDependenciesTest();
+	if (strstr(lpCmdLine, "-test-render-graph"))
+		return RunRenderGraphTest();
+	if (strstr(lpCmdLine, "-test-dynamic-resolution"))
+		return RunDynamicResolutionTest(lpCmdLine);
+	if (strstr(lpCmdLine, "-decode-benchmark"))
+		return RunDecodeBenchmark(lpCmdLine);
+	if (strstr(lpCmdLine, "-build-archive"))
+		return RunBuildArchive(lpCmdLine);
+	if (strstr(lpCmdLine, "-compile-scene"))
+		return RunCompileScene();
+
 	// Create the Game object using
 	// the app handle we got from WinMain
 	Game dxGame(hInstance);
@@ -0,0 +1,86 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::filesystem::path& path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+	file = handle;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart <= 0)
+	{
+		Close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	mapping = CreateFileMappingW(handle, 0, PAGE_READONLY, 0, 0, 0);
+	if (!mapping)
+	{
+		Close();
+		return false;
+	}
+	base = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return false;
+
+	struct stat info = {};
+	if (fstat(descriptor, &info) != 0 || info.st_size <= 0)
+	{
+		close(descriptor);
+		return false;
+	}
+	size = (size_t)info.st_size;
+
+	void* view = mmap(0, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor); // The mapping keeps the file open
+	base = view == MAP_FAILED ? 0 : (const uint8_t*)view;
+#endif
+	if (!base)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (base)
+		UnmapViewOfFile(base);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+#else
+	if (base)
+		munmap((void*)base, size);
+#endif
+
+	base = 0;
+	size = 0;
+	file = 0;
+	mapping = 0;
+}
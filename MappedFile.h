@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// --------------------------------------------------------
+// A whole file mapped read only into memory, so reading it
+// is just reading memory, and pages only come in as they're
+// touched.  Stays mapped until it's closed or destroyed.
+// --------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// False if the file is missing, empty or couldn't be mapped
+	bool Open(const std::filesystem::path& path);
+	void Close();
+	bool IsOpen() const { return base != 0; }
+
+	const uint8_t* GetData() const { return base; }
+	size_t GetSize() const { return size; }
+
+private:
+	const uint8_t* base = 0;
+	size_t size = 0;
+
+	// Platform handles for the mapping
+	void* file = 0;
+	void* mapping = 0;
+};
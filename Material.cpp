@@ -6,7 +6,7 @@ Material::Material(
 	DirectX::XMFLOAT4 color,
 	float shininess,
 	DirectX::XMFLOAT2 uvScale,
-	TextureBundle* textures,
+	AssetHandle<TextureBundle>* textures,
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler,
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> clampler)
 {
@@ -15,6 +15,7 @@ Material::Material(
 	this->color = color;
 	this->shininess = shininess;
 	this->SRVs = textures;
+	this->SRVs->AddReference();
 	this->sampler = sampler;
 	this->uvScale = uvScale;
 	this->clampSampler = clampler;
@@ -23,6 +24,14 @@ Material::Material(
 
 Material::~Material()
 {
+	SRVs->RemoveReference();
+}
+
+void Material::SetSRVs(AssetHandle<TextureBundle>* b)
+{
+	b->AddReference();
+	SRVs->RemoveReference();
+	SRVs = b;
 }
 
 void Material::PrepareMaterial(Transform* transform, Camera* cam)
@@ -45,10 +54,12 @@ void Material::PrepareMaterial(Transform* transform, Camera* cam)
 	ps->CopyBufferData("perMaterial");
 
 	// Set SRVs
-	ps->SetShaderResourceView("AlbedoTexture", SRVs->albedo);
-	ps->SetShaderResourceView("NormalTexture", SRVs->normal);
-	ps->SetShaderResourceView("RoughnessTexture", SRVs->roughness);
-	ps->SetShaderResourceView("MetalTexture", SRVs->metalness);
+	TextureBundle* textures = GetSRVs();
+	ps->SetShaderResourceView("AlbedoTexture", textures->albedo);
+	ps->SetShaderResourceView("NormalTexture", textures->normal);
+	ps->SetShaderResourceView("RoughnessTexture", textures->roughness ? textures->roughness : textures->roughnessMetalAO);
+	ps->SetShaderResourceView("MetalTexture", textures->metalness);
+	ps->SetShaderResourceView("RoughnessMetalAOTexture", textures->roughnessMetalAO);
 
 	// Set sampler
 	ps->SetSamplerState("BasicSampler", sampler);
@@ -72,10 +83,12 @@ void Material::SetPerMaterialDataAndResources(bool copyToGPUNow)
 	}
 
 	// Loop and set any other resources
-	ps->SetShaderResourceView("AlbedoTexture", SRVs->albedo.Get());
-	ps->SetShaderResourceView("NormalTexture", SRVs->normal.Get());
-	ps->SetShaderResourceView("RoughnessTexture", SRVs->roughness.Get());
-	ps->SetShaderResourceView("MetalnessTexture", SRVs->metalness.Get());
+	TextureBundle* textures = GetSRVs();
+	ps->SetShaderResourceView("AlbedoTexture", textures->albedo.Get());
+	ps->SetShaderResourceView("NormalTexture", textures->normal.Get());
+	ps->SetShaderResourceView("RoughnessTexture", textures->roughness ? textures->roughness.Get() : textures->roughnessMetalAO.Get());
+	ps->SetShaderResourceView("MetalTexture", textures->metalness.Get());
+	ps->SetShaderResourceView("RoughnessMetalAOTexture", textures->roughnessMetalAO.Get());
 	ps->SetSamplerState("BasicSampler", sampler);
 	ps->SetSamplerState("ClampSampler", clampSampler);
 }
@@ -8,6 +8,7 @@
 #include "Camera.h"
 #include "Lights.h"
 #include "TextureBundle.h"
+#include "AssetHandle.h"
 #include "Transform.h"
 
 class Material
@@ -19,11 +20,14 @@ public:
 		DirectX::XMFLOAT4 color, 
 		float shininess, 
 		DirectX::XMFLOAT2 uvScale, 
-		TextureBundle* textures,
+		AssetHandle<TextureBundle>* textures,
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler,
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> clampler);
 	~Material();
 
+	Material(const Material&) = delete;
+	Material& operator=(const Material&) = delete;
+
 	void PrepareMaterial(Transform* transform, Camera* cam);
 	void SetPerMaterialDataAndResources(bool copyToGPUNow = true);
 
@@ -35,9 +39,15 @@ public:
 	void SetVS(SimpleVertexShader* vs) { this->vs = vs; }
 	void SetPS(SimplePixelShader* ps) { this->ps = ps; }
 
-	TextureBundle* GetSRVs() { return SRVs; }
+	DirectX::XMFLOAT4 GetColor() { return color; }
+	float GetShininess() { return shininess; }
+	DirectX::XMFLOAT2 GetUVScale() { return uvScale; }
+
+	TextureBundle* GetSRVs() { return SRVs->Get(); }
+	AssetHandle<TextureBundle>* GetTextures() { return SRVs; }
 
-	void SetSRVs(TextureBundle* b) { this->SRVs = b; }
+	// Materials hold a reference to their textures' handle
+	void SetSRVs(AssetHandle<TextureBundle>* b);
 
 private:
 	SimpleVertexShader* vs;
@@ -48,7 +58,7 @@ private:
 	float shininess;
 	bool refractive;
 
-	TextureBundle* SRVs;
+	AssetHandle<TextureBundle>* SRVs;	// Placeholder textures until the real ones load
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> clampSampler;
 };
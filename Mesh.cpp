@@ -1,4 +1,6 @@
 #include "Mesh.h"
+#include "PipelineStateCache.h"
+#include "DerivedDataCache.h"
 #include <DirectXMath.h>
 #include <vector>
 #include <fstream>
@@ -14,19 +16,33 @@ Mesh::Mesh(std::string name, Vertex* vertArray, int numVerts, unsigned int* inde
 Mesh::Mesh(std::string name, const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 {
 	this->name = name;
+
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	if (!ParseOBJ(objFile, verts, indices))
+		return;
+
+	CreateBuffers(&verts[0], (int)verts.size(), &indices[0], (int)indices.size(), device);
+}
+
+bool Mesh::ParseOBJ(const char* objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
 	// File input object
 	std::ifstream obj(objFile);
 
 	// Check for successful open
 	if (!obj.is_open())
-		return;
+		return false;
+
+	return ParseOBJ(obj, verts, indices);
+}
 
+bool Mesh::ParseOBJ(std::istream& obj, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
 	// Variables used while reading the file
 	std::vector<XMFLOAT3> positions;     // Positions from the file
 	std::vector<XMFLOAT3> normals;       // Normals from the file
 	std::vector<XMFLOAT2> uvs;           // UVs from the file
-	std::vector<Vertex> verts;           // Verts we're assembling
-	std::vector<UINT> indices;           // Indices of these verts
 	unsigned int vertCounter = 0;        // Count of vertices/indices
 	char chars[100];                     // String for line reading
 
@@ -171,10 +187,6 @@ Mesh::Mesh(std::string name, const char* objFile, Microsoft::WRL::ComPtr<ID3D11D
 		}
 	}
 
-	// Close the file and create the actual buffers
-	obj.close();
-
-
 	// - At this point, "verts" is a vector of Vertex structs, and can be used
 	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
 	//
@@ -186,9 +198,46 @@ Mesh::Mesh(std::string name, const char* objFile, Microsoft::WRL::ComPtr<ID3D11D
 	//    an index buffer in this case?  Sure!  Though, if your mesh class assumes you have
 	//    one, you'll need to write some extra code to handle cases when you don't.
 
-	CreateBuffers(&verts[0], vertCounter, &indices[0], vertCounter, device);
+	return vertCounter > 0;
+}
 
+uint64_t Mesh::HashInputs(const uint8_t* source, size_t size)
+{
+	uint64_t hash = DerivedDataCache::FNVOffset;
+	DerivedDataCache::HashBytes(hash, &CacheVersion, sizeof(CacheVersion));
+	DerivedDataCache::HashBytes(hash, source, size);
+	return hash;
+}
+
+std::vector<uint8_t> Mesh::SerializeGeometry(const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices)
+{
+	DerivedDataWriter out;
+	out.Write((uint32_t)verts.size());
+	out.Write((uint32_t)indices.size());
+	out.Write(verts.data(), verts.size() * sizeof(Vertex));
+	out.Write(indices.data(), indices.size() * sizeof(unsigned int));
+	return out.Data;
+}
 
+bool Mesh::DeserializeGeometry(const std::vector<uint8_t>& data, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	DerivedDataReader in = { data.data(), data.size() };
+
+	uint32_t counts[2] = {};
+	if (!in.Read(counts) || counts[0] > data.size() / sizeof(Vertex) || counts[1] > data.size() / sizeof(unsigned int))
+		return false;
+
+	std::vector<Vertex> loadedVerts(counts[0]);
+	std::vector<unsigned int> loadedIndices(counts[1]);
+	if (!in.Read(loadedVerts.data(), loadedVerts.size() * sizeof(Vertex)) ||
+		!in.Read(loadedIndices.data(), loadedIndices.size() * sizeof(unsigned int)) ||
+		!in.IsFinished() ||
+		loadedVerts.empty())
+		return false;
+
+	verts = std::move(loadedVerts);
+	indices = std::move(loadedIndices);
+	return true;
 }
 
 
@@ -202,6 +251,7 @@ void Mesh::CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArr
 {
 	// Always calculate the tangents before copying to buffer
 	CalculateTangents(vertArray, numVerts, indexArray, numIndices);
+	CalculateBounds(vertArray, numVerts, indexArray, numIndices);
 
 
 	// Create the vertex buffer
@@ -230,6 +280,41 @@ void Mesh::CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArr
 
 	// Save the indices
 	this->numIndices = numIndices;
+	bufferBytes = vbd.ByteWidth + ibd.ByteWidth;
+}
+
+
+// Works out the bounding radius, and the UV density: the square
+// root of how much UV area there is for each unit of surface area
+void Mesh::CalculateBounds(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+{
+	float radiusSquared = 0;
+	for (int i = 0; i < numVerts; i++)
+	{
+		XMVECTOR position = XMLoadFloat3(&verts[i].Position);
+		radiusSquared = fmaxf(radiusSquared, XMVectorGetX(XMVector3LengthSq(position)));
+	}
+	boundingRadius = sqrtf(radiusSquared);
+
+	float area = 0;
+	float uvArea = 0;
+	for (int i = 0; i + 2 < numIndices; i += 3)
+	{
+		Vertex& v0 = verts[indices[i]];
+		Vertex& v1 = verts[indices[i + 1]];
+		Vertex& v2 = verts[indices[i + 2]];
+
+		XMVECTOR edge1 = XMLoadFloat3(&v1.Position) - XMLoadFloat3(&v0.Position);
+		XMVECTOR edge2 = XMLoadFloat3(&v2.Position) - XMLoadFloat3(&v0.Position);
+		area += XMVectorGetX(XMVector3Length(XMVector3Cross(edge1, edge2))) * 0.5f;
+
+		float u1 = v1.UV.x - v0.UV.x, t1 = v1.UV.y - v0.UV.y;
+		float u2 = v2.UV.x - v0.UV.x, t2 = v2.UV.y - v0.UV.y;
+		uvArea += fabsf(u1 * t2 - u2 * t1) * 0.5f;
+	}
+
+	// Anything without UVs (or surface) just counts as one to one
+	uvDensity = (area > 0 && uvArea > 0) ? sqrtf(uvArea / area) : 1.0f;
 }
 
 
@@ -317,8 +402,17 @@ void Mesh::SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context
 	// Set buffers in the input assembler
 	UINT stride = sizeof(Vertex);
 	UINT offset = 0;
-	context->IASetVertexBuffers(0, 1, vb.GetAddressOf(), &stride, &offset);
-	context->IASetIndexBuffer(ib.Get(), DXGI_FORMAT_R32_UINT, 0);
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+	if (cache.IsInitialized())
+	{
+		cache.SetVertexBuffer(0, vb.Get(), stride, offset);
+		cache.SetIndexBuffer(ib.Get(), DXGI_FORMAT_R32_UINT, 0);
+	}
+	else
+	{
+		context->IASetVertexBuffers(0, 1, vb.GetAddressOf(), &stride, &offset);
+		context->IASetIndexBuffer(ib.Get(), DXGI_FORMAT_R32_UINT, 0);
+	}
 
 	// Draw this mesh
 	context->DrawIndexed(this->numIndices, 0, 0);
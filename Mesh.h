@@ -2,7 +2,9 @@
 
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <istream>
 #include <string>
+#include <vector>
 
 #include "Vertex.h"
 
@@ -14,9 +16,30 @@ public:
 	Mesh(std::string name, const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
 	~Mesh(void);
 
+	// Reads an OBJ file into vertices and indices without touching the
+	// GPU, so it's safe to call from any thread.  False if the file
+	// couldn't be opened or had no faces.  The stream version is for
+	// files that are already in memory (like ones in an archive).
+	static bool ParseOBJ(const char* objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+	static bool ParseOBJ(std::istream& obj, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
+	// Parsed geometry for the derived data cache.  Bump the version
+	// whenever parsing changes what comes out.
+	static const uint32_t CacheVersion = 1;
+	static uint64_t HashInputs(const uint8_t* source, size_t size);
+	static std::vector<uint8_t> SerializeGeometry(const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices);
+	static bool DeserializeGeometry(const std::vector<uint8_t>& data, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer() { return vb; }
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer() { return ib; }
 	int GetIndexCount() { return numIndices; }
+	size_t GetBufferBytes() { return bufferBytes; }	// Vertices and indices, on the GPU
+
+	// How far the furthest vertex is from the origin, and how much
+	// UV space a unit of surface covers on average (which is what
+	// works out how densely its textures are seen)
+	float GetBoundingRadius() { return boundingRadius; }
+	float GetUVDensity() { return uvDensity; }
 
 	void SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
@@ -26,9 +49,13 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vb;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ib;
 	int numIndices;
+	size_t bufferBytes;
+	float boundingRadius;
+	float uvDensity;
 
 	void CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device);
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	void CalculateBounds(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
 
 };
 
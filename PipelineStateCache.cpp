@@ -0,0 +1,183 @@
+#include "PipelineStateCache.h"
+
+// Singleton requirement
+PipelineStateCache* PipelineStateCache::instance;
+
+PipelineStateCache::~PipelineStateCache()
+{
+}
+
+void PipelineStateCache::Initialize(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->context = context;
+	Invalidate();
+}
+
+// --------------------------------------------------------
+// Marks every tracked slot as unknown, so the next call
+// for each of them goes straight to the context
+// --------------------------------------------------------
+void PipelineStateCache::Invalidate()
+{
+	vertexShader.Known = false;
+	pixelShader.Known = false;
+	inputLayout.Known = false;
+	indexBuffer.Known = false;
+	topology.Known = false;
+
+	for (int stage = 0; stage < PIPELINE_STAGE_COUNT; stage++)
+	{
+		for (auto& cb : constantBuffers[stage]) cb.Known = false;
+		for (auto& s : samplers[stage]) s.Known = false;
+	}
+
+	for (auto& vb : vertexBuffers) vb.Known = false;
+
+	InvalidateShaderResources();
+}
+
+void PipelineStateCache::InvalidateShaderResources()
+{
+	for (int stage = 0; stage < PIPELINE_STAGE_COUNT; stage++)
+	{
+		for (auto& srv : shaderResources[stage]) srv.Known = false;
+	}
+}
+
+template<typename T>
+bool PipelineStateCache::Update(Slot<T>& slot, const T& value, PipelineStateCall call)
+{
+	// Already bound?  Drop the call
+	if (slot.Known && slot.Bound == value)
+	{
+		counters[call].Filtered++;
+		return false;
+	}
+
+	slot.Bound = value;
+	slot.Known = true;
+	counters[call].Issued++;
+	return true;
+}
+
+void PipelineStateCache::SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	context->OMSetRenderTargets(count, rtvs, dsv);
+
+	// Any of these targets that were bound as inputs have
+	// just been unbound by the runtime without telling us
+	InvalidateShaderResources();
+}
+
+void PipelineStateCache::SetVertexShader(ID3D11VertexShader* shader)
+{
+	if (Update(vertexShader, shader, PIPELINE_CALL_SHADER))
+		context->VSSetShader(shader, 0, 0);
+}
+
+void PipelineStateCache::SetPixelShader(ID3D11PixelShader* shader)
+{
+	if (Update(pixelShader, shader, PIPELINE_CALL_SHADER))
+		context->PSSetShader(shader, 0, 0);
+}
+
+void PipelineStateCache::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (Update(inputLayout, layout, PIPELINE_CALL_INPUT_LAYOUT))
+		context->IASetInputLayout(layout);
+}
+
+void PipelineStateCache::SetConstantBuffer(PipelineStage stage, unsigned int slot, ID3D11Buffer* buffer)
+{
+	if (slot >= MaxConstantBuffers || !Update(constantBuffers[stage][slot], buffer, PIPELINE_CALL_CONSTANT_BUFFER))
+		return;
+
+	switch (stage)
+	{
+	case PIPELINE_STAGE_VERTEX: context->VSSetConstantBuffers(slot, 1, &buffer); break;
+	case PIPELINE_STAGE_PIXEL: context->PSSetConstantBuffers(slot, 1, &buffer); break;
+	}
+}
+
+void PipelineStateCache::SetShaderResource(PipelineStage stage, unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	if (slot >= MaxShaderResources || !Update(shaderResources[stage][slot], srv, PIPELINE_CALL_SHADER_RESOURCE))
+		return;
+
+	switch (stage)
+	{
+	case PIPELINE_STAGE_VERTEX: context->VSSetShaderResources(slot, 1, &srv); break;
+	case PIPELINE_STAGE_PIXEL: context->PSSetShaderResources(slot, 1, &srv); break;
+	}
+}
+
+void PipelineStateCache::SetSampler(PipelineStage stage, unsigned int slot, ID3D11SamplerState* sampler)
+{
+	if (slot >= MaxSamplers || !Update(samplers[stage][slot], sampler, PIPELINE_CALL_SAMPLER))
+		return;
+
+	switch (stage)
+	{
+	case PIPELINE_STAGE_VERTEX: context->VSSetSamplers(slot, 1, &sampler); break;
+	case PIPELINE_STAGE_PIXEL: context->PSSetSamplers(slot, 1, &sampler); break;
+	}
+}
+
+void PipelineStateCache::SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	VertexBufferBinding binding = { buffer, stride, offset };
+	if (slot < MaxVertexBuffers && Update(vertexBuffers[slot], binding, PIPELINE_CALL_VERTEX_BUFFER))
+		context->IASetVertexBuffers(slot, 1, &buffer, &stride, &offset);
+}
+
+void PipelineStateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	IndexBufferBinding binding = { buffer, format, offset };
+	if (Update(indexBuffer, binding, PIPELINE_CALL_INDEX_BUFFER))
+		context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void PipelineStateCache::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (Update(this->topology, topology, PIPELINE_CALL_TOPOLOGY))
+		context->IASetPrimitiveTopology(topology);
+}
+
+// --------------------------------------------------------
+// Unbinds a range of SRV slots.  Only slots that might
+// still hold something count towards the issued calls, but
+// the range always goes to the context as a single call
+// --------------------------------------------------------
+void PipelineStateCache::ClearShaderResources(PipelineStage stage, unsigned int startSlot, unsigned int count)
+{
+	if (startSlot >= MaxShaderResources)
+		return;
+	if (startSlot + count > MaxShaderResources)
+		count = MaxShaderResources - startSlot;
+
+	bool anyBound = false;
+	for (unsigned int i = startSlot; i < startSlot + count; i++)
+	{
+		ID3D11ShaderResourceView* nullSRV = 0;
+		anyBound = Update(shaderResources[stage][i], nullSRV, PIPELINE_CALL_SHADER_RESOURCE) || anyBound;
+	}
+
+	if (!anyBound)
+		return;
+
+	ID3D11ShaderResourceView* nullSRVs[MaxShaderResources] = {};
+	switch (stage)
+	{
+	case PIPELINE_STAGE_VERTEX: context->VSSetShaderResources(startSlot, count, nullSRVs); break;
+	case PIPELINE_STAGE_PIXEL: context->PSSetShaderResources(startSlot, count, nullSRVs); break;
+	}
+}
+
+void PipelineStateCache::EndFrame()
+{
+	for (int i = 0; i < PIPELINE_CALL_COUNT; i++)
+	{
+		lastFrameCounters[i] = counters[i];
+		counters[i] = {};
+	}
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// Shader stages the cache tracks (the only two the renderer uses)
+enum PipelineStage
+{
+	PIPELINE_STAGE_VERTEX,
+	PIPELINE_STAGE_PIXEL,
+
+	// Count is always the last one!
+	PIPELINE_STAGE_COUNT
+};
+
+// Categories of device context calls that go through the cache
+enum PipelineStateCall
+{
+	PIPELINE_CALL_SHADER,
+	PIPELINE_CALL_INPUT_LAYOUT,
+	PIPELINE_CALL_CONSTANT_BUFFER,
+	PIPELINE_CALL_SHADER_RESOURCE,
+	PIPELINE_CALL_SAMPLER,
+	PIPELINE_CALL_VERTEX_BUFFER,
+	PIPELINE_CALL_INDEX_BUFFER,
+	PIPELINE_CALL_TOPOLOGY,
+
+	// Count is always the last one!
+	PIPELINE_CALL_COUNT
+};
+
+// String representations of the call categories
+constexpr const char* PipelineCallToString(int value) {
+	switch (value) {
+	case PIPELINE_CALL_SHADER: return "Shaders";
+	case PIPELINE_CALL_INPUT_LAYOUT: return "Input Layouts";
+	case PIPELINE_CALL_CONSTANT_BUFFER: return "Constant Buffers";
+	case PIPELINE_CALL_SHADER_RESOURCE: return "Shader Resources";
+	case PIPELINE_CALL_SAMPLER: return "Samplers";
+	case PIPELINE_CALL_VERTEX_BUFFER: return "Vertex Buffers";
+	case PIPELINE_CALL_INDEX_BUFFER: return "Index Buffers";
+	default: return "Topology";
+	}
+}
+
+// How many calls of one category reached the device context,
+// and how many were dropped because the state was already bound
+struct PipelineStateCounter
+{
+	unsigned int Issued;
+	unsigned int Filtered;
+};
+
+// --------------------------------------------------------
+// Sits in front of the device context and drops calls that
+// would re-bind state that is already bound.
+//
+// Anything that binds tracked state directly on the context
+// (instead of through this class) must call Invalidate()
+// afterwards so the cache doesn't filter a needed call.
+// --------------------------------------------------------
+class PipelineStateCache
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static PipelineStateCache& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new PipelineStateCache();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	PipelineStateCache(PipelineStateCache const&) = delete;
+	void operator=(PipelineStateCache const&) = delete;
+
+private:
+	static PipelineStateCache* instance;
+	PipelineStateCache() : counters(), lastFrameCounters() { Invalidate(); };
+#pragma endregion
+
+public:
+	~PipelineStateCache();
+
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	bool IsInitialized() { return context != 0; }
+
+	// Forget everything we think is bound
+	void Invalidate();
+
+	// Binding render targets silently unbinds any of their SRVs,
+	// so this always issues and forgets all shader resource slots
+	void SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv);
+
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetConstantBuffer(PipelineStage stage, unsigned int slot, ID3D11Buffer* buffer);
+	void SetShaderResource(PipelineStage stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(PipelineStage stage, unsigned int slot, ID3D11SamplerState* sampler);
+	void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+
+	// Unbinds a range of shader resource slots in one call
+	void ClearShaderResources(PipelineStage stage, unsigned int startSlot, unsigned int count);
+
+	// Counters are accumulated per frame; EndFrame() saves them
+	// for display and starts over
+	void EndFrame();
+	const PipelineStateCounter& GetFrameCounter(PipelineStateCall call) { return lastFrameCounters[call]; }
+
+private:
+	static const unsigned int MaxConstantBuffers = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	static const unsigned int MaxShaderResources = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+	static const unsigned int MaxSamplers = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	static const unsigned int MaxVertexBuffers = D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+
+	// A single piece of tracked state.  Known is false until
+	// the cache has bound something there itself.
+	template<typename T>
+	struct Slot
+	{
+		T Bound;
+		bool Known;
+	};
+
+	struct VertexBufferBinding
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Stride;
+		unsigned int Offset;
+		bool operator==(const VertexBufferBinding&) const = default;
+	};
+
+	struct IndexBufferBinding
+	{
+		ID3D11Buffer* Buffer;
+		DXGI_FORMAT Format;
+		unsigned int Offset;
+		bool operator==(const IndexBufferBinding&) const = default;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	// Raw pointers are safe here: the context holds a reference
+	// to anything that is actually bound
+	Slot<ID3D11VertexShader*> vertexShader;
+	Slot<ID3D11PixelShader*> pixelShader;
+	Slot<ID3D11InputLayout*> inputLayout;
+	Slot<ID3D11Buffer*> constantBuffers[PIPELINE_STAGE_COUNT][MaxConstantBuffers];
+	Slot<ID3D11ShaderResourceView*> shaderResources[PIPELINE_STAGE_COUNT][MaxShaderResources];
+	Slot<ID3D11SamplerState*> samplers[PIPELINE_STAGE_COUNT][MaxSamplers];
+	Slot<VertexBufferBinding> vertexBuffers[MaxVertexBuffers];
+	Slot<IndexBufferBinding> indexBuffer;
+	Slot<D3D11_PRIMITIVE_TOPOLOGY> topology;
+
+	PipelineStateCounter counters[PIPELINE_CALL_COUNT];
+	PipelineStateCounter lastFrameCounters[PIPELINE_CALL_COUNT];
+
+	void InvalidateShaderResources();
+
+	// Returns true (and counts an issued call) if the slot needs the new value
+	template<typename T>
+	bool Update(Slot<T>& slot, const T& value, PipelineStateCall call);
+};
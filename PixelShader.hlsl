@@ -1,9 +1,6 @@
 
 #include "Lighting.hlsli"
 
-// How many lights could we handle?
-#define MAX_LIGHTS 128
-
 // Data that can change per material
 cbuffer perMaterial : register(b0)
 {
@@ -17,9 +14,6 @@ cbuffer perMaterial : register(b0)
 // Data that only changes once per frame
 cbuffer perFrame : register(b1)
 {
-	// An array of light data
-	Light Lights[MAX_LIGHTS];
-
 	// The amount of lights THIS FRAME
 	int LightCount;
 
@@ -50,6 +44,7 @@ struct PS_Output
 Texture2D AlbedoTexture			: register(t0);
 Texture2D NormalTexture			: register(t1);
 Texture2D RoughnessTexture		: register(t2);
+StructuredBuffer<PackedLight> Lights	: register(t3);
 SamplerState BasicSampler		: register(s0);
 
 
@@ -78,19 +73,21 @@ PS_Output main(VertexToPixel input) : SV_TARGET
 	// Loop through all lights this frame
 	for(int i = 0; i < LightCount; i++)
 	{
+		Light light = UnpackLight(Lights[i]);
+
 		// Which kind of light?
-		switch (Lights[i].Type)
+		switch (light.Type)
 		{
 		case LIGHT_TYPE_DIRECTIONAL:
-			totalColor += DirLight(Lights[i], input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
+			totalColor += DirLight(light, input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
 			break;
 
 		case LIGHT_TYPE_POINT:
-			totalColor += PointLight(Lights[i], input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
+			totalColor += PointLight(light, input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
 			break;
 
 		case LIGHT_TYPE_SPOT:
-			totalColor += SpotLight(Lights[i], input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
+			totalColor += SpotLight(light, input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
 			break;
 		}
 	}
@@ -1,9 +1,6 @@
 
 #include "Lighting.hlsli"
 
-// How many lights could we handle?
-#define MAX_LIGHTS 128
-
 // Data that can change per material
 cbuffer perMaterial : register(b0)
 {
@@ -14,14 +11,18 @@ cbuffer perMaterial : register(b0)
 // Data that only changes once per frame
 cbuffer perFrame : register(b1)
 {
-	// An array of light data
-	Light Lights[MAX_LIGHTS];
-
 	// The amount of lights THIS FRAME
 	int LightCount;
 
 	// Needed for specular (reflection) calculation
 	float3 CameraPosition;
+
+	// Not used here, but keeps the layout of the shared per-frame data
+	int SpecIBLTotalMipLevels;
+	float3 perFramePadding;
+
+	// Diffuse light from the sky, as packed spherical harmonics
+	float4 IrradianceSH[7];
 };
 
 
@@ -46,8 +47,13 @@ struct PS_Output
 // Texture-related variables
 Texture2D AlbedoTexture			: register(t0);
 Texture2D NormalTexture			: register(t1);
+#ifdef PACKED_ROUGHNESS_METAL_AO
+Texture2D RoughnessMetalAOTexture	: register(t2); // See PixelShaderPBRPacked.hlsl
+#else
 Texture2D RoughnessTexture		: register(t2);
 Texture2D MetalTexture			: register(t3);
+#endif
+StructuredBuffer<PackedLight> Lights	: register(t4);
 SamplerState BasicSampler		: register(s0);
 
 
@@ -60,8 +66,16 @@ PS_Output main(VertexToPixel input) : SV_TARGET
 
 	// Sample various textures
 	input.normal = NormalMapping(NormalTexture, BasicSampler, input.uv, input.normal, input.tangent);
+#ifdef PACKED_ROUGHNESS_METAL_AO
+	float3 roughnessMetalAO = RoughnessMetalAOTexture.Sample(BasicSampler, input.uv).rgb;
+	float roughness = roughnessMetalAO.r;
+	float metal = roughnessMetalAO.g;
+	float ao = roughnessMetalAO.b;
+#else
 	float roughness = RoughnessTexture.Sample(BasicSampler, input.uv).r;
 	float metal = MetalTexture.Sample(BasicSampler, input.uv).r;
+	float ao = 1;
+#endif
 
 	// Gamma correct the texture back to linear space and apply the color tint
 	float4 surfaceColor = AlbedoTexture.Sample(BasicSampler, input.uv);
@@ -78,23 +92,28 @@ PS_Output main(VertexToPixel input) : SV_TARGET
 	// Loop through all lights this frame
 	for(int i = 0; i < LightCount; i++)
 	{
+		Light light = UnpackLight(Lights[i]);
+
 		// Which kind of light?
-		switch (Lights[i].Type)
+		switch (light.Type)
 		{
 		case LIGHT_TYPE_DIRECTIONAL:
-			totalColor += DirLightPBR(Lights[i], input.normal, input.worldPos, CameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+			totalColor += DirLightPBR(light, input.normal, input.worldPos, CameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
 
 		case LIGHT_TYPE_POINT:
-			totalColor += PointLightPBR(Lights[i], input.normal, input.worldPos, CameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+			totalColor += PointLightPBR(light, input.normal, input.worldPos, CameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
 
 		case LIGHT_TYPE_SPOT:
-			totalColor += SpotLightPBR(Lights[i], input.normal, input.worldPos, CameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+			totalColor += SpotLightPBR(light, input.normal, input.worldPos, CameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
 		}
 	}
 
+	// Indirect diffuse from the environment (metals have no diffuse)
+	totalColor += IndirectDiffuseSH(IrradianceSH, input.normal) * surfaceColor.rgb * (1 - metal) * ao;
+
 	PS_Output output;
 	output.color = float4(pow(totalColor, 1.0f / 2.2f), 1); // Gamma correction
 	output.normals = float4(input.normal * 0.5f + 0.5f, 1);
@@ -0,0 +1,6 @@
+
+// The PBR shader, reading roughness, metalness and ambient
+// occlusion from one packed texture (one sample instead of
+// two) for bundles made with "packed": true
+#define PACKED_ROUGHNESS_METAL_AO
+#include "PixelShaderPBR.hlsl"
@@ -0,0 +1,803 @@
+#include "PngDecoder.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PNG_DECODER_SSE2
+#endif
+
+// ----------------------------------------------------------------------------
+// Inflate (RFC 1950/1951)
+//
+// Bits are kept in a 64-bit buffer that's topped up once per symbol, which is
+// always enough for a length/distance pair and all of their extra bits.
+// Huffman codes of up to FastBits are decoded with a single table look up.
+// ----------------------------------------------------------------------------
+
+struct InflateBits
+{
+	const uint8_t* Data;
+	size_t Size;
+	size_t Position;
+	uint64_t Bits;
+	int Count;
+	int Padding; // Zero bytes fed in past the end of the data
+
+	void Refill()
+	{
+		// Little endian load of as many whole bytes as fit
+		if (Position + 8 <= Size)
+		{
+			uint64_t word;
+			memcpy(&word, Data + Position, 8);
+			Bits |= word << Count;
+			Position += (63 - Count) >> 3;
+			Count |= 56;
+			return;
+		}
+
+		while (Count <= 56)
+		{
+			if (Position < Size)
+				Bits |= (uint64_t)Data[Position++] << Count;
+			else
+				Padding++;
+			Count += 8;
+		}
+	}
+
+	unsigned int Read(int count)
+	{
+		unsigned int value = (unsigned int)(Bits & ((1ull << count) - 1));
+		Bits >>= count;
+		Count -= count;
+		return value;
+	}
+
+	// True if we've used bits that weren't actually there
+	bool Overrun() { return Padding * 8 > Count; }
+};
+
+struct InflateHuffman
+{
+	static const int FastBits = 10;
+
+	uint16_t Fast[1 << FastBits];	// (length << 9) | symbol, or 0 for longer codes
+	int MaxCode[17];				// One past the last code of each length, shifted up to 16 bits
+	uint16_t FirstCode[16];
+	uint16_t FirstSymbol[16];
+	uint8_t Lengths[288];
+	uint16_t Symbols[288];
+};
+
+static unsigned int ReverseBits(unsigned int value, int count)
+{
+	value = ((value & 0xAAAA) >> 1) | ((value & 0x5555) << 1);
+	value = ((value & 0xCCCC) >> 2) | ((value & 0x3333) << 2);
+	value = ((value & 0xF0F0) >> 4) | ((value & 0x0F0F) << 4);
+	value = ((value & 0xFF00) >> 8) | ((value & 0x00FF) << 8);
+	return value >> (16 - count);
+}
+
+// Canonical Huffman codes from a list of code lengths
+static bool BuildHuffman(InflateHuffman& huffman, const uint8_t* lengths, int count)
+{
+	int lengthCounts[17] = {};
+	int nextCode[16] = {};
+	memset(huffman.Fast, 0, sizeof(huffman.Fast));
+
+	for (int i = 0; i < count; i++)
+		lengthCounts[lengths[i]]++;
+	lengthCounts[0] = 0;
+
+	int code = 0;
+	int symbol = 0;
+	for (int length = 1; length < 16; length++)
+	{
+		if (lengthCounts[length] > (1 << length))
+			return false;
+
+		nextCode[length] = code;
+		huffman.FirstCode[length] = (uint16_t)code;
+		huffman.FirstSymbol[length] = (uint16_t)symbol;
+		code += lengthCounts[length];
+		if (lengthCounts[length] && code - 1 >= (1 << length))
+			return false;
+
+		huffman.MaxCode[length] = code << (16 - length);
+		code <<= 1;
+		symbol += lengthCounts[length];
+	}
+	huffman.MaxCode[16] = 0x10000;
+
+	for (int i = 0; i < count; i++)
+	{
+		int length = lengths[i];
+		if (!length)
+			continue;
+
+		int slot = nextCode[length] - huffman.FirstCode[length] + huffman.FirstSymbol[length];
+		huffman.Lengths[slot] = (uint8_t)length;
+		huffman.Symbols[slot] = (uint16_t)i;
+
+		// Codes are stored most significant bit first, but read the other way
+		if (length <= InflateHuffman::FastBits)
+		{
+			uint16_t entry = (uint16_t)((length << 9) | i);
+			for (unsigned int j = ReverseBits(nextCode[length], length); j < (1u << InflateHuffman::FastBits); j += 1u << length)
+				huffman.Fast[j] = entry;
+		}
+		nextCode[length]++;
+	}
+
+	return true;
+}
+
+// Returns -1 for an invalid code.  Bits must have been topped up.
+static int DecodeSymbol(InflateBits& in, const InflateHuffman& huffman)
+{
+	uint16_t entry = huffman.Fast[in.Bits & ((1 << InflateHuffman::FastBits) - 1)];
+	if (entry)
+	{
+		in.Read(entry >> 9);
+		return entry & 511;
+	}
+
+	// Longer codes: find the length by comparing against each maximum
+	int code = (int)ReverseBits((unsigned int)(in.Bits & 0xFFFF), 16);
+	int length = InflateHuffman::FastBits + 1;
+	while (code >= huffman.MaxCode[length])
+		length++;
+	if (length >= 16)
+		return -1;
+
+	int slot = (code >> (16 - length)) - huffman.FirstCode[length] + huffman.FirstSymbol[length];
+	if (slot >= 288 || huffman.Lengths[slot] != length)
+		return -1;
+
+	in.Read(length);
+	return huffman.Symbols[slot];
+}
+
+static const uint16_t LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static bool InflateBlock(InflateBits& in, const InflateHuffman& lengths, const InflateHuffman& distances, uint8_t* output, size_t& written, size_t outputSize)
+{
+	uint8_t* out = output + written;
+	uint8_t* end = output + outputSize;
+
+	while (true)
+	{
+		in.Refill();
+		int symbol = DecodeSymbol(in, lengths);
+		if (symbol < 256)
+		{
+			if (symbol < 0 || out == end)
+				return false;
+			*out++ = (uint8_t)symbol;
+			continue;
+		}
+		if (symbol == 256)
+			break;
+
+		symbol -= 257;
+		if (symbol >= 29)
+			return false;
+		size_t length = LengthBase[symbol] + in.Read(LengthExtra[symbol]);
+
+		int distanceSymbol = DecodeSymbol(in, distances);
+		if (distanceSymbol < 0 || distanceSymbol >= 30)
+			return false;
+		size_t distance = DistanceBase[distanceSymbol] + in.Read(DistanceExtra[distanceSymbol]);
+
+		if (distance > (size_t)(out - output) || length > (size_t)(end - out))
+			return false;
+
+		// Overlapping copies repeat what they've just written, so
+		// they're only done 8 bytes at a time when that's not a problem
+		const uint8_t* from = out - distance;
+		if (distance == 1)
+		{
+			memset(out, *from, length);
+			out += length;
+		}
+		else if (distance >= 8 && length + 8 <= (size_t)(end - out))
+		{
+			uint8_t* stop = out + length;
+			while (out < stop)
+			{
+				memcpy(out, from, 8);
+				out += 8;
+				from += 8;
+			}
+			out = stop;
+		}
+		else
+		{
+			while (length--)
+				*out++ = *from++;
+		}
+	}
+
+	written = out - output;
+	return !in.Overrun();
+}
+
+static void FixedHuffman(InflateHuffman& lengths, InflateHuffman& distances)
+{
+	uint8_t lengthSizes[288];
+	memset(lengthSizes + 0, 8, 144);
+	memset(lengthSizes + 144, 9, 112);
+	memset(lengthSizes + 256, 7, 24);
+	memset(lengthSizes + 280, 8, 8);
+	BuildHuffman(lengths, lengthSizes, 288);
+
+	uint8_t distanceSizes[30];
+	memset(distanceSizes, 5, 30);
+	BuildHuffman(distances, distanceSizes, 30);
+}
+
+static bool DynamicHuffman(InflateBits& in, InflateHuffman& lengths, InflateHuffman& distances)
+{
+	static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	in.Refill();
+	int lengthCount = in.Read(5) + 257;
+	int distanceCount = in.Read(5) + 1;
+	int codeLengthCount = in.Read(4) + 4;
+
+	uint8_t codeLengthSizes[19] = {};
+	for (int i = 0; i < codeLengthCount; i++)
+	{
+		in.Refill();
+		codeLengthSizes[order[i]] = (uint8_t)in.Read(3);
+	}
+
+	InflateHuffman codeLengths;
+	if (!BuildHuffman(codeLengths, codeLengthSizes, 19))
+		return false;
+
+	// Both sets of sizes come as one run, and repeats can cross between them
+	uint8_t sizes[286 + 30] = {};
+	int total = lengthCount + distanceCount;
+	int n = 0;
+	while (n < total)
+	{
+		in.Refill();
+		int symbol = DecodeSymbol(in, codeLengths);
+		if (symbol < 0)
+			return false;
+
+		if (symbol < 16)
+		{
+			sizes[n++] = (uint8_t)symbol;
+			continue;
+		}
+
+		uint8_t fill = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (n == 0)
+				return false;
+			fill = sizes[n - 1];
+			repeat = 3 + in.Read(2);
+		}
+		else if (symbol == 17)
+			repeat = 3 + in.Read(3);
+		else
+			repeat = 11 + in.Read(7);
+
+		if (n + repeat > total)
+			return false;
+		memset(sizes + n, fill, repeat);
+		n += repeat;
+	}
+
+	if (in.Overrun())
+		return false;
+
+	return
+		BuildHuffman(lengths, sizes, lengthCount) &&
+		BuildHuffman(distances, sizes + lengthCount, distanceCount);
+}
+
+bool PngDecoder::Inflate(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize)
+{
+	// zlib header: deflate, no preset dictionary
+	if (size < 2 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20))
+		return false;
+
+	InflateBits in = { data, size, 2, 0, 0, 0 };
+	InflateHuffman lengths;
+	InflateHuffman distances;
+	size_t written = 0;
+
+	bool last = false;
+	while (!last)
+	{
+		in.Refill();
+		last = in.Read(1) != 0;
+		unsigned int type = in.Read(2);
+
+		if (type == 0)
+		{
+			// Stored: skip to the next byte, and copy straight from the input
+			in.Read(in.Count & 7);
+			size_t position = in.Position + in.Padding - in.Count / 8;
+			in.Bits = 0;
+			in.Count = 0;
+			in.Padding = 0;
+			if (position + 4 > size)
+				return false;
+
+			unsigned int length = data[position] | (data[position + 1] << 8);
+			unsigned int check = data[position + 2] | (data[position + 3] << 8);
+			position += 4;
+			if ((length ^ 0xFFFF) != check || position + length > size || length > outputSize - written)
+				return false;
+
+			memcpy(output + written, data + position, length);
+			written += length;
+			in.Position = position + length;
+			continue;
+		}
+
+		if (type == 1)
+			FixedHuffman(lengths, distances);
+		else if (type != 2 || !DynamicHuffman(in, lengths, distances))
+			return false;
+
+		if (!InflateBlock(in, lengths, distances, output, written, outputSize))
+			return false;
+	}
+
+	// The Adler-32 check is skipped, the same as the chunk CRCs
+	return written == outputSize;
+}
+
+// ----------------------------------------------------------------------------
+// Unfiltering
+//
+// Sub, Average and Paeth depend on the pixel to the left, so they go one pixel
+// at a time.  For 3 and 4 byte pixels (nearly everything we ship) each pixel
+// is done as a whole in one SSE2 register, which is the same approach libpng
+// takes.  Up has no such dependency and is done 16 bytes at a time.
+// ----------------------------------------------------------------------------
+
+static uint8_t Paeth(int a, int b, int c)
+{
+	int pa = abs(b - c);
+	int pb = abs(a - c);
+	int pc = abs(a + b - 2 * c);
+	if (pa <= pb && pa <= pc)
+		return (uint8_t)a;
+	return (uint8_t)(pb <= pc ? b : c);
+}
+
+#ifdef PNG_DECODER_SSE2
+// Pixel sizes are template parameters so these have a fixed size.
+// 3 byte pixels are put together in a register, since going through
+// memory would stall on the (smaller) stores that came before.
+template <unsigned int bytesPerPixel>
+static __m128i LoadPixel(const uint8_t* p)
+{
+	int value = 0;
+	if (bytesPerPixel == 3)
+		value = p[0] | (p[1] << 8) | (p[2] << 16);
+	else
+		memcpy(&value, p, bytesPerPixel);
+	return _mm_cvtsi32_si128(value);
+}
+
+template <unsigned int bytesPerPixel>
+static void StorePixel(uint8_t* p, __m128i pixel)
+{
+	int value = _mm_cvtsi128_si32(pixel);
+	memcpy(p, &value, bytesPerPixel);
+}
+
+template <unsigned int bpp>
+static void UnfilterSubSSE2(uint8_t* row, size_t rowBytes)
+{
+	__m128i a = _mm_setzero_si128();
+	for (size_t i = 0; i < rowBytes; i += bpp)
+	{
+		a = _mm_add_epi8(a, LoadPixel<bpp>(row + i));
+		StorePixel<bpp>(row + i, a);
+	}
+}
+
+template <unsigned int bpp>
+static void UnfilterAverageSSE2(uint8_t* row, const uint8_t* previous, size_t rowBytes)
+{
+	// _mm_avg_epu8() rounds up, so take the low bit back off where it did
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	for (size_t i = 0; i < rowBytes; i += bpp)
+	{
+		__m128i b = LoadPixel<bpp>(previous + i);
+		__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(LoadPixel<bpp>(row + i), average);
+		StorePixel<bpp>(row + i, a);
+	}
+}
+
+template <unsigned int bpp>
+static void UnfilterPaethSSE2(uint8_t* row, const uint8_t* previous, size_t rowBytes)
+{
+	// Worked out in 16 bits, where the predictor can't overflow
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lowBytes = _mm_set1_epi16(0xFF);
+	__m128i a = zero;
+	__m128i c = zero;
+	for (size_t i = 0; i < rowBytes; i += bpp)
+	{
+		__m128i b = _mm_unpacklo_epi8(LoadPixel<bpp>(previous + i), zero);
+		__m128i x = _mm_unpacklo_epi8(LoadPixel<bpp>(row + i), zero);
+
+		// p = a + b - c, so p - a = b - c and p - b = a - c
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a, c);
+		__m128i pc = _mm_add_epi16(pa, pb);
+		pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+		pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+		pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+		// Ties go to a, then b, then c
+		__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		__m128i useA = _mm_cmpeq_epi16(smallest, pa);
+		__m128i useB = _mm_cmpeq_epi16(smallest, pb);
+		__m128i nearest = _mm_or_si128(_mm_and_si128(useB, b), _mm_andnot_si128(useB, c));
+		nearest = _mm_or_si128(_mm_and_si128(useA, a), _mm_andnot_si128(useA, nearest));
+
+		x = _mm_and_si128(_mm_add_epi16(x, nearest), lowBytes);
+		StorePixel<bpp>(row + i, _mm_packus_epi16(x, x));
+
+		a = x;
+		c = b;
+	}
+}
+#endif
+
+bool PngDecoder::UnfilterRow(uint8_t filter, uint8_t* row, const uint8_t* previous, size_t rowBytes, unsigned int bpp)
+{
+	// The row above the first one is all zeroes, which turns
+	// Up into nothing and Paeth into Sub
+	if (!previous)
+	{
+		if (filter == 2)
+			return true;
+		if (filter == 4)
+			filter = 1;
+	}
+
+	switch (filter)
+	{
+	case 0: // None
+		return true;
+
+	case 1: // Sub
+#ifdef PNG_DECODER_SSE2
+		if (bpp == 3 || bpp == 4)
+		{
+			if (bpp == 3)
+				UnfilterSubSSE2<3>(row, rowBytes);
+			else
+				UnfilterSubSSE2<4>(row, rowBytes);
+			return true;
+		}
+#endif
+		for (size_t i = bpp; i < rowBytes; i++)
+			row[i] += row[i - bpp];
+		return true;
+
+	case 2: // Up
+	{
+		size_t i = 0;
+#ifdef PNG_DECODER_SSE2
+		for (; i + 16 <= rowBytes; i += 16)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(previous + i));
+			_mm_storeu_si128((__m128i*)(row + i), _mm_add_epi8(x, b));
+		}
+#endif
+		for (; i < rowBytes; i++)
+			row[i] += previous[i];
+		return true;
+	}
+
+	case 3: // Average
+		if (!previous)
+		{
+			for (size_t i = bpp; i < rowBytes; i++)
+				row[i] += row[i - bpp] >> 1;
+			return true;
+		}
+#ifdef PNG_DECODER_SSE2
+		if (bpp == 3 || bpp == 4)
+		{
+			if (bpp == 3)
+				UnfilterAverageSSE2<3>(row, previous, rowBytes);
+			else
+				UnfilterAverageSSE2<4>(row, previous, rowBytes);
+			return true;
+		}
+#endif
+		for (size_t i = 0; i < bpp; i++)
+			row[i] += previous[i] >> 1;
+		for (size_t i = bpp; i < rowBytes; i++)
+			row[i] += (row[i - bpp] + previous[i]) >> 1;
+		return true;
+
+	case 4: // Paeth
+#ifdef PNG_DECODER_SSE2
+		if (bpp == 3 || bpp == 4)
+		{
+			if (bpp == 3)
+				UnfilterPaethSSE2<3>(row, previous, rowBytes);
+			else
+				UnfilterPaethSSE2<4>(row, previous, rowBytes);
+			return true;
+		}
+#endif
+		for (size_t i = 0; i < bpp; i++)
+			row[i] += previous[i];
+		for (size_t i = bpp; i < rowBytes; i++)
+			row[i] += Paeth(row[i - bpp], previous[i], previous[i - bpp]);
+		return true;
+	}
+
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+// PNG files
+// ----------------------------------------------------------------------------
+
+static const uint8_t Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+static uint32_t ReadBigEndian(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+struct PngHeader
+{
+	uint32_t Width;
+	uint32_t Height;
+	uint8_t BitDepth;
+	uint8_t ColorType;
+	unsigned int Channels;
+};
+
+static bool ReadHeader(const uint8_t* data, size_t size, PngHeader& header)
+{
+	// The signature, then IHDR (which has to be first)
+	if (size < 8 + 8 + 13 || memcmp(data, Signature, 8) != 0 || ReadBigEndian(data + 8) != 13 || memcmp(data + 12, "IHDR", 4) != 0)
+		return false;
+
+	const uint8_t* ihdr = data + 16;
+	header.Width = ReadBigEndian(ihdr);
+	header.Height = ReadBigEndian(ihdr + 4);
+	header.BitDepth = ihdr[8];
+	header.ColorType = ihdr[9];
+	uint8_t compression = ihdr[10];
+	uint8_t filterMethod = ihdr[11];
+	uint8_t interlace = ihdr[12];
+
+	switch (header.ColorType)
+	{
+	case 0: header.Channels = 1; break; // Grey
+	case 2: header.Channels = 3; break; // RGB
+	case 3: header.Channels = 1; break; // Palette
+	case 4: header.Channels = 2; break; // Grey and alpha
+	case 6: header.Channels = 4; break; // RGBA
+	default: return false;
+	}
+
+	return
+		header.Width > 0 && header.Width <= (1u << 24) &&
+		header.Height > 0 && header.Height <= (1u << 24) &&
+		(header.BitDepth == 8 || (header.BitDepth == 16 && header.ColorType != 3)) &&
+		compression == 0 && filterMethod == 0 && interlace == 0;
+}
+
+bool PngDecoder::CanDecode(const uint8_t* data, size_t size)
+{
+	PngHeader header;
+	return ReadHeader(data, size, header);
+}
+
+bool PngDecoder::Decode(const uint8_t* data, size_t size, ImageData& image)
+{
+	PngHeader header;
+	if (!ReadHeader(data, size, header))
+		return false;
+
+	// Gather the chunks we care about.  The image data is usually
+	// in a single IDAT, in which case it's used where it is.
+	uint8_t palette[256][4] = {};
+	bool hasColorKey = false;
+	uint16_t colorKey[3] = {};
+	std::vector<const uint8_t*> idatData;
+	std::vector<size_t> idatSizes;
+	size_t idatTotal = 0;
+
+	size_t position = 8;
+	while (position + 12 <= size)
+	{
+		size_t length = ReadBigEndian(data + position);
+		const uint8_t* type = data + position + 4;
+		const uint8_t* chunk = data + position + 8;
+		if (length > size - position - 12)
+			return false;
+
+		if (memcmp(type, "IDAT", 4) == 0)
+		{
+			idatData.push_back(chunk);
+			idatSizes.push_back(length);
+			idatTotal += length;
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			for (size_t i = 0; i < length / 3 && i < 256; i++)
+			{
+				palette[i][0] = chunk[i * 3 + 0];
+				palette[i][1] = chunk[i * 3 + 1];
+				palette[i][2] = chunk[i * 3 + 2];
+				palette[i][3] = 255;
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (header.ColorType == 3)
+			{
+				for (size_t i = 0; i < length && i < 256; i++)
+					palette[i][3] = chunk[i];
+			}
+			else if ((header.ColorType == 0 && length >= 2) || (header.ColorType == 2 && length >= 6))
+			{
+				hasColorKey = true;
+				for (size_t c = 0; c < length / 2 && c < 3; c++)
+					colorKey[c] = (uint16_t)((chunk[c * 2] << 8) | chunk[c * 2 + 1]);
+			}
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+		{
+			break;
+		}
+
+		position += length + 12;
+	}
+
+	if (idatData.empty())
+		return false;
+
+	std::vector<uint8_t> joined;
+	const uint8_t* compressed = idatData[0];
+	if (idatData.size() > 1)
+	{
+		joined.resize(idatTotal);
+		size_t offset = 0;
+		for (size_t i = 0; i < idatData.size(); i++)
+		{
+			memcpy(joined.data() + offset, idatData[i], idatSizes[i]);
+			offset += idatSizes[i];
+		}
+		compressed = joined.data();
+	}
+
+	// Each row is a filter type byte followed by the pixels
+	const unsigned int bytesPerPixel = header.Channels * header.BitDepth / 8;
+	const size_t rowBytes = (size_t)header.Width * bytesPerPixel;
+	const size_t stride = rowBytes + 1;
+	std::vector<uint8_t> raw(stride * header.Height);
+	if (!Inflate(compressed, idatTotal, raw.data(), raw.size()))
+		return false;
+
+	for (uint32_t y = 0; y < header.Height; y++)
+	{
+		uint8_t* row = &raw[y * stride + 1];
+		const uint8_t* previous = y > 0 ? row - stride : 0;
+		if (!UnfilterRow(row[-1], row, previous, rowBytes, bytesPerPixel))
+			return false;
+	}
+
+	// Everything ends up as RGBA8
+	image.Width = header.Width;
+	image.Height = header.Height;
+	image.Pixels.resize((size_t)header.Width * header.Height * 4);
+
+	const unsigned int sampleBytes = header.BitDepth / 8; // 16-bit samples are big endian, so the first byte is the top 8 bits
+	for (uint32_t y = 0; y < header.Height; y++)
+	{
+		const uint8_t* src = &raw[y * stride + 1];
+		uint8_t* dst = &image.Pixels[(size_t)y * header.Width * 4];
+
+		// The common cases get their own loops
+		if (sampleBytes == 1 && !hasColorKey)
+		{
+			switch (header.ColorType)
+			{
+			case 6:
+				memcpy(dst, src, rowBytes);
+				continue;
+			case 2:
+				for (uint32_t x = 0; x < header.Width; x++, src += 3, dst += 4)
+				{
+					dst[0] = src[0];
+					dst[1] = src[1];
+					dst[2] = src[2];
+					dst[3] = 255;
+				}
+				continue;
+			case 0:
+				for (uint32_t x = 0; x < header.Width; x++, src++, dst += 4)
+				{
+					dst[0] = dst[1] = dst[2] = *src;
+					dst[3] = 255;
+				}
+				continue;
+			}
+		}
+
+		for (uint32_t x = 0; x < header.Width; x++, src += bytesPerPixel, dst += 4)
+		{
+			switch (header.ColorType)
+			{
+			case 0:
+			case 4:
+				dst[0] = dst[1] = dst[2] = src[0];
+				dst[3] = header.ColorType == 4 ? src[sampleBytes] : 255;
+				break;
+			case 2:
+			case 6:
+				dst[0] = src[0];
+				dst[1] = src[sampleBytes];
+				dst[2] = src[sampleBytes * 2];
+				dst[3] = header.ColorType == 6 ? src[sampleBytes * 3] : 255;
+				break;
+			case 3:
+				memcpy(dst, palette[src[0]], 4);
+				break;
+			}
+
+			// Pixels matching the key (at full precision) are transparent
+			if (hasColorKey)
+			{
+				bool match = true;
+				for (unsigned int c = 0; c < header.Channels; c++)
+				{
+					uint16_t sample = sampleBytes == 2 ? (uint16_t)((src[c * 2] << 8) | src[c * 2 + 1]) : src[c];
+					match = match && sample == colorKey[c];
+				}
+				if (match)
+					dst[3] = 0;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool PngDecoder::DecodeFile(const std::filesystem::path& file, ImageData& image)
+{
+	std::ifstream stream(file, std::ios::binary | std::ios::ate);
+	if (!stream)
+		return false;
+
+	std::vector<uint8_t> data((size_t)stream.tellg());
+	stream.seekg(0);
+	if (!stream.read((char*)data.data(), data.size()))
+		return false;
+
+	return Decode(data.data(), data.size(), image);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// 8-bit RGBA pixels, rows top to bottom with no padding
+struct ImageData
+{
+	unsigned int Width;
+	unsigned int Height;
+	std::vector<uint8_t> Pixels;
+};
+
+// --------------------------------------------------------
+// A PNG decoder with no platform dependencies (its own
+// inflate, no WIC), so the same code runs in our tools as
+// in the game.  Output is always RGBA8, ready for upload.
+//
+// Handles what we actually ship: non-interlaced, 8 or 16
+// bits per channel, in any color type (16-bit channels are
+// cut down to 8).  Anything else is reported as a failure
+// so the caller can fall back to something more general.
+//
+// Everything here is safe to call from any thread, and one
+// file never touches another's state, so many files can be
+// decoded at once (see AssetManager::Load()).
+// --------------------------------------------------------
+class PngDecoder
+{
+public:
+	static bool Decode(const uint8_t* data, size_t size, ImageData& image);
+	static bool DecodeFile(const std::filesystem::path& file, ImageData& image);
+
+	// Just the header: true if this is a PNG Decode() can handle
+	static bool CanDecode(const uint8_t* data, size_t size);
+
+	// Raw zlib stream to exactly outputSize bytes (false if the
+	// stream is broken or doesn't match that size)
+	static bool Inflate(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize);
+
+	// Undoes a row's filter in place.  previous is the row above
+	// (already unfiltered), or 0 for the first row.
+	static bool UnfilterRow(uint8_t filter, uint8_t* row, const uint8_t* previous, size_t rowBytes, unsigned int bytesPerPixel);
+};
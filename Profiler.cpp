@@ -0,0 +1,203 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+Profiler* Profiler::instance;
+std::atomic<bool> Profiler::recording;
+thread_local Profiler::ThreadBuffer* Profiler::threadBuffer;
+
+Profiler::~Profiler()
+{
+	// Nothing can record into buffers that are gone
+	recording.store(false);
+}
+
+void Profiler::Start()
+{
+	origin = std::chrono::steady_clock::now();
+	stopped = 0;
+
+	// The first buffer is the main thread's
+	GetThreadBuffer();
+	recording.store(true);
+}
+
+void Profiler::Stop()
+{
+	if (recording.exchange(false))
+		stopped = GetTime();
+}
+
+void Profiler::Finish(const char* path)
+{
+	Stop();
+	if (WriteTrace(path))
+		printf("Wrote a startup trace to %s\n", path);
+	else
+		printf("Couldn't write a startup trace to %s\n", path);
+	PrintSummary();
+}
+
+double Profiler::GetTime()
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer()
+{
+	if (threadBuffer)
+		return threadBuffer;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto buffer = std::make_unique<ThreadBuffer>();
+	buffer->Id = (uint32_t)buffers.size();
+	buffer->Name = buffer->Id == 0 ? "Main thread" : "Thread " + std::to_string(buffer->Id);
+	buffer->Events = std::make_unique<Event[]>(EventsPerThread);
+	threadBuffer = buffer.get();
+	buffers.push_back(std::move(buffer));
+	return threadBuffer;
+}
+
+void Profiler::Record(const char* category, const std::string& name, double start, double end)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+
+	// Only this thread writes here, so it's the only one moving Count
+	size_t index = buffer->Count.load(std::memory_order_relaxed);
+	if (index >= EventsPerThread) {
+		buffer->Dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	Event& event = buffer->Events[index];
+	event.Category = category;
+	size_t length = std::min(name.size(), MaxNameLength);
+	name.copy(event.Name, length);
+	event.Name[length] = 0;
+	event.Start = start;
+	event.Duration = end - start;
+	buffer->Count.store(index + 1, std::memory_order_release);
+}
+
+// Quotes and backslashes (from paths) are all names should have,
+// but anything below a space is escaped as well
+static void WriteString(std::ofstream& file, const char* text)
+{
+	file << '"';
+	for (const char* c = text; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			file << '\\' << *c;
+		else if ((unsigned char)*c < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+			file << escaped;
+		}
+		else
+			file << *c;
+	}
+	file << '"';
+}
+
+bool Profiler::WriteTrace(const char* path)
+{
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	file << std::fixed;
+	file.precision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+	for (auto& buffer : buffers) {
+		file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->Id << ",\"args\":{\"name\":";
+		WriteString(file, buffer->Name.c_str());
+		file << "}}";
+		first = false;
+
+		size_t count = buffer->Count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; i++) {
+			Event& event = buffer->Events[i];
+			file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->Id << ",\"ts\":" << event.Start << ",\"dur\":" << event.Duration << ",\"cat\":";
+			WriteString(file, event.Category);
+			file << ",\"name\":";
+			WriteString(file, event.Name[0] ? event.Name : event.Category);
+			file << "}";
+		}
+	}
+
+	file << "\n]}\n";
+	return file.good();
+}
+
+void Profiler::PrintSummary()
+{
+	struct Totals
+	{
+		size_t Count = 0;
+		double Total = 0;
+		double Max = 0;
+		const char* Slowest = "";
+	};
+
+	// By category name, as the same literal can be at more than one address
+	std::map<std::string, Totals> categories;
+	size_t dropped = 0;
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& buffer : buffers) {
+		size_t count = buffer->Count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; i++) {
+			Event& event = buffer->Events[i];
+			Totals& totals = categories[event.Category];
+			totals.Count++;
+			totals.Total += event.Duration;
+			if (event.Duration >= totals.Max) {
+				totals.Max = event.Duration;
+				totals.Slowest = event.Name;
+			}
+		}
+		dropped += buffer->Dropped.load(std::memory_order_relaxed);
+	}
+
+	std::vector<std::pair<std::string, Totals>> sorted(categories.begin(), categories.end());
+	std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.Total > b.second.Total; });
+
+	// Scopes inside others count towards both, and threads overlap,
+	// so totals can add up to more than the time it took
+	printf("Startup profile (%.1f ms on %zu threads, times include nested scopes):\n", (stopped ? stopped : GetTime()) / 1000.0, buffers.size());
+	printf("  %-24s %6s %11s %10s %10s  %s\n", "Category", "Count", "Total ms", "Mean ms", "Max ms", "Slowest");
+	for (auto& [category, totals] : sorted) {
+		printf("  %-24s %6zu %11.2f %10.2f %10.2f  %s\n",
+			category.c_str(),
+			totals.Count,
+			totals.Total / 1000.0,
+			totals.Total / totals.Count / 1000.0,
+			totals.Max / 1000.0,
+			totals.Slowest);
+	}
+	if (dropped)
+		printf("  %zu events didn't fit (more than %zu on a thread)\n", dropped, EventsPerThread);
+}
+
+ProfileScope::ProfileScope(const char* category, const std::string& name)
+	: category(category), start(0), recording(Profiler::IsRecording())
+{
+	if (!recording)
+		return;
+
+	this->name = name;
+	start = Profiler::GetInstance().GetTime();
+}
+
+ProfileScope::~ProfileScope()
+{
+	if (!recording)
+		return;
+
+	Profiler& profiler = Profiler::GetInstance();
+	profiler.Record(category, name, start, profiler.GetTime());
+}
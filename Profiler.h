@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Times named stretches of work on any thread, to find out
+// where startup goes.  Wrap work in a ProfileScope, then
+// Finish() saves every scope as a Chrome trace (open it in
+// chrome://tracing or ui.perfetto.dev) and prints a table
+// of each category's totals.
+//
+// Each thread records into its own fixed size buffer, so a
+// scope never takes a lock: only the owning thread writes to
+// a buffer, and each event is published through an atomic
+// count.  A thread only locks once, the first time it records,
+// to register its buffer.  Events past the end of a buffer are
+// counted as dropped.
+//
+// Nothing is recorded until Start(), and a scope costs one
+// atomic load until then.
+// --------------------------------------------------------
+class Profiler
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static Profiler& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new Profiler();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	Profiler(Profiler const&) = delete;
+	void operator=(Profiler const&) = delete;
+
+private:
+	static Profiler* instance;
+	Profiler() : origin(std::chrono::steady_clock::now()), stopped(0) {};
+#pragma endregion
+
+public:
+	~Profiler();
+
+	static constexpr size_t EventsPerThread = 16384;
+	static constexpr size_t MaxNameLength = 63;
+	static constexpr const char* TracePath = ".\\StartupTrace.json";
+
+	// Safe from any thread, without the instance
+	static bool IsRecording() { return recording.load(std::memory_order_relaxed); }
+
+	// Call on the main thread (it's named after the caller), before
+	// any threads that should be profiled are started
+	void Start();
+	void Stop();
+
+	// Stops, writes the trace to path and prints the summary.  Call
+	// once every thread that recorded is done with its scopes.
+	void Finish(const char* path = TracePath);
+
+	// Microseconds since the profiler was made
+	double GetTime();
+
+	// Records a finished scope (ProfileScope does this)
+	void Record(const char* category, const std::string& name, double start, double end);
+
+	bool WriteTrace(const char* path);
+	void PrintSummary();
+
+private:
+	struct Event
+	{
+		const char* Category;	// A literal, so it's never copied
+		char Name[MaxNameLength + 1];
+		double Start;
+		double Duration;
+	};
+
+	struct ThreadBuffer
+	{
+		std::string Name;
+		uint32_t Id;
+		std::unique_ptr<Event[]> Events;
+		std::atomic<size_t> Count;
+		std::atomic<size_t> Dropped;
+	};
+
+	static std::atomic<bool> recording;
+	static thread_local ThreadBuffer* threadBuffer;
+
+	std::chrono::steady_clock::time_point origin;
+	double stopped;
+
+	// Only locked to add a buffer, and to read them once recording's done
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+	ThreadBuffer* GetThreadBuffer();
+};
+
+// --------------------------------------------------------
+// Times from where it's made until it goes out of scope.
+// category groups scopes in the summary (it has to outlive
+// the profiler, so pass a literal), and name tells them apart
+// in the trace ("Mesh", "sphere" say).
+// --------------------------------------------------------
+class ProfileScope
+{
+public:
+	ProfileScope(const char* category, const std::string& name = "");
+	~ProfileScope();
+
+	ProfileScope(ProfileScope const&) = delete;
+	void operator=(ProfileScope const&) = delete;
+
+private:
+	const char* category;
+	std::string name;
+	double start;
+	bool recording;
+};
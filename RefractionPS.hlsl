@@ -1,14 +1,8 @@
 #include "Lighting.hlsli"
 
-// How many lights could we handle?
-#define MAX_LIGHTS 128
-
 // Data that only changes once per frame
 cbuffer perFrame : register(b0)
 {
-	// An array of light data
-	Light Lights[MAX_LIGHTS];
-
 	// The amount of lights THIS FRAME
 	int LightCount;
 
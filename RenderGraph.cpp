@@ -0,0 +1,288 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+
+void RenderGraph::Reset()
+{
+	resources.clear();
+	passes.clear();
+	executionOrder.clear();
+	physicalDescs.clear();
+	requestedBytes = 0;
+	allocatedBytes = 0;
+	compiled = false;
+	error.clear();
+}
+
+int RenderGraph::CreateTexture(std::string name, const RenderGraphTextureDesc& desc, bool clearOnFirstUse)
+{
+	Resource r = {};
+	r.Name = name;
+	r.Desc = desc;
+	r.Imported = false;
+	r.ClearOnFirstUse = clearOnFirstUse;
+	resources.push_back(r);
+
+	compiled = false;
+	return (int)resources.size() - 1;
+}
+
+int RenderGraph::ImportTexture(std::string name)
+{
+	Resource r = {};
+	r.Name = name;
+	r.Imported = true;
+	resources.push_back(r);
+
+	compiled = false;
+	return (int)resources.size() - 1;
+}
+
+int RenderGraph::AddPass(std::string name, std::function<void()> execute)
+{
+	Pass p = {};
+	p.Name = name;
+	p.Execute = execute;
+	passes.push_back(p);
+
+	compiled = false;
+	return (int)passes.size() - 1;
+}
+
+void RenderGraph::Read(int pass, int resource)
+{
+	if (pass < 0 || pass >= (int)passes.size() || !ValidateResource(resource))
+	{
+		error = "Read() with an invalid pass or resource";
+		return;
+	}
+
+	passes[pass].Reads.push_back(resource);
+	compiled = false;
+}
+
+void RenderGraph::Write(int pass, int resource)
+{
+	if (pass < 0 || pass >= (int)passes.size() || !ValidateResource(resource))
+	{
+		error = "Write() with an invalid pass or resource";
+		return;
+	}
+
+	passes[pass].Writes.push_back(resource);
+	compiled = false;
+}
+
+void RenderGraph::SetSideEffect(int pass)
+{
+	if (pass < 0 || pass >= (int)passes.size())
+		return;
+
+	passes[pass].SideEffect = true;
+	compiled = false;
+}
+
+bool RenderGraph::ValidateResource(int resource)
+{
+	return resource >= 0 && resource < (int)resources.size();
+}
+
+// --------------------------------------------------------
+// Works out everything the frame needs from the declared
+// passes.  Must be called after any change to the graph
+// and before Execute().
+// --------------------------------------------------------
+bool RenderGraph::Compile()
+{
+	// Declaration errors are kept until the graph is reset
+	if (!error.empty())
+		return false;
+
+	CullPasses();
+	ComputeLifetimes();
+	AssignPhysical();
+
+	compiled = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// Walks the passes backwards: a pass stays if it has a side
+// effect (including writing an imported texture) or if a
+// later live pass reads something it writes.
+// --------------------------------------------------------
+void RenderGraph::CullPasses()
+{
+	std::vector<bool> needed(resources.size(), false);
+
+	for (int i = (int)passes.size() - 1; i >= 0; i--)
+	{
+		Pass& p = passes[i];
+		bool alive = p.SideEffect;
+		for (int w : p.Writes)
+			alive = alive || resources[w].Imported || needed[w];
+
+		p.Culled = !alive;
+		if (!alive)
+			continue;
+
+		for (int r : p.Reads)
+			needed[r] = true;
+	}
+
+	// Live passes run in the order they were added
+	executionOrder.clear();
+	for (int i = 0; i < (int)passes.size(); i++)
+	{
+		if (!passes[i].Culled)
+			executionOrder.push_back(i);
+	}
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+	for (auto& r : resources)
+	{
+		r.Lifetime = { -1, -1 };
+		r.FirstUsePass = -1;
+	}
+
+	for (auto& p : passes)
+		p.Clears.clear();
+
+	for (int order = 0; order < (int)executionOrder.size(); order++)
+	{
+		int passIndex = executionOrder[order];
+		Pass& p = passes[passIndex];
+
+		// Reads first, so a resource that is read before anything
+		// writes it is known to have undefined contents
+		auto use = [&](int index, bool isRead)
+		{
+			Resource& r = resources[index];
+			if (r.Imported)
+				return;
+
+			if (r.Lifetime.First < 0)
+			{
+				r.Lifetime.First = order;
+				r.FirstUsePass = passIndex;
+
+				// Aliased memory holds whatever was there last, so
+				// anything read before being written gets cleared too
+				if (r.ClearOnFirstUse || isRead)
+					p.Clears.push_back(index);
+			}
+			r.Lifetime.Last = order;
+		};
+
+		for (int r : p.Reads) use(r, true);
+		for (int w : p.Writes) use(w, false);
+	}
+}
+
+// --------------------------------------------------------
+// Greedy interval packing: resources are visited in order
+// of first use and placed in the first physical texture
+// with a matching description that is free by then
+// --------------------------------------------------------
+void RenderGraph::AssignPhysical()
+{
+	physicalDescs.clear();
+	requestedBytes = 0;
+	allocatedBytes = 0;
+
+	std::vector<int> used;
+	for (int i = 0; i < (int)resources.size(); i++)
+	{
+		resources[i].Physical = -1;
+		if (!resources[i].Imported && resources[i].Lifetime.First >= 0)
+			used.push_back(i);
+	}
+
+	std::stable_sort(used.begin(), used.end(), [&](int a, int b)
+		{
+			return resources[a].Lifetime.First < resources[b].Lifetime.First;
+		});
+
+	// Last use of each physical texture so far
+	std::vector<int> physicalLastUse;
+
+	for (int index : used)
+	{
+		Resource& r = resources[index];
+		size_t bytes = (size_t)r.Desc.Width * r.Desc.Height * r.Desc.BytesPerPixel;
+		requestedBytes += bytes;
+
+		for (int p = 0; p < (int)physicalDescs.size(); p++)
+		{
+			if (physicalDescs[p] == r.Desc && physicalLastUse[p] < r.Lifetime.First)
+			{
+				r.Physical = p;
+				physicalLastUse[p] = r.Lifetime.Last;
+				break;
+			}
+		}
+
+		if (r.Physical < 0)
+		{
+			r.Physical = (int)physicalDescs.size();
+			physicalDescs.push_back(r.Desc);
+			physicalLastUse.push_back(r.Lifetime.Last);
+			allocatedBytes += bytes;
+		}
+	}
+}
+
+void RenderGraph::Execute(std::function<void(int)> clear)
+{
+	if (!compiled)
+		return;
+
+	for (int passIndex : executionOrder)
+	{
+		Pass& p = passes[passIndex];
+
+		if (clear)
+		{
+			for (int r : p.Clears)
+				clear(r);
+		}
+
+		if (p.Execute)
+			p.Execute();
+	}
+}
+
+bool RenderGraph::IsPassCulled(int pass)
+{
+	if (pass < 0 || pass >= (int)passes.size())
+		return true;
+
+	return passes[pass].Culled;
+}
+
+RenderGraphLifetime RenderGraph::GetLifetime(int resource)
+{
+	if (!ValidateResource(resource))
+		return { -1, -1 };
+
+	return resources[resource].Lifetime;
+}
+
+bool RenderGraph::NeedsClear(int resource)
+{
+	if (!ValidateResource(resource) || resources[resource].FirstUsePass < 0)
+		return false;
+
+	const std::vector<int>& clears = passes[resources[resource].FirstUsePass].Clears;
+	return std::find(clears.begin(), clears.end(), resource) != clears.end();
+}
+
+int RenderGraph::GetPhysicalIndex(int resource)
+{
+	if (!ValidateResource(resource))
+		return -1;
+
+	return resources[resource].Physical;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// A render graph: passes declare which textures they read
+// and write, and Compile() works out from that
+//  - which passes actually contribute to the frame (the
+//    rest are culled)
+//  - the order to run them in
+//  - how long each texture needs to live, which textures
+//    can share the same memory, and which need a clear
+//
+// Nothing in here touches the GPU, so the whole compile
+// step can be run (and checked) without a device.  The
+// owner allocates one real texture per "physical" index
+// and maps resources onto them with GetPhysicalIndex().
+// --------------------------------------------------------
+
+// Description of a texture the graph manages.  Two textures
+// can only share memory if their descriptions match exactly.
+struct RenderGraphTextureDesc
+{
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int Format;		// Opaque to the graph (a DXGI_FORMAT for the renderer)
+	unsigned int BytesPerPixel;	// Only used for memory stats
+
+	bool operator==(const RenderGraphTextureDesc&) const = default;
+};
+
+// First and last position (in execution order) a resource is used
+struct RenderGraphLifetime
+{
+	int First;
+	int Last;
+};
+
+class RenderGraph
+{
+public:
+	// Removes all passes and resources so the graph can be rebuilt
+	void Reset();
+
+	// Textures the graph may allocate (and alias) itself
+	int CreateTexture(std::string name, const RenderGraphTextureDesc& desc, bool clearOnFirstUse = true);
+
+	// Textures owned elsewhere (back buffer, depth buffer).  These are never
+	// allocated or aliased, and writing one keeps a pass alive.
+	int ImportTexture(std::string name);
+
+	// Passes run in the order they are added, so a pass reading a
+	// resource sees whatever the passes added before it wrote there
+	int AddPass(std::string name, std::function<void()> execute);
+	void Read(int pass, int resource);
+	void Write(int pass, int resource);
+
+	// Never cull this pass, even if nothing reads its output
+	void SetSideEffect(int pass);
+
+	// Returns false (and leaves an error message) if the graph is invalid
+	bool Compile();
+	const std::string& GetError() { return error; }
+
+	// Runs every live pass in order.  clear is called for each resource
+	// that needs clearing, right before the pass that first uses it.
+	void Execute(std::function<void(int)> clear);
+
+	// Compiled results -----------------------------------
+	const std::vector<int>& GetExecutionOrder() { return executionOrder; }
+	bool IsPassCulled(int pass);
+	RenderGraphLifetime GetLifetime(int resource);
+	bool NeedsClear(int resource);
+
+	// -1 for imported or unused resources
+	int GetPhysicalIndex(int resource);
+	int GetPhysicalCount() { return (int)physicalDescs.size(); }
+	const RenderGraphTextureDesc& GetPhysicalDesc(int physical) { return physicalDescs[physical]; }
+
+	// Memory if every used texture had its own allocation, vs. after aliasing
+	size_t GetRequestedBytes() { return requestedBytes; }
+	size_t GetAllocatedBytes() { return allocatedBytes; }
+
+	// Debug info -----------------------------------------
+	int GetPassCount() { return (int)passes.size(); }
+	int GetResourceCount() { return (int)resources.size(); }
+	const std::string& GetPassName(int pass) { return passes[pass].Name; }
+	const std::string& GetResourceName(int resource) { return resources[resource].Name; }
+
+private:
+	struct Resource
+	{
+		std::string Name;
+		RenderGraphTextureDesc Desc;
+		bool Imported;
+		bool ClearOnFirstUse;
+
+		// Filled in by Compile()
+		RenderGraphLifetime Lifetime;
+		int Physical;
+		int FirstUsePass;
+	};
+
+	struct Pass
+	{
+		std::string Name;
+		std::function<void()> Execute;
+		std::vector<int> Reads;
+		std::vector<int> Writes;
+		bool SideEffect;
+
+		// Filled in by Compile()
+		bool Culled;
+		std::vector<int> Clears;
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<int> executionOrder;
+	std::vector<RenderGraphTextureDesc> physicalDescs;
+	size_t requestedBytes = 0;
+	size_t allocatedBytes = 0;
+	bool compiled = false;
+	std::string error;
+
+	bool ValidateResource(int resource);
+	void CullPasses();
+	void ComputeLifetimes();
+	void AssignPhysical();
+};
@@ -1,5 +1,7 @@
 #include "Renderer.h"
 #include "AssetManager.h"
+#include "PipelineStateCache.h"
+#include "Profiler.h"
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_win32.h"
@@ -12,11 +14,14 @@ Renderer::Renderer(Microsoft::WRL::ComPtr<ID3D11Device> device,
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV, 
 	unsigned int windowWidth, unsigned int windowHeight, 
 	std::vector<Light>& lights) : lights(lights),
+	lightBuffer(device, context),
 	refractionScale(0.1f),
 	useRefractionSilhouette(false),
 	refractionFromNormalMap(true),
-	indexOfRefraction(0.5f)
+	indexOfRefraction(0.5f),
+	showAllRenderTargets(false)
 {
+	ProfileScope profile("Renderer");
 	this->device = device;
 	this->context = context;
 	this->swapChain = swapChain;
@@ -28,30 +33,47 @@ Renderer::Renderer(Microsoft::WRL::ComPtr<ID3D11Device> device,
 	// Initialize structs
 	vsPerFrameData = {};
 	psPerFrameData = {};
+	psPerFrameDataUploaded = false;
 
-	// Grab two shaders on which to base per-frame cbuffers
-	// Note: We're assuming ALL entity/material per-frame buffers are identical!
-	//       And that they're all called "perFrame"
-	AssetManager& assets = AssetManager::GetInstance();
-	SimplePixelShader* ps = assets.GetPixelShader("PixelShaderPBR");
-	SimpleVertexShader* vs = assets.GetVertexShader("VertexShader");
-
-	// Struct to hold the descriptions from existing buffers
+	// Make the per-frame cbuffers from our own structs
 	D3D11_BUFFER_DESC bufferDesc = {};
-	const SimpleConstantBuffer* scb = 0;
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
 
-	// Make a new buffer that matches the existing PS per-frame buffer
-	scb = ps->GetBufferInfo("perFrame");
-	scb->ConstantBuffer.Get()->GetDesc(&bufferDesc);
+	bufferDesc.ByteWidth = sizeof(PSPerFrameData);
 	device->CreateBuffer(&bufferDesc, 0, psPerFrameConstantBuffer.GetAddressOf());
 
-	// Make a new buffer that matches the existing PS per-frame buffer
-	scb = vs->GetBufferInfo("perFrame");
-	scb->ConstantBuffer.Get()->GetDesc(&bufferDesc);
+	bufferDesc.ByteWidth = sizeof(VSPerFrameData);
 	device->CreateBuffer(&bufferDesc, 0, vsPerFrameConstantBuffer.GetAddressOf());
 
-	// Create render targets (just calling post resize which sets them all up)
-	PostResize(windowWidth, windowHeight, backBufferRTV, depthBufferDSV);
+	// Have every shader bind our buffers in place of their own
+	// "perFrame" cbuffers, wherever the shader put them
+	// Note: We're assuming ALL per-frame buffers start with the
+	//       same layout as our structs (some may stop early)
+	AssetManager& assets = AssetManager::GetInstance();
+	for (auto& s : assets.GetShaders())
+	{
+		const SimpleConstantBuffer* scb = s.Value->GetBufferInfo("perFrame");
+		if (!scb)
+			continue;
+
+		if (dynamic_cast<SimpleVertexShader*>(s.Value) && scb->Size <= sizeof(VSPerFrameData))
+			s.Value->SetExternalConstantBuffer("perFrame", vsPerFrameConstantBuffer);
+		else if (dynamic_cast<SimplePixelShader*>(s.Value) && scb->Size <= sizeof(PSPerFrameData))
+			s.Value->SetExternalConstantBuffer("perFrame", psPerFrameConstantBuffer);
+	}
+
+	// Render targets come from the render graph, and don't exist until it needs them
+	for (int& resource : renderTargetResources) resource = -1;
+	targetWidth = renderWidth = windowWidth;
+	targetHeight = renderHeight = windowHeight;
+
+	// Light gizmo resources (the instance buffer is made on first use)
+	lightMesh = assets.GetMesh("sphere"_id);
+	if (lightMesh) lightMesh->AddReference();
+	lightGizmoVS = assets.GetVertexShader("LightGizmoVS"_id);
+	lightGizmoPS = assets.GetPixelShader("LightGizmoPS"_id);
+	lightInstanceCapacity = 0;
 
 	// Depth state for refraction silhouette
 	D3D11_DEPTH_STENCIL_DESC depthDesc = {};
@@ -61,6 +83,11 @@ Renderer::Renderer(Microsoft::WRL::ComPtr<ID3D11Device> device,
 	device->CreateDepthStencilState(&depthDesc, refractionSilhouetteDepthState.GetAddressOf());
 }
 
+Renderer::~Renderer()
+{
+	if (lightMesh) lightMesh->RemoveReference();
+}
+
 void Renderer::PreResize()
 {
 	backBufferRTV.Reset();
@@ -74,16 +101,8 @@ void Renderer::PostResize(unsigned int windowWidth, unsigned int windowHeight, M
 	this->backBufferRTV = backBufferRTV;
 	this->depthBufferDSV = depthBufferDSV; 
 
-
-	CreateRenderTarget(windowWidth, windowHeight, renderTargetRTVs[RenderTargetType::SCENE_COLORS_NO_AMBIENT], renderTargetSRVs[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
-	CreateRenderTarget(windowWidth, windowHeight, renderTargetRTVs[RenderTargetType::SCENE_AMBIENT], renderTargetSRVs[RenderTargetType::SCENE_AMBIENT]);
-	CreateRenderTarget(windowWidth, windowHeight, renderTargetRTVs[RenderTargetType::SCENE_NORMALS], renderTargetSRVs[RenderTargetType::SCENE_NORMALS]);
-	CreateRenderTarget(windowWidth, windowHeight, renderTargetRTVs[RenderTargetType::SCENE_DEPTHS], renderTargetSRVs[RenderTargetType::SCENE_DEPTHS], DXGI_FORMAT_R32_FLOAT);
-	CreateRenderTarget(windowWidth, windowHeight, renderTargetRTVs[RenderTargetType::FINAL_COMPOSITE], renderTargetSRVs[RenderTargetType::FINAL_COMPOSITE]);
-	CreateRenderTarget(windowWidth, windowHeight, renderTargetRTVs[RenderTargetType::SSAO_RESULTS], renderTargetSRVs[RenderTargetType::SSAO_RESULTS]);
-	CreateRenderTarget(windowWidth, windowHeight, renderTargetRTVs[RenderTargetType::SSAO_BLUR], renderTargetSRVs[RenderTargetType::SSAO_BLUR]);
-	CreateRenderTarget(windowWidth, windowHeight, renderTargetRTVs[RenderTargetType::REFRACTION_SILHOUETTE], renderTargetSRVs[RenderTargetType::REFRACTION_SILHOUETTE], DXGI_FORMAT_R8_UNORM);
-
+	// Render targets themselves are (re)allocated by the
+	// render graph next frame, once it knows the new size
 }
 
 void Renderer::Render(Camera* camera)
@@ -102,16 +121,7 @@ void Renderer::Render(Camera* camera)
 		0);
 
 	AssetManager& assets = AssetManager::GetInstance();
-
-	for (auto& rt : renderTargetRTVs) context->ClearRenderTargetView(rt.Get(), color);
-
-	const int numTargets = 4;
-	ID3D11RenderTargetView* targets[numTargets] = {};
-	targets[0] = renderTargetRTVs[RenderTargetType::SCENE_COLORS_NO_AMBIENT].Get();
-	targets[1] = renderTargetRTVs[RenderTargetType::SCENE_AMBIENT].Get();
-	targets[2] = renderTargetRTVs[RenderTargetType::SCENE_NORMALS].Get();
-	targets[3] = renderTargetRTVs[RenderTargetType::SCENE_DEPTHS].Get();
-	context->OMSetRenderTargets(numTargets, targets, depthBufferDSV.Get());
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
 
 	// Collect all per-frame data and copy to GPU
 	{
@@ -120,39 +130,246 @@ void Renderer::Render(Camera* camera)
 		vsPerFrameData.ProjectionMatrix = camera->GetProjection();
 		context->UpdateSubresource(vsPerFrameConstantBuffer.Get(), 0, 0, &vsPerFrameData, 0, 0);
 
-		// ps ----
-		memcpy(&psPerFrameData.Lights, &lights[0], sizeof(Light) * lights.size());
-		psPerFrameData.LightCount = lights.size();
-		psPerFrameData.CameraPosition = camera->GetTransform()->GetPosition();
-		psPerFrameData.TotalSpecIBLMipLevels = assets.sky->GetTotalSpecIBLMipLevels();
-		context->UpdateSubresource(psPerFrameConstantBuffer.Get(), 0, 0, &psPerFrameData, 0, 0);
+		// ps ---- (skipped when nothing changed)
+		PSPerFrameData ps = {};
+		ps.LightCount = (int)lights.size();
+		ps.CameraPosition = camera->GetTransform()->GetPosition();
+		ps.TotalSpecIBLMipLevels = assets.sky->GetTotalSpecIBLMipLevels();
+		memcpy(ps.IrradianceSH, assets.sky->GetIrradianceSH(), sizeof(ps.IrradianceSH));
+		if (!psPerFrameDataUploaded || memcmp(&ps, &psPerFrameData, sizeof(PSPerFrameData)) != 0)
+		{
+			psPerFrameData = ps;
+			psPerFrameDataUploaded = true;
+			context->UpdateSubresource(psPerFrameConstantBuffer.Get(), 0, 0, &psPerFrameData, 0, 0);
+		}
+
+		// Lights live in their own buffer, and only changes are uploaded
+		lightBuffer.Update(lights);
 	}
 
-	std::vector<GameEntity*> toDraw;
+	// Sort entities by material, and set aside
+	// the refractive ones for their own passes
+	opaqueEntities.clear();
+	refractiveEntities.clear();
 	for (auto& p : assets.GetEntities()) {
-		toDraw.push_back(p.second);
+		if (p.Value->GetMaterial()->GetRefractive())
+			refractiveEntities.push_back(p.Value);
+		else
+			opaqueEntities.push_back(p.Value);
 	}
-	std::sort(toDraw.begin(), toDraw.end(), [](const auto& e1, const auto& e2)
+	std::sort(opaqueEntities.begin(), opaqueEntities.end(), [](const auto& e1, const auto& e2)
 		{
 			// Compare pointers to materials
 			return e1->GetMaterial() < e2->GetMaterial();
 		});
 
-	// Collect all refractive entities for later
-	std::vector<GameEntity*> refractiveEntities;
+	// Targets are allocated at the largest scale we allow, and
+	// this frame only renders into the top left part of them
+	float maxScale = dynamicResolution.GetSettings().MaxScale;
+	float scale = dynamicResolution.GetScale();
+	targetWidth = max((unsigned int)(windowWidth * maxScale), 1u);
+	targetHeight = max((unsigned int)(windowHeight * maxScale), 1u);
+	renderWidth = max((unsigned int)(windowWidth * scale), 1u);
+	renderHeight = max((unsigned int)(windowHeight * scale), 1u);
+
+	// Work out what actually needs to run this frame,
+	// then make sure its render targets exist
+	BuildRenderGraph(camera);
+	if (renderGraph.Compile())
+	{
+		AllocateRenderTargets();
+
+		// Every scene pass uses the scaled viewport; the
+		// upscale pass puts the full one back at the end
+		SetViewport(renderWidth, renderHeight);
+
+		// Run the passes, clearing targets right before their first use
+		renderGraph.Execute([&](int resource)
+			{
+				context->ClearRenderTargetView(GetGraphRTV(resource), color);
+			});
+	}
+
+	ImGui::Render();
+	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+
+	// ImGui binds its own state behind the cache's back
+	cache.Invalidate();
+
+	// The UI has drawn with last frame's targets, so they can go now
+	retiredRenderTargets.clear();
+
+	// Present the back buffer to the user
+	//  - Puts the final frame we're drawing into the window so the user can see it
+	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
+	swapChain->Present(0, 0);
+
+	// Due to the usage of a more sophisticated swap chain,
+	// the render target must be re-bound after every call to Present()
+	cache.SetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+
+	// Unbind all SRVs at the end of the frame so they're not still bound for input
+	// when we begin the MRTs of the next frame
+	cache.ClearShaderResources(PIPELINE_STAGE_PIXEL, 0, 16);
+
+	// Save this frame's call counts for display
+	cache.EndFrame();
+}
+
+// --------------------------------------------------------
+// Declares this frame's passes and what they read and write.
+// Passes whose output nobody uses are culled by the graph,
+// and targets no pass touches are never allocated or cleared.
+// --------------------------------------------------------
+void Renderer::BuildRenderGraph(Camera* camera)
+{
+	renderGraph.Reset();
+
+	RenderGraphTextureDesc colorDesc = { targetWidth, targetHeight, DXGI_FORMAT_R8G8B8A8_UNORM, 4 };
+	RenderGraphTextureDesc depthDesc = { targetWidth, targetHeight, DXGI_FORMAT_R32_FLOAT, 4 };
+	RenderGraphTextureDesc maskDesc = { targetWidth, targetHeight, DXGI_FORMAT_R8_UNORM, 1 };
+
+	for (int i = 0; i < RenderTargetType::RENDER_TARGET_TYPE_COUNT; i++)
+	{
+		RenderGraphTextureDesc desc = colorDesc;
+		if (i == RenderTargetType::SCENE_DEPTHS) desc = depthDesc;
+		if (i == RenderTargetType::REFRACTION_SILHOUETTE) desc = maskDesc;
+
+		renderTargetResources[i] = renderGraph.CreateTexture(RenderTargetTypeToString(i), desc);
+	}
+
+	int backBuffer = renderGraph.ImportTexture("Back Buffer");
+	int depthBuffer = renderGraph.ImportTexture("Depth Buffer");
+
+	// Opaque entities into the MRTs.  Only the UI looks at the
+	// ambient, normals and depths, so they're only written (and
+	// allocated) while it's showing them; otherwise they're not
+	// in the graph, and DrawOpaque() binds nothing in their place.
+	int opaque = renderGraph.AddPass("Opaque", [=]() { DrawOpaque(); });
+	renderGraph.Write(opaque, renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+	if (showAllRenderTargets)
+	{
+		renderGraph.Write(opaque, renderTargetResources[RenderTargetType::SCENE_AMBIENT]);
+		renderGraph.Write(opaque, renderTargetResources[RenderTargetType::SCENE_NORMALS]);
+		renderGraph.Write(opaque, renderTargetResources[RenderTargetType::SCENE_DEPTHS]);
+	}
+	renderGraph.Write(opaque, depthBuffer);
+
+	// Sky fills in the remaining scene colors
+	int sky = renderGraph.AddPass("Sky", [=]() { DrawSky(camera); });
+	renderGraph.Read(sky, depthBuffer);
+	renderGraph.Write(sky, renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+
+	if (!refractiveEntities.empty())
+	{
+		if (useRefractionSilhouette)
+		{
+			int silhouette = renderGraph.AddPass("Refraction Silhouette", [=]() { DrawRefractionSilhouette(camera); });
+			renderGraph.Read(silhouette, depthBuffer);
+			renderGraph.Write(silhouette, renderTargetResources[RenderTargetType::REFRACTION_SILHOUETTE]);
+		}
+
+		// Refraction reads the scene behind the objects from a copy,
+		// since it draws into the scene colors itself
+		int composite = renderGraph.AddPass("Copy Scene", [=]() { CopySceneToComposite(); });
+		renderGraph.Read(composite, renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+		renderGraph.Write(composite, renderTargetResources[RenderTargetType::FINAL_COMPOSITE]);
+
+		int refraction = renderGraph.AddPass("Refraction", [=]() { DrawRefraction(camera); });
+		renderGraph.Read(refraction, renderTargetResources[RenderTargetType::FINAL_COMPOSITE]);
+		if (useRefractionSilhouette)
+			renderGraph.Read(refraction, renderTargetResources[RenderTargetType::REFRACTION_SILHOUETTE]);
+		renderGraph.Read(refraction, depthBuffer);
+		renderGraph.Write(refraction, renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+	}
+
+	// Light sources on top of everything
+	int pointLights = renderGraph.AddPass("Point Lights", [=]() { DrawPointLights(); });
+	renderGraph.Write(pointLights, renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+	renderGraph.Write(pointLights, depthBuffer);
+
+	// Stretch the scene over the whole back buffer
+	int upscale = renderGraph.AddPass("Upscale", [=]() { DrawUpscale(); });
+	renderGraph.Read(upscale, renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+	renderGraph.Write(upscale, backBuffer);
+
+	// The UI shows every target, so they all have to survive (unaliased)
+	// until the end of the frame while it's open
+	if (showAllRenderTargets)
+	{
+		int debugView = renderGraph.AddPass("Render Target Debug View", []() {});
+		for (int resource : renderTargetResources)
+			renderGraph.Read(debugView, resource);
+		renderGraph.SetSideEffect(debugView);
+	}
+}
+
+// --------------------------------------------------------
+// Makes sure there is a real texture for each of the graph's
+// physical targets.  Only ones whose size or format changed
+// are recreated.
+// --------------------------------------------------------
+void Renderer::AllocateRenderTargets()
+{
+	int count = renderGraph.GetPhysicalCount();
+
+	// Anything no longer needed is kept alive until the UI has drawn
+	for (int i = count; i < (int)physicalTargetDescs.size(); i++)
+		retiredRenderTargets.push_back(physicalSRVs[i]);
+
+	physicalRTVs.resize(count);
+	physicalSRVs.resize(count);
+	physicalTargetDescs.resize(count, {});
+
+	for (int i = 0; i < count; i++)
+	{
+		const RenderGraphTextureDesc& desc = renderGraph.GetPhysicalDesc(i);
+		if (physicalRTVs[i] && physicalTargetDescs[i] == desc)
+			continue;
+
+		if (physicalSRVs[i])
+			retiredRenderTargets.push_back(physicalSRVs[i]);
+
+		physicalRTVs[i].Reset();
+		physicalSRVs[i].Reset();
+		CreateRenderTarget(desc.Width, desc.Height, physicalRTVs[i], physicalSRVs[i], (DXGI_FORMAT)desc.Format);
+		physicalTargetDescs[i] = desc;
+	}
+}
+
+ID3D11RenderTargetView* Renderer::GetGraphRTV(int resource)
+{
+	int physical = renderGraph.GetPhysicalIndex(resource);
+	return physical < 0 ? 0 : physicalRTVs[physical].Get();
+}
+
+ID3D11ShaderResourceView* Renderer::GetGraphSRV(int resource)
+{
+	int physical = renderGraph.GetPhysicalIndex(resource);
+	return physical < 0 ? 0 : physicalSRVs[physical].Get();
+}
+
+void Renderer::DrawOpaque()
+{
+	AssetManager& assets = AssetManager::GetInstance();
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+
+	// Targets that aren't in this frame's graph are null, so
+	// whatever the shader writes to them is dropped
+	const int numTargets = 4;
+	ID3D11RenderTargetView* targets[numTargets] = {};
+	targets[0] = GetGraphRTV(renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+	targets[1] = GetGraphRTV(renderTargetResources[RenderTargetType::SCENE_AMBIENT]);
+	targets[2] = GetGraphRTV(renderTargetResources[RenderTargetType::SCENE_NORMALS]);
+	targets[3] = GetGraphRTV(renderTargetResources[RenderTargetType::SCENE_DEPTHS]);
+	cache.SetRenderTargets(numTargets, targets, depthBufferDSV.Get());
 
 	// Draw all of the entities
 	SimpleVertexShader* currentVS = 0;
 	SimplePixelShader* currentPS = 0;
 	Material* currentMaterial = 0;
 	Mesh* currentMesh = 0;
-	for (auto& ge : toDraw) {
-		// Skip refractive materials for now
-		if (ge->GetMaterial()->GetRefractive())
-		{
-			refractiveEntities.push_back(ge);
-			continue;
-		}
+	for (auto& ge : opaqueEntities) {
 		// Track the current material and swap as necessary
 		// (including swapping shaders)
 		if (currentMaterial != ge->GetMaterial())
@@ -164,13 +381,6 @@ void Renderer::Render(Camera* camera)
 			{
 				currentVS = currentMaterial->GetVS();
 				currentVS->SetShader();
-
-				// Must re-bind per-frame cbuffer as
-				// as we're using the renderer's now!
-				// Note: Would be nice to have the option
-				//       for SimpleShader to NOT auto-bind
-				//       cbuffers - might add this feature
-				context->VSSetConstantBuffers(0, 1, vsPerFrameConstantBuffer.GetAddressOf());
 			}
 
 			// Swap pixel shader if necessary
@@ -179,14 +389,10 @@ void Renderer::Render(Camera* camera)
 				currentPS = currentMaterial->GetPS();
 				currentPS->SetShader();
 
-				// Must re-bind per-frame cbuffer as
-				// as we're using the renderer's now!
-				context->PSSetConstantBuffers(0, 1, psPerFrameConstantBuffer.GetAddressOf());
-
 				// Set IBL textures now, too
-				currentPS->SetShaderResourceView("IrradianceIBLMap", assets.sky->GetIrradianceIBL());
 				currentPS->SetShaderResourceView("SpecularIBLMap", assets.sky->GetSpecularIBL());
 				currentPS->SetShaderResourceView("BrdfLookUpMap", assets.sky->GetBrdfLookUpMap());
+				currentPS->SetShaderResourceView("Lights", lightBuffer.GetSRV());
 			}
 
 			// Now that the material is set, we should
@@ -202,8 +408,8 @@ void Renderer::Render(Camera* camera)
 			// Bind new buffers
 			UINT stride = sizeof(Vertex);
 			UINT offset = 0;
-			context->IASetVertexBuffers(0, 1, currentMesh->GetVertexBuffer().GetAddressOf(), &stride, &offset);
-			context->IASetIndexBuffer(currentMesh->GetIndexBuffer().Get(), DXGI_FORMAT_R32_UINT, 0);
+			cache.SetVertexBuffer(0, currentMesh->GetVertexBuffer().Get(), stride, offset);
+			cache.SetIndexBuffer(currentMesh->GetIndexBuffer().Get(), DXGI_FORMAT_R32_UINT, 0);
 		}
 
 
@@ -222,179 +428,262 @@ void Renderer::Render(Camera* camera)
 			context->DrawIndexed(currentMesh->GetIndexCount(), 0, 0);
 		}
 	}
+}
 
-	// Draw the sky
-	assets.sky->Draw(camera);
+void Renderer::DrawSky(Camera* camera)
+{
+	ID3D11RenderTargetView* target = GetGraphRTV(renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+	PipelineStateCache::GetInstance().SetRenderTargets(1, &target, depthBufferDSV.Get());
+
+	AssetManager::GetInstance().sky->Draw(camera);
+}
 
-	// Now refraction (if necessary)
+// --------------------------------------------------------
+// Renders the refractive objects to the silhouette texture
+// --------------------------------------------------------
+void Renderer::DrawRefractionSilhouette(Camera* camera)
+{
+	AssetManager& assets = AssetManager::GetInstance();
+
+	ID3D11RenderTargetView* target = GetGraphRTV(renderTargetResources[RenderTargetType::REFRACTION_SILHOUETTE]);
+	PipelineStateCache::GetInstance().SetRenderTargets(1, &target, depthBufferDSV.Get());
+
+	// Depth state
+	context->OMSetDepthStencilState(refractionSilhouetteDepthState.Get(), 0);
+
+	// Grab the solid color shader
+	SimplePixelShader* solidColorPS = assets.GetPixelShader("SolidColorPS"_id);
+
+	// Loop and draw each one
+	for (auto ge : refractiveEntities)
 	{
-		// Loop and render the refractive objects to the silhouette texture (if use silhouettes)
-		if (useRefractionSilhouette)
-		{
-			targets[0] = renderTargetRTVs[RenderTargetType::REFRACTION_SILHOUETTE].Get();
-			context->OMSetRenderTargets(1, targets, depthBufferDSV.Get());
+		// Get this material and sub the refraction PS for now
+		Material* mat = ge->GetMaterial();
+		SimplePixelShader* prevPS = mat->GetPS();
+		mat->SetPS(solidColorPS);
 
-			// Depth state
-			context->OMSetDepthStencilState(refractionSilhouetteDepthState.Get(), 0);
+		// Overall material prep
+		mat->PrepareMaterial(ge->GetTransform(), camera);
+		mat->SetPerMaterialDataAndResources(true);
 
-			// Grab the solid color shader
-			SimplePixelShader* solidColorPS = assets.GetPixelShader("SolidColorPS");
+		// Set up the refraction specific data
+		solidColorPS->SetFloat3("Color", XMFLOAT3(1, 1, 1));
+		solidColorPS->CopyBufferData("externalData");
 
-			// Loop and draw each one
-			for (auto ge : refractiveEntities)
-			{
-				// Get this material and sub the refraction PS for now
-				Material* mat = ge->GetMaterial();
-				SimplePixelShader* prevPS = mat->GetPS();
-				mat->SetPS(solidColorPS);
+		// Draw
+		ge->GetMesh()->SetBuffersAndDraw(context);
 
-				// Overall material prep
-				mat->PrepareMaterial(ge->GetTransform(), camera);
-				mat->SetPerMaterialDataAndResources(true);
+		// Reset this material's PS
+		mat->SetPS(prevPS);
+	}
 
-				// Set up the refraction specific data
-				solidColorPS->SetFloat3("Color", XMFLOAT3(1, 1, 1));
-				solidColorPS->CopyBufferData("externalData");
+	// Reset depth state
+	context->OMSetDepthStencilState(0, 0);
+}
 
-				// Reset "per frame" buffer for VS
-				context->VSSetConstantBuffers(0, 1, vsPerFrameConstantBuffer.GetAddressOf());
+void Renderer::DrawRefraction(Camera* camera)
+{
+	AssetManager& assets = AssetManager::GetInstance();
 
-				// Draw
-				ge->GetMesh()->SetBuffersAndDraw(context);
+	// Set up pipeline for refractive draw
+	// Back into the scene colors, and now we need the depth buffer again
+	ID3D11RenderTargetView* target = GetGraphRTV(renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+	PipelineStateCache::GetInstance().SetRenderTargets(1, &target, depthBufferDSV.Get());
 
-				// Reset this material's PS
-				mat->SetPS(prevPS);
-			}
+	// Screen uvs are relative to the whole texture, and the
+	// offset should cover the same part of the view at any scale
+	float scale = (float)renderWidth / targetWidth;
 
-			// Reset depth state
-			context->OMSetDepthStencilState(0, 0);
-		}
+	// Grab the refractive shader
+	SimplePixelShader* refractionPS = assets.GetPixelShader("RefractionPS"_id);
 
-		// Loop and draw refractive objects
-		{
-			// Set up pipeline for refractive draw
-			// Same target (back buffer), but now we need the depth buffer again
-			targets[0] = backBufferRTV.Get();
-			context->OMSetRenderTargets(1, targets, depthBufferDSV.Get());
+	// Loop and draw each one
+	for (auto ge : refractiveEntities)
+	{
+		// Get this material and sub the refraction PS for now
+		Material* mat = ge->GetMaterial();
+		SimplePixelShader* prevPS = mat->GetPS();
+		mat->SetPS(refractionPS);
+
+		// Overall material prep
+		mat->PrepareMaterial(ge->GetTransform(), camera);
+		mat->SetPerMaterialDataAndResources(true);
+
+		// Set up the refraction specific data
+		refractionPS->SetFloat2("screenSize", XMFLOAT2((float)targetWidth, (float)targetHeight));
+		refractionPS->SetMatrix4x4("viewMatrix", camera->GetView());
+		refractionPS->SetMatrix4x4("projMatrix", camera->GetProjection());
+		refractionPS->SetInt("useRefractionSilhouette", useRefractionSilhouette);
+		refractionPS->SetInt("refractionFromNormalMap", refractionFromNormalMap);
+		refractionPS->SetFloat("indexOfRefraction", indexOfRefraction);
+		refractionPS->SetFloat("refractionScale", refractionScale * scale);
+		refractionPS->CopyBufferData("perObject");
+
+		// Set textures
+		refractionPS->SetShaderResourceView("ScreenPixels", GetGraphSRV(renderTargetResources[RenderTargetType::FINAL_COMPOSITE]));
+		refractionPS->SetShaderResourceView("RefractionSilhouette", GetGraphSRV(renderTargetResources[RenderTargetType::REFRACTION_SILHOUETTE]));
+		refractionPS->SetShaderResourceView("EnvironmentMap", assets.sky->GetEnvironmentSRV());
 
-			// Grab the refractive shader
-			SimplePixelShader* refractionPS = assets.GetPixelShader("RefractionPS");
+		// Draw
+		ge->GetMesh()->SetBuffersAndDraw(context);
 
-			// Loop and draw each one
-			for (auto ge : refractiveEntities)
-			{
-				// Get this material and sub the refraction PS for now
-				Material* mat = ge->GetMaterial();
-				SimplePixelShader* prevPS = mat->GetPS();
-				mat->SetPS(refractionPS);
-
-				// Overall material prep
-				mat->PrepareMaterial(ge->GetTransform(), camera);
-				mat->SetPerMaterialDataAndResources(true);
-
-				// Set up the refraction specific data
-				refractionPS->SetFloat2("screenSize", XMFLOAT2((float)windowWidth, (float)windowHeight));
-				refractionPS->SetMatrix4x4("viewMatrix", camera->GetView());
-				refractionPS->SetMatrix4x4("projMatrix", camera->GetProjection());
-				refractionPS->SetInt("useRefractionSilhouette", useRefractionSilhouette);
-				refractionPS->SetInt("refractionFromNormalMap", refractionFromNormalMap);
-				refractionPS->SetFloat("indexOfRefraction", indexOfRefraction);
-				refractionPS->SetFloat("refractionScale", refractionScale);
-				refractionPS->CopyBufferData("perObject");
-
-				// Set textures
-				refractionPS->SetShaderResourceView("ScreenPixels", renderTargetSRVs[RenderTargetType::FINAL_COMPOSITE].Get());
-				refractionPS->SetShaderResourceView("RefractionSilhouette", renderTargetSRVs[RenderTargetType::REFRACTION_SILHOUETTE].Get());
-				refractionPS->SetShaderResourceView("EnvironmentMap", assets.sky->GetEnvironmentSRV());
-
-
-				// Reset "per frame" buffers
-				context->VSSetConstantBuffers(0, 1, vsPerFrameConstantBuffer.GetAddressOf());
-				context->PSSetConstantBuffers(0, 1, psPerFrameConstantBuffer.GetAddressOf());
-
-				// Draw
-				ge->GetMesh()->SetBuffersAndDraw(context);
-
-				// Reset this material's PS
-				mat->SetPS(prevPS);
-			}
-		}
+		// Reset this material's PS
+		mat->SetPS(prevPS);
 	}
+}
 
-	// Draw the light sources
-	DrawPointLights(camera);
+// --------------------------------------------------------
+// Copies this frame's part of the scene colors into the
+// composite target, for passes that sample the scene
+// while drawing into it
+// --------------------------------------------------------
+void Renderer::CopySceneToComposite()
+{
+	Microsoft::WRL::ComPtr<ID3D11Resource> source;
+	Microsoft::WRL::ComPtr<ID3D11Resource> dest;
+	GetGraphRTV(renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT])->GetResource(source.GetAddressOf());
+	GetGraphRTV(renderTargetResources[RenderTargetType::FINAL_COMPOSITE])->GetResource(dest.GetAddressOf());
+
+	D3D11_BOX box = {};
+	box.right = renderWidth;
+	box.bottom = renderHeight;
+	box.back = 1;
+	context->CopySubresourceRegion(dest.Get(), 0, 0, 0, 0, source.Get(), 0, &box);
+}
 
-	ImGui::Render();
-	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+// --------------------------------------------------------
+// Stretches the scaled scene over the full back buffer
+// --------------------------------------------------------
+void Renderer::DrawUpscale()
+{
+	AssetManager& assets = AssetManager::GetInstance();
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
 
-	// Present the back buffer to the user
-	//  - Puts the final frame we're drawing into the window so the user can see it
-	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
-	swapChain->Present(0, 0);
+	cache.SetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+	SetViewport(windowWidth, windowHeight);
 
-	// Due to the usage of a more sophisticated swap chain,
-	// the render target must be re-bound after every call to Present()
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+	SimpleVertexShader* fullscreenVS = assets.GetVertexShader("FullscreenVS"_id);
+	SimplePixelShader* upscalePS = assets.GetPixelShader("UpscalePS"_id);
+	fullscreenVS->SetShader();
+	upscalePS->SetShader();
 
-	// Unbind all SRVs at the end of the frame so they're not still bound for input
-	// when we begin the MRTs of the next frame
-	ID3D11ShaderResourceView* nullSRVs[16] = {};
-	context->PSSetShaderResources(0, 16, nullSRVs);
+	// Keep bilinear filtering from pulling in pixels
+	// from outside this frame's region
+	upscalePS->SetFloat2("uvScale", XMFLOAT2((float)renderWidth / targetWidth, (float)renderHeight / targetHeight));
+	upscalePS->SetFloat2("uvMax", XMFLOAT2((renderWidth - 0.5f) / targetWidth, (renderHeight - 0.5f) / targetHeight));
+	upscalePS->CopyAllBufferData();
+
+	upscalePS->SetShaderResourceView("SceneColors", GetGraphSRV(renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]));
+	upscalePS->SetSamplerState("ClampSampler", assets.clamplerOptions);
+
+	context->Draw(3, 0);
+
+	// Put the depth buffer back for anything drawn after the graph
+	cache.SetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
 }
 
-void Renderer::DrawPointLights(Camera* camera)
+void Renderer::SetViewport(unsigned int width, unsigned int height)
 {
-	AssetManager& assets = AssetManager::GetInstance();
-	SimpleVertexShader* lightVS = assets.GetVertexShader("VertexShader");
-	SimplePixelShader* lightPS = assets.GetPixelShader("SolidColorPS");
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)width;
+	viewport.Height = (float)height;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
+}
 
-	// Turn on these shaders
-	lightVS->SetShader();
-	lightPS->SetShader();
+void Renderer::UpdateDynamicResolution(float frameTime)
+{
+	dynamicResolution.Update(frameTime);
+}
 
-	// Set up vertex shader
-	lightVS->SetMatrix4x4("view", camera->GetView());
-	lightVS->SetMatrix4x4("projection", camera->GetProjection());
+// --------------------------------------------------------
+// Packs the point lights into gizmo instances, skipping
+// other light types.  Each light is two 16-byte loads and
+// a few SIMD ops: (Range, Position) and (Intensity, Color)
+// are rotated into (Position, Scale) and (Color * Intensity, 1).
+//
+// Returns how many instances were written
+// --------------------------------------------------------
+static unsigned int PackLightGizmos(const Light* lights, size_t count, LightGizmoInstance* instances)
+{
+	// Quick scale based on range (assuming range is between 5 - 10)
+	const XMVECTOR rangeToScale = XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f / 10.0f);
+	const XMVECTOR selectXYZ = XMVectorSelectControl(1, 1, 1, 0);
+	const XMVECTOR one = XMVectorSplatOne();
 
-	for (const Light& light : lights)
+	unsigned int written = 0;
+	for (size_t i = 0; i < count; i++)
 	{
+		const Light& light = lights[i];
+
 		// Only drawing points, so skip others
 		if (light.Type != LIGHT_TYPE_POINT)
 			continue;
 
-		// Calc quick scale based on range
-		// (assuming range is between 5 - 10)
-		float scale = light.Range / 10.0f;
-
-		// Make the transform for this light
-		XMMATRIX rotMat = XMMatrixIdentity();
-		XMMATRIX scaleMat = XMMatrixScaling(scale, scale, scale);
-		XMMATRIX transMat = XMMatrixTranslation(light.Position.x, light.Position.y, light.Position.z);
-		XMMATRIX worldMat = scaleMat * rotMat * transMat;
+		XMVECTOR rangePos = XMLoadFloat4((const XMFLOAT4*)&light.Range);
+		XMVECTOR intensityColor = XMLoadFloat4((const XMFLOAT4*)&light.Intensity);
 
-		XMFLOAT4X4 world;
-		XMFLOAT4X4 worldInvTrans;
-		XMStoreFloat4x4(&world, worldMat);
-		XMStoreFloat4x4(&worldInvTrans, XMMatrixInverse(0, XMMatrixTranspose(worldMat)));
+		XMVECTOR posScale = XMVectorMultiply(XMVectorSwizzle<1, 2, 3, 0>(rangePos), rangeToScale);
+		XMVECTOR color = XMVectorMultiply(XMVectorSwizzle<1, 2, 3, 0>(intensityColor), XMVectorSplatX(intensityColor));
+		color = XMVectorSelect(one, color, selectXYZ);
 
-		// Set up the world matrix for this light
-		lightVS->SetMatrix4x4("world", world);
-		lightVS->SetMatrix4x4("worldInverseTranspose", worldInvTrans);
+		XMStoreFloat4(&instances[written].PositionScale, posScale);
+		XMStoreFloat4(&instances[written].Color, color);
+		written++;
+	}
 
-		// Set up the pixel shader data
-		XMFLOAT3 finalColor = light.Color;
-		finalColor.x *= light.Intensity;
-		finalColor.y *= light.Intensity;
-		finalColor.z *= light.Intensity;
-		lightPS->SetFloat3("Color", finalColor);
+	return written;
+}
 
-		// Copy data
-		lightVS->CopyAllBufferData();
-		lightPS->CopyAllBufferData();
+// --------------------------------------------------------
+// Draws every point light's gizmo with one instanced draw
+// --------------------------------------------------------
+void Renderer::DrawPointLights()
+{
+	if (lights.empty() || !lightMesh)
+		return;
 
-		// Draw
-		assets.GetMesh("sphere")->SetBuffersAndDraw(context);
+	// Grow the instance buffer if we have more lights than ever before
+	if (lights.size() > lightInstanceCapacity)
+	{
+		lightInstanceCapacity = max((unsigned int)lights.size(), lightInstanceCapacity * 2);
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = sizeof(LightGizmoInstance) * lightInstanceCapacity;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		lightInstanceBuffer.Reset();
+		device->CreateBuffer(&desc, 0, lightInstanceBuffer.GetAddressOf());
 	}
+
+	// Pack straight into the buffer
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(lightInstanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	unsigned int instanceCount = PackLightGizmos(&lights[0], lights.size(), (LightGizmoInstance*)mapped.pData);
+	context->Unmap(lightInstanceBuffer.Get(), 0);
+
+	if (instanceCount == 0)
+		return;
+
+	// Lights go on top of the finished scene
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+	ID3D11RenderTargetView* target = GetGraphRTV(renderTargetResources[RenderTargetType::SCENE_COLORS_NO_AMBIENT]);
+	cache.SetRenderTargets(1, &target, depthBufferDSV.Get());
+
+	// View and projection come from the shared per-frame buffer
+	lightGizmoVS->SetShader();
+	lightGizmoPS->SetShader();
+
+	// Sphere (or its placeholder) in slot 0, instances in slot 1
+	Mesh* mesh = lightMesh->Get();
+	cache.SetVertexBuffer(0, mesh->GetVertexBuffer().Get(), sizeof(Vertex), 0);
+	cache.SetVertexBuffer(1, lightInstanceBuffer.Get(), sizeof(LightGizmoInstance), 0);
+	cache.SetIndexBuffer(mesh->GetIndexBuffer().Get(), DXGI_FORMAT_R32_UINT, 0);
+
+	context->DrawIndexedInstanced(mesh->GetIndexCount(), instanceCount, 0, 0, 0);
 }
 
 bool Renderer::GetUseRefractionSilhouette() { return useRefractionSilhouette; }
@@ -407,12 +696,23 @@ void Renderer::SetRefractionFromNormalMap(bool fromNormals) { refractionFromNorm
 void Renderer::SetIndexOfRefraction(float index) { indexOfRefraction = index; }
 void Renderer::SetRefractionScale(float scale) { refractionScale = scale; }
 
+void Renderer::SetShowAllRenderTargets(bool show) { showAllRenderTargets = show; }
+
+void Renderer::MarkLightDirty(unsigned int index) { lightBuffer.MarkDirty(index); }
+void Renderer::MarkAllLightsDirty() { lightBuffer.MarkAllDirty(); }
+
+// --------------------------------------------------------
+// Gets the texture currently backing a render target, or
+// null if last frame's graph didn't need it.  Unless the
+// "all render targets" view is on, the contents may have
+// been overwritten by another target sharing its memory.
+// --------------------------------------------------------
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Renderer::GetRenderTargetSRV(RenderTargetType type)
 {
 	if (type < 0 || type >= RenderTargetType::RENDER_TARGET_TYPE_COUNT)
 		return 0;
 
-	return renderTargetSRVs[type];
+	return GetGraphSRV(renderTargetResources[type]);
 }
 
 void Renderer::CreateRenderTarget(
@@ -8,6 +8,9 @@
 #include "Sky.h"
 #include "GameEntity.h"
 #include "AssetManager.h"
+#include "RenderGraph.h"
+#include "DynamicResolution.h"
+#include "LightBuffer.h"
 
 enum RenderTargetType
 {
@@ -24,6 +27,20 @@ enum RenderTargetType
 	RENDER_TARGET_TYPE_COUNT
 };
 
+// String representations of the render target types
+constexpr const char* RenderTargetTypeToString(int value) {
+	switch (value) {
+	case SCENE_COLORS_NO_AMBIENT: return "Scene Colors (No Ambient)";
+	case SCENE_AMBIENT: return "Scene Ambient";
+	case SCENE_NORMALS: return "Scene Normals";
+	case SCENE_DEPTHS: return "Scene Depths";
+	case SSAO_RESULTS: return "SSAO Results";
+	case SSAO_BLUR: return "SSAO Blur";
+	case REFRACTION_SILHOUETTE: return "Refraction Silhouette";
+	default: return "Final Composite";
+	}
+}
+
 // This needs to match the expected per-frame vertex shader data
 struct VSPerFrameData
 {
@@ -34,10 +51,19 @@ struct VSPerFrameData
 // This needs to match the expected per-frame pixel shader data
 struct PSPerFrameData
 {
-	Light Lights[MAX_LIGHTS];
 	int LightCount;
 	DirectX::XMFLOAT3 CameraPosition;
 	int TotalSpecIBLMipLevels;
+	DirectX::XMFLOAT3 Padding; // Keeps the next member on a 16 byte boundary
+	DirectX::XMFLOAT4 IrradianceSH[7];
+};
+static_assert(sizeof(PSPerFrameData) % 16 == 0, "PSPerFrameData must be a multiple of 16 bytes");
+
+// This needs to match the per-instance input of LightGizmoVS
+struct LightGizmoInstance
+{
+	DirectX::XMFLOAT4 PositionScale; // xyz = position, w = scale
+	DirectX::XMFLOAT4 Color;
 };
 
 using namespace DirectX;
@@ -54,13 +80,30 @@ private:
 	unsigned int windowWidth;
 	unsigned int windowHeight;
 
+	// Dynamic resolution: targets are targetWidth x targetHeight,
+	// and this frame's scene covers renderWidth x renderHeight of them
+	DynamicResolution dynamicResolution;
+	unsigned int targetWidth;
+	unsigned int targetHeight;
+	unsigned int renderWidth;
+	unsigned int renderHeight;
+
 	std::vector<Light>& lights;
+	LightBuffer lightBuffer;
 
 	// Per-frame constant buffers and data
 	Microsoft::WRL::ComPtr<ID3D11Buffer> psPerFrameConstantBuffer;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vsPerFrameConstantBuffer;
 	PSPerFrameData psPerFrameData;
 	VSPerFrameData vsPerFrameData;
+	bool psPerFrameDataUploaded;
+
+	// Point light gizmos
+	AssetHandle<Mesh>* lightMesh;
+	SimpleVertexShader* lightGizmoVS;
+	SimplePixelShader* lightGizmoPS;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lightInstanceBuffer;
+	unsigned int lightInstanceCapacity;
 
 	// Refraction related
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> refractionSilhouetteDepthState;
@@ -69,10 +112,22 @@ private:
 	float indexOfRefraction;
 	float refractionScale;
 
-	// Render targets
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> renderTargetRTVs[RenderTargetType::RENDER_TARGET_TYPE_COUNT];
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> renderTargetSRVs[RenderTargetType::RENDER_TARGET_TYPE_COUNT];
+	// Render graph, rebuilt every frame
+	RenderGraph renderGraph;
+	int renderTargetResources[RenderTargetType::RENDER_TARGET_TYPE_COUNT];
+	bool showAllRenderTargets;
 
+	// Real textures behind the graph's physical targets
+	std::vector<Microsoft::WRL::ComPtr<ID3D11RenderTargetView>> physicalRTVs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> physicalSRVs;
+	std::vector<RenderGraphTextureDesc> physicalTargetDescs;
+
+	// Replaced targets the UI may still reference this frame
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> retiredRenderTargets;
+
+	// Entities for this frame, split up for the passes
+	std::vector<GameEntity*> opaqueEntities;
+	std::vector<GameEntity*> refractiveEntities;
 	
 
 public:
@@ -86,6 +141,7 @@ public:
 		unsigned int windowHeight,
 		std::vector<Light>& lights
 	);
+	~Renderer();
 
 	void PreResize();
 
@@ -109,12 +165,41 @@ public:
 	void SetIndexOfRefraction(float index);
 	void SetRefractionScale(float scale);
 
+	// Feeds the last frame's time to the resolution controller
+	void UpdateDynamicResolution(float frameTime);
+	DynamicResolution& GetDynamicResolution() { return dynamicResolution; }
+	unsigned int GetRenderWidth() { return renderWidth; }
+	unsigned int GetRenderHeight() { return renderHeight; }
+
+	// Keeps every render target alive and unaliased for the debug UI
+	void SetShowAllRenderTargets(bool show);
+	RenderGraph& GetRenderGraph() { return renderGraph; }
+
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetRenderTargetSRV(RenderTargetType type);
 
+	// Lights are only re-uploaded when marked as changed
+	void MarkLightDirty(unsigned int index);
+	void MarkAllLightsDirty();
+	LightBuffer& GetLightBuffer() { return lightBuffer; }
+
 	void CreateRenderTarget(unsigned int width, unsigned int height, Microsoft::WRL::ComPtr<ID3D11RenderTargetView>& rtv, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv, DXGI_FORMAT colorFormat = DXGI_FORMAT_R8G8B8A8_UNORM);
 	
 
 private:
-	void DrawPointLights(Camera* camera);
+	void BuildRenderGraph(Camera* camera);
+	void AllocateRenderTargets();
+	ID3D11RenderTargetView* GetGraphRTV(int resource);
+	ID3D11ShaderResourceView* GetGraphSRV(int resource);
+
+	// Render graph passes
+	void DrawOpaque();
+	void DrawSky(Camera* camera);
+	void DrawRefractionSilhouette(Camera* camera);
+	void DrawRefraction(Camera* camera);
+	void CopySceneToComposite();
+	void DrawPointLights();
+	void DrawUpscale();
+
+	void SetViewport(unsigned int width, unsigned int height);
 };
 
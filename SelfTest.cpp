@@ -0,0 +1,960 @@
+#include "SelfTest.h"
+#include "AssetDependencies.h"
+#include "DynamicResolution.h"
+#include "IBLPrecompute.h"
+#include "RenderGraph.h"
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+static const float PI = 3.14159265359f;
+
+bool SelfTest::Check(bool passed, const char* format, ...)
+{
+	printf("  %s  ", passed ? "pass" : "FAIL");
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+	return passed;
+}
+
+// --------------------------------------------------------
+// Helpers for the IBL checks
+// --------------------------------------------------------
+
+// A linear cube map, from radiance(direction, rgb)
+template <typename Radiance>
+static IBLFloatCube MakeCube(unsigned int size, Radiance radiance)
+{
+	IBLFloatCube cube = {};
+	cube.Size = size;
+	for (int face = 0; face < 6; face++)
+	{
+		cube.Faces[face].resize(size * size * 4);
+		for (unsigned int y = 0; y < size; y++)
+		{
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float dir[3];
+				IBLPrecompute::FaceUVToDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+				float* texel = &cube.Faces[face][(y * size + x) * 4];
+				radiance(dir, texel);
+				texel[3] = 1.0f;
+			}
+		}
+	}
+	return cube;
+}
+
+// The same, gamma encoded as a sky's faces would be
+static IBLCubeImage EncodeImage(const IBLFloatCube& cube)
+{
+	std::vector<uint32_t> texels = IBLPrecompute::EncodeCube(cube);
+	size_t texelsPerFace = (size_t)cube.Size * cube.Size;
+
+	IBLCubeImage image = {};
+	image.Size = cube.Size;
+	for (int face = 0; face < 6; face++)
+		image.Faces[face].assign(texels.begin() + face * texelsPerFace, texels.begin() + (face + 1) * texelsPerFace);
+	return image;
+}
+
+static float DecodeChannel(uint32_t texel, int channel)
+{
+	return std::pow(((texel >> (channel * 8)) & 0xFF) / 255.0f, 2.2f);
+}
+
+// Largest difference in any channel, in 8-bit steps
+static int ChannelDifference(uint32_t a, uint32_t b)
+{
+	int difference = 0;
+	for (int channel = 0; channel < 3; channel++)
+		difference = std::max(difference, std::abs((int)((a >> (channel * 8)) & 0xFF) - (int)((b >> (channel * 8)) & 0xFF)));
+	return difference;
+}
+
+// Small enough to run in moments, big enough to mean something
+static IBLSettings GetTestSettings()
+{
+	IBLSettings settings = IBLPrecompute::GetDefaultSettings();
+	settings.SHProjectionSize = 32;
+	settings.SpecularSize = 32;
+	settings.SpecularMipLevels = 4;
+	settings.SpecularSamples = 64;
+	settings.EnvironmentSamples = 64;
+	settings.ImportanceTableSize = 16;
+	settings.BrdfLookUpSize = 32;
+	settings.BrdfLookUpSamples = 256;
+	return settings;
+}
+
+// Normals to check lighting from: the axes and the cube's corners
+static std::vector<std::array<float, 3>> GetTestNormals()
+{
+	std::vector<std::array<float, 3>> normals = {
+		{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+	};
+	const float corner = 1.0f / std::sqrt(3.0f);
+	for (int i = 0; i < 8; i++)
+		normals.push_back({ i & 1 ? corner : -corner, i & 2 ? corner : -corner, i & 4 ? corner : -corner });
+	return normals;
+}
+
+// Van der Corput, as in Hammersley2d() in Lighting.hlsli
+static float RadicalInverse(uint32_t bits)
+{
+	uint32_t reversed = 0;
+	for (int bit = 0; bit < 32; bit++)
+		reversed |= ((bits >> bit) & 1u) << (31 - bit);
+	return (float)(reversed * 2.3283064365386963e-10);
+}
+
+// --------------------------------------------------------
+// IntegrateBRDF() from IBLBrdfLookUpTablePS.hlsl, one sample
+// at a time, as the reference for the table
+// --------------------------------------------------------
+static void IntegrateBRDF(float roughness, float nDotV, unsigned int samples, float& scale, float& bias)
+{
+	const float v[3] = { std::sqrt(1 - nDotV * nDotV), 0, nDotV };
+	const float a = roughness * roughness;
+	const float k = roughness * roughness / 2;
+	auto g1 = [&](float nDotX) { return nDotX / (nDotX * (1 - k) + k); };
+
+	double sumA = 0;
+	double sumB = 0;
+	for (unsigned int i = 0; i < samples; i++)
+	{
+		float phi = 2 * PI * (i / (float)samples);
+		float xiY = RadicalInverse(i);
+		float cosTheta = std::sqrt((1 - xiY) / (1 + (a * a - 1) * xiY));
+		float sinTheta = std::sqrt(std::max(1 - cosTheta * cosTheta, 0.0f));
+
+		// ImportanceSampleGGX()'s tangents for N = (0, 0, 1) are
+		// X = (0, -1, 0) and Y = (1, 0, 0)
+		float h[3] = { sinTheta * std::sin(phi), -sinTheta * std::cos(phi), cosTheta };
+		float vDotH = v[0] * h[0] + v[1] * h[1] + v[2] * h[2];
+		float lz = 2 * vDotH * h[2] - v[2];
+
+		float nDotL = std::clamp(lz, 0.0f, 1.0f);
+		float nDotH = std::clamp(h[2], 0.0f, 1.0f);
+		vDotH = std::clamp(vDotH, 0.0f, 1.0f);
+		if (nDotL > 0)
+		{
+			float gVis = g1(nDotV) * g1(nDotL) * vDotH / (nDotH * nDotV);
+			float fc = std::pow(1 - vDotH, 5.0f);
+			sumA += (1 - fc) * gVis;
+			sumB += fc * gVis;
+		}
+	}
+
+	scale = (float)(sumA / samples);
+	bias = (float)(sumB / samples);
+}
+
+// Spread evenly over the sphere (a Fibonacci spiral)
+static std::vector<std::array<float, 3>> GetSphereNormals(unsigned int count)
+{
+	std::vector<std::array<float, 3>> normals;
+	const float goldenAngle = PI * (3 - std::sqrt(5.0f));
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float y = 1 - (i + 0.5f) / count * 2;
+		float radius = std::sqrt(1 - y * y);
+		normals.push_back({ radius * std::cos(goldenAngle * i), y, radius * std::sin(goldenAngle * i) });
+	}
+	return normals;
+}
+
+// EnvironmentPdf() times solid angle, summed over a grid 4 times
+// finer than the table on every face (solid angles as below)
+static float IntegrateEnvironmentPdf(const IBLEnvironmentCDF& cdf)
+{
+	double sum = 0;
+	double totalWeight = 0;
+	const unsigned int size = cdf.Size * 4;
+	for (int face = 0; face < 6; face++)
+	{
+		for (unsigned int y = 0; y < size; y++)
+		{
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float u = (x + 0.5f) / size * 2 - 1;
+				float v = (y + 0.5f) / size * 2 - 1;
+				float r2 = 1 + u * u + v * v;
+				float weight = 1.0f / (r2 * std::sqrt(r2));
+				totalWeight += weight;
+
+				float dir[3];
+				IBLPrecompute::FaceUVToDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+				sum += IBLPrecompute::EnvironmentPdf(cdf, dir) * weight;
+			}
+		}
+	}
+	return (float)(sum * (4 * PI / totalWeight));
+}
+
+// --------------------------------------------------------
+// Irradiance / PI for a normal, summed over every texel with
+// the same solid angles ProjectSH9() uses, so it's the exact
+// answer for the cube map as it is
+// --------------------------------------------------------
+static float IntegrateIrradiance(const IBLFloatCube& cube, const float normal[3])
+{
+	double sum = 0;
+	double totalWeight = 0;
+	const unsigned int size = cube.Size;
+	for (int face = 0; face < 6; face++)
+	{
+		for (unsigned int y = 0; y < size; y++)
+		{
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float u = (x + 0.5f) / size * 2 - 1;
+				float v = (y + 0.5f) / size * 2 - 1;
+				float r2 = 1 + u * u + v * v;
+				float weight = 1.0f / (r2 * std::sqrt(r2));
+				totalWeight += weight;
+
+				float dir[3];
+				IBLPrecompute::FaceUVToDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+				float nDotL = normal[0] * dir[0] + normal[1] * dir[1] + normal[2] * dir[2];
+				if (nDotL > 0)
+					sum += cube.Faces[face][(y * size + x) * 4] * nDotL * weight;
+			}
+		}
+	}
+	return (float)(sum * (4 * PI / totalWeight) / PI);
+}
+
+bool SelfTest::IBL(unsigned int threadCount)
+{
+	printf("IBL precompute:\n");
+	bool passed = true;
+	const unsigned int environmentSize = 64;
+	IBLSettings settings = GetTestSettings();
+
+	// A constant environment stays constant however rough, and
+	// lights every normal the same (irradiance / PI is the radiance)
+	{
+		IBLCubeImage environment = EncodeImage(MakeCube(environmentSize, [](const float*, float* rgb) { rgb[0] = 0.5f; rgb[1] = 0.25f; rgb[2] = 0.125f; }));
+		IBLResults results = IBLPrecompute::Compute(environment, settings, threadCount);
+
+		uint32_t texel = environment.Faces[0][0];
+		int largest = 0;
+		for (auto& mip : results.Specular)
+			for (uint32_t specular : mip)
+				largest = std::max(largest, ChannelDifference(specular, texel));
+		passed &= Check(largest <= 1, "Constant environment: every specular mip within %d 8-bit steps of it (1 allowed)", largest);
+
+		float worst = 0;
+		for (auto& normal : GetTestNormals())
+		{
+			float rgb[3];
+			IBLPrecompute::EvaluateIrradianceSH(results.IrradianceSH, normal.data(), rgb);
+			for (int channel = 0; channel < 3; channel++)
+			{
+				float expected = DecodeChannel(texel, channel);
+				worst = std::max(worst, std::fabs(rgb[channel] - expected) / expected);
+			}
+		}
+		passed &= Check(worst <= 0.005f, "Constant environment: irradiance off by %.4f%% at most (0.5%% allowed)", worst * 100);
+	}
+
+	// Light from above that falls off linearly to nothing at the
+	// horizon, and none below it
+	IBLCubeImage environment = EncodeImage(MakeCube(environmentSize, [](const float* dir, float* rgb) { rgb[0] = rgb[1] = rgb[2] = std::max(dir[1], 0.0f); }));
+	IBLResults results = IBLPrecompute::Compute(environment, settings, threadCount);
+	{
+		// Rougher mips blur it: looking up gets darker, looking down
+		// gets lighter, and up stays brighter than down
+		auto centre = [](const std::vector<uint32_t>& mip, unsigned int size, int face) { return mip[face * size * size + (size / 2) * size + size / 2] & 0xFF; };
+		bool blurred = true;
+		unsigned int previousUp = 255;
+		unsigned int previousDown = 0;
+		for (size_t mip = 0; mip < results.Specular.size(); mip++)
+		{
+			unsigned int size = std::max(results.SpecularSize >> mip, 1u);
+			unsigned int up = centre(results.Specular[mip], size, 2);
+			unsigned int down = centre(results.Specular[mip], size, 3);
+			printf("        mip %zu: up %u, down %u\n", mip, up, down);
+			blurred = blurred && up <= previousUp + 1 && down + 1 >= previousDown && up > down;
+			previousUp = up;
+			previousDown = down;
+		}
+		passed &= Check(blurred, "Clamped linear environment: every rougher mip is blurrier than the last");
+
+		// Roughness 0 is the (box filtered) environment itself
+		std::vector<IBLFloatCube> mips = IBLPrecompute::BuildMipChain(environment, settings.SpecularSize, threadCount);
+		IBLFloatCube sharp = IBLPrecompute::Specular(mips, 0, mips[0].Size, 0.0f, settings.SpecularSamples, 0, threadCount);
+		float largest = 0;
+		for (int face = 0; face < 6; face++)
+			for (size_t i = 0; i < sharp.Faces[face].size(); i++)
+				largest = std::max(largest, std::fabs(sharp.Faces[face][i] - mips[0].Faces[face][i]));
+		passed &= Check(largest <= 1e-6f, "Roughness 0: passes the environment through, off by %g at most (1e-6 allowed)", largest);
+
+		std::vector<uint32_t> encoded = IBLPrecompute::EncodeCube(mips[0]);
+		size_t different = 0;
+		for (size_t i = 0; i < encoded.size(); i++)
+			different += encoded[i] != results.Specular[0][i];
+		passed &= Check(different == 0, "Roughness 0: %zu texels of the top specular mip differ from the environment", different);
+	}
+
+	// Each texel is at the centre of its roughness and N dot V cell
+	{
+		float largest = 0;
+		unsigned int size = results.BrdfLookUpSize;
+		for (unsigned int y = 0; y < size; y++)
+		{
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float scale, bias;
+				IntegrateBRDF((x + 0.5f) / size, (y + 0.5f) / size, settings.BrdfLookUpSamples, scale, bias);
+				uint32_t packed = results.BrdfLookUp[y * size + x];
+				largest = std::max(largest, std::fabs((packed & 0xFFFF) / 65535.0f - scale));
+				largest = std::max(largest, std::fabs((packed >> 16) / 65535.0f - bias));
+			}
+		}
+		passed &= Check(largest <= 2e-4f, "BRDF table: off from IntegrateBRDF() by %g at most (2e-4 allowed)", largest);
+	}
+
+	// Importance sampling a dim sky with a small, bright sun, so the
+	// pdf is anything but uniform
+	{
+		const float sun[3] = { 0.48f, 0.6f, 0.64f };
+		auto sunAndSky = [&](const float* dir, float* rgb)
+			{
+				bool inSun = dir[0] * sun[0] + dir[1] * sun[1] + dir[2] * sun[2] > 0.985f;
+				rgb[0] = rgb[1] = rgb[2] = inSun ? 50.0f : 0.2f;
+			};
+		IBLEnvironmentCDF cdf = IBLPrecompute::BuildEnvironmentCDF(MakeCube(settings.ImportanceTableSize, sunAndSky));
+		float integral = IntegrateEnvironmentPdf(cdf);
+		passed &= Check(std::fabs(integral - 1) <= 1e-3f, "Environment pdf: integrates to %.5f over the sphere (1 +- 0.001 allowed)", integral);
+
+		// Whatever SampleEnvironment() picks, EnvironmentPdf() agrees
+		const unsigned int samples = 4096;
+		float worst = 0;
+		for (unsigned int i = 0; i < samples; i++)
+		{
+			float dir[3];
+			float pdf = IBLPrecompute::SampleEnvironment(cdf, (i + 0.5f) / samples, RadicalInverse(i), dir);
+			worst = std::max(worst, std::fabs(pdf - IBLPrecompute::EnvironmentPdf(cdf, dir)) / pdf);
+		}
+		passed &= Check(worst <= 1e-3f, "Environment pdf: SampleEnvironment() and EnvironmentPdf() differ by %.5f%% at most (0.1%% allowed)", worst * 100);
+
+		// A constant environment is sampled uniformly.  The table is
+		// constant over each texel's UVs, so within a texel the pdf
+		// follows the cube's stretching; it's judged at the centres,
+		// where that's accounted for.
+		const unsigned int tableSize = settings.ImportanceTableSize;
+		IBLEnvironmentCDF flat = IBLPrecompute::BuildEnvironmentCDF(MakeCube(tableSize, [](const float*, float* rgb) { rgb[0] = rgb[1] = rgb[2] = 0.5f; }));
+		const float uniform = 1 / (4 * PI);
+		float furthest = 0;
+		for (int face = 0; face < 6; face++)
+		{
+			for (unsigned int y = 0; y < tableSize; y++)
+			{
+				for (unsigned int x = 0; x < tableSize; x++)
+				{
+					float dir[3];
+					IBLPrecompute::FaceUVToDirection(face, (x + 0.5f) / tableSize, (y + 0.5f) / tableSize, dir);
+					furthest = std::max(furthest, std::fabs(IBLPrecompute::EnvironmentPdf(flat, dir) - uniform) / uniform);
+				}
+			}
+		}
+		passed &= Check(furthest <= 0.005f, "Environment pdf: constant environment within %.3f%% of uniform at every texel (0.5%% allowed)", furthest * 100);
+
+		// Each texel only depends on its own samples, so how the work's
+		// split up doesn't change a thing
+		std::vector<IBLFloatCube> mips = IBLPrecompute::BuildMipChain(EncodeImage(MakeCube(environmentSize, sunAndSky)), settings.SpecularSize);
+		const IBLFloatCube* table = &mips.back();
+		for (auto& mip : mips)
+			if (mip.Size == settings.ImportanceTableSize)
+				table = &mip;
+		IBLEnvironmentCDF mipCDF = IBLPrecompute::BuildEnvironmentCDF(*table);
+		const unsigned int size = settings.SpecularSize / 2;
+		IBLFloatCube one = IBLPrecompute::Specular(mips, &mipCDF, size, 0.5f, settings.SpecularSamples, settings.EnvironmentSamples, 1);
+		IBLFloatCube many = IBLPrecompute::Specular(mips, &mipCDF, size, 0.5f, settings.SpecularSamples, settings.EnvironmentSamples, 4);
+		bool same = true;
+		for (int face = 0; face < 6; face++)
+			same = same && one.Faces[face] == many.Faces[face];
+		passed &= Check(same, "Specular(): identical on 1 thread and on 4, with environment samples");
+	}
+
+	// What's cached comes back exactly, and nothing else is taken for it
+	{
+		std::vector<uint8_t> data = IBLPrecompute::Serialize(results);
+		IBLResults loaded = {};
+		bool same = IBLPrecompute::Deserialize(data, loaded) &&
+			memcmp(&loaded.IrradianceSH, &results.IrradianceSH, sizeof(IBLSH9)) == 0 &&
+			loaded.SpecularSize == results.SpecularSize &&
+			loaded.Specular == results.Specular &&
+			loaded.BrdfLookUpSize == results.BrdfLookUpSize &&
+			loaded.BrdfLookUp == results.BrdfLookUp;
+		passed &= Check(same, "Cache: results come back the same");
+
+		std::vector<uint8_t> shorter(data.begin(), data.end() - 1);
+		std::vector<uint8_t> longer = data;
+		longer.push_back(0);
+		passed &= Check(!IBLPrecompute::Deserialize(shorter, loaded) && !IBLPrecompute::Deserialize(longer, loaded), "Cache: cut off or overlong data is turned down");
+
+		IBLCubeImage changed = environment;
+		changed.Faces[4][0] ^= 1;
+		IBLSettings rougher = settings;
+		rougher.SpecularSamples++;
+		uint64_t hash = IBLPrecompute::HashInputs(environment, settings);
+		passed &= Check(hash == IBLPrecompute::HashInputs(environment, settings) &&
+			hash != IBLPrecompute::HashInputs(changed, settings) &&
+			hash != IBLPrecompute::HashInputs(environment, rougher),
+			"Cache: the key changes with the environment and settings, and only with them");
+	}
+
+	return passed;
+}
+
+bool SelfTest::SphericalHarmonics()
+{
+	printf("Spherical harmonics:\n");
+	bool passed = true;
+	const unsigned int size = 32;
+	std::vector<std::array<float, 3>> normals = GetSphereNormals(256);
+
+	// Largest of the 2nd and 3rd bands' coefficients
+	auto largestAbove = [](const IBLSH9& sh, int first)
+		{
+			float largest = 0;
+			for (int i = first; i < 9; i++)
+				largest = std::max(largest, std::fabs(sh.Coefficients[i][0]));
+			return largest;
+		};
+
+	// Only the first coefficient (the average) is there, and
+	// every normal gets the radiance
+	{
+		const float radiance = 0.5f;
+		IBLSH9 sh = IBLPrecompute::ProjectSH9(MakeCube(size, [&](const float*, float* rgb) { rgb[0] = rgb[1] = rgb[2] = radiance; }));
+
+		float expected = radiance * std::sqrt(4 * PI);
+		float projection = std::max(std::fabs(sh.Coefficients[0][0] - expected), largestAbove(sh, 1)) / expected;
+		passed &= Check(projection <= 1e-4f, "Constant: projection off by %.5f%% at most (0.01%% allowed)", projection * 100);
+
+		float worst = 0;
+		for (auto& normal : normals)
+		{
+			float rgb[3];
+			IBLPrecompute::EvaluateIrradianceSH(sh, normal.data(), rgb);
+			worst = std::max(worst, std::fabs(rgb[0] - radiance) / radiance);
+		}
+		passed &= Check(worst <= 1e-4f, "Constant: irradiance off by %.5f%% at most (0.01%% allowed)", worst * 100);
+	}
+
+	// a + b (d . axis) is all in the first two bands, and the
+	// cosine lobe scales the second by 2/3, so irradiance / PI
+	// is a + 2/3 b (n . axis)
+	{
+		const float a = 0.5f;
+		const float b = 0.4f;
+		const float length = std::sqrt(14.0f);
+		const float axis[3] = { 1 / length, 2 / length, 3 / length };
+		IBLSH9 sh = IBLPrecompute::ProjectSH9(MakeCube(size, [&](const float* dir, float* rgb)
+			{
+				rgb[0] = rgb[1] = rgb[2] = a + b * (dir[0] * axis[0] + dir[1] * axis[1] + dir[2] * axis[2]);
+			}));
+
+		float projection = largestAbove(sh, 4) / sh.Coefficients[0][0];
+		passed &= Check(projection <= 1e-3f, "Linear: third band is %.4f%% of the first (0.1%% allowed)", projection * 100);
+
+		float worst = 0;
+		for (auto& normal : normals)
+		{
+			float rgb[3];
+			IBLPrecompute::EvaluateIrradianceSH(sh, normal.data(), rgb);
+			float expected = a + 2.0f / 3 * b * (normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2]);
+			worst = std::max(worst, std::fabs(rgb[0] - expected) / a);
+		}
+		passed &= Check(worst <= 2e-3f, "Linear: irradiance off by %.4f%% of the average at most (0.2%% allowed)", worst * 100);
+	}
+
+	// A dim sky and a sun 3 degrees across that lights a surface
+	// facing it about 5 times as much.  9 coefficients can't hold
+	// anything that sharp: for a point light they overshoot by
+	// 1/16 facing it and by 3/32 of that at the horizon, which is
+	// about as far off as this is allowed to get.  The average is
+	// all in the first coefficient, so that should still be right.
+	{
+		const float sky = 0.05f;
+		const float sunCos = std::cos(1.5f * PI / 180);
+		const float sunRadiance = 1.0f / (2 * PI * (1 - sunCos));
+		const float length = std::sqrt(3.0f);
+		const float sun[3] = { 1 / length, 1 / length, -1 / length };
+		IBLFloatCube cube = MakeCube(size, [&](const float* dir, float* rgb)
+			{
+				bool inSun = dir[0] * sun[0] + dir[1] * sun[1] + dir[2] * sun[2] >= sunCos;
+				rgb[0] = rgb[1] = rgb[2] = inSun ? sunRadiance : sky;
+			});
+		IBLSH9 sh = IBLPrecompute::ProjectSH9(cube);
+
+		float facing = IntegrateIrradiance(cube, sun);
+		float worst = 0;
+		float average = 0;
+		float exactAverage = 0;
+		for (auto& normal : normals)
+		{
+			float rgb[3];
+			IBLPrecompute::EvaluateIrradianceSH(sh, normal.data(), rgb);
+			float expected = IntegrateIrradiance(cube, normal.data());
+			worst = std::max(worst, std::fabs(rgb[0] - expected) / facing);
+			average += rgb[0] / normals.size();
+			exactAverage += expected / normals.size();
+		}
+
+		float rgb[3];
+		IBLPrecompute::EvaluateIrradianceSH(sh, sun, rgb);
+		float towards = std::fabs(rgb[0] - facing) / facing;
+		passed &= Check(towards <= 0.07f, "Sun: irradiance facing the sun off by %.3f%% (7%% allowed)", towards * 100);
+		passed &= Check(worst <= 0.1f, "Sun: irradiance off by %.3f%% of that at most (10%% allowed)", worst * 100);
+
+		float drift = std::fabs(average - exactAverage) / exactAverage;
+		passed &= Check(drift <= 0.01f, "Sun: average irradiance off by %.3f%% (1%% allowed)", drift * 100);
+	}
+
+	return passed;
+}
+
+bool SelfTest::TextureStreaming()
+{
+	printf("Texture streaming:\n");
+	bool passed = true;
+
+	// 256 x 256 has 9 mips, and 512 x 128 goes by its longer side
+	{
+		struct Case
+		{
+			uint32_t Width, Height, MipCount;
+			float UVPerPixel;
+			uint32_t Expected;
+		};
+		const float infinity = std::numeric_limits<float>::infinity();
+		const Case cases[] = {
+			{ 256, 256, 9, 1 / 256.0f, 0 },		// A texel a pixel
+			{ 256, 256, 9, 1 / 1024.0f, 0 },	// Magnified
+			{ 256, 256, 9, 2 / 256.0f, 1 },
+			{ 256, 256, 9, 3 / 256.0f, 1 },		// Towards more detail
+			{ 256, 256, 9, 4 / 256.0f, 2 },
+			{ 256, 256, 9, 1.0f, 8 },
+			{ 256, 256, 9, 1000.0f, 8 },		// No smaller mip than the last
+			{ 256, 256, 9, 0.0f, 0 },
+			{ 256, 256, 9, std::nanf(""), 0 },
+			{ 256, 256, 9, infinity, 8 },
+			{ 512, 128, 10, 2 / 512.0f, 1 },
+		};
+		int wrong = 0;
+		for (const Case& c : cases)
+		{
+			uint32_t mip = TextureStreamer::SelectMip(c.Width, c.Height, c.MipCount, c.UVPerPixel);
+			if (mip != c.Expected)
+			{
+				printf("        %u x %u at %g UV per pixel: mip %u, not %u\n", c.Width, c.Height, c.UVPerPixel, mip, c.Expected);
+				wrong++;
+			}
+		}
+		passed &= Check(wrong == 0, "SelectMip(): %d of %zu cases picked the wrong mip", wrong, std::size(cases));
+	}
+
+	// 1024 x 1024 BC1 textures start at mip 3 (128 x 128)
+	const uint32_t size = 1024;
+	const uint32_t mipCount = TextureStreamer::GetFullMipCount(size, size);
+	const uint32_t startMip = TextureStreamer::GetStartMip(size, size, mipCount);
+	passed &= Check(mipCount == 11 && startMip == 3, "GetStartMip(): %u x %u starts at mip %u of %u", size, size, startMip, mipCount);
+
+	// Makes every change, as StreamTextures() would
+	auto update = [](TextureStreamer& streamer)
+		{
+			std::vector<TextureMipChange> changes = streamer.Update();
+			for (auto& change : changes)
+				streamer.SetResidentMip(change.Name, change.ToMip);
+			return changes;
+		};
+
+	{
+		TextureStreamer streamer;
+		streamer.Add("a", size, size, mipCount, 8, startMip);
+		uint64_t startBytes = streamer.GetResidentBytes();
+		passed &= Check(update(streamer).empty(), "Update(): nothing happens to what isn't asked for");
+
+		streamer.Request("a", 1.0f / size);
+		std::vector<TextureMipChange> changes = update(streamer);
+		passed &= Check(changes.size() == 1 && changes[0].FromMip == startMip && changes[0].ToMip == 0 &&
+			streamer.GetResidentBytes() == TextureStreamer::GetBytes(size, size, 0, mipCount, 8),
+			"Update(): seen a texel a pixel, every mip is uploaded");
+
+		// Kept for DropDelay frames without being asked for, then back
+		// to what it started with
+		uint32_t frames = 0;
+		while (frames < TextureStreamer::DropDelay * 2 && streamer.GetResidentMip("a") == 0)
+		{
+			update(streamer);
+			frames++;
+		}
+		passed &= Check(frames == TextureStreamer::DropDelay && streamer.GetResidentMip("a") == startMip && streamer.GetResidentBytes() == startBytes,
+			"Update(): dropped back to mip %u after %u frames (%u expected)", streamer.GetResidentMip("a"), frames, TextureStreamer::DropDelay);
+	}
+
+	// With next to no bandwidth, the one that's furthest off goes
+	// first, and only one a frame
+	{
+		TextureStreamer streamer;
+		streamer.SetBandwidthBudget(1);
+		streamer.Add("near", size, size, mipCount, 8, startMip);
+		streamer.Add("far", size, size, mipCount, 8, startMip);
+
+		bool oneAtATime = true;
+		for (int frame = 0; frame < 2; frame++)
+		{
+			streamer.Request("near", 1.0f / size);
+			streamer.Request("far", 2.0f / size);
+			std::vector<TextureMipChange> changes = update(streamer);
+			const char* expected = frame == 0 ? "near" : "far";
+			oneAtATime = oneAtATime && changes.size() == 1 && changes[0].Name == expected;
+		}
+		passed &= Check(oneAtATime && streamer.GetResidentMip("near") == 0 && streamer.GetResidentMip("far") == 1,
+			"Update(): the bandwidth budget lets one upload through a frame, neediest first");
+	}
+
+	// Lowering the memory budget drops mips from whatever has the
+	// most detail to spare, and never below where a texture started
+	{
+		TextureStreamer streamer;
+		streamer.Add("wanted", size, size, mipCount, 8, startMip);
+		streamer.Add("spare", size, size, mipCount, 8, startMip);
+		streamer.Request("wanted", 1.0f / size);
+		streamer.Request("spare", 1.0f / size);
+		update(streamer);
+
+		uint64_t budget = TextureStreamer::GetBytes(size, size, 0, mipCount, 8) + TextureStreamer::GetBytes(size, size, 2, mipCount, 8);
+		streamer.SetMemoryBudget(budget);
+		streamer.Request("wanted", 1.0f / size);
+		streamer.Request("spare", 8.0f / size);
+		update(streamer);
+		passed &= Check(streamer.GetResidentBytes() <= budget && streamer.GetResidentMip("wanted") == 0 && streamer.GetResidentMip("spare") == 2,
+			"Update(): over the memory budget, dropped to mips %u and %u (0 and 2 expected)", streamer.GetResidentMip("wanted"), streamer.GetResidentMip("spare"));
+
+		streamer.SetMemoryBudget(0);
+		update(streamer);
+		passed &= Check(streamer.GetResidentMip("wanted") == startMip && streamer.GetResidentMip("spare") == startMip,
+			"Update(): with no memory at all, both keep the mips they started with");
+	}
+
+	return passed;
+}
+
+bool SelfTest::DynamicScaling(const char* recordedTracePath)
+{
+	printf("Dynamic resolution:\n");
+	bool passed = true;
+
+	std::vector<float> frameTimes;
+	bool read = DynamicResolution::LoadTrace(StepResponsePath, frameTimes);
+	if (!Check(read && !frameTimes.empty(), "LoadTrace(): %zu frames of synthetic step input from %s", frameTimes.size(), StepResponsePath))
+		return false;
+	passed &= CheckScaling(frameTimes, true);
+
+	// The targets are never bigger than the window, since the
+	// depth buffer isn't
+	{
+		DynamicResolutionSettings settings = DynamicResolution::GetDefaultSettings();
+		DynamicResolutionSettings tooBig = settings;
+		tooBig.MaxScale = 1.5f;
+		tooBig.MinScale = 1.25f;
+		DynamicResolution clamped(tooBig);
+		bool constructed = clamped.GetSettings().MaxScale == 1.0f && clamped.GetSettings().MinScale <= 1.0f;
+		clamped.SetSettings(settings);
+		clamped.SetSettings(tooBig);
+		bool set = clamped.GetSettings().MaxScale == 1.0f && clamped.GetSettings().MinScale <= 1.0f;
+		std::vector<float> clampedScales = clamped.Replay(frameTimes);
+		float largest = *std::max_element(clampedScales.begin(), clampedScales.end());
+		passed &= Check(constructed && set && largest <= 1.0f, "SetSettings(): a max scale of %.2f is clamped to %.2f", tooBig.MaxScale, largest);
+	}
+
+	if (recordedTracePath)
+	{
+		std::vector<float> recorded;
+		read = DynamicResolution::LoadTrace(recordedTracePath, recorded);
+		if (!Check(read && !recorded.empty(), "LoadTrace(): %zu recorded frames from %s", recorded.size(), recordedTracePath))
+			return false;
+		passed &= CheckScaling(recorded, false);
+	}
+
+	return passed;
+}
+
+bool SelfTest::CheckScaling(const std::vector<float>& frameTimes, bool needsLoadAndSpare)
+{
+	bool passed = true;
+	DynamicResolutionSettings settings = DynamicResolution::GetDefaultSettings();
+	DynamicResolution controller(settings);
+	std::vector<float> scales = controller.Replay(frameTimes);
+	passed &= Check(scales == controller.Replay(frameTimes) && scales == DynamicResolution(settings).Replay(frameTimes),
+		"Replay(): the same scales every time");
+
+	int offStep = 0;
+	for (float scale : scales)
+	{
+		float steps = (scale - settings.MinScale) / settings.ScaleStep;
+		bool onStep = std::fabs(steps - std::round(steps)) < 1e-3f || scale == settings.MaxScale;
+		if (scale < settings.MinScale || scale > settings.MaxScale || !onStep)
+			offStep++;
+	}
+	passed &= Check(offStep == 0, "Replay(): %d scales off a step or outside [%.2f, %.2f]", offStep, settings.MinScale, settings.MaxScale);
+
+	// Judged by the average over a window ending at each frame,
+	// well clear of the target either way, so noise and the odd
+	// hitch don't decide it.  Time to spare has to have lasted
+	// up to the frame, not just averaged out over the window.
+	auto averageTime = [&](size_t end, size_t count)
+		{
+			if (end + 1 < count)
+				return settings.TargetFrameTime;
+			float total = 0;
+			for (size_t i = end + 1 - count; i <= end; i++)
+				total += frameTimes[i];
+			return total / count;
+		};
+	const size_t loadFrames = 60;
+	const size_t spareFrames = 240;
+	const size_t recentFrames = 30;
+	size_t loaded = 0, stillFull = 0, spare = 0, notFull = 0;
+	for (size_t i = 0; i < frameTimes.size(); i++)
+	{
+		if (averageTime(i, loadFrames) > settings.TargetFrameTime * 1.25f)
+		{
+			loaded++;
+			stillFull += scales[i] == settings.MaxScale;
+		}
+		if (averageTime(i, spareFrames) < settings.TargetFrameTime * 0.85f && averageTime(i, recentFrames) < settings.TargetFrameTime * 0.85f)
+		{
+			spare++;
+			notFull += scales[i] != settings.MaxScale;
+		}
+	}
+	passed &= Check((loaded > 0 || !needsLoadAndSpare) && stillFull == 0,
+		"Replay(): still at full scale on %zu of %zu frames after %zu averaging 25%% over budget", stillFull, loaded, loadFrames);
+	passed &= Check((spare > 0 || !needsLoadAndSpare) && notFull == 0,
+		"Replay(): below full scale on %zu of %zu frames after %zu averaging 15%% under budget", notFull, spare, spareFrames);
+
+	// A step one way then straight back is the flicker ScaleStep's
+	// dead band is there to stop
+	const size_t flickerFrames = 30;
+	size_t changes = 0, flickers = 0;
+	size_t lastChange = 0;
+	float lastDirection = 0;
+	for (size_t i = 1; i < scales.size(); i++)
+	{
+		if (scales[i] == scales[i - 1])
+			continue;
+		float direction = scales[i] > scales[i - 1] ? 1.0f : -1.0f;
+		if (changes > 0 && direction != lastDirection && i - lastChange < flickerFrames)
+			flickers++;
+		changes++;
+		lastChange = i;
+		lastDirection = direction;
+	}
+	passed &= Check(flickers == 0, "Replay(): %zu of %zu scale changes turned back within %zu frames", flickers, changes, flickerFrames);
+	return passed;
+}
+
+bool SelfTest::RenderGraph()
+{
+	printf("Render graph:\n");
+	bool passed = true;
+	const RenderGraphTextureDesc desc = { 64, 64, 28, 4 }; // DXGI_FORMAT_R8G8B8A8_UNORM
+
+	// Scene -> Blur -> Tonemap -> Present, with Dead reading the scene
+	// into a texture nobody reads.  Scene is done with after Blur, so
+	// Tonemap's output can go in its memory.
+	{
+		::RenderGraph graph;
+		int scene = graph.CreateTexture("Scene", desc);
+		int blurred = graph.CreateTexture("Blurred", desc);
+		int unused = graph.CreateTexture("Unused", desc);
+		int toneMapped = graph.CreateTexture("Tone mapped", desc);
+		int backBuffer = graph.ImportTexture("Back buffer");
+
+		std::vector<int> ran;
+		std::vector<int> cleared;
+		auto addPass = [&](const char* name)
+			{
+				int pass = graph.GetPassCount();
+				return graph.AddPass(name, [&ran, pass]() { ran.push_back(pass); });
+			};
+		int scenePass = addPass("Scene");
+		graph.Write(scenePass, scene);
+		int blurPass = addPass("Blur");
+		graph.Read(blurPass, scene);
+		graph.Write(blurPass, blurred);
+		int deadPass = addPass("Dead");
+		graph.Read(deadPass, scene);
+		graph.Write(deadPass, unused);
+		int toneMapPass = addPass("Tonemap");
+		graph.Read(toneMapPass, blurred);
+		graph.Write(toneMapPass, toneMapped);
+		int presentPass = addPass("Present");
+		graph.Read(presentPass, toneMapped);
+		graph.Write(presentPass, backBuffer);
+
+		bool compiled = graph.Compile();
+		passed &= Check(compiled, "Compile(): %s", compiled ? "no errors" : graph.GetError().c_str());
+		if (!compiled)
+			return false;
+
+		passed &= Check(graph.IsPassCulled(deadPass) && graph.GetPhysicalIndex(unused) == -1,
+			"Compile(): the pass nobody reads from is culled, and its output never allocated");
+
+		// Each pass has to come after the one writing what it reads
+		const std::vector<int>& order = graph.GetExecutionOrder();
+		auto position = [&](int pass) { return (int)(std::find(order.begin(), order.end(), pass) - order.begin()); };
+		const std::pair<int, int> edges[] = { { scenePass, blurPass }, { blurPass, toneMapPass }, { toneMapPass, presentPass } };
+		bool topological = order.size() == 4;
+		for (auto& [writer, reader] : edges)
+			topological &= position(writer) < position(reader) && position(reader) < (int)order.size();
+		passed &= Check(topological, "Compile(): %zu live passes, each after the pass writing what it reads", order.size());
+
+		RenderGraphLifetime sceneLife = graph.GetLifetime(scene);
+		RenderGraphLifetime toneMappedLife = graph.GetLifetime(toneMapped);
+		passed &= Check(sceneLife.First == 0 && sceneLife.Last == 1 && toneMappedLife.First == 2 && toneMappedLife.Last == 3,
+			"GetLifetime(): Scene lives [%d, %d] and Tone mapped [%d, %d] ([0, 1] and [2, 3] expected)",
+			sceneLife.First, sceneLife.Last, toneMappedLife.First, toneMappedLife.Last);
+
+		passed &= Check(graph.GetPhysicalIndex(scene) == graph.GetPhysicalIndex(toneMapped) &&
+			graph.GetPhysicalIndex(scene) != graph.GetPhysicalIndex(blurred) &&
+			graph.GetPhysicalCount() == 2 && graph.GetPhysicalIndex(backBuffer) == -1,
+			"AssignPhysical(): Scene and Tone mapped share one of %d textures (%zu of %zu bytes allocated)",
+			graph.GetPhysicalCount(), graph.GetAllocatedBytes(), graph.GetRequestedBytes());
+
+		graph.Execute([&](int resource) { cleared.push_back(resource); });
+		passed &= Check(ran == order && cleared.size() == 3 && graph.NeedsClear(scene) && graph.NeedsClear(blurred) && graph.NeedsClear(toneMapped),
+			"Execute(): ran %zu passes in order, clearing %zu textures before their first use", ran.size(), cleared.size());
+	}
+
+	// The renderer's opaque pass (see Renderer::BuildRenderGraph())
+	// only writes the ambient, normals and depths while the UI shows
+	// them.  Otherwise they get no texture, and it binds null RTVs.
+	for (bool showAllRenderTargets : { false, true })
+	{
+		::RenderGraph graph;
+		int colors = graph.CreateTexture("Colors", desc);
+		int debugTargets[] = { graph.CreateTexture("Ambient", desc), graph.CreateTexture("Normals", desc), graph.CreateTexture("Depths", desc) };
+		int backBuffer = graph.ImportTexture("Back buffer");
+
+		int opaque = graph.AddPass("Opaque", 0);
+		graph.Write(opaque, colors);
+		if (showAllRenderTargets)
+			for (int target : debugTargets)
+				graph.Write(opaque, target);
+		int upscale = graph.AddPass("Upscale", 0);
+		graph.Read(upscale, colors);
+		graph.Write(upscale, backBuffer);
+		if (showAllRenderTargets)
+		{
+			int debugView = graph.AddPass("Render Target Debug View", 0);
+			graph.Read(debugView, colors);
+			for (int target : debugTargets)
+				graph.Read(debugView, target);
+			graph.SetSideEffect(debugView);
+		}
+		graph.Compile();
+
+		int allocated = 0;
+		for (int target : debugTargets)
+			allocated += graph.GetPhysicalIndex(target) >= 0;
+		int expected = showAllRenderTargets ? 3 : 0;
+		passed &= Check(allocated == expected && graph.GetPhysicalIndex(colors) >= 0,
+			"Debug targets %s shown: %d of 3 allocated (%d expected)", showAllRenderTargets ? "while" : "when not", allocated, expected);
+	}
+
+	return passed;
+}
+
+bool SelfTest::Dependencies()
+{
+	printf("Asset dependencies:\n");
+	bool passed = true;
+
+	// Added backwards, so the order can't just be the order they came
+	// in, and arm (a child of statue) sorts before its parent by name
+	const AssetRef texture = { AssetKind::Texture, ".\\Assets\\Textures\\bronze_albedo" };
+	const AssetRef bundle = { AssetKind::Bundle, "bronze" };
+	const AssetRef material = { AssetKind::Material, "bronze" };
+	const AssetRef entity = { AssetKind::Entity, "statue" };
+	const AssetRef mesh = { AssetKind::Mesh, "sphere" };
+	const AssetRef child = { AssetKind::Entity, "arm" };
+	const AssetRef bystander = { AssetKind::Entity, "floor" };
+
+	::AssetDependencies dependencies;
+	dependencies.AddFile(child, ".\\Definitions\\arm.ge");
+	dependencies.AddDependency(child, entity);
+	dependencies.AddFile(entity, ".\\Definitions\\statue.ge");
+	dependencies.AddDependency(entity, material);
+	dependencies.AddDependency(entity, mesh);
+	dependencies.AddFile(material, ".\\Definitions\\bronze.material");
+	dependencies.AddDependency(material, bundle);
+	dependencies.AddFile(bundle, ".\\Definitions\\bronze.bundle");
+	dependencies.AddDependency(bundle, texture);
+	dependencies.AddFile(texture, ".\\Assets\\Textures\\bronze_albedo.png");
+	dependencies.AddFile(mesh, ".\\Assets\\Models\\sphere.obj");
+	dependencies.AddFile(bystander, ".\\Definitions\\floor.ge");
+	dependencies.AddDependency(bystander, mesh);
+
+	// Paths match however they're written
+	std::vector<AssetRef> built = dependencies.GetAssetsBuiltFrom({ "Assets/Textures/BRONZE_albedo.png" });
+	passed &= Check(built.size() == 1 && built[0] == texture, "GetAssetsBuiltFrom(): the texture, from its path in another case and slashes");
+
+	std::vector<AssetRef> affected = dependencies.GetAffected({ texture });
+	std::vector<AssetRef> chain = { texture, bundle, material, entity, child };
+	passed &= Check(affected == chain, "GetAffected(): %zu assets from the texture (texture, bundle, material, statue, arm expected)", affected.size());
+
+	// Already resolved: no cycles, and nothing missing
+	AssetResolution resolution = dependencies.Resolve();
+	passed &= Check(resolution.Missing.empty() && resolution.Cycles.empty() && resolution.Order.size() == 7,
+		"Resolve(): %zu assets, %zu missing and %zu cycles (7, 0 and 0 expected)", resolution.Order.size(), resolution.Missing.size(), resolution.Cycles.size());
+
+	// Two entities parenting each other, and one with a parent that
+	// doesn't exist
+	const AssetRef a = { AssetKind::Entity, "a" };
+	const AssetRef b = { AssetKind::Entity, "b" };
+	const AssetRef orphan = { AssetKind::Entity, "orphan" };
+	const AssetRef nobody = { AssetKind::Entity, "nobody" };
+	dependencies.AddFile(a, ".\\Definitions\\a.ge");
+	dependencies.AddDependency(a, b);
+	dependencies.AddFile(b, ".\\Definitions\\b.ge");
+	dependencies.AddDependency(b, a);
+	dependencies.AddFile(orphan, ".\\Definitions\\orphan.ge");
+	dependencies.AddDependency(orphan, nobody);
+	resolution = dependencies.Resolve();
+
+	bool cycleFound = resolution.Cycles.size() == 1 && resolution.Cycles[0].size() == 2 &&
+		std::count(resolution.Cycles[0].begin(), resolution.Cycles[0].end(), a) == 1 &&
+		std::count(resolution.Cycles[0].begin(), resolution.Cycles[0].end(), b) == 1;
+	passed &= Check(cycleFound, "Resolve(): %zu cycles, the first of %zu assets (a and b expected)",
+		resolution.Cycles.size(), resolution.Cycles.empty() ? 0 : resolution.Cycles[0].size());
+
+	bool missingFound = resolution.Missing.size() == 1 && resolution.Missing[0].first == orphan && resolution.Missing[0].second == nobody;
+	passed &= Check(missingFound, "Resolve(): %zu missing (orphan's parent, nobody, expected)", resolution.Missing.size());
+
+	// Everything still comes out after what it uses, cycle aside
+	auto position = [&](const AssetRef& asset) { return std::find(resolution.Order.begin(), resolution.Order.end(), asset) - resolution.Order.begin(); };
+	passed &= Check(position(texture) < position(bundle) && position(bundle) < position(material) && position(material) < position(entity) && position(entity) < position(child) &&
+		position(nobody) == (std::ptrdiff_t)resolution.Order.size(),
+		"Resolve(): each asset after what it uses, and nothing missing in the order");
+
+	return passed;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+// --------------------------------------------------------
+// Checks of the CPU side code that don't need a window or a
+// device, run from command line modes (see Main.cpp).  Each
+// check prints what it measured against its tolerance, and
+// each group returns false if any check in it failed.
+// --------------------------------------------------------
+class SelfTest
+{
+public:
+	// IBLPrecompute against environments with known answers: a
+	// constant one, a clamped linear one, roughness 0 passing the
+	// environment straight through, the BRDF table against the
+	// look up table shader's IntegrateBRDF(), the environment's
+	// importance sampling pdf, and the cache.
+	static bool IBL(unsigned int threadCount = 0);
+
+	// How far projecting onto 9 spherical harmonics and lighting
+	// from them is off, for a constant, a linear and a sun and sky
+	// environment, against the exact answers (or a brute force
+	// cosine integral of the same cube map, for the sun).
+	static bool SphericalHarmonics();
+
+	// TextureStreamer's choice of mip for a screen density, and what
+	// Update() plans: uploads as they're asked for, within the
+	// bandwidth and memory budgets, and drops once DropDelay passes.
+	static bool TextureStreaming();
+
+	// DynamicResolution's response to a synthetic step input (see
+	// StepResponsePath; it isn't a recording): the same scales every
+	// time, always on a step within the limits, lowered under
+	// sustained load, back to full once there's time to spare, and
+	// without flicking back and forth.  Also that scales past 1 are
+	// clamped.  A recorded trace (see DynamicResolution::TracePath),
+	// if given, goes through the same checks, with load and spare
+	// time only judged where the recording has any.
+	static constexpr const char* StepResponsePath = ".\\Traces\\StepResponse.txt";
+	static bool DynamicScaling(const char* recordedTracePath = 0);
+
+	// RenderGraph compiling a small graph with a dead pass, a read
+	// after write chain and two transients that are never alive at
+	// once: culling, execution order, lifetimes, clears and aliasing.
+	// Also that the debug scene targets only get memory while the
+	// All Render Targets view is open.
+	static bool RenderGraph();
+
+	// AssetDependencies tracing a changed texture through the bundle,
+	// material and entity that use it (in the order to rebuild them),
+	// and Resolve() reporting a two asset cycle and a missing asset.
+	static bool Dependencies();
+
+private:
+	// Prints the result, and passes it on
+	static bool Check(bool passed, const char* format, ...);
+
+	// The checks DynamicScaling() makes of one trace's scales
+	static bool CheckScaling(const std::vector<float>& frameTimes, bool needsLoadAndSpare);
+};
@@ -1,4 +1,5 @@
 #include "SimpleShader.h"
+#include "PipelineStateCache.h"
 
 // Default error reporting state
 bool ISimpleShader::ReportErrors = false;
@@ -138,6 +139,8 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		switch (resourceDesc.Type)
 		{
 		case D3D_SIT_TEXTURE: // A texture resource
+		case D3D_SIT_STRUCTURED: // Read-only buffers are set the same way
+		case D3D_SIT_BYTEADDRESS:
 		{
 			// Create the SRV wrapper
 			SimpleSRV* srv = new SimpleSRV();
@@ -274,6 +277,15 @@ SimpleConstantBuffer* ISimpleShader::FindConstantBuffer(std::string name)
 	return result->second;
 }
 
+// --------------------------------------------------------
+// Gets the buffer that should be bound for the given
+// constant buffer - the external override if one was set
+// --------------------------------------------------------
+ID3D11Buffer* ISimpleShader::GetBoundBuffer(const SimpleConstantBuffer& cb)
+{
+	return cb.ExternalBuffer ? cb.ExternalBuffer.Get() : cb.ConstantBuffer.Get();
+}
+
 // --------------------------------------------------------
 // Prints the specified message to the console with the 
 // given color and Visual Studio's output window
@@ -344,6 +356,9 @@ void ISimpleShader::CopyAllBufferData()
 	// Loop through the constant buffers and copy all data
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
+		// Externally owned buffers are filled by their owner
+		if (constantBuffers[i].ExternalBuffer) continue;
+
 		// Copy the entire local data buffer
 		deviceContext->UpdateSubresource(
 			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
@@ -373,7 +388,7 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
-	if (!cb) return;
+	if (!cb || cb->ExternalBuffer) return;
 
 	// Copy the data and get out
 	deviceContext->UpdateSubresource(
@@ -395,7 +410,7 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
-	if (!cb) return;
+	if (!cb || cb->ExternalBuffer) return;
 
 	// Copy the data and get out
 	deviceContext->UpdateSubresource(
@@ -404,6 +419,27 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 }
 
 
+// --------------------------------------------------------
+// Replaces the named constant buffer with one owned elsewhere,
+// so data shared between shaders (like per-frame data) can
+// live in a single buffer.  Pass null to go back to the
+// shader's own buffer.
+//
+// name - The name of the constant buffer in the shader
+// buffer - The buffer to bind in its place
+//
+// Returns true if the constant buffer was found, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::SetExternalConstantBuffer(std::string name, Microsoft::WRL::ComPtr<ID3D11Buffer> buffer)
+{
+	SimpleConstantBuffer* cb = FindConstantBuffer(name);
+	if (!cb)
+		return false;
+
+	cb->ExternalBuffer = buffer;
+	return true;
+}
+
 // --------------------------------------------------------
 // Sets a variable by name with arbitrary data of the specified size
 //
@@ -864,6 +900,20 @@ void SimpleVertexShader::SetShaderAndCBs()
 	// Is shader valid?
 	if (!shaderValid) return;
 
+	// Go through the state cache if there is one, so
+	// anything that is already bound gets skipped
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+	if (cache.IsInitialized())
+	{
+		cache.SetInputLayout(inputLayout.Get());
+		cache.SetVertexShader(shader.Get());
+
+		for (unsigned int i = 0; i < constantBufferCount; i++)
+			cache.SetConstantBuffer(PIPELINE_STAGE_VERTEX, constantBuffers[i].BindIndex, GetBoundBuffer(constantBuffers[i]));
+
+		return;
+	}
+
 	// Set the shader and input layout
 	deviceContext->IASetInputLayout(inputLayout.Get());
 	deviceContext->VSSetShader(shader.Get(), 0, 0);
@@ -871,10 +921,11 @@ void SimpleVertexShader::SetShaderAndCBs()
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
+		ID3D11Buffer* buffer = GetBoundBuffer(constantBuffers[i]);
 		deviceContext->VSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			&buffer);
 	}
 }
 
@@ -902,7 +953,11 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+	if (cache.IsInitialized())
+		cache.SetShaderResource(PIPELINE_STAGE_VERTEX, srvInfo->BindIndex, srv.Get());
+	else
+		deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -932,7 +987,11 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+	if (cache.IsInitialized())
+		cache.SetSampler(PIPELINE_STAGE_VERTEX, sampInfo->BindIndex, samplerState.Get());
+	else
+		deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1002,16 +1061,30 @@ void SimplePixelShader::SetShaderAndCBs()
 	// Is shader valid?
 	if (!shaderValid) return;
 	
+	// Go through the state cache if there is one, so
+	// anything that is already bound gets skipped
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+	if (cache.IsInitialized())
+	{
+		cache.SetPixelShader(shader.Get());
+
+		for (unsigned int i = 0; i < constantBufferCount; i++)
+			cache.SetConstantBuffer(PIPELINE_STAGE_PIXEL, constantBuffers[i].BindIndex, GetBoundBuffer(constantBuffers[i]));
+
+		return;
+	}
+
 	// Set the shader
 	deviceContext->PSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
+		ID3D11Buffer* buffer = GetBoundBuffer(constantBuffers[i]);
 		deviceContext->PSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			&buffer);
 	}
 }
 
@@ -1039,7 +1112,11 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+	if (cache.IsInitialized())
+		cache.SetShaderResource(PIPELINE_STAGE_PIXEL, srvInfo->BindIndex, srv.Get());
+	else
+		deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1069,7 +1146,11 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	PipelineStateCache& cache = PipelineStateCache::GetInstance();
+	if (cache.IsInitialized())
+		cache.SetSampler(PIPELINE_STAGE_PIXEL, sampInfo->BindIndex, samplerState.Get());
+	else
+		deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
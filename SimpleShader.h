@@ -34,6 +34,7 @@ struct SimpleConstantBuffer
 	unsigned int Size;
 	unsigned int BindIndex;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> ExternalBuffer = 0; // Bound instead of ConstantBuffer when set
 	unsigned char* LocalDataBuffer = 0;
 	std::vector<SimpleShaderVariable> Variables;
 };
@@ -88,6 +89,10 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	// Binds a buffer owned by someone else in place of the named
+	// constant buffer (which is then never copied or bound)
+	bool SetExternalConstantBuffer(std::string name, Microsoft::WRL::ComPtr<ID3D11Buffer> buffer);
+
 	// Setting shader resources
 	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
 	virtual bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
@@ -153,6 +158,9 @@ protected:
 	SimpleShaderVariable* FindVariable(std::string name, int size);
 	SimpleConstantBuffer* FindConstantBuffer(std::string name);
 
+	// The buffer that should actually be bound for a constant buffer
+	ID3D11Buffer* GetBoundBuffer(const SimpleConstantBuffer& cb);
+
 	// Error logging
 	void Log(std::string message, WORD color);
 	void LogW(std::wstring message, WORD color);
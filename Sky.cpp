@@ -1,13 +1,16 @@
 #include "Sky.h"
-#include "WICTextureLoader.h"
 #include "DDSTextureLoader.h"
 #include "AssetManager.h"
+#include "ImageLoader.h"
+#include "Profiler.h"
+
+#include <chrono>
 
 using namespace DirectX;
 
 Sky::Sky(
 	const wchar_t* cubemapDDSFile, 
-	Mesh* mesh, 
+	AssetHandle<Mesh>* mesh, 
 	SimpleVertexShader* skyVS, 
 	SimplePixelShader* skyPS, 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions, 
@@ -16,11 +19,13 @@ Sky::Sky(
 {
 	// Save params
 	this->skyMesh = mesh;
+	mesh->AddReference();
 	this->device = device;
 	this->context = context;
 	this->samplerOptions = samplerOptions;
 	this->skyVS = skyVS;
 	this->skyPS = skyPS;
+	memset(irradianceSH, 0, sizeof(irradianceSH)); // No diffuse IBL unless the CPU path runs
 
 	// Init render states
 	InitRenderStates();
@@ -28,9 +33,36 @@ Sky::Sky(
 	// Load texture
 	CreateDDSTextureFromFile(device.Get(), cubemapDDSFile, 0, skySRV.GetAddressOf());
 
-	IBLCreateIrradianceMap();
-	IBLCreateConvolvedSpecularMap();
-	IBLCreateBRDFLookUpTexture();
+	InitIBLFromCubemap();
+}
+
+Sky::Sky(
+	const uint8_t* cubemapDDSData,
+	size_t cubemapDDSSize,
+	AssetHandle<Mesh>* mesh,
+	SimpleVertexShader* skyVS,
+	SimplePixelShader* skyPS,
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	// Save params
+	this->skyMesh = mesh;
+	mesh->AddReference();
+	this->device = device;
+	this->context = context;
+	this->samplerOptions = samplerOptions;
+	this->skyVS = skyVS;
+	this->skyPS = skyPS;
+	memset(irradianceSH, 0, sizeof(irradianceSH)); // No diffuse IBL unless the CPU path runs
+
+	// Init render states
+	InitRenderStates();
+
+	// Load texture
+	CreateDDSTextureFromMemory(device.Get(), cubemapDDSData, cubemapDDSSize, 0, skySRV.GetAddressOf());
+
+	InitIBLFromCubemap();
 }
 
 Sky::Sky(
@@ -40,7 +72,21 @@ Sky::Sky(
 	const wchar_t* down, 
 	const wchar_t* front, 
 	const wchar_t* back, 
-	Mesh* mesh,
+	AssetHandle<Mesh>* mesh,
+	SimpleVertexShader* skyVS,
+	SimplePixelShader* skyPS,
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	DirectX::XMFLOAT3 missingFaceColor)
+	: Sky(DecodeFaces(std::vector<std::wstring>{ right, left, up, down, front, back }.data(), missingFaceColor),
+		mesh, skyVS, skyPS, samplerOptions, device, context)
+{
+}
+
+Sky::Sky(
+	const IBLCubeImage& faces,
+	AssetHandle<Mesh>* mesh,
 	SimpleVertexShader* skyVS,
 	SimplePixelShader* skyPS,
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
@@ -49,6 +95,7 @@ Sky::Sky(
 {
 	// Save params
 	this->skyMesh = mesh;
+	mesh->AddReference();
 	this->device = device;
 	this->context = context;
 	this->samplerOptions = samplerOptions;
@@ -58,16 +105,15 @@ Sky::Sky(
 	// Init render states
 	InitRenderStates();
 
-	// Create texture from 6 images
-	skySRV = CreateCubemap(right, left, up, down, front, back);
-
-	IBLCreateIrradianceMap();
-	IBLCreateConvolvedSpecularMap();
-	IBLCreateBRDFLookUpTexture();
+	// Create texture from the 6 faces, which we already
+	// have on the CPU, so there's nothing to read back
+	skySRV = CreateCubemap(faces);
+	IBLPrecomputeOnCPU(faces);
 }
 
 Sky::~Sky()
 {
+	skyMesh->RemoveReference();
 }
 
 void Sky::Draw(Camera* camera)
@@ -90,13 +136,22 @@ void Sky::Draw(Camera* camera)
 	skyPS->SetSamplerState("samplerOptions", samplerOptions);
 
 	// Set mesh buffers and draw
-	skyMesh->SetBuffersAndDraw(context);
+	skyMesh->Get()->SetBuffersAndDraw(context);
 
 	// Reset my rasterizer state to the default
 	context->RSSetState(0); // Null (or 0) puts back the defaults
 	context->OMSetDepthStencilState(0, 0);
 }
 
+void Sky::InitIBLFromCubemap()
+{
+	if (!IBLPrecomputeOnCPU())
+	{
+		IBLCreateConvolvedSpecularMap();
+		IBLCreateBRDFLookUpTexture();
+	}
+}
+
 void Sky::InitRenderStates()
 {
 	// Rasterizer to reverse the cull mode
@@ -114,24 +169,67 @@ void Sky::InitRenderStates()
 	device->CreateDepthStencilState(&depthDesc, skyDepthState.GetAddressOf());
 }
 
-Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_t* right, const wchar_t* left, const wchar_t* up, const wchar_t* down, const wchar_t* front, const wchar_t* back)
+IBLCubeImage Sky::DecodeFaces(const std::wstring files[6], XMFLOAT3 missingFaceColor)
 {
-	// Load the 6 textures into an array.
-	// - We need references to the TEXTURES, not the SHADER RESOURCE VIEWS!
-	// - Specifically NOT generating mipmaps, as we don't need them for the sky!
-	// - Order matters here!  +X, -X, +Y, -Y, +Z, -Z
-	ID3D11Texture2D* textures[6] = {};
-	CreateWICTextureFromFile(device.Get(), right, (ID3D11Resource**)&textures[0], 0);
-	CreateWICTextureFromFile(device.Get(), left, (ID3D11Resource**)&textures[1], 0);
-	CreateWICTextureFromFile(device.Get(), up, (ID3D11Resource**)&textures[2], 0);
-	CreateWICTextureFromFile(device.Get(), down, (ID3D11Resource**)&textures[3], 0);
-	CreateWICTextureFromFile(device.Get(), front, (ID3D11Resource**)&textures[4], 0);
-	CreateWICTextureFromFile(device.Get(), back, (ID3D11Resource**)&textures[5], 0);
-
-	// We'll assume all of the textures are the same color format and resolution,
-	// so get the description of the first shader resource view
-	D3D11_TEXTURE2D_DESC faceDesc = {};
-	textures[0]->GetDesc(&faceDesc);
+	// Order matters here!  +X, -X, +Y, -Y, +Z, -Z
+	ImageData images[6] = {};
+	for (int i = 0; i < 6; i++)
+		if (!ImageLoader::Decode(files[i], images[i]))
+			images[i] = {};
+
+	return MakeFaces(images, missingFaceColor);
+}
+
+IBLCubeImage Sky::MakeFaces(const ImageData images[6], XMFLOAT3 missingFaceColor)
+{
+	bool loaded[6] = {};
+	for (int i = 0; i < 6; i++)
+		loaded[i] = !images[i].Pixels.empty();
+
+	// We'll assume all of the faces are the same (square) size,
+	// so take it from the first one that actually loaded
+	IBLCubeImage faces = {};
+	faces.Size = 1;
+	for (int i = 0; i < 6; i++)
+	{
+		if (loaded[i])
+		{
+			faces.Size = images[i].Width;
+			break;
+		}
+	}
+
+	unsigned int r = (unsigned int)(missingFaceColor.x * 255.0f + 0.5f);
+	unsigned int g = (unsigned int)(missingFaceColor.y * 255.0f + 0.5f);
+	unsigned int b = (unsigned int)(missingFaceColor.z * 255.0f + 0.5f);
+	uint32_t fill = r | (g << 8) | (b << 16) | 0xFF000000;
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (loaded[i] && images[i].Width == faces.Size && images[i].Height == faces.Size)
+		{
+			faces.Faces[i].resize(faces.Size * faces.Size);
+			memcpy(faces.Faces[i].data(), images[i].Pixels.data(), images[i].Pixels.size());
+			continue;
+		}
+
+		// Missing (or mismatched) faces become a solid color of the same size
+		printf("Sky face %d couldn't be loaded, filling it with a solid color\n", i);
+		faces.Faces[i].assign(faces.Size * faces.Size, fill);
+	}
+
+	return faces;
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const IBLCubeImage& faces)
+{
+	// One subresource per face, in +X, -X, +Y, -Y, +Z, -Z order
+	D3D11_SUBRESOURCE_DATA data[6] = {};
+	for (int i = 0; i < 6; i++)
+	{
+		data[i].pSysMem = faces.Faces[i].data();
+		data[i].SysMemPitch = faces.Size * sizeof(uint32_t);
+	}
 
 	// Describe the resource for the cube map, which is simply 
 	// a "texture 2d array".  This is a special GPU resource format, 
@@ -140,184 +238,223 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_
 	cubeDesc.ArraySize = 6; // Cube map!
 	cubeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE; // We'll be using as a texture in a shader
 	cubeDesc.CPUAccessFlags = 0; // No read back
-	cubeDesc.Format = faceDesc.Format; // Match the loaded texture's color format
-	cubeDesc.Width = faceDesc.Width;  // Match the size
-	cubeDesc.Height = faceDesc.Height; // Match the size
+	cubeDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // What the faces were decoded to
+	cubeDesc.Width = faces.Size;
+	cubeDesc.Height = faces.Size;
 	cubeDesc.MipLevels = 1; // Only need 1
 	cubeDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE; // This should be treated as a CUBE, not 6 separate textures
-	cubeDesc.Usage = D3D11_USAGE_DEFAULT; // Standard usage
+	cubeDesc.Usage = D3D11_USAGE_IMMUTABLE; // Filled in once, right here
 	cubeDesc.SampleDesc.Count = 1;
 	cubeDesc.SampleDesc.Quality = 0;
 
 	// Create the actual texture resource
-	ID3D11Texture2D* cubeMapTexture = 0;
-	device->CreateTexture2D(&cubeDesc, 0, &cubeMapTexture);
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> cubeMapTexture;
+	device->CreateTexture2D(&cubeDesc, data, cubeMapTexture.GetAddressOf());
 
-	// Loop through the individual face textures and copy them,
-	// one at a time, to the cube map texure
-	for (int i = 0; i < 6; i++)
-	{
-		// Calculate the subresource position to copy into
-		unsigned int subresource = D3D11CalcSubresource(
-			0,	// Which mip (zero, since there's only one)
-			i,	// Which array element?
-			1); // How many mip levels are in the texture?
-
-		// Copy from one resource (texture) to another
-		context->CopySubresourceRegion(
-			cubeMapTexture, // Destination resource
-			subresource,	// Dest subresource index (one of the array elements)
-			0, 0, 0,		// XYZ location of copy
-			textures[i],	// Source resource
-			0,				// Source subresource index (we're assuming there's only one)
-			0);				// Source subresource "box" of data to copy (zero means the whole thing)
-	}
-
-	// At this point, all of the faces have been copied into the 
-	// cube map texture, so we can describe a shader resource view for it
+	// Describe a shader resource view for it
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = cubeDesc.Format; // Same format as texture
 	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE; // Treat this as a cube!
 	srvDesc.TextureCube.MipLevels = 1;	// Only need access to 1 mip
 	srvDesc.TextureCube.MostDetailedMip = 0; // Index of the first mip we want to see
 
-	// Make the SRV
+	// Make the SRV, which is what we need for our shaders
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeSRV;
-	device->CreateShaderResourceView(cubeMapTexture, &srvDesc, cubeSRV.GetAddressOf());
-
-	// Now that we're done, clean up the stuff we don't need anymore
-	cubeMapTexture->Release();  // Done with this particular reference (the SRV has another)
-	for (int i = 0; i < 6; i++)
-		textures[i]->Release();
-
-	// Send back the SRV, which is what we need for our shaders
+	device->CreateShaderResourceView(cubeMapTexture.Get(), &srvDesc, cubeSRV.GetAddressOf());
 	return cubeSRV;
 }
 
-void Sky::IBLCreateIrradianceMap()
+// ----------------------------------------------------------------------------
+// Builds the irradiance SH, specular and BRDF maps on the CPU, or loads them if
+// this exact environment (and set of IBL settings) was seen before.  Results
+// are cached by a hash of the face images, so editing a sky invalidates it.
+// ----------------------------------------------------------------------------
+bool Sky::IBLPrecomputeOnCPU()
 {
-	printf("Creating irradiance map for indirect diffuse lighting...");
+	IBLCubeImage environment = {};
+	if (!ReadBackCubemap(environment))
+		return false;
 
-	// == The DX resources we'll need ===============================
-
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> irrMapFinalTexture;	// Final texture once we have the full irradiance
-
-
-	// == Set up DX resources =======================================
-
-	// Create the final irradiance cube texture
-	D3D11_TEXTURE2D_DESC texDesc = {};
-	texDesc.Width = IBLCubeSize;
-	texDesc.Height = IBLCubeSize;
-	texDesc.ArraySize = 6; // Cube map means 6 textures
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;  // Basic texture format
-	texDesc.MipLevels = 1; // No mip chain needed
-	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE; // It's a cube map
-	texDesc.SampleDesc.Count = 1; // Can't be zero
-	device->CreateTexture2D(&texDesc, 0, irrMapFinalTexture.GetAddressOf());
+	IBLPrecomputeOnCPU(environment);
+	return true;
+}
 
-	// Create an SRV for the irradiance texture
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;	// Treat this resource as a cube map
-	srvDesc.TextureCube.MipLevels = 1;			// Only 1 mip level
-	srvDesc.TextureCube.MostDetailedMip = 0;	// Accessing the first (and only) mip
-	srvDesc.Format = texDesc.Format;			// Same format as texture
-	device->CreateShaderResourceView(irrMapFinalTexture.Get(), &srvDesc, irradianceIBL.GetAddressOf());
+void Sky::IBLPrecomputeOnCPU(const IBLCubeImage& environment)
+{
+	// Same mip count as the GPU version, though tiny environments
+	// (like a solid color placeholder) don't need a full size map
+	int specularSize = min(IBLCubeSize, (int)environment.Size);
+	totalSpecIBLMipLevels = max((int)(log2(specularSize)) + 1 - specIBLMipLevelsToSkip, 1);
+
+	IBLSettings settings = IBLPrecompute::GetDefaultSettings();
+	settings.SpecularSize = specularSize;
+	settings.SpecularMipLevels = totalSpecIBLMipLevels;
+	settings.BrdfLookUpSize = IBLLookUpTextureSize;
+
+	DerivedDataCache& cache = AssetManager::GetInstance().GetDerivedDataCache();
+	uint64_t key = IBLPrecompute::HashInputs(environment, settings);
+
+	IBLResults results = {};
+	std::vector<uint8_t> cached;
+	bool loaded;
+	{
+		ProfileScope profile("IBL cache load");
+		loaded = cache.Load("ibl", key, cached) && IBLPrecompute::Deserialize(cached, results);
+	}
+	if (loaded)
+	{
+		printf("Loaded IBL maps from cache\n");
+	}
+	else
+	{
+		printf("Precomputing IBL maps on the CPU...");
+		auto start = std::chrono::steady_clock::now();
+		results = IBLPrecompute::Compute(environment, settings);
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (cache.Store("ibl", key, IBLPrecompute::Serialize(results), milliseconds))
+			printf("done!\n");
+		else
+			printf("done! (couldn't write the cache)\n");
+	}
 
+	CreateIBLTextures(results);
+}
 
+// Copies the top mip of the environment cube map back to the CPU
+bool Sky::ReadBackCubemap(IBLCubeImage& image)
+{
+	ProfileScope profile("IBL read back");
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> cubeTexture;
+	skySRV->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&cubeTexture)))
+		return false;
 
-	// == Save previous DX states ===================================
+	D3D11_TEXTURE2D_DESC cubeDesc = {};
+	cubeTexture->GetDesc(&cubeDesc);
+	if (cubeDesc.ArraySize != 6 || cubeDesc.Width != cubeDesc.Height)
+		return false;
 
-	// Save current render target and depth buffer
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> prevRTV;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> prevDSV;
-	context->OMGetRenderTargets(1, prevRTV.GetAddressOf(), prevDSV.GetAddressOf());
+	// Only plain 8-bit color is handled on the CPU
+	bool swapRedBlue = false;
+	switch (cubeDesc.Format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		swapRedBlue = true;
+		break;
+	default:
+		return false;
+	}
 
-	// Save current viewport
-	unsigned int vpCount = 1;
-	D3D11_VIEWPORT prevVP = {};
-	context->RSGetViewports(&vpCount, &prevVP);
+	// One face at a time through a CPU readable texture
+	D3D11_TEXTURE2D_DESC stagingDesc = cubeDesc;
+	stagingDesc.ArraySize = 1;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.MiscFlags = 0;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(device->CreateTexture2D(&stagingDesc, 0, staging.GetAddressOf())))
+		return false;
 
+	image.Size = cubeDesc.Width;
+	for (int face = 0; face < 6; face++)
+	{
+		unsigned int subresource = D3D11CalcSubresource(0, face, cubeDesc.MipLevels);
+		context->CopySubresourceRegion(staging.Get(), 0, 0, 0, 0, cubeTexture.Get(), subresource, 0);
 
-	// == Set current DX states for rendering =======================
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (FAILED(context->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped)))
+			return false;
 
-	// Make sure the viewport matches the texture size
-	D3D11_VIEWPORT vp = {};
-	vp.Width = (float)IBLCubeSize;
-	vp.Height = (float)IBLCubeSize;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	context->RSSetViewports(1, &vp);
+		std::vector<uint32_t>& texels = image.Faces[face];
+		texels.resize(image.Size * image.Size);
+		for (unsigned int y = 0; y < image.Size; y++)
+			memcpy(&texels[y * image.Size], (char*)mapped.pData + y * mapped.RowPitch, image.Size * sizeof(uint32_t));
 
-	// Set states that may or may not be set yet
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context->Unmap(staging.Get(), 0);
 
+		if (swapRedBlue)
+		{
+			for (uint32_t& c : texels)
+				c = (c & 0xFF00FF00) | ((c >> 16) & 0xFF) | ((c & 0xFF) << 16);
+		}
+	}
 
+	return true;
+}
 
-	// == Set up shaders ============================================
-	AssetManager& assets = AssetManager::GetInstance();
-	SimpleVertexShader* fullscreenVS = assets.GetVertexShader("FullscreenVS");
-	SimplePixelShader* irradiancePS = assets.GetPixelShader("IBLIrradianceMapPS");
+// Makes the final (immutable) IBL textures from precomputed data
+void Sky::CreateIBLTextures(const IBLResults& results)
+{
+	ProfileScope profile("IBL textures");
+	// Diffuse irradiance is just a handful of constants
+	IBLPrecompute::PackIrradianceSH(results.IrradianceSH, irradianceSH);
 
-	fullscreenVS->SetShader();
-	irradiancePS->SetShader();
-	irradiancePS->SetShaderResourceView("EnvironmentMap", skySRV.Get());
-	irradiancePS->SetSamplerState("BasicSampler", samplerOptions.Get());
+	// Specular cube, one mip per roughness
+	{
+		totalSpecIBLMipLevels = (int)results.Specular.size();
 
+		std::vector<D3D11_SUBRESOURCE_DATA> data(6 * totalSpecIBLMipLevels);
+		for (int face = 0; face < 6; face++)
+		{
+			for (int mip = 0; mip < totalSpecIBLMipLevels; mip++)
+			{
+				unsigned int size = max(results.SpecularSize >> mip, 1u);
+				D3D11_SUBRESOURCE_DATA& d = data[D3D11CalcSubresource(mip, face, totalSpecIBLMipLevels)];
+				d.pSysMem = &results.Specular[mip][face * size * size];
+				d.SysMemPitch = size * sizeof(uint32_t);
+			}
+		}
 
-	// == Render irradiance =======================================
+		D3D11_TEXTURE2D_DESC texDesc = {};
+		texDesc.Width = results.SpecularSize;
+		texDesc.Height = results.SpecularSize;
+		texDesc.ArraySize = 6;
+		texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		texDesc.MipLevels = totalSpecIBLMipLevels;
+		texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		device->CreateTexture2D(&texDesc, data.data(), texture.GetAddressOf());
+		device->CreateShaderResourceView(texture.Get(), 0, specularIBL.ReleaseAndGetAddressOf());
+	}
 
-	// Loop through the six cubemap faces and calculate 
-	// the irradiance for each, resulting in a full 360 degree
-	// irradiance map, once completed
-	for (int face = 0; face < 6; face++)
+	// BRDF look up table
 	{
-		// Make a render target view for this face
-		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-		rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;	// This points to a Texture2D Array
-		rtvDesc.Texture2DArray.ArraySize = 1;			// How much of the array do we need access to?
-		rtvDesc.Texture2DArray.FirstArraySlice = face;	// Which texture are we rendering into?
-		rtvDesc.Texture2DArray.MipSlice = 0;			// Which mip of that texture are we rendering into?
-		rtvDesc.Format = texDesc.Format;				// Same format as texture
-
-		// Create the render target view itself
-		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtv;
-		device->CreateRenderTargetView(irrMapFinalTexture.Get(), &rtvDesc, rtv.GetAddressOf());
-
-		// Clear and set this render target
-		float black[4] = {}; // Initialize to all zeroes
-		context->ClearRenderTargetView(rtv.Get(), black);
-		context->OMSetRenderTargets(1, rtv.GetAddressOf(), 0);
-
-		// Per-face shader data and copy
-		irradiancePS->SetInt("faceIndex", face);
-		irradiancePS->SetFloat("sampleStepPhi", 0.025f);
-		irradiancePS->SetFloat("sampleStepTheta", 0.025f);
-		irradiancePS->CopyAllBufferData();
-
-		// Render exactly 3 vertices
-		context->Draw(3, 0);
-
-		// Ensure we flush the graphics pipe to so that we don't cause 
-		// a hardware timeout which can result in a driver crash
-		// NOTE: This might make C++ sit and wait for a sec!  Better than a crash!
-		context->Flush();
+		D3D11_SUBRESOURCE_DATA data = {};
+		data.pSysMem = results.BrdfLookUp.data();
+		data.SysMemPitch = results.BrdfLookUpSize * sizeof(uint32_t);
+
+		D3D11_TEXTURE2D_DESC texDesc = {};
+		texDesc.Width = results.BrdfLookUpSize;
+		texDesc.Height = results.BrdfLookUpSize;
+		texDesc.ArraySize = 1;
+		texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		texDesc.Format = DXGI_FORMAT_R16G16_UNORM;
+		texDesc.MipLevels = 1;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		device->CreateTexture2D(&texDesc, &data, texture.GetAddressOf());
+		device->CreateShaderResourceView(texture.Get(), 0, brdfLookUpMap.ReleaseAndGetAddressOf());
 	}
-
-
-	// == Restore old states & release refs =========================
-
-	// Restore the old render target and viewport
-	context->OMSetRenderTargets(1, prevRTV.GetAddressOf(), prevDSV.Get());
-	context->RSSetViewports(1, &prevVP);
-
-	printf("done!\n");
 }
 
 void Sky::IBLCreateConvolvedSpecularMap()
 {
+	ProfileScope profile("IBL specular (GPU)");
 	printf("Creating convolved environment map for indirect specular lighting...");
 
 	// Calculate how many mip levels we'll need, potentially skipping
@@ -377,8 +514,8 @@ void Sky::IBLCreateConvolvedSpecularMap()
 
 	// == Set up shaders ============================================
 	AssetManager& assets = AssetManager::GetInstance();
-	SimpleVertexShader* fullscreenVS = assets.GetVertexShader("FullscreenVS");
-	SimplePixelShader* specConvPS = assets.GetPixelShader("IBLSpecularConvolutionPS");
+	SimpleVertexShader* fullscreenVS = assets.GetVertexShader("FullscreenVS"_id);
+	SimplePixelShader* specConvPS = assets.GetPixelShader("IBLSpecularConvolutionPS"_id);
 
 	fullscreenVS->SetShader();
 	specConvPS->SetShader();
@@ -462,6 +599,7 @@ void Sky::IBLCreateConvolvedSpecularMap()
 // ----------------------------------------------------------------------------
 void Sky::IBLCreateBRDFLookUpTexture()
 {
+	ProfileScope profile("IBL BRDF (GPU)");
 	printf("Creating pre-calculated environment BRDF lookup texture...");
 
 	// == The DX resources we'll need ===============================
@@ -522,8 +660,8 @@ void Sky::IBLCreateBRDFLookUpTexture()
 
 	// == Set up shaders ============================================
 	AssetManager& assets = AssetManager::GetInstance();
-	SimpleVertexShader* fullscreenVS = assets.GetVertexShader("FullscreenVS");
-	SimplePixelShader* envBrdfPS = assets.GetPixelShader("IBLBrdfLookUpTablePS");
+	SimpleVertexShader* fullscreenVS = assets.GetVertexShader("FullscreenVS"_id);
+	SimplePixelShader* envBrdfPS = assets.GetPixelShader("IBLBrdfLookUpTablePS"_id);
 
 	fullscreenVS->SetShader();
 	envBrdfPS->SetShader();
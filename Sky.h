@@ -1,10 +1,14 @@
 #pragma once
 
 #include "Mesh.h"
+#include "AssetHandle.h"
 #include "SimpleShader.h"
 #include "Camera.h"
+#include "IBLPrecompute.h"
+#include "PngDecoder.h"
 
 #include <wrl/client.h> // Used for ComPtr
+#include <string>
 
 class Sky
 {
@@ -13,7 +17,7 @@ public:
 	// Constructor that loads a DDS cube map file
 	Sky(
 		const wchar_t* cubemapDDSFile,
-		Mesh* mesh,
+		AssetHandle<Mesh>* mesh,
 		SimpleVertexShader* skyVS,
 		SimplePixelShader* skyPS,
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
@@ -21,7 +25,20 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context
 	);
 
-	// Constructor that loads 6 textures and makes a cube map
+	// Constructor that takes a DDS cube map that's already in memory
+	Sky(
+		const uint8_t* cubemapDDSData,
+		size_t cubemapDDSSize,
+		AssetHandle<Mesh>* mesh,
+		SimpleVertexShader* skyVS,
+		SimplePixelShader* skyPS,
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context
+	);
+
+	// Constructor that loads 6 textures and makes a cube map.
+	// Faces that fail to load are filled with missingFaceColor.
 	Sky(
 		const wchar_t* right,
 		const wchar_t* left,
@@ -29,7 +46,20 @@ public:
 		const wchar_t* down,
 		const wchar_t* front,
 		const wchar_t* back,
-		Mesh* mesh,
+		AssetHandle<Mesh>* mesh,
+		SimpleVertexShader* skyVS,
+		SimplePixelShader* skyPS,
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		DirectX::XMFLOAT3 missingFaceColor = DirectX::XMFLOAT3(0, 0, 0)
+	);
+
+	// Constructor that takes 6 already decoded faces.  This one only
+	// uses the device, so it's safe to call off the main thread.
+	Sky(
+		const IBLCubeImage& faces,
+		AssetHandle<Mesh>* mesh,
 		SimpleVertexShader* skyVS,
 		SimplePixelShader* skyPS,
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
@@ -39,10 +69,18 @@ public:
 
 	~Sky();
 
+	// Reads and decodes 6 face images (on any thread).  Faces that
+	// fail to load are filled with missingFaceColor.
+	static IBLCubeImage DecodeFaces(const std::wstring files[6], DirectX::XMFLOAT3 missingFaceColor);
+
+	// The same for faces that are already decoded.  Images with no
+	// pixels count as missing.
+	static IBLCubeImage MakeFaces(const ImageData images[6], DirectX::XMFLOAT3 missingFaceColor);
+
 	void Draw(Camera* camera);
 
 	int GetTotalSpecIBLMipLevels() { return totalSpecIBLMipLevels; }
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetIrradianceIBL() { return irradianceIBL; }		// Incoming diffuse light
+	const float* GetIrradianceSH() { return &irradianceSH[0][0]; }		// Incoming diffuse light (7 float4s)
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSpecularIBL() { return specularIBL; }		// Incoming specular light
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetBrdfLookUpMap() {return brdfLookUpMap; }		// Holds some pre-calculated BRDF results
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetEnvironmentSRV() { return skySRV; }
@@ -51,16 +89,20 @@ private:
 
 	void InitRenderStates();
 
-	// Helper for creating a cubemap from 6 individual textures
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
-		const wchar_t* right,
-		const wchar_t* left,
-		const wchar_t* up,
-		const wchar_t* down,
-		const wchar_t* front,
-		const wchar_t* back);
+	// IBL for a cube map that came from a DDS file
+	void InitIBLFromCubemap();
+
+	// Helper for creating a cubemap from 6 decoded faces
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(const IBLCubeImage& faces);
 
-	void IBLCreateIrradianceMap();
+	// Precomputes (or loads from the cache) all IBL data on the CPU.
+	// Returns false if the cube map can't be read back, in which
+	// case the GPU versions below are used instead (with no
+	// diffuse IBL).
+	bool IBLPrecomputeOnCPU();
+	void IBLPrecomputeOnCPU(const IBLCubeImage& environment);
+	bool ReadBackCubemap(IBLCubeImage& image);
+	void CreateIBLTextures(const IBLResults& results);
 
 	void IBLCreateConvolvedSpecularMap();
 
@@ -72,7 +114,7 @@ private:
 	SimpleVertexShader* skyVS;
 	SimplePixelShader* skyPS;
 	
-	Mesh* skyMesh;
+	AssetHandle<Mesh>* skyMesh;	// Referenced, so the budget leaves it be
 
 
 	const int IBLCubeSize = 256;
@@ -80,7 +122,7 @@ private:
 	const int specIBLMipLevelsToSkip = 3; // Number of lower mips (1x1, 2x2, etc.) to exclude from the maps
 	int totalSpecIBLMipLevels;
 
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> irradianceIBL;		// Incoming diffuse light
+	float irradianceSH[7][4];											// Incoming diffuse light, see IndirectDiffuseSH() in Lighting.hlsli
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> specularIBL;		// Incoming specular light
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> brdfLookUpMap;		// Holds some pre-calculated BRDF results
 
@@ -6,6 +6,7 @@ TextureBundle::TextureBundle()
 	normal = Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>();
 	roughness = Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>();
 	metalness = Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>();
+	roughnessMetalAO = Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>();
 }
 
 TextureBundle::TextureBundle(std::string name) : TextureBundle::TextureBundle() {
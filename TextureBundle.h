@@ -12,4 +12,10 @@ struct TextureBundle {
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normal;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughness;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> metalness;
+
+	// Packed bundles have this instead of roughness and metalness:
+	// roughness in red, metalness in green and ambient occlusion in
+	// blue.  Red matching a roughness map means shaders that only
+	// want roughness can read it as is.
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughnessMetalAO;
 };
\ No newline at end of file
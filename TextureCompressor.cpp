@@ -0,0 +1,1056 @@
+#include "TextureCompressor.h"
+#include "DerivedDataCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#include <emmintrin.h> // SSE2
+
+// BC7 weights for 4-bit indices, out of 64
+static const int BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// --------------------------------------------------------
+// Runs job(i) for every i in [0, count) across threads
+// --------------------------------------------------------
+template<typename Job>
+static void ParallelFor(unsigned int count, unsigned int threadCount, Job job)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	threadCount = std::max(std::min(threadCount, count), 1u);
+
+	std::atomic<unsigned int> next = 0;
+	auto worker = [&]()
+	{
+		for (unsigned int i = next++; i < count; i = next++)
+			job(i);
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < threadCount; t++)
+		threads.emplace_back(worker);
+
+	worker(); // This thread helps too
+	for (auto& t : threads)
+		t.join();
+}
+
+unsigned int TextureCompressor::GetBlockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+const char* TextureCompressor::GetFormatName(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1: return "BC1";
+	case BlockFormat::BC4: return "BC4";
+	case BlockFormat::BC5: return "BC5";
+	case BlockFormat::BC7: return "BC7";
+	}
+	return "?";
+}
+
+bool TextureCompressor::CanCompress(const ImageData& image)
+{
+	return image.Width > 0 && image.Height > 0 &&
+		image.Width % 4 == 0 && image.Height % 4 == 0 &&
+		image.Pixels.size() == (size_t)image.Width * image.Height * 4;
+}
+
+// --------------------------------------------------------
+// Endpoint fitting shared by BC1 and BC7
+// --------------------------------------------------------
+
+// Mean and main axis (by power iteration on the covariance)
+// of the first `channels` channels of 16 texels
+static void FitLine(const float texels[16][4], int channels, float mean[4], float axis[4])
+{
+	for (int c = 0; c < 4; c++)
+	{
+		mean[c] = 0;
+		for (int i = 0; i < 16; i++)
+			mean[c] += texels[i][c];
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float d[4];
+		for (int c = 0; c < 4; c++)
+			d[c] = texels[i][c] - mean[c];
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < channels; b++)
+				covariance[a][b] += d[a] * d[b];
+	}
+
+	// Start from the channel that varies the most
+	for (int c = 0; c < 4; c++)
+		axis[c] = 0;
+	int widest = 0;
+	for (int c = 1; c < channels; c++)
+		if (covariance[c][c] > covariance[widest][widest])
+			widest = c;
+	axis[widest] = 1;
+
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < channels; b++)
+				next[a] += covariance[a][b] * axis[b];
+
+		float length = 0;
+		for (int c = 0; c < channels; c++)
+			length += next[c] * next[c];
+		if (length < 1e-12f)
+			break; // Flat block, any axis will do
+
+		length = 1.0f / std::sqrt(length);
+		for (int c = 0; c < channels; c++)
+			axis[c] = next[c] * length;
+	}
+}
+
+// Ends of the line through the texels, clamped to [0, 255]
+static void LineEndpoints(const float texels[16][4], int channels, float e0[4], float e1[4])
+{
+	float mean[4], axis[4];
+	FitLine(texels, channels, mean, axis);
+
+	float low = std::numeric_limits<float>::max();
+	float high = -std::numeric_limits<float>::max();
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0;
+		for (int c = 0; c < channels; c++)
+			t += (texels[i][c] - mean[c]) * axis[c];
+		low = std::min(low, t);
+		high = std::max(high, t);
+	}
+
+	for (int c = 0; c < 4; c++)
+	{
+		e0[c] = std::clamp(mean[c] + axis[c] * low, 0.0f, 255.0f);
+		e1[c] = std::clamp(mean[c] + axis[c] * high, 0.0f, 255.0f);
+	}
+}
+
+// Endpoints that best fit the texels given their indices, where
+// weights[i] is how far along from e0 to e1 texel i sits.  Leaves
+// the endpoints alone if every texel picked the same weight.
+static void LeastSquaresEndpoints(const float texels[16][4], const float weights[16], int channels, float e0[4], float e1[4])
+{
+	float aa = 0, ab = 0, bb = 0;
+	float ax[4] = {}, bx[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float b = weights[i];
+		float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < channels; c++)
+		{
+			ax[c] += a * texels[i][c];
+			bx[c] += b * texels[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+		return;
+
+	float inverse = 1.0f / determinant;
+	for (int c = 0; c < channels; c++)
+	{
+		e0[c] = std::clamp((bb * ax[c] - ab * bx[c]) * inverse, 0.0f, 255.0f);
+		e1[c] = std::clamp((aa * bx[c] - ab * ax[c]) * inverse, 0.0f, 255.0f);
+	}
+}
+
+// Index of the closest palette entry for each texel, returning the
+// total squared error.  The palette is 16 entries, stored planar
+// (all of red, then green and so on) so four compare at once.
+static float ClosestIndices16(const float texels[16][4], const float palette[4][16], int indices[16])
+{
+	float total = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		__m128 r = _mm_set1_ps(texels[i][0]);
+		__m128 g = _mm_set1_ps(texels[i][1]);
+		__m128 b = _mm_set1_ps(texels[i][2]);
+		__m128 a = _mm_set1_ps(texels[i][3]);
+
+		__m128 distance[4];
+		for (int j = 0; j < 4; j++)
+		{
+			__m128 dr = _mm_sub_ps(_mm_loadu_ps(&palette[0][j * 4]), r);
+			__m128 dg = _mm_sub_ps(_mm_loadu_ps(&palette[1][j * 4]), g);
+			__m128 db = _mm_sub_ps(_mm_loadu_ps(&palette[2][j * 4]), b);
+			__m128 da = _mm_sub_ps(_mm_loadu_ps(&palette[3][j * 4]), a);
+			distance[j] = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+				_mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+		}
+
+		// Smallest distance in every lane, then the first entry that has it
+		__m128 best = _mm_min_ps(_mm_min_ps(distance[0], distance[1]), _mm_min_ps(distance[2], distance[3]));
+		best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+		best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(1, 0, 3, 2)));
+
+		int mask = 0;
+		for (int j = 3; j >= 0; j--)
+			mask = (mask << 4) | _mm_movemask_ps(_mm_cmpeq_ps(distance[j], best));
+
+		int index = 0;
+		while (!(mask & (1 << index)))
+			index++;
+
+		indices[i] = index;
+		total += _mm_cvtss_f32(best);
+	}
+	return total;
+}
+
+static void GatherTexels(const uint8_t texels[64], float out[16][4])
+{
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 4; c++)
+			out[i][c] = texels[i * 4 + c];
+}
+
+// Little endian bit packing for BC7
+struct BlockWriter
+{
+	uint8_t* Block;
+	unsigned int Position;
+
+	void Write(uint32_t value, unsigned int bits)
+	{
+		for (unsigned int b = 0; b < bits; b++, Position++)
+			if (value & (1u << b))
+				Block[Position >> 3] |= (uint8_t)(1u << (Position & 7));
+	}
+};
+
+struct BlockReader
+{
+	const uint8_t* Block;
+	unsigned int Position;
+
+	uint32_t Read(unsigned int bits)
+	{
+		uint32_t value = 0;
+		for (unsigned int b = 0; b < bits; b++, Position++)
+			value |= (uint32_t)((Block[Position >> 3] >> (Position & 7)) & 1) << b;
+		return value;
+	}
+};
+
+// --------------------------------------------------------
+// BC1
+// --------------------------------------------------------
+static uint16_t PackRGB565(const float rgb[4])
+{
+	int r = (int)(rgb[0] * 31.0f / 255.0f + 0.5f);
+	int g = (int)(rgb[1] * 63.0f / 255.0f + 0.5f);
+	int b = (int)(rgb[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(uint16_t color, int rgb[3])
+{
+	int r = (color >> 11) & 31;
+	int g = (color >> 5) & 63;
+	int b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Four color mode palette (c0 > c1), or all c0 if they match
+static void BC1Palette(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+	UnpackRGB565(c0, palette[0]);
+	UnpackRGB565(c1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+}
+
+// Picks indices for a pair of endpoints, returning the error
+static float BC1Indices(const float texels[16][4], uint16_t c0, uint16_t c1, int indices[16])
+{
+	int palette[4][3];
+	BC1Palette(c0, c1, palette);
+
+	float total = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float best = std::numeric_limits<float>::max();
+		for (int p = 0; p < 4; p++)
+		{
+			float dr = texels[i][0] - palette[p][0];
+			float dg = texels[i][1] - palette[p][1];
+			float db = texels[i][2] - palette[p][2];
+			float distance = dr * dr + dg * dg + db * db;
+			if (distance < best)
+			{
+				best = distance;
+				indices[i] = p;
+			}
+		}
+		total += best;
+	}
+	return total;
+}
+
+void TextureCompressor::EncodeBC1Block(const uint8_t texels[64], uint8_t block[8])
+{
+	static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	float t[16][4];
+	GatherTexels(texels, t);
+
+	float e0[4], e1[4];
+	LineEndpoints(t, 3, e0, e1);
+
+	// Brightest first, so the four color mode is picked
+	uint16_t best0 = PackRGB565(e1);
+	uint16_t best1 = PackRGB565(e0);
+	if (best0 < best1)
+		std::swap(best0, best1);
+	int bestIndices[16];
+	float bestError = BC1Indices(t, best0, best1, bestIndices);
+
+	// One round of least squares on the endpoints
+	if (best0 != best1)
+	{
+		float w[16];
+		for (int i = 0; i < 16; i++)
+			w[i] = weights[bestIndices[i]];
+
+		int rgb0[3], rgb1[3];
+		UnpackRGB565(best0, rgb0);
+		UnpackRGB565(best1, rgb1);
+		float f0[4] = {}, f1[4] = {};
+		for (int c = 0; c < 3; c++)
+		{
+			f0[c] = (float)rgb0[c];
+			f1[c] = (float)rgb1[c];
+		}
+
+		LeastSquaresEndpoints(t, w, 3, f0, f1);
+		uint16_t c0 = PackRGB565(f0);
+		uint16_t c1 = PackRGB565(f1);
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		int indices[16];
+		float error = BC1Indices(t, c0, c1, indices);
+		if (error < bestError)
+		{
+			bestError = error;
+			best0 = c0;
+			best1 = c1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+	}
+
+	uint32_t packed = 0;
+	if (best0 != best1)
+	{
+		for (int i = 0; i < 16; i++)
+			packed |= (uint32_t)bestIndices[i] << (i * 2);
+	}
+
+	block[0] = (uint8_t)best0;
+	block[1] = (uint8_t)(best0 >> 8);
+	block[2] = (uint8_t)best1;
+	block[3] = (uint8_t)(best1 >> 8);
+	memcpy(block + 4, &packed, 4);
+}
+
+void TextureCompressor::DecodeBC1Block(const uint8_t block[8], uint8_t texels[64])
+{
+	uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+	uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+	uint32_t packed;
+	memcpy(&packed, block + 4, 4);
+
+	int palette[4][3];
+	BC1Palette(c0, c1, palette);
+	if (c0 <= c1)
+	{
+		// Three color mode, with black in the last slot
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		int index = (packed >> (i * 2)) & 3;
+		for (int c = 0; c < 3; c++)
+			texels[i * 4 + c] = (uint8_t)palette[index][c];
+	}
+}
+
+// --------------------------------------------------------
+// BC4 and BC5
+// --------------------------------------------------------
+static void BC4Palette(int r0, int r1, int palette[8])
+{
+	palette[0] = r0;
+	palette[1] = r1;
+	if (r0 > r1)
+	{
+		for (int k = 2; k < 8; k++)
+			palette[k] = ((8 - k) * r0 + (k - 1) * r1 + 3) / 7;
+	}
+	else
+	{
+		for (int k = 2; k < 6; k++)
+			palette[k] = ((6 - k) * r0 + (k - 1) * r1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+void TextureCompressor::EncodeBC4Block(const uint8_t texels[64], unsigned int channel, uint8_t block[8])
+{
+	int low = 255, high = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		low = std::min(low, (int)texels[i * 4 + channel]);
+		high = std::max(high, (int)texels[i * 4 + channel]);
+	}
+
+	block[0] = (uint8_t)high;
+	block[1] = (uint8_t)low;
+
+	uint64_t packed = 0;
+	if (high != low)
+	{
+		int palette[8];
+		BC4Palette(high, low, palette);
+
+		for (int i = 0; i < 16; i++)
+		{
+			int value = texels[i * 4 + channel];
+			int best = 0;
+			for (int k = 1; k < 8; k++)
+				if (std::abs(palette[k] - value) < std::abs(palette[best] - value))
+					best = k;
+			packed |= (uint64_t)best << (i * 3);
+		}
+	}
+
+	for (int b = 0; b < 6; b++)
+		block[2 + b] = (uint8_t)(packed >> (b * 8));
+}
+
+void TextureCompressor::DecodeBC4Block(const uint8_t block[8], unsigned int channel, uint8_t texels[64])
+{
+	int palette[8];
+	BC4Palette(block[0], block[1], palette);
+
+	uint64_t packed = 0;
+	for (int b = 0; b < 6; b++)
+		packed |= (uint64_t)block[2 + b] << (b * 8);
+
+	for (int i = 0; i < 16; i++)
+		texels[i * 4 + channel] = (uint8_t)palette[(packed >> (i * 3)) & 7];
+}
+
+void TextureCompressor::EncodeBC5Block(const uint8_t texels[64], uint8_t block[16])
+{
+	EncodeBC4Block(texels, 0, block);
+	EncodeBC4Block(texels, 1, block + 8);
+}
+
+void TextureCompressor::DecodeBC5Block(const uint8_t block[16], uint8_t texels[64])
+{
+	DecodeBC4Block(block, 0, texels);
+	DecodeBC4Block(block + 8, 1, texels);
+}
+
+// --------------------------------------------------------
+// BC7 (mode 6)
+// --------------------------------------------------------
+struct BC7Mode6
+{
+	int Endpoints[2][4];	// 7 bits each
+	int PBits[2];
+	int Indices[16];
+	float Error;
+};
+
+// Rounds float endpoints to 7 bits plus the given p-bits, then
+// picks indices for them
+static void BC7Quantize(const float texels[16][4], const float e0[4], const float e1[4], int p0, int p1, BC7Mode6& result)
+{
+	result.PBits[0] = p0;
+	result.PBits[1] = p1;
+
+	int full[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		result.Endpoints[0][c] = std::clamp((int)((e0[c] - p0) * 0.5f + 0.5f), 0, 127);
+		result.Endpoints[1][c] = std::clamp((int)((e1[c] - p1) * 0.5f + 0.5f), 0, 127);
+		full[0][c] = (result.Endpoints[0][c] << 1) | p0;
+		full[1][c] = (result.Endpoints[1][c] << 1) | p1;
+	}
+
+	float palette[4][16];
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 4; c++)
+			palette[c][i] = (float)(((64 - BC7Weights[i]) * full[0][c] + BC7Weights[i] * full[1][c] + 32) >> 6);
+
+	result.Error = ClosestIndices16(texels, palette, result.Indices);
+}
+
+void TextureCompressor::EncodeBC7Block(const uint8_t texels[64], uint8_t block[16])
+{
+	float t[16][4];
+	GatherTexels(texels, t);
+
+	float e0[4], e1[4];
+	LineEndpoints(t, 4, e0, e1);
+
+	BC7Mode6 best = {};
+	best.Error = std::numeric_limits<float>::max();
+	for (int round = 0; round < 2; round++)
+	{
+		for (int p = 0; p < 4; p++)
+		{
+			BC7Mode6 candidate;
+			BC7Quantize(t, e0, e1, p & 1, p >> 1, candidate);
+			if (candidate.Error < best.Error)
+				best = candidate;
+		}
+
+		if (best.Error == 0)
+			break;
+
+		// Refit the endpoints to the best indices for the next round
+		float w[16];
+		for (int i = 0; i < 16; i++)
+			w[i] = BC7Weights[best.Indices[i]] / 64.0f;
+		LeastSquaresEndpoints(t, w, 4, e0, e1);
+	}
+
+	// The first index's top bit is implied to be 0
+	if (best.Indices[0] & 8)
+	{
+		for (int c = 0; c < 4; c++)
+			std::swap(best.Endpoints[0][c], best.Endpoints[1][c]);
+		std::swap(best.PBits[0], best.PBits[1]);
+		for (int i = 0; i < 16; i++)
+			best.Indices[i] = 15 - best.Indices[i];
+	}
+
+	memset(block, 0, 16);
+	BlockWriter writer = { block, 0 };
+	writer.Write(1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		writer.Write(best.Endpoints[0][c], 7);
+		writer.Write(best.Endpoints[1][c], 7);
+	}
+	writer.Write(best.PBits[0], 1);
+	writer.Write(best.PBits[1], 1);
+	writer.Write(best.Indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		writer.Write(best.Indices[i], 4);
+}
+
+bool TextureCompressor::DecodeBC7Block(const uint8_t block[16], uint8_t texels[64])
+{
+	if ((block[0] & 0x7F) != 0x40)
+		return false;
+
+	BlockReader reader = { block, 7 };
+	int endpoints[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = reader.Read(7) << 1;
+		endpoints[1][c] = reader.Read(7) << 1;
+	}
+	int p0 = reader.Read(1);
+	int p1 = reader.Read(1);
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] |= p0;
+		endpoints[1][c] |= p1;
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		int weight = BC7Weights[reader.Read(i == 0 ? 3 : 4)];
+		for (int c = 0; c < 4; c++)
+			texels[i * 4 + c] = (uint8_t)(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+	}
+	return true;
+}
+
+// --------------------------------------------------------
+// Whole textures
+// --------------------------------------------------------
+
+// Kaiser windowed sinc, for halving: x is in destination texels
+// and the filter reaches FilterRadius of them either side
+static const float FilterRadius = 3.0f;
+
+static float Bessel0(float x)
+{
+	// Series for the modified Bessel function of the first kind
+	float sum = 1, term = 1;
+	for (int k = 1; k < 16; k++)
+	{
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+static float KaiserSinc(float x)
+{
+	const float PI = 3.14159265359f;
+	const float alpha = 4.0f;
+
+	float t = x / FilterRadius;
+	if (std::fabs(t) >= 1)
+		return 0;
+
+	float sinc = x == 0 ? 1 : std::sin(PI * x) / (PI * x);
+	return sinc * Bessel0(alpha * std::sqrt(1 - t * t)) / Bessel0(alpha);
+}
+
+// A level as 4 floats per texel
+struct FloatLevel
+{
+	unsigned int Width;
+	unsigned int Height;
+	std::vector<float> Texels;
+};
+
+// Half size (down to 1) along one axis, wrapping around the edges
+// like the sampler does.  Kaiser for color and normals, a 2 texel
+// box for data.
+static FloatLevel HalveAxis(const FloatLevel& level, bool horizontal, MipContent content, unsigned int threadCount)
+{
+	unsigned int sourceLength = horizontal ? level.Width : level.Height;
+	unsigned int length = std::max(sourceLength / 2, 1u);
+
+	// Same weights for every texel, as each one sits between
+	// the two source texels it was made from
+	std::vector<float> weights;
+	int firstTap = 0;
+	if (content == MipContent::Data || sourceLength == 1)
+	{
+		weights = { 0.5f, 0.5f };
+		firstTap = 0;
+	}
+	else
+	{
+		int taps = (int)(FilterRadius * 2);
+		firstTap = 1 - taps;
+		float total = 0;
+		for (int t = firstTap; t < taps + 1; t++)
+		{
+			// Source texel centre, relative to the destination's, in destination texels
+			float weight = KaiserSinc((t + 0.5f - 1.0f) * 0.5f);
+			weights.push_back(weight);
+			total += weight;
+		}
+		for (float& w : weights)
+			w /= total;
+	}
+
+	// Which source texels (or rows) each tap reads, wrapped
+	std::vector<unsigned int> sources(length * weights.size());
+	for (unsigned int i = 0; i < length; i++)
+	{
+		for (size_t w = 0; w < weights.size(); w++)
+		{
+			int source = (int)(i * 2) + firstTap + (int)w;
+			sources[i * weights.size() + w] = ((source % (int)sourceLength) + sourceLength) % sourceLength;
+		}
+	}
+
+	FloatLevel result = {};
+	result.Width = horizontal ? length : level.Width;
+	result.Height = horizontal ? level.Height : length;
+	result.Texels.resize((size_t)result.Width * result.Height * 4);
+
+	if (horizontal)
+	{
+		ParallelFor(result.Height, threadCount, [&](unsigned int y)
+			{
+				const float* row = &level.Texels[(size_t)y * level.Width * 4];
+				float* out = &result.Texels[(size_t)y * result.Width * 4];
+				for (unsigned int x = 0; x < length; x++)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (size_t w = 0; w < weights.size(); w++)
+					{
+						__m128 texel = _mm_loadu_ps(&row[sources[x * weights.size() + w] * 4]);
+						sum = _mm_add_ps(sum, _mm_mul_ps(texel, _mm_set1_ps(weights[w])));
+					}
+					_mm_storeu_ps(&out[x * 4], sum);
+				}
+			});
+	}
+	else
+	{
+		// Whole rows at a time, so reads stay in order
+		size_t rowFloats = (size_t)level.Width * 4;
+		ParallelFor(result.Height, threadCount, [&](unsigned int y)
+			{
+				float* out = &result.Texels[y * rowFloats];
+				for (size_t w = 0; w < weights.size(); w++)
+				{
+					const float* row = &level.Texels[sources[y * weights.size() + w] * rowFloats];
+					__m128 weight = _mm_set1_ps(weights[w]);
+					for (size_t i = 0; i < rowFloats; i += 4)
+						_mm_storeu_ps(&out[i], _mm_add_ps(_mm_loadu_ps(&out[i]), _mm_mul_ps(_mm_loadu_ps(&row[i]), weight)));
+				}
+			});
+	}
+
+	return result;
+}
+
+ImageData TextureCompressor::PackChannels(const ImageData* sources[4], const uint8_t fill[4])
+{
+	ImageData result = {};
+	for (int c = 0; c < 4; c++)
+	{
+		if (sources[c] && !sources[c]->Pixels.empty())
+		{
+			result.Width = std::max(result.Width, sources[c]->Width);
+			result.Height = std::max(result.Height, sources[c]->Height);
+		}
+	}
+	if (result.Width == 0)
+		return result;
+
+	result.Pixels.resize((size_t)result.Width * result.Height * 4);
+	for (int c = 0; c < 4; c++)
+	{
+		const ImageData* source = sources[c];
+		if (!source || source->Pixels.empty())
+		{
+			for (size_t i = c; i < result.Pixels.size(); i += 4)
+				result.Pixels[i] = fill[c];
+			continue;
+		}
+
+		// Same texel centres as a GPU sampling the smaller image
+		float scaleX = (float)source->Width / result.Width;
+		float scaleY = (float)source->Height / result.Height;
+		for (unsigned int y = 0; y < result.Height; y++)
+		{
+			float sy = (y + 0.5f) * scaleY - 0.5f;
+			int y0 = (int)std::floor(sy);
+			float fy = sy - y0;
+			unsigned int row0 = (unsigned int)((y0 + (int)source->Height) % (int)source->Height);
+			unsigned int row1 = (row0 + 1) % source->Height;
+
+			for (unsigned int x = 0; x < result.Width; x++)
+			{
+				float sx = (x + 0.5f) * scaleX - 0.5f;
+				int x0 = (int)std::floor(sx);
+				float fx = sx - x0;
+				unsigned int column0 = (unsigned int)((x0 + (int)source->Width) % (int)source->Width);
+				unsigned int column1 = (column0 + 1) % source->Width;
+
+				auto red = [&](unsigned int row, unsigned int column) { return (float)source->Pixels[((size_t)row * source->Width + column) * 4]; };
+				float top = red(row0, column0) + (red(row0, column1) - red(row0, column0)) * fx;
+				float bottom = red(row1, column0) + (red(row1, column1) - red(row1, column0)) * fx;
+				result.Pixels[((size_t)y * result.Width + x) * 4 + c] = (uint8_t)(top + (bottom - top) * fy + 0.5f);
+			}
+		}
+	}
+	return result;
+}
+
+std::vector<ImageData> TextureCompressor::BuildMipChain(const ImageData& image, MipContent content, unsigned int threadCount)
+{
+	std::vector<ImageData> chain;
+	chain.push_back(image);
+	if (image.Pixels.empty())
+		return chain;
+
+	// To floats: linear color, unit vectors or data as is
+	float toLinear[256];
+	for (int i = 0; i < 256; i++)
+		toLinear[i] = std::pow(i / 255.0f, 2.2f); // Same curve as the shaders
+
+	FloatLevel level = { image.Width, image.Height, {} };
+	level.Texels.resize(image.Pixels.size());
+	for (size_t i = 0; i < image.Pixels.size(); i += 4)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			uint8_t value = image.Pixels[i + c];
+			switch (content)
+			{
+			case MipContent::Color: level.Texels[i + c] = c < 3 ? toLinear[value] : value / 255.0f; break;
+			case MipContent::Normal: level.Texels[i + c] = c < 3 ? value / 127.5f - 1.0f : value / 255.0f; break;
+			case MipContent::Data: level.Texels[i + c] = value / 255.0f; break;
+			}
+		}
+	}
+
+	// Each level is filtered from the one above, kept as floats
+	// so rounding doesn't build up
+	while (level.Width > 1 || level.Height > 1)
+	{
+		level = HalveAxis(HalveAxis(level, true, content, threadCount), false, content, threadCount);
+
+		ImageData mip = {};
+		mip.Width = level.Width;
+		mip.Height = level.Height;
+		mip.Pixels.resize(level.Texels.size());
+		ParallelFor(level.Height, threadCount, [&](unsigned int y)
+			{
+				for (size_t i = (size_t)y * level.Width * 4; i < (size_t)(y + 1) * level.Width * 4; i += 4)
+				{
+					float* texel = &level.Texels[i];
+					float rgb[3] = { texel[0], texel[1], texel[2] };
+					if (content == MipContent::Color)
+					{
+						for (int c = 0; c < 3; c++)
+							rgb[c] = std::pow(std::max(rgb[c], 0.0f), 1.0f / 2.2f);
+					}
+					else if (content == MipContent::Normal)
+					{
+						// Averaging shortens normals, so bring them back to unit length
+						float length = std::sqrt(rgb[0] * rgb[0] + rgb[1] * rgb[1] + rgb[2] * rgb[2]);
+						if (length > 1e-6f)
+						{
+							for (int c = 0; c < 3; c++)
+								texel[c] = rgb[c] /= length;
+						}
+						else
+						{
+							texel[0] = texel[1] = rgb[0] = rgb[1] = 0;
+							texel[2] = rgb[2] = 1;
+						}
+						for (int c = 0; c < 3; c++)
+							rgb[c] = rgb[c] * 0.5f + 0.5f;
+					}
+
+					for (int c = 0; c < 4; c++)
+					{
+						float value = c < 3 ? rgb[c] : texel[3];
+						mip.Pixels[i + c] = (uint8_t)std::clamp((int)(value * 255.0f + 0.5f), 0, 255);
+					}
+				}
+			});
+		chain.push_back(std::move(mip));
+	}
+
+	return chain;
+}
+
+// Compresses one level.  Blocks hanging off the edge (only in
+// mips smaller than a block) repeat the last row and column.
+static std::vector<uint8_t> CompressLevel(const ImageData& image, BlockFormat format, unsigned int threadCount)
+{
+	unsigned int blocksWide = (image.Width + 3) / 4;
+	unsigned int blocksHigh = (image.Height + 3) / 4;
+	unsigned int blockBytes = TextureCompressor::GetBlockBytes(format);
+	std::vector<uint8_t> blocks((size_t)blocksWide * blocksHigh * blockBytes);
+
+	ParallelFor(blocksHigh, threadCount, [&](unsigned int by)
+		{
+			uint8_t texels[64];
+			for (unsigned int bx = 0; bx < blocksWide; bx++)
+			{
+				for (unsigned int i = 0; i < 16; i++)
+				{
+					unsigned int x = std::min(bx * 4 + (i & 3), image.Width - 1);
+					unsigned int y = std::min(by * 4 + (i >> 2), image.Height - 1);
+					memcpy(&texels[i * 4], &image.Pixels[((size_t)y * image.Width + x) * 4], 4);
+				}
+
+				uint8_t* block = &blocks[((size_t)by * blocksWide + bx) * blockBytes];
+				switch (format)
+				{
+				case BlockFormat::BC1: TextureCompressor::EncodeBC1Block(texels, block); break;
+				case BlockFormat::BC4: TextureCompressor::EncodeBC4Block(texels, 0, block); break;
+				case BlockFormat::BC5: TextureCompressor::EncodeBC5Block(texels, block); break;
+				case BlockFormat::BC7: TextureCompressor::EncodeBC7Block(texels, block); break;
+				}
+			}
+		});
+
+	return blocks;
+}
+
+CompressedTexture TextureCompressor::Compress(const ImageData& image, BlockFormat format, MipContent content, unsigned int threadCount)
+{
+	CompressedTexture result = {};
+	result.Format = format;
+	result.Width = image.Width;
+	result.Height = image.Height;
+	if (!CanCompress(image))
+		return result;
+
+	for (const ImageData& level : BuildMipChain(image, content, threadCount))
+		result.Mips.push_back(CompressLevel(level, format, threadCount));
+	return result;
+}
+
+ImageData TextureCompressor::Decompress(const CompressedTexture& texture)
+{
+	ImageData image = {};
+	if (texture.Mips.empty())
+		return image;
+
+	image.Width = texture.Width;
+	image.Height = texture.Height;
+	image.Pixels.resize((size_t)image.Width * image.Height * 4);
+
+	unsigned int blocksWide = (image.Width + 3) / 4;
+	unsigned int blocksHigh = (image.Height + 3) / 4;
+	unsigned int blockBytes = GetBlockBytes(texture.Format);
+	for (unsigned int by = 0; by < blocksHigh; by++)
+	{
+		for (unsigned int bx = 0; bx < blocksWide; bx++)
+		{
+			uint8_t texels[64];
+			for (int i = 0; i < 16; i++)
+			{
+				texels[i * 4 + 0] = texels[i * 4 + 1] = texels[i * 4 + 2] = 0;
+				texels[i * 4 + 3] = 255;
+			}
+
+			const uint8_t* block = &texture.Mips[0][((size_t)by * blocksWide + bx) * blockBytes];
+			switch (texture.Format)
+			{
+			case BlockFormat::BC1: DecodeBC1Block(block, texels); break;
+			case BlockFormat::BC4: DecodeBC4Block(block, 0, texels); break;
+			case BlockFormat::BC5: DecodeBC5Block(block, texels); break;
+			case BlockFormat::BC7: DecodeBC7Block(block, texels); break;
+			}
+
+			for (unsigned int i = 0; i < 16; i++)
+			{
+				unsigned int x = bx * 4 + (i & 3);
+				unsigned int y = by * 4 + (i >> 2);
+				if (x < image.Width && y < image.Height)
+					memcpy(&image.Pixels[((size_t)y * image.Width + x) * 4], &texels[i * 4], 4);
+			}
+		}
+	}
+	return image;
+}
+
+double TextureCompressor::PSNR(const ImageData& original, const CompressedTexture& compressed)
+{
+	ImageData decoded = Decompress(compressed);
+	if (decoded.Pixels.size() != original.Pixels.size() || original.Pixels.empty())
+		return 0;
+
+	unsigned int channels = 4;
+	switch (compressed.Format)
+	{
+	case BlockFormat::BC1: channels = 3; break;
+	case BlockFormat::BC4: channels = 1; break;
+	case BlockFormat::BC5: channels = 2; break;
+	case BlockFormat::BC7: channels = 4; break;
+	}
+
+	double sum = 0;
+	for (size_t i = 0; i < original.Pixels.size(); i += 4)
+	{
+		for (unsigned int c = 0; c < channels; c++)
+		{
+			double d = (double)original.Pixels[i + c] - decoded.Pixels[i + c];
+			sum += d * d;
+		}
+	}
+
+	double mse = sum / ((double)original.Width * original.Height * channels);
+	if (mse == 0)
+		return std::numeric_limits<double>::infinity();
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// --------------------------------------------------------
+// FNV-1a over everything that affects the results
+// --------------------------------------------------------
+uint64_t TextureCompressor::HashInputs(const uint8_t* source, size_t size, BlockFormat format, MipContent content)
+{
+	uint64_t hash = DerivedDataCache::FNVOffset;
+
+	uint32_t header[] = { CacheVersion, (uint32_t)format, (uint32_t)content };
+	DerivedDataCache::HashBytes(hash, header, sizeof(header));
+	DerivedDataCache::HashBytes(hash, source, size);
+
+	return hash;
+}
+
+std::vector<uint8_t> TextureCompressor::Serialize(const CompressedTexture& texture)
+{
+	DerivedDataWriter out;
+	out.Write((uint32_t)texture.Format);
+	out.Write((uint32_t)texture.Width);
+	out.Write((uint32_t)texture.Height);
+	out.Write((uint32_t)texture.Mips.size());
+
+	for (auto& mip : texture.Mips)
+	{
+		out.Write((uint32_t)mip.size());
+		out.Write(mip.data(), mip.size());
+	}
+
+	return out.Data;
+}
+
+bool TextureCompressor::Deserialize(const std::vector<uint8_t>& data, CompressedTexture& texture)
+{
+	DerivedDataReader in = { data.data(), data.size() };
+
+	uint32_t sizes[4] = {};
+	if (!in.Read(sizes) || sizes[0] > (uint32_t)BlockFormat::BC7)
+		return false;
+
+	CompressedTexture loaded = {};
+	loaded.Format = (BlockFormat)sizes[0];
+	loaded.Width = sizes[1];
+	loaded.Height = sizes[2];
+
+	for (uint32_t mip = 0; mip < sizes[3]; mip++)
+	{
+		uint32_t bytes = 0;
+		if (!in.Read(bytes) || bytes > data.size())
+			return false;
+
+		std::vector<uint8_t> blocks(bytes);
+		if (!in.Read(blocks.data(), blocks.size()))
+			return false;
+		loaded.Mips.push_back(std::move(blocks));
+	}
+
+	if (!in.IsFinished())
+		return false;
+
+	texture = std::move(loaded);
+	return true;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "PngDecoder.h"
+
+// Block compressed formats we can make.  Every one of them works
+// on 4x4 blocks; BC1 and BC4 blocks are 8 bytes, BC5 and BC7 16.
+enum class BlockFormat : uint32_t
+{
+	BC1,	// RGB, 4 bits per texel
+	BC4,	// R only, 4 bits per texel
+	BC5,	// RG only (normal maps, with Z rebuilt in the shader)
+	BC7		// RGBA, 8 bits per texel
+};
+
+// What a texture holds, which decides how its mips are filtered
+enum class MipContent : uint32_t
+{
+	Color,	// Gamma encoded color, filtered in linear space
+	Normal,	// Tangent space normals, renormalized after filtering
+	Data	// Anything else (roughness, metalness), plainly averaged
+};
+
+// A full mip chain of blocks, ready to upload as is
+struct CompressedTexture
+{
+	BlockFormat Format;
+	unsigned int Width;
+	unsigned int Height;
+	std::vector<std::vector<uint8_t>> Mips;
+};
+
+// --------------------------------------------------------
+// Block compression on the CPU, done when textures are
+// imported and kept in the cache so later runs just load
+// the blocks.  The mips are made here too, rather than by
+// GenerateMips(), so they can be filtered properly for
+// what's in them.
+//
+// The encoders aim for good quality at import speeds rather
+// than the best possible result:
+//  - BC1 fits a line through the block's colors and refines
+//    the endpoints with least squares
+//  - BC4/BC5 use the channel's min and max as endpoints
+//  - BC7 only uses mode 6 (one subset, RGBA endpoints with
+//    per-endpoint p-bits, 4-bit indices), refined the same
+//    way as BC1
+// --------------------------------------------------------
+class TextureCompressor
+{
+public:
+	// Bump this whenever the output of any step changes
+	static const uint32_t CacheVersion = 2;
+
+	static unsigned int GetBlockBytes(BlockFormat format);
+	static const char* GetFormatName(BlockFormat format);
+
+	// False if the image can't be block compressed (D3D wants the
+	// top level to be a whole number of blocks)
+	static bool CanCompress(const ImageData& image);
+
+	// Channel c of the result is the red channel of sources[c], all
+	// resized to the largest source (bilinear, wrapping at the edges).
+	// Channels without a source (null) are filled with fill[c].
+	static ImageData PackChannels(const ImageData* sources[4], const uint8_t fill[4]);
+
+	// The image followed by every mip down to 1x1.  Color and normals
+	// use a Kaiser filter (wrapping at the edges, as the textures tile)
+	// and data uses a box.  Each level's rows are split across threads
+	// (threadCount 0 means one per core).
+	static std::vector<ImageData> BuildMipChain(const ImageData& image, MipContent content, unsigned int threadCount = 0);
+
+	// The mip chain above, each level compressed.  Rows of blocks are
+	// split across threads the same way.
+	static CompressedTexture Compress(const ImageData& image, BlockFormat format, MipContent content, unsigned int threadCount = 0);
+
+	// Decompresses the top level back to RGBA8 (channels the format
+	// doesn't store come back as 0, and alpha as 255)
+	static ImageData Decompress(const CompressedTexture& texture);
+
+	// Peak signal to noise ratio in dB, over only the channels the
+	// format stores.  Higher is better; identical images give +inf.
+	static double PSNR(const ImageData& original, const CompressedTexture& compressed);
+
+	// Single blocks ---------------------------------------
+
+	// texels is 16 RGBA8 texels, row by row
+	static void EncodeBC1Block(const uint8_t texels[64], uint8_t block[8]);
+	static void EncodeBC4Block(const uint8_t texels[64], unsigned int channel, uint8_t block[8]);
+	static void EncodeBC5Block(const uint8_t texels[64], uint8_t block[16]);
+	static void EncodeBC7Block(const uint8_t texels[64], uint8_t block[16]);
+
+	// Only writes the channels the format stores
+	static void DecodeBC1Block(const uint8_t block[8], uint8_t texels[64]);
+	static void DecodeBC4Block(const uint8_t block[8], unsigned int channel, uint8_t texels[64]);
+	static void DecodeBC5Block(const uint8_t block[16], uint8_t texels[64]);
+	static bool DecodeBC7Block(const uint8_t block[16], uint8_t texels[64]); // Mode 6 only
+
+	// Derived data cache ---------------------------------
+
+	// Key for the cache, from the source file's bytes and how it's compressed
+	static uint64_t HashInputs(const uint8_t* source, size_t size, BlockFormat format, MipContent content);
+
+	static std::vector<uint8_t> Serialize(const CompressedTexture& texture);
+
+	// Fails if the data is cut off or isn't a texture
+	static bool Deserialize(const std::vector<uint8_t>& data, CompressedTexture& texture);
+};
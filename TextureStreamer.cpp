@@ -0,0 +1,237 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+uint32_t TextureStreamer::GetFullMipCount(uint32_t width, uint32_t height)
+{
+	uint32_t count = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+		count++;
+	return count;
+}
+
+uint64_t TextureStreamer::GetMipBytes(uint32_t width, uint32_t height, uint32_t mip, uint32_t blockBytes)
+{
+	uint64_t mipWidth = std::max(width >> mip, 1u);
+	uint64_t mipHeight = std::max(height >> mip, 1u);
+	return ((mipWidth + 3) / 4) * ((mipHeight + 3) / 4) * blockBytes;
+}
+
+uint64_t TextureStreamer::GetBytes(uint32_t width, uint32_t height, uint32_t firstMip, uint32_t mipCount, uint32_t blockBytes)
+{
+	uint64_t bytes = 0;
+	for (uint32_t mip = firstMip; mip < mipCount; mip++)
+		bytes += GetMipBytes(width, height, mip, blockBytes);
+	return bytes;
+}
+
+uint32_t TextureStreamer::GetStartMip(uint32_t width, uint32_t height, uint32_t mipCount)
+{
+	uint32_t mip = 0;
+	while (mip + 1 < mipCount && std::max(width >> mip, height >> mip) > StartSize) {
+		// The top mip of a block compressed texture has to be whole blocks
+		if ((width >> (mip + 1)) % 4 != 0 || (height >> (mip + 1)) % 4 != 0)
+			break;
+		mip++;
+	}
+	return mip;
+}
+
+uint32_t TextureStreamer::SelectMip(uint32_t width, uint32_t height, uint32_t mipCount, float uvPerPixel)
+{
+	// Also catches NaN, from something drawn at no size at all
+	float texelsPerPixel = std::max(width, height) * uvPerPixel;
+	if (!(texelsPerPixel > 1.0f))
+		return 0;
+	if (std::isinf(texelsPerPixel))
+		return mipCount - 1;
+
+	uint32_t mip = (uint32_t)std::floor(std::log2(texelsPerPixel));
+	return std::min(mip, mipCount - 1);
+}
+
+TextureStreamer::TextureStreamer() : bandwidthBudget(8 * 1024 * 1024), memoryBudget(Unlimited), residentBytes(0), uploadedBytes(0)
+{
+}
+
+uint64_t TextureStreamer::GetBytes(const Texture& texture, uint32_t firstMip)
+{
+	return GetBytes(texture.Width, texture.Height, firstMip, texture.MipCount, texture.BlockBytes);
+}
+
+void TextureStreamer::Add(const std::string& name, uint32_t width, uint32_t height, uint32_t mipCount, uint32_t blockBytes, uint32_t residentMip)
+{
+	Remove(name);
+
+	Texture texture = {};
+	texture.Width = width;
+	texture.Height = height;
+	texture.MipCount = std::max(mipCount, 1u);
+	texture.BlockBytes = blockBytes;
+	texture.ResidentMip = std::min(residentMip, texture.MipCount - 1);
+	texture.StartMip = texture.ResidentMip;
+	texture.RequestedMip = texture.MipCount;
+	texture.WantedMip = texture.ResidentMip;
+	residentBytes += GetBytes(texture, texture.ResidentMip);
+	textures[name] = texture;
+}
+
+void TextureStreamer::Remove(const std::string& name)
+{
+	auto found = textures.find(name);
+	if (found == textures.end())
+		return;
+
+	residentBytes -= GetBytes(found->second, found->second.ResidentMip);
+	textures.erase(found);
+}
+
+void TextureStreamer::Request(const std::string& name, float uvPerPixel)
+{
+	auto found = textures.find(name);
+	if (found == textures.end())
+		return;
+
+	Texture& texture = found->second;
+	uint32_t mip = SelectMip(texture.Width, texture.Height, texture.MipCount, uvPerPixel);
+	texture.RequestedMip = std::min(texture.RequestedMip, mip);
+}
+
+std::vector<TextureMipChange> TextureStreamer::Update()
+{
+	// Sorted by name, so the same requests always plan the same way
+	std::vector<std::pair<const std::string*, Texture*>> sorted;
+	sorted.reserve(textures.size());
+	for (auto& [name, texture] : textures)
+		sorted.push_back({ &name, &texture });
+	std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return *a.first < *b.first; });
+
+	// What each texture wants this frame.  Anything that wasn't
+	// asked for only needs what it started with.
+	for (auto& [name, texture] : sorted) {
+		texture->WantedMip = std::min(texture->RequestedMip, texture->StartMip);
+		texture->RequestedMip = texture->MipCount;
+		if (texture->WantedMip > texture->ResidentMip)
+			texture->FramesUnneeded++;
+		else
+			texture->FramesUnneeded = 0;
+	}
+
+	std::vector<TextureMipChange> changes;
+	std::unordered_map<Texture*, uint32_t> planned;	// Where each dropped texture ends up
+	uint64_t projectedBytes = residentBytes;
+	auto drop = [&](Texture* texture, uint32_t to)
+		{
+			uint32_t from = planned.contains(texture) ? planned[texture] : texture->ResidentMip;
+			projectedBytes -= GetBytes(*texture, from) - GetBytes(*texture, to);
+			planned[texture] = to;
+		};
+
+	// Drops ---------------------------------------------------
+	for (auto& [name, texture] : sorted)
+		if (texture->FramesUnneeded >= DropDelay)
+			drop(texture, texture->WantedMip);
+
+	// Over the memory budget, one mip at a time comes off whatever
+	// has the most detail to spare (and then the biggest mip)
+	while (projectedBytes > memoryBudget) {
+		Texture* victim = 0;
+		int victimSpare = 0;
+		uint64_t victimBytes = 0;
+		for (auto& [name, texture] : sorted) {
+			uint32_t mip = planned.contains(texture) ? planned[texture] : texture->ResidentMip;
+			if (mip >= texture->StartMip)
+				continue;
+
+			int spare = (int)texture->WantedMip - (int)mip;
+			uint64_t bytes = GetMipBytes(texture->Width, texture->Height, mip, texture->BlockBytes);
+			if (!victim || spare > victimSpare || (spare == victimSpare && bytes > victimBytes)) {
+				victim = texture;
+				victimSpare = spare;
+				victimBytes = bytes;
+			}
+		}
+		if (!victim)
+			break;
+
+		uint32_t mip = planned.contains(victim) ? planned[victim] : victim->ResidentMip;
+		drop(victim, mip + 1);
+	}
+
+	for (auto& [name, texture] : sorted)
+		if (planned.contains(texture) && planned[texture] != texture->ResidentMip)
+			changes.push_back({ *name, texture->ResidentMip, planned[texture] });
+
+	// Uploads -------------------------------------------------
+	// Whatever's furthest from what it wants goes first
+	std::vector<std::pair<const std::string*, Texture*>> wanting;
+	for (auto& entry : sorted)
+		if (!planned.contains(entry.second) && entry.second->WantedMip < entry.second->ResidentMip)
+			wanting.push_back(entry);
+	std::stable_sort(wanting.begin(), wanting.end(), [](const auto& a, const auto& b)
+		{
+			return a.second->ResidentMip - a.second->WantedMip > b.second->ResidentMip - b.second->WantedMip;
+		});
+
+	uint64_t bandwidth = 0;
+	for (auto& [name, texture] : wanting) {
+		if (bandwidth >= bandwidthBudget)
+			break;
+
+		// Short of the way there if that's all that fits
+		uint32_t to = texture->WantedMip;
+		uint64_t bytes = GetBytes(*texture, to) - GetBytes(*texture, texture->ResidentMip);
+		while (to < texture->ResidentMip) {
+			bool fitsBandwidth = bandwidth == 0 || bandwidth + bytes <= bandwidthBudget;
+			bool fitsMemory = projectedBytes + bytes <= memoryBudget;
+			if (fitsBandwidth && fitsMemory)
+				break;
+
+			bytes -= GetMipBytes(texture->Width, texture->Height, to, texture->BlockBytes);
+			to++;
+		}
+		if (to == texture->ResidentMip)
+			continue;
+
+		changes.push_back({ *name, texture->ResidentMip, to });
+		bandwidth += bytes;
+		projectedBytes += bytes;
+	}
+	uploadedBytes += bandwidth;
+	return changes;
+}
+
+void TextureStreamer::SetResidentMip(const std::string& name, uint32_t mip)
+{
+	auto found = textures.find(name);
+	if (found == textures.end())
+		return;
+
+	Texture& texture = found->second;
+	mip = std::min(mip, texture.MipCount - 1);
+	residentBytes -= GetBytes(texture, texture.ResidentMip);
+	texture.ResidentMip = mip;
+	texture.FramesUnneeded = 0;
+	residentBytes += GetBytes(texture, mip);
+}
+
+uint32_t TextureStreamer::GetResidentMip(const std::string& name)
+{
+	auto found = textures.find(name);
+	return found == textures.end() ? 0 : found->second.ResidentMip;
+}
+
+uint32_t TextureStreamer::GetWantedMip(const std::string& name)
+{
+	auto found = textures.find(name);
+	return found == textures.end() ? 0 : found->second.WantedMip;
+}
+
+uint64_t TextureStreamer::GetFullBytes()
+{
+	uint64_t bytes = 0;
+	for (auto& [name, texture] : textures)
+		bytes += GetBytes(texture, 0);
+	return bytes;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One texture's top mip going from FromMip to ToMip: lower
+// means mips are uploaded, higher means they're dropped
+struct TextureMipChange
+{
+	std::string Name;
+	uint32_t FromMip;
+	uint32_t ToMip;
+};
+
+// --------------------------------------------------------
+// Decides which mips of each block compressed texture should
+// be resident, from how densely they're seen on screen.  It
+// doesn't touch the GPU: each frame, whatever draws textures
+// asks for the mip it needs (see Request()), and Update()
+// hands back what to upload and drop, which the caller does
+// and then confirms (see SetResidentMip()).
+//
+// "Resident mip" is the most detailed one on the GPU; every
+// smaller one is there too.  Each texture keeps at least the
+// mips it started with, so there's always something to draw.
+//
+// Uploads are limited by a per-frame bandwidth budget and
+// a memory budget for every streamed texture together.  What
+// isn't needed is only dropped after DropDelay frames, so a
+// texture flickering in and out of view doesn't thrash.  If
+// the memory budget's lowered below what's resident, mips
+// are dropped from whatever has the most detail to spare.
+// --------------------------------------------------------
+class TextureStreamer
+{
+public:
+	static constexpr uint64_t Unlimited = UINT64_MAX;
+	static constexpr uint32_t StartSize = 128;	// Largest side of the mips a texture starts with
+	static constexpr uint32_t DropDelay = 60;	// Frames
+
+	// --------------------------------------------------------
+	// Helpers for sizes.  blockBytes is per 4x4 block (8 or 16).
+	// --------------------------------------------------------
+	static uint32_t GetFullMipCount(uint32_t width, uint32_t height);
+	static uint64_t GetMipBytes(uint32_t width, uint32_t height, uint32_t mip, uint32_t blockBytes);
+	static uint64_t GetBytes(uint32_t width, uint32_t height, uint32_t firstMip, uint32_t mipCount, uint32_t blockBytes);
+
+	// The first mip no bigger than StartSize (or the last one, or the
+	// last that's still whole blocks).  0 means it won't stream.
+	static uint32_t GetStartMip(uint32_t width, uint32_t height, uint32_t mipCount);
+
+	// --------------------------------------------------------
+	// The most detailed mip worth having when one screen pixel
+	// covers uvPerPixel of the texture's UV space (so 1/256 for
+	// a 256 texel wide texture drawn 256 pixels wide needs mip
+	// 0).  Rounds towards more detail, so a pixel never spans
+	// more than two texels.
+	// --------------------------------------------------------
+	static uint32_t SelectMip(uint32_t width, uint32_t height, uint32_t mipCount, float uvPerPixel);
+
+	TextureStreamer();
+
+	void SetBandwidthBudget(uint64_t bytesPerFrame) { bandwidthBudget = bytesPerFrame; }
+	void SetMemoryBudget(uint64_t bytes) { memoryBudget = bytes; }
+	uint64_t GetBandwidthBudget() { return bandwidthBudget; }
+	uint64_t GetMemoryBudget() { return memoryBudget; }
+
+	// Starts (or restarts) streaming a texture, with residentMip
+	// and everything smaller already on the GPU
+	void Add(const std::string& name, uint32_t width, uint32_t height, uint32_t mipCount, uint32_t blockBytes, uint32_t residentMip);
+	void Remove(const std::string& name);
+	bool Contains(const std::string& name) { return textures.contains(name); }
+
+	// Asks for a texture, seen at uvPerPixel (see SelectMip()), this
+	// frame.  The most detailed request in a frame is the one kept.
+	void Request(const std::string& name, float uvPerPixel);
+
+	// --------------------------------------------------------
+	// Call once a frame, after every request.  Returns the changes
+	// to make: drops first (which free memory), then uploads of
+	// what's furthest from the detail it wants, as far as the
+	// budgets go.  One upload is let through per frame whatever
+	// its size, so big mips still get their turn.
+	// --------------------------------------------------------
+	std::vector<TextureMipChange> Update();
+
+	// Once a change is made (or fails, in which case pass the mip it's still at)
+	void SetResidentMip(const std::string& name, uint32_t mip);
+
+	uint32_t GetResidentMip(const std::string& name);
+	uint32_t GetWantedMip(const std::string& name);
+	uint64_t GetResidentBytes() { return residentBytes; }
+	uint64_t GetFullBytes();	// If every mip of everything were resident
+	size_t GetCount() { return textures.size(); }
+	uint64_t GetUploadedBytes() { return uploadedBytes; }
+
+private:
+	struct Texture
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t MipCount;
+		uint32_t BlockBytes;
+		uint32_t StartMip;		// Never dropped below this
+		uint32_t ResidentMip;
+		uint32_t RequestedMip;	// This frame, or MipCount if it wasn't asked for
+		uint32_t WantedMip;		// The last one asked for
+		uint32_t FramesUnneeded;
+	};
+
+	std::unordered_map<std::string, Texture> textures;
+	uint64_t bandwidthBudget;
+	uint64_t memoryBudget;
+	uint64_t residentBytes;
+	uint64_t uploadedBytes;
+
+	uint64_t GetBytes(const Texture& texture, uint32_t firstMip);
+};
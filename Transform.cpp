@@ -140,14 +140,19 @@ void Transform::CorrectPosition() {
 void Transform::AddChild(Transform* child)
 {
 	if (child != nullptr && IndexOfChild(child) == -1) {
-		children.push_back(child);
+		AttachChild(child);
+	}
+}
+
+void Transform::AttachChild(Transform* child)
+{
+	children.push_back(child);
 
-		child->parent = this;
+	child->parent = this;
 
-		child->CorrectPosition();
+	child->CorrectPosition();
 
-		child->MarkChildTransformDirty();
-	}
+	child->MarkChildTransformDirty();
 }
 
 void Transform::RemoveChild(Transform* child)
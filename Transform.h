@@ -27,6 +27,11 @@ public:
 	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
 
 	void AddChild(Transform* child);
+
+	// AddChild(), for a child that's known not to be one already
+	// (which saves searching the children, for building a whole
+	// hierarchy at once)
+	void AttachChild(Transform* child);
 	void RemoveChild(Transform* child);
 
 	Transform* GetChild(unsigned int index);
@@ -0,0 +1,28 @@
+cbuffer externalData : register(b0)
+{
+	// How much of the source texture holds this frame's pixels
+	float2 uvScale;
+
+	// Furthest uv we can sample without filtering in
+	// pixels from outside that region
+	float2 uvMax;
+};
+
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv           : TEXCOORD0;
+};
+
+// Textures and samplers
+Texture2D SceneColors		: register(t0);
+SamplerState ClampSampler	: register(s0);
+
+// Stretches the (possibly lower resolution) scene
+// back up to fill the whole screen
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	float2 uv = min(input.uv * uvScale, uvMax);
+	return float4(SceneColors.Sample(ClampSampler, uv).rgb, 1);
+}